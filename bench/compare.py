@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Compares a benchmark run against a stored baseline.
+
+Both files are the JSON written by growgrid_bench.elf. A benchmark whose
+metric got slower than the baseline by more than the threshold counts as a
+regression. Baselines are only comparable on the machine they were taken on.
+
+  ./compare.py baseline.json result.json --metric p50 --threshold 5
+  ./compare.py --save baseline.json result.json   # accept as new baseline
+
+Exits with 1 if any benchmark regressed.
+"""
+
+import argparse
+import json
+import shutil
+import sys
+
+METRICS = ("mean", "min", "p50", "p90", "p99", "max")
+
+
+def load(path):
+    with open(path) as f:
+        doc = json.load(f)
+    return {r["name"]: r["ns_per_op"] for r in doc["results"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawTextHelpFormatter)
+    parser.add_argument("baseline")
+    parser.add_argument("result")
+    parser.add_argument("--metric", choices=METRICS, default="p50")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="allowed slowdown in percent (default 5)")
+    parser.add_argument("--save", action="store_true",
+                        help="copy the result over the baseline and exit")
+    args = parser.parse_args()
+
+    if args.save:
+        shutil.copyfile(args.result, args.baseline)
+        print("Saved %s as baseline %s" % (args.result, args.baseline))
+        return 0
+
+    baseline = load(args.baseline)
+    result = load(args.result)
+
+    regressed = []
+    print("%-36s %12s %12s %9s" % ("benchmark", "baseline ns",
+                                   "result ns", "change"))
+    for name in sorted(set(baseline) | set(result)):
+        if name not in baseline or name not in result:
+            print("%-36s %s" % (name, "only in " + (
+                "result" if name in result else "baseline")))
+            continue
+        old = baseline[name][args.metric]
+        new = result[name][args.metric]
+        change = (new - old) / old * 100 if old > 0 else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressed.append(name)
+        elif change < -args.threshold:
+            flag = "  faster"
+        print("%-36s %12.2f %12.2f %+8.1f%%%s" % (name, old, new, change,
+                                                  flag))
+
+    if regressed:
+        print("%d benchmark(s) slower than %.1f%% on %s: %s" % (
+            len(regressed), args.threshold, args.metric, ", ".join(regressed)),
+            file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,93 @@
+#include "bench.h"
+#include "sdkconfig.h"
+#include <stdlib.h>
+#include <time.h>
+
+static double s_samples[BENCH_MAX_SAMPLES];
+static volatile uint32_t s_sink;
+
+typedef struct {
+  const char *name;
+  double value;
+} metric_t;
+
+static metric_t s_metrics[BENCH_MAX_METRICS];
+static int s_metric_count;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples.
+static double percentile(const double *sorted, uint32_t count, int pct) {
+  uint32_t rank = (uint32_t)(((uint64_t)pct * count + 99) / 100);
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void bench_run(const bench_t *bench, bench_result_t *result) {
+  uint32_t samples =
+      bench->samples < BENCH_MAX_SAMPLES ? bench->samples : BENCH_MAX_SAMPLES;
+
+  if (bench->setup != NULL) {
+    bench->setup();
+  }
+  for (uint32_t i = 0; i < bench->warmup; i++) {
+    bench->run(bench->ops);
+  }
+
+  double sum = 0;
+  for (uint32_t i = 0; i < samples; i++) {
+    uint64_t start = now_ns();
+    bench->run(bench->ops);
+    s_samples[i] = (double)(now_ns() - start) / bench->ops;
+    sum += s_samples[i];
+  }
+  qsort(s_samples, samples, sizeof(s_samples[0]), compare_double);
+
+  *result = (bench_result_t){
+      .bench = bench,
+      .mean_ns = sum / samples,
+      .min_ns = s_samples[0],
+      .p50_ns = percentile(s_samples, samples, 50),
+      .p90_ns = percentile(s_samples, samples, 90),
+      .p99_ns = percentile(s_samples, samples, 99),
+      .max_ns = s_samples[samples - 1],
+  };
+}
+
+void bench_write_json(FILE *out, const bench_result_t *results, int count) {
+  fprintf(out, "{\"suite\":\"growgrid\",\"target\":\"%s\",\"results\":[",
+          CONFIG_IDF_TARGET);
+  for (int i = 0; i < count; i++) {
+    const bench_result_t *r = &results[i];
+    fprintf(out,
+            "%s\n{\"name\":\"%s\",\"warmup\":%u,\"samples\":%u,\"ops\":%u,"
+            "\"ns_per_op\":{\"mean\":%.2f,\"min\":%.2f,\"p50\":%.2f,"
+            "\"p90\":%.2f,\"p99\":%.2f,\"max\":%.2f}}",
+            i > 0 ? "," : "", r->bench->name, (unsigned)r->bench->warmup,
+            (unsigned)r->bench->samples, (unsigned)r->bench->ops, r->mean_ns,
+            r->min_ns, r->p50_ns, r->p90_ns, r->p99_ns, r->max_ns);
+  }
+  fprintf(out, "\n],\"metrics\":{");
+  for (int i = 0; i < s_metric_count; i++) {
+    fprintf(out, "%s\n\"%s\":%.4f", i > 0 ? "," : "", s_metrics[i].name,
+            s_metrics[i].value);
+  }
+  fprintf(out, "\n}}\n");
+}
+
+void bench_metric(const char *name, double value) {
+  if (s_metric_count < BENCH_MAX_METRICS) {
+    s_metrics[s_metric_count++] = (metric_t){name, value};
+  }
+}
+
+void bench_consume(uint32_t value) { s_sink += value; }
@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+#define BENCH_MAX_SAMPLES 20000
+#define BENCH_MAX_METRICS 16
+
+/**
+ * One microbenchmark. Every sample times `ops` calls of `run` work and is
+ * recorded as nanoseconds per operation, so throughput benchmarks batch
+ * many operations per sample and latency benchmarks use one.
+ */
+typedef struct {
+  const char *name;
+  uint32_t warmup;  // Samples run and discarded before measuring
+  uint32_t samples; // Measured samples, at most BENCH_MAX_SAMPLES
+  uint32_t ops;     // Operations per sample
+  void (*setup)(void);
+  void (*run)(uint32_t ops);
+} bench_t;
+
+typedef struct {
+  const bench_t *bench;
+  double mean_ns;
+  double min_ns;
+  double p50_ns;
+  double p90_ns;
+  double p99_ns;
+  double max_ns;
+} bench_result_t;
+
+/**
+ * @brief Runs a benchmark and computes the per-operation percentiles.
+ */
+void bench_run(const bench_t *bench, bench_result_t *result);
+
+/**
+ * @brief Records a figure that is not a time, e.g. bytes per stored sample.
+ *
+ * Metrics are reported next to the results, compare.py ignores them. Beyond
+ * BENCH_MAX_METRICS they are dropped.
+ */
+void bench_metric(const char *name, double value);
+
+/**
+ * @brief Writes all results and metrics as one JSON document.
+ *
+ * The format is read by compare.py:
+ * `{"suite","target","results":[{"name","warmup","samples","ops",
+ * "ns_per_op":{"mean","min","p50","p90","p99","max"}}],
+ * "metrics":{"<name>":<value>}}`.
+ */
+void bench_write_json(FILE *out, const bench_result_t *results, int count);
+
+/**
+ * @brief Keeps a value alive so the compiler cannot drop the benchmarked
+ * work.
+ */
+void bench_consume(uint32_t value);
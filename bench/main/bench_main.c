@@ -0,0 +1,522 @@
+#include "app_config.h"
+#include "bench.h"
+#include "derived_metrics.h"
+#include "esp_log.h"
+#include "event_bus.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "history.h"
+#include "irrigation.h"
+#include "map_value.h"
+#include "rule_engine.h"
+#include "soil_moisture.h"
+#include "telemetry.h"
+#include "tsdb.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Runs every benchmark whose name contains $BENCH_FILTER (all if unset) and
+ * writes the JSON results to $BENCH_OUTPUT, or stdout.
+ *
+ * Inputs are fixed tables so runs on the same machine are comparable.
+ */
+
+static const char *TAG = "BENCH";
+
+#define INPUT_COUNT 64
+
+static telemetry_point_t s_points[INPUT_COUNT];
+static sensor_data_t s_sensor_data[INPUT_COUNT];
+static int s_raw_soil[INPUT_COUNT];
+static QueueHandle_t s_subscriber;
+// Sensor noise around the middle of the range, within ±0.5.
+static float s_jitter[INPUT_COUNT];
+static rule_program_t s_program;
+static rule_engine_t s_engine;
+static irrigation_model_t s_model;
+static dli_t s_dli;
+
+// A NOR flash partition as big as the device's history partition. Erased
+// bytes read 0xFF and a write that would set a bit aborts, like the real
+// part it would corrupt.
+#define HISTORY_SECTORS 240
+static uint8_t s_flash[HISTORY_SECTORS * TSDB_SECTOR_BYTES];
+static tsdb_t s_tsdb;
+static tsdb_t s_tsdb_mounted;
+static tsdb_query_t s_tsdb_query;
+static uint32_t s_tsdb_now_s; // Time of the last minute appended
+static history_t s_history;
+static uint32_t s_history_now_s; // Time of the last sample appended
+
+static void fill_inputs(void) {
+  for (int i = 0; i < INPUT_COUNT; i++) {
+    uint64_t ts = TELEMETRY_MIN_VALID_TIMESTAMP_US + (uint64_t)i * 5000000;
+    s_points[i] = (telemetry_point_t){
+        .timestamp_us = ts,
+        .channel = (telemetry_channel_t)(i % TELEMETRY_CHANNEL_COUNT),
+        .value = 12.5f + (float)(i * 37 % 1000) / 10.0f,
+    };
+    s_sensor_data[i] = (sensor_data_t){
+        .timestamp_us = ts,
+        .type = SENSOR_DATA_TYPE_TEMP_HUMIDITY,
+        .payload.temp_humidity = {.temperature = 20.0f + (float)i / 8.0f,
+                                  .humidity = 40.0f + (float)i / 2.0f},
+    };
+    // Spans the calibrated range and a little beyond on both ends.
+    s_raw_soil[i] = 1100 + i * 30;
+    s_jitter[i] = 50.0f + (float)(i * 37 % 11 - 5) / 10.0f;
+  }
+}
+
+static void run_format_json(uint32_t ops) {
+  char buf[96];
+  for (uint32_t i = 0; i < ops; i++) {
+    bench_consume(telemetry_format_json(&s_points[i % INPUT_COUNT], buf,
+                                        sizeof(buf)));
+  }
+}
+
+static void run_format_line_protocol(uint32_t ops) {
+  char buf[160];
+  for (uint32_t i = 0; i < ops; i++) {
+    bench_consume(telemetry_format_line_protocol(
+        &s_points[i % INPUT_COUNT], "site=bench,device=bench-01", buf,
+        sizeof(buf)));
+  }
+}
+
+static void run_points_from_sensor_data(uint32_t ops) {
+  telemetry_point_t points[TELEMETRY_MAX_POINTS_PER_SAMPLE];
+  for (uint32_t i = 0; i < ops; i++) {
+    bench_consume(telemetry_points_from_sensor_data(
+        &s_sensor_data[i % INPUT_COUNT], points));
+  }
+}
+
+static void run_map_value(uint32_t ops) {
+  for (uint32_t i = 0; i < ops; i++) {
+    bench_consume(map_value(s_raw_soil[i % INPUT_COUNT], 1200, 2900, 0, 100));
+  }
+}
+
+static void run_soil_moisture_percent(uint32_t ops) {
+  for (uint32_t i = 0; i < ops; i++) {
+    bench_consume(soil_moisture_percent(s_raw_soil[i % INPUT_COUNT], 1200,
+                                        2900));
+  }
+}
+
+static const char *const s_rule_signals[] = {"temperature", "humidity",
+                                             "light", "soil_moisture"};
+
+// Rules spread over all sensor signals with thresholds spread over 0-100,
+// half of them also restricted to a time window.
+static void setup_rules(int count) {
+  static char src[64 * RULE_MAX_RULES];
+  size_t len = 0;
+  int per_signal = count / 4;
+  for (int i = 0; i < count; i++) {
+    float threshold = 100.0f * ((float)(i / 4) + 0.5f) / (float)per_signal;
+    const char *signal = s_rule_signals[i % 4];
+    len += (size_t)snprintf(
+        src + len, sizeof(src) - len,
+        i % 2 == 0 ? "on if %s < %.2f reset %.2f and time 06:00-22:00\n"
+                   : "inhibit if %s > %.2f reset %.2f\n",
+        signal, threshold, i % 2 == 0 ? threshold + 1 : threshold - 1);
+  }
+  int line;
+  if (len >= sizeof(src) ||
+      rule_compile(src, len, &s_program, &line) != RULE_COMPILE_OK) {
+    ESP_LOGE(TAG, "Failed to compile %d bench rules", count);
+    abort();
+  }
+  rule_engine_init(&s_engine, &s_program);
+  rule_engine_update(&s_engine, RULE_SIGNAL_TIME_OF_DAY, 12 * 60);
+}
+
+static void setup_rules_8(void) { setup_rules(8); }
+static void setup_rules_64(void) { setup_rules(64); }
+static void setup_rules_512(void) { setup_rules(512); }
+
+// One sensor reading per op, cycling through the signals.
+static void run_rule_engine_update(uint32_t ops) {
+  for (uint32_t i = 0; i < ops; i++) {
+    rule_engine_update(&s_engine, (rule_signal_t)(i % 4),
+                       s_jitter[i % INPUT_COUNT]);
+    bench_consume(rule_engine_pump(&s_engine, i));
+  }
+}
+
+static void setup_irrigation(void) {
+  static const irrigation_config_t config = IRRIGATION_CONFIG;
+  irrigation_model_init(&s_model, &config, 0);
+}
+
+// One soil sample every 5 s, a bin closes every 180 samples.
+static void run_irrigation_add_moisture(uint32_t ops) {
+  static uint32_t now_s;
+  for (uint32_t i = 0; i < ops; i++) {
+    now_s += 5;
+    irrigation_model_add_moisture(&s_model, now_s,
+                                  (int)s_jitter[i % INPUT_COUNT]);
+  }
+  bench_consume((uint32_t)s_model.mean_q16);
+}
+
+// VPD and dew point of one temperature/humidity sample per op.
+static void run_derived_climate(uint32_t ops) {
+  for (uint32_t i = 0; i < ops; i++) {
+    const temp_humidity_data_t *th =
+        &s_sensor_data[i % INPUT_COUNT].payload.temp_humidity;
+    derived_climate_t climate;
+    derived_climate((int32_t)(th->temperature * 100),
+                    (int32_t)(th->humidity * 100), &climate);
+    bench_consume((uint32_t)climate.dew_point_cc);
+  }
+}
+
+static void setup_dli(void) {
+  dli_init(&s_dli, DLI_LUX_PER_PPFD, DLI_MAX_GAP_MS);
+}
+
+// One light sample every 5 s within the same day.
+static void run_dli_add(uint32_t ops) {
+  static uint64_t now_us;
+  float dli = 0;
+  for (uint32_t i = 0; i < ops; i++) {
+    uint32_t lux = (uint32_t)(s_jitter[i % INPUT_COUNT] * 400);
+    now_us += 5000000;
+    dli = dli_add(&s_dli, now_us, 1, lux);
+  }
+  bench_consume((uint32_t)dli);
+}
+
+static void setup_event_bus(void) {
+  if (s_subscriber != NULL) {
+    return;
+  }
+  ESP_ERROR_CHECK(event_bus_init());
+  ESP_ERROR_CHECK(event_bus_start_distributor());
+  s_subscriber = event_bus_subscribe();
+  if (s_subscriber == NULL) {
+    ESP_LOGE(TAG, "Failed to subscribe to the event bus");
+    abort();
+  }
+}
+
+static void post_event(uint32_t i) {
+  event_t event = {.type = EVENT_TYPE_SENSOR_DATA};
+  event.data.sensor_data = s_sensor_data[i % INPUT_COUNT];
+  event_bus_post(&event, EVENT_BUS_POST_TIMEOUT_MS);
+}
+
+// Post, distribute and receive of a single event.
+static void run_event_bus_latency(uint32_t ops) {
+  event_t event;
+  for (uint32_t i = 0; i < ops; i++) {
+    post_event(i);
+    xQueueReceive(s_subscriber, &event, portMAX_DELAY);
+  }
+}
+
+// Bursts that fill the subscriber queue before it is drained.
+static void run_event_bus_throughput(uint32_t ops) {
+  event_t event;
+  for (uint32_t done = 0; done < ops; done += EVENT_BUS_QUEUE_SIZE) {
+    uint32_t burst = ops - done < EVENT_BUS_QUEUE_SIZE ? ops - done
+                                                       : EVENT_BUS_QUEUE_SIZE;
+    for (uint32_t i = 0; i < burst; i++) {
+      post_event(i);
+    }
+    for (uint32_t i = 0; i < burst; i++) {
+      xQueueReceive(s_subscriber, &event, portMAX_DELAY);
+    }
+  }
+}
+
+static bool flash_read(void *ctx, uint32_t offset, void *buf, size_t len) {
+  memcpy(buf, s_flash + offset, len);
+  return true;
+}
+
+static bool flash_write(void *ctx, uint32_t offset, const void *buf,
+                        size_t len) {
+  const uint8_t *bytes = buf;
+  for (size_t i = 0; i < len; i++) {
+    if ((s_flash[offset + i] & bytes[i]) != bytes[i]) {
+      ESP_LOGE(TAG, "Write sets bits at 0x%x", (unsigned)(offset + i));
+      abort();
+    }
+    s_flash[offset + i] = bytes[i];
+  }
+  return true;
+}
+
+static bool flash_erase(void *ctx, uint32_t offset) {
+  memset(s_flash + offset, 0xFF, TSDB_SECTOR_BYTES);
+  return true;
+}
+
+// The history task's per-minute means of a greenhouse day, rounded as it
+// rounds them: a diurnal cycle with sensor noise, light only by day and a
+// soil drying out between waterings.
+static void append_minute(uint32_t minute) {
+  static uint32_t seed = 1;
+  static float dli;
+  float day = (float)(minute % 1440) / 1440.0f;
+  float sun = sinf(2 * (float)M_PI * (day - 0.25f));
+  float noise[3];
+  for (int i = 0; i < 3; i++) {
+    seed = seed * 1103515245 + 12345;
+    noise[i] = (float)((seed >> 16) % 21) / 100.0f - 0.1f;
+  }
+  float temperature = 22.0f + 4.0f * sun + noise[0];
+  float humidity = 60.0f - 10.0f * sun + noise[1];
+  float lux = sun > 0 ? 30000.0f * sun * (1.0f + noise[2]) : 0;
+  dli = minute % 1440 == 0 ? 0 : dli + lux / DLI_LUX_PER_PPFD * 60e-6f;
+  float values[TELEMETRY_CHANNEL_COUNT] = {
+      [TELEMETRY_CHANNEL_TEMPERATURE] = temperature,
+      [TELEMETRY_CHANNEL_HUMIDITY] = humidity,
+      [TELEMETRY_CHANNEL_LIGHT] = lux,
+      [TELEMETRY_CHANNEL_SOIL_MOISTURE] = 60.0f - (float)(minute % 4320) / 144,
+      [TELEMETRY_CHANNEL_VPD] =
+          0.61f * expf(17.27f * temperature / (temperature + 237.3f)) *
+          (1 - humidity / 100),
+      [TELEMETRY_CHANNEL_DEW_POINT] = temperature - (100 - humidity) / 5,
+      [TELEMETRY_CHANNEL_DLI] = dli,
+  };
+
+  s_tsdb_now_s = (uint32_t)(TELEMETRY_MIN_VALID_TIMESTAMP_US / 1000000) +
+                 minute * 60;
+  for (int i = 0; i < TELEMETRY_CHANNEL_COUNT; i++) {
+    float resolution = telemetry_channel_resolution(i);
+    tsdb_append(&s_tsdb, i, s_tsdb_now_s,
+                roundf(values[i] / resolution) * resolution);
+  }
+  tsdb_flush(&s_tsdb, s_tsdb_now_s - HISTORY_FLUSH_AGE_S);
+}
+
+// Fills the partition with 60 days of history, so it has wrapped and the
+// oldest sectors were erased.
+static void setup_tsdb(void) {
+  if (s_tsdb.sectors != 0) {
+    return;
+  }
+  memset(s_flash, 0xFF, sizeof(s_flash));
+  const tsdb_flash_t flash = {NULL, sizeof(s_flash), flash_read, flash_write,
+                              flash_erase};
+  if (!tsdb_mount(&s_tsdb, &flash)) {
+    ESP_LOGE(TAG, "Failed to mount the simulated partition");
+    abort();
+  }
+  for (uint32_t minute = 0; minute < 60 * 1440; minute++) {
+    append_minute(minute);
+  }
+
+  const tsdb_stats_t *stats = &s_tsdb.stats;
+  bench_metric("tsdb_bytes_per_point",
+               (double)stats->flash_bytes / stats->points);
+  bench_metric("tsdb_encoded_bytes_per_point",
+               (double)stats->encoded_bytes / stats->points);
+  // Headers, padding and sector headers per byte of point data.
+  bench_metric("tsdb_write_amplification",
+               (double)stats->flash_bytes / stats->encoded_bytes);
+  bench_metric("tsdb_erases_per_day", (double)stats->erases / 60);
+  // The sector after the head is the oldest.
+  uint16_t oldest = (uint16_t)((s_tsdb.head + 1) % s_tsdb.sectors);
+  bench_metric("tsdb_retained_days",
+               (double)(s_tsdb_now_s - s_tsdb.spans[oldest].min_s) / 86400);
+}
+
+// One minute of all channels per op, with the device's flush policy.
+static void run_tsdb_append_minute(uint32_t ops) {
+  static uint32_t minute = 60 * 1440;
+  for (uint32_t i = 0; i < ops; i++) {
+    append_minute(minute++);
+  }
+}
+
+static void run_tsdb_query(uint32_t span_s, uint32_t step_s) {
+  uint32_t time_s;
+  float value;
+  uint32_t count = 0;
+  tsdb_query_begin(&s_tsdb, &s_tsdb_query, TELEMETRY_CHANNEL_TEMPERATURE,
+                   s_tsdb_now_s - span_s, s_tsdb_now_s, step_s);
+  while (tsdb_query_next(&s_tsdb_query, &time_s, &value)) {
+    count++;
+  }
+  bench_consume(count);
+}
+
+// What a `history` command of the last day or week costs before
+// formatting.
+static void run_tsdb_query_day_raw(uint32_t ops) {
+  for (uint32_t i = 0; i < ops; i++) {
+    run_tsdb_query(86400, 0);
+  }
+}
+
+static void run_tsdb_query_week_hourly(uint32_t ops) {
+  for (uint32_t i = 0; i < ops; i++) {
+    run_tsdb_query(7 * 86400, 3600);
+  }
+}
+
+// Scans every sector and record header, as at boot.
+static void run_tsdb_mount(uint32_t ops) {
+  for (uint32_t i = 0; i < ops; i++) {
+    tsdb_mount(&s_tsdb_mounted, &s_tsdb.flash);
+    bench_consume(s_tsdb_mounted.head);
+  }
+}
+
+// A sample of every channel per op, 5 s apart as the sensors take them.
+static void append_sample(void) {
+  s_history_now_s += 5;
+  float phase = (float)(s_history_now_s % 86400) / 86400.0f;
+  for (int i = 0; i < TELEMETRY_CHANNEL_COUNT; i++) {
+    history_append(&s_history, i, s_history_now_s, s_points[i].value * phase);
+  }
+}
+
+// Fills every tier of the RAM history, as after a week of uptime.
+static void setup_history(void) {
+  if (s_history_now_s != 0) {
+    return;
+  }
+  history_init(&s_history);
+  s_history_now_s = (uint32_t)(TELEMETRY_MIN_VALID_TIMESTAMP_US / 1000000);
+  for (uint32_t i = 0; i < 8 * 86400 / 5; i++) {
+    append_sample();
+  }
+  bench_metric("history_bytes", (double)sizeof(s_history));
+}
+
+static void run_history_append(uint32_t ops) {
+  for (uint32_t i = 0; i < ops; i++) {
+    append_sample();
+  }
+}
+
+// The readers a local consumer runs: the latest value, the mean of the
+// last day of minutes and the range of the last week of quarter hours.
+static void run_history_latest(uint32_t ops) {
+  history_view_t view;
+  for (uint32_t i = 0; i < ops; i++) {
+    history_view(&s_history, TELEMETRY_CHANNEL_TEMPERATURE, HISTORY_TIER_RAW,
+                 &view);
+    float value = history_view_value(&view, view.end - 1);
+    if (history_view_first_valid(&view) == view.end) {
+      value = 0;
+    }
+    bench_consume((uint32_t)value);
+  }
+}
+
+static void run_history_day_mean(uint32_t ops) {
+  history_view_t view;
+  for (uint32_t i = 0; i < ops; i++) {
+    history_view(&s_history, TELEMETRY_CHANNEL_TEMPERATURE,
+                 HISTORY_TIER_MINUTE, &view);
+    float sum = 0;
+    uint32_t count = 0;
+    for (uint32_t n = view.first; n < view.end; n++) {
+      float value = history_view_value(&view, n);
+      if (!isnan(value)) {
+        sum += value;
+        count++;
+      }
+    }
+    if (history_view_first_valid(&view) != view.first) {
+      count = 0;
+    }
+    bench_consume(count != 0 ? (uint32_t)(sum / count) : 0);
+  }
+}
+
+static void run_history_week_range(uint32_t ops) {
+  history_view_t view;
+  for (uint32_t i = 0; i < ops; i++) {
+    history_view(&s_history, TELEMETRY_CHANNEL_TEMPERATURE,
+                 HISTORY_TIER_QUARTER, &view);
+    float min = INFINITY;
+    float max = -INFINITY;
+    for (uint32_t n = view.first; n < view.end; n++) {
+      float value = history_view_value(&view, n);
+      min = fminf(min, value);
+      max = fmaxf(max, value);
+    }
+    if (history_view_first_valid(&view) != view.first) {
+      max = min;
+    }
+    bench_consume((uint32_t)(max - min));
+  }
+}
+
+static const bench_t s_benches[] = {
+    {"telemetry_format_json", 100, 2000, 256, NULL, run_format_json},
+    {"telemetry_format_line_protocol", 100, 2000, 256, NULL,
+     run_format_line_protocol},
+    {"telemetry_points_from_sensor_data", 100, 2000, 1024, NULL,
+     run_points_from_sensor_data},
+    {"map_value", 100, 2000, 4096, NULL, run_map_value},
+    {"soil_moisture_percent", 100, 2000, 4096, NULL,
+     run_soil_moisture_percent},
+    {"rule_engine_update_8", 100, 2000, 4096, setup_rules_8,
+     run_rule_engine_update},
+    {"rule_engine_update_64", 100, 2000, 4096, setup_rules_64,
+     run_rule_engine_update},
+    {"rule_engine_update_512", 100, 2000, 4096, setup_rules_512,
+     run_rule_engine_update},
+    {"irrigation_model_add_moisture", 100, 2000, 4096, setup_irrigation,
+     run_irrigation_add_moisture},
+    {"derived_climate", 100, 2000, 4096, NULL, run_derived_climate},
+    {"dli_add", 100, 2000, 4096, setup_dli, run_dli_add},
+    {"event_bus_latency", 200, 5000, 1, setup_event_bus,
+     run_event_bus_latency},
+    {"event_bus_throughput", 20, 500, EVENT_BUS_QUEUE_SIZE * 4,
+     setup_event_bus, run_event_bus_throughput},
+    {"tsdb_append_minute", 10, 200, 60, setup_tsdb, run_tsdb_append_minute},
+    {"tsdb_query_day_raw", 10, 200, 1, setup_tsdb, run_tsdb_query_day_raw},
+    {"tsdb_query_week_hourly", 10, 200, 1, setup_tsdb,
+     run_tsdb_query_week_hourly},
+    {"tsdb_mount", 2, 50, 1, setup_tsdb, run_tsdb_mount},
+    {"history_append", 100, 2000, 1024, setup_history, run_history_append},
+    {"history_latest", 100, 2000, 4096, setup_history, run_history_latest},
+    {"history_day_mean", 20, 500, 1, setup_history, run_history_day_mean},
+    {"history_week_range", 20, 500, 1, setup_history,
+     run_history_week_range},
+};
+
+#define BENCH_COUNT (int)(sizeof(s_benches) / sizeof(s_benches[0]))
+
+void app_main(void) {
+  const char *filter = getenv("BENCH_FILTER");
+  const char *path = getenv("BENCH_OUTPUT");
+  fill_inputs();
+
+  static bench_result_t results[BENCH_COUNT];
+  int count = 0;
+  for (int i = 0; i < BENCH_COUNT; i++) {
+    if (filter != NULL && strstr(s_benches[i].name, filter) == NULL) {
+      continue;
+    }
+    fprintf(stderr, "Running %s\n", s_benches[i].name);
+    bench_run(&s_benches[i], &results[count++]);
+  }
+
+  FILE *out = path != NULL ? fopen(path, "w") : stdout;
+  if (out == NULL) {
+    ESP_LOGE(TAG, "Cannot open %s", path);
+    exit(1);
+  }
+  bench_write_json(out, results, count);
+  if (out != stdout) {
+    fclose(out);
+  }
+  // The scheduler keeps running after app_main returns on this target.
+  exit(0);
+}
@@ -0,0 +1,76 @@
+#!/bin/sh
+# Measures ingest rate and CPU cost for the JSON and the line protocol device
+# formats against the dev stack (compose.dev.yml), end to end from
+# mosquitto to InfluxDB.
+#
+# Usage: INFLUXDB_TOKEN=... ./ingest_bench.sh [points] [container]
+#
+# <container> is the ingester to measure: ingest_bridge (default) or
+# telegraf (docker compose --profile telegraf, with ingest_bridge stopped).
+# Each mode publishes <points> messages to mosquitto and times how long it
+# takes until all of them are queryable in InfluxDB. Points go to the
+# temperature measurement of site "bench", devices bench-json and bench-lp,
+# so real telemetry is untouched.
+set -eu
+
+POINTS=${1:-10000}
+CONTAINER=${2:-ingest_bridge}
+INFLUX_URL=${INFLUXDB_URL:-http://localhost:8086}
+TOKEN=${INFLUXDB_TOKEN:?INFLUXDB_TOKEN must be set}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# Unique timestamps per run so repeated runs do not overwrite each other.
+BASE_US=$(($(date +%s) * 1000000))
+
+count_points() {
+  curl -fsS "$INFLUX_URL/api/v2/query?org=growgrid" \
+    -H "Authorization: Token $TOKEN" \
+    -H "Accept: application/csv" -H "Content-type: application/vnd.flux" \
+    --data "from(bucket: \"growgrid\")
+      |> range(start: $((BASE_US / 1000000 - 1)), stop: $((BASE_US / 1000000 + POINTS)))
+      |> filter(fn: (r) => r._measurement == \"temperature\" and r.site == \"bench\" and r.device == \"$1\")
+      |> count()" |
+    awk -F, 'NR > 1 && $NF ~ /^[0-9]+\r?$/ { n += $NF } END { print n + 0 }'
+}
+
+# CPU time of the ingest container in microseconds (cgroup v2, then v1).
+cpu_usec() {
+  docker exec "$CONTAINER" sh -c \
+    'awk "/^usage_usec/ { print \$2 }" /sys/fs/cgroup/cpu.stat 2>/dev/null ||
+     awk "{ print int(\$1 / 1000) }" /sys/fs/cgroup/cpuacct/cpuacct.usage'
+}
+
+run_mode() {
+  device=$1
+  topic=$2
+  file=$3
+
+  cpu_start=$(cpu_usec)
+  start=$(date +%s.%N)
+  docker exec -i mosquitto mosquitto_pub -q 0 -t "$topic" -l <"$file"
+  while [ "$(count_points "$device")" -lt "$POINTS" ]; do
+    sleep 0.2
+  done
+  end=$(date +%s.%N)
+  cpu_end=$(cpu_usec)
+
+  echo "$device $POINTS $start $end $cpu_start $cpu_end" |
+    awk '{ cpu = ($6 - $5) / 1e6
+           printf "%-10s %8d points %7.2f s %10.0f points/s %10.0f points/CPU s\n",
+                  $1, $2, $4 - $3, $2 / ($4 - $3), cpu > 0 ? $2 / cpu : 0 }'
+}
+
+awk -v n="$POINTS" -v base="$BASE_US" 'BEGIN {
+  for (i = 0; i < n; i++)
+    printf "{\"value\":%.2f,\"timestamp_us\":%d}\n", 20 + (i % 100) / 10, base + i * 1000000
+}' >"$TMP/json.txt"
+
+awk -v n="$POINTS" -v base="$BASE_US" 'BEGIN {
+  for (i = 0; i < n; i++)
+    printf "temperature,site=bench,device=bench-lp value=%.2f %d000\n", 20 + (i % 100) / 10, base + i * 1000000
+}' >"$TMP/lp.txt"
+
+echo "Ingest via $CONTAINER"
+run_mode bench-json growgrid/bench/bench-json/telemetry/temperature "$TMP/json.txt"
+run_mode bench-lp growgrid/bench/bench-lp/lp "$TMP/lp.txt"
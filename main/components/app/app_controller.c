@@ -1,10 +1,23 @@
 #include "app_controller.h"
+#include "app_config.h"
+#include "boot.h"
+#include "command_task.h"
+#include "config_store.h"
+#include "diag_task.h"
+#include "dlog.h"
 #include "esp_log.h"
+#include "esp_mac.h"
 #include "event_bus.h"
+#include "event_recorder.h"
 #include "hal_i2c.h"
 #include "hal_pump.h"
 #include "hal_sensors.h"
+#include "history_task.h"
+#include "low_power.h"
+#include "mem_layout.h"
+#include "mqtt_topics.h"
 #include "nvs_flash.h"
+#include "platform_http.h"
 #include "platform_mqtt.h"
 #include "platform_sntp.h"
 #include "platform_wifi.h"
@@ -12,40 +25,180 @@
 #include "pump_control_task.h"
 #include "sensor_tasks.h"
 #include "storage.h"
+#include <stdio.h>
+#include <string.h>
 
 static const char *TAG = "APP_CONTROLLER";
 
-static void start_application(const credentials_t *creds) {
-  ESP_ERROR_CHECK(event_bus_init());
-  ESP_ERROR_CHECK(event_bus_start_distributor());
+// Fills in whatever the provisioning form left empty: the site falls back to
+// DEVICE_DEFAULT_SITE and the device name to "gg-" plus the station MAC.
+static void resolve_identity(device_identity_t *identity) {
+  if (storage_read_identity(identity) != ESP_OK) {
+    memset(identity, 0, sizeof(*identity));
+  }
+  if (identity->site[0] == '\0') {
+    strncpy(identity->site, DEVICE_DEFAULT_SITE, sizeof(identity->site) - 1);
+  }
+  if (identity->device[0] == '\0') {
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    snprintf(identity->device, sizeof(identity->device),
+             "gg-%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3],
+             mac[4], mac[5]);
+  }
+}
+
+// Values of settings never changed by a command.
+static const config_t s_config_defaults = {
+    .sample_interval_ms =
+        {
+#define SENSOR_INTERVAL_(ID, name, type, interval_ms)                          \
+  [SENSOR_DATA_TYPE_##ID] = (interval_ms),
+            SENSOR_REGISTRY(SENSOR_INTERVAL_)
+#undef SENSOR_INTERVAL_
+        },
+    .telemetry_mode = MQTT_TELEMETRY_MODE,
+    .telemetry_window_ms = MQTT_TELEMETRY_WINDOW_MS,
+};
 
-  ESP_LOGI(TAG, "Initializing WiFi...");
-  ESP_ERROR_CHECK(platform_wifi_init_sta(creds->wifi_ssid, creds->wifi_pass));
-  ESP_LOGI(TAG, "WiFi connected.");
+static void on_config_change(config_key_t key, uint8_t index) {
+  event_t event = {.type = EVENT_TYPE_CONFIG_CHANGED};
+  event.data.config_changed.key = key;
+  event.data.config_changed.index = index;
+  event_bus_post(&event, EVENT_BUS_POST_TIMEOUT_MS);
+}
 
-  ESP_LOGI(TAG, "Initializing SNTP...");
-  platform_sntp_init(creds->ntp_server);
+#if GROWGRID_EVENT_RECORD
+// QoS 1 backlog class: chunks wait in the outbox while MQTT is down. Chunks
+// finished before MQTT is up are lost, replay reports them as a gap.
+static void publish_event_chunk(const uint8_t *chunk, size_t len) {
+  const mqtt_topics_t *topics = mqtt_topics_get();
+  if (platform_mqtt_publish(MQTT_TOPIC_CLASS_BACKLOG, topics->events,
+                            (const char *)chunk, (int)len) != ESP_OK) {
+    DLOG_W(TAG, "Event chunk of %u bytes dropped", (unsigned)len);
+  }
+}
+#endif
 
-  ESP_LOGI(TAG, "Initializing MQTT...");
-  ESP_ERROR_CHECK(platform_mqtt_init(creds->mqtt_broker, creds->mqtt_user,
-                                     creds->mqtt_pass));
+static esp_err_t stage_event_bus(void *ctx) {
+  ESP_ERROR_CHECK(event_bus_init());
+#if GROWGRID_EVENT_RECORD
+  ESP_ERROR_CHECK(event_recorder_start(publish_event_chunk));
+#endif
+  return event_bus_start_distributor();
+}
 
-  ESP_LOGI(TAG, "Initializing HAL...");
+static esp_err_t stage_hal(void *ctx) {
   ESP_ERROR_CHECK(hal_i2c_init());
   ESP_ERROR_CHECK(hal_pump_init());
   ESP_ERROR_CHECK(hal_sensors_init());
-  ESP_LOGI(TAG, "HAL initialized.");
+  const config_t *config = config_store_get();
+  if (config->soil_dry_raw != 0) {
+    hal_sensors_set_soil_calibration(config->soil_dry_raw,
+                                     config->soil_wet_raw);
+  }
+  return ESP_OK;
+}
 
-  ESP_LOGI(TAG, "Starting application tasks...");
-  ESP_ERROR_CHECK(app_sensor_tasks_start());
+static esp_err_t stage_sensors(void *ctx) { return app_sensor_tasks_start(); }
+
+static esp_err_t stage_control(void *ctx) {
   ESP_ERROR_CHECK(app_pump_control_task_start());
-  ESP_LOGI(TAG, "Application tasks started.");
+  return app_command_task_start();
+}
 
-  ESP_LOGI(TAG, "Application startup complete. System is running.");
+static esp_err_t stage_diag(void *ctx) { return app_diag_task_start(); }
+
+static esp_err_t stage_history(void *ctx) { return app_history_task_start(); }
+
+static esp_err_t stage_identity(void *ctx) {
+  device_identity_t identity;
+  resolve_identity(&identity);
+  ESP_LOGI(TAG, "Device identity: site=%s device=%s", identity.site,
+           identity.device);
+  return mqtt_topics_init(identity.site, identity.device);
+}
+
+static esp_err_t stage_wifi(void *ctx) {
+  const credentials_t *creds = ctx;
+  return platform_wifi_init_sta(creds->wifi_ssid, creds->wifi_pass);
 }
 
+static esp_err_t stage_sntp(void *ctx) {
+  const credentials_t *creds = ctx;
+  // The clock is set whenever SNTP gets through, boot goes on without it.
+  platform_sntp_init(creds->ntp_server, SNTP_SYNC_TIMEOUT_MS);
+  return ESP_OK;
+}
+
+static esp_err_t stage_mqtt(void *ctx) {
+  const credentials_t *creds = ctx;
+  return platform_mqtt_init(creds->mqtt_broker, creds->mqtt_user,
+                            creds->mqtt_pass);
+}
+
+#if GROWGRID_HTTP_API
+static esp_err_t stage_http(void *ctx) { return platform_http_start(); }
+#endif
+
+enum {
+  BOOT_EVENT_BUS,
+  BOOT_HAL,
+  BOOT_SENSORS,
+  BOOT_CONTROL,
+  BOOT_DIAG,
+  BOOT_HISTORY,
+  BOOT_IDENTITY,
+  BOOT_WIFI,
+  BOOT_SNTP,
+  BOOT_MQTT,
+#if GROWGRID_HTTP_API
+  BOOT_HTTP,
+#endif
+};
+
+// Sensing and pump control only need the bus and the HAL, so they come up
+// while Wi-Fi is still associating. Networking never blocks a sample.
+static const boot_stage_t s_boot_stages[] = {
+    [BOOT_EVENT_BUS] = {"event_bus", stage_event_bus, 0, TASK_STACK_BOOT},
+    [BOOT_HAL] = {"hal", stage_hal, BOOT_STAGE(BOOT_EVENT_BUS),
+                  TASK_STACK_BOOT},
+    [BOOT_SENSORS] = {"sensors", stage_sensors,
+                      BOOT_STAGE(BOOT_EVENT_BUS) | BOOT_STAGE(BOOT_HAL),
+                      TASK_STACK_BOOT},
+    [BOOT_CONTROL] = {"control", stage_control,
+                      BOOT_STAGE(BOOT_EVENT_BUS) | BOOT_STAGE(BOOT_HAL),
+                      TASK_STACK_BOOT},
+    [BOOT_DIAG] = {"diag", stage_diag, 0, TASK_STACK_BOOT},
+    [BOOT_HISTORY] = {"history", stage_history, BOOT_STAGE(BOOT_EVENT_BUS),
+                      TASK_STACK_BOOT},
+    [BOOT_IDENTITY] = {"identity", stage_identity, 0, TASK_STACK_BOOT},
+    [BOOT_WIFI] = {"wifi", stage_wifi, BOOT_STAGE(BOOT_EVENT_BUS),
+                   TASK_STACK_BOOT},
+    [BOOT_SNTP] = {"sntp", stage_sntp, BOOT_STAGE(BOOT_WIFI),
+                   TASK_STACK_BOOT},
+    [BOOT_MQTT] = {"mqtt", stage_mqtt,
+                   BOOT_STAGE(BOOT_WIFI) | BOOT_STAGE(BOOT_IDENTITY),
+                   TASK_STACK_BOOT},
+#if GROWGRID_HTTP_API
+    [BOOT_HTTP] = {"http", stage_http,
+                   BOOT_STAGE(BOOT_EVENT_BUS) | BOOT_STAGE(BOOT_WIFI),
+                   TASK_STACK_BOOT},
+#endif
+};
+
+// Stage tasks outlive app_controller_init.
+static credentials_t s_creds;
+
 esp_err_t app_controller_init(void) {
   ESP_LOGI(TAG, "Initializing application controller...");
+#if GROWGRID_DLOG
+  // First, so deferred records of every boot stage get formatted.
+  if (mem_task_create(MEM_TASK_LOG, 0, dlog_task, "dlog", NULL, TASK_PRIO_LOG,
+                      NULL) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create log formatter task");
+  }
+#endif
 
   esp_err_t ret = nvs_flash_init();
   if (ret == ESP_ERR_NVS_NO_FREE_PAGES ||
@@ -54,11 +207,25 @@ esp_err_t app_controller_init(void) {
     ret = nvs_flash_init();
   }
   ESP_ERROR_CHECK(ret);
+  ESP_ERROR_CHECK(config_store_init(&s_config_defaults, CONFIG_COMMIT_DELAY_MS,
+                                    on_config_change));
+  if (mem_task_create(MEM_TASK_CONFIG_COMMIT, 0, config_store_task,
+                      "config_commit", NULL, TASK_PRIO_CONFIG_COMMIT,
+                      NULL) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create settings commit task");
+  }
 
-  credentials_t creds;
-  if (storage_read_credentials(&creds) == ESP_OK) {
+  if (storage_read_credentials(&s_creds) == ESP_OK) {
     ESP_LOGI(TAG, "Credentials found in NVS. Starting application.");
-    start_application(&creds);
+#if LOW_POWER_MODE_ENABLED
+    device_identity_t identity;
+    resolve_identity(&identity);
+    ESP_ERROR_CHECK(app_low_power_start(&s_creds, &identity));
+#else
+    ESP_ERROR_CHECK(boot_run(s_boot_stages,
+                             sizeof(s_boot_stages) / sizeof(s_boot_stages[0]),
+                             &s_creds));
+#endif
   } else {
     ESP_LOGI(TAG, "Credentials not found. Starting provisioning mode.");
     provisioning_start();
@@ -0,0 +1,136 @@
+#include "boot.h"
+#include "app_config.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+#include <inttypes.h>
+
+static const char *TAG = "BOOT";
+
+#define BOOT_MAX_MARKS 8
+
+typedef enum {
+  STAGE_PENDING,
+  STAGE_OK,
+  STAGE_FAILED,
+  STAGE_SKIPPED,
+} stage_status_t;
+
+typedef struct {
+  stage_status_t status;
+  int64_t start_us;
+  int64_t end_us;
+} stage_record_t;
+
+static const boot_stage_t *s_stages;
+static size_t s_stage_count;
+static void *s_ctx;
+static stage_record_t s_records[BOOT_MAX_STAGES];
+static EventGroupHandle_t s_done_bits;
+
+static portMUX_TYPE s_mark_lock = portMUX_INITIALIZER_UNLOCKED;
+static const char *s_marks[BOOT_MAX_MARKS];
+static size_t s_mark_count;
+
+static void log_summary(void) {
+  static const char *const status_names[] = {"pending", "ok", "FAILED",
+                                             "skipped"};
+  ESP_LOGI(TAG, "Boot profile (ms since power-on):");
+  for (size_t i = 0; i < s_stage_count; i++) {
+    const stage_record_t *rec = &s_records[i];
+    ESP_LOGI(TAG, "  %-12s %6" PRId64 " -> %6" PRId64 " (%5" PRId64 " ms) %s",
+             s_stages[i].name,
+             rec->start_us / 1000, rec->end_us / 1000,
+             (rec->end_us - rec->start_us) / 1000, status_names[rec->status]);
+  }
+}
+
+static void boot_stage_task(void *arg) {
+  size_t index = (size_t)arg;
+  const boot_stage_t *stage = &s_stages[index];
+  stage_record_t *rec = &s_records[index];
+
+  if (stage->deps != 0) {
+    xEventGroupWaitBits(s_done_bits, stage->deps, pdFALSE, pdTRUE,
+                        portMAX_DELAY);
+  }
+
+  bool deps_ok = true;
+  for (size_t i = 0; i < s_stage_count; i++) {
+    if ((stage->deps & BOOT_STAGE(i)) && s_records[i].status != STAGE_OK) {
+      deps_ok = false;
+    }
+  }
+
+  rec->start_us = esp_timer_get_time();
+  if (!deps_ok) {
+    ESP_LOGW(TAG, "Stage %s skipped, a dependency failed", stage->name);
+    rec->status = STAGE_SKIPPED;
+  } else {
+    ESP_LOGI(TAG, "Stage %s started at %" PRId64 " ms", stage->name,
+             rec->start_us / 1000);
+    esp_err_t err = stage->fn(s_ctx);
+    rec->status = err == ESP_OK ? STAGE_OK : STAGE_FAILED;
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Stage %s failed: %s", stage->name, esp_err_to_name(err));
+    }
+  }
+  rec->end_us = esp_timer_get_time();
+  ESP_LOGI(TAG, "Stage %s finished at %" PRId64 " ms", stage->name,
+           rec->end_us / 1000);
+
+  EventBits_t all = BOOT_STAGE(s_stage_count) - 1;
+  if ((xEventGroupSetBits(s_done_bits, BOOT_STAGE(index)) & all) == all) {
+    log_summary();
+  }
+  vTaskDelete(NULL);
+}
+
+esp_err_t boot_run(const boot_stage_t *stages, size_t count, void *ctx) {
+  if (count == 0 || count > BOOT_MAX_STAGES) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  s_stages = stages;
+  s_stage_count = count;
+  s_ctx = ctx;
+  s_done_bits = xEventGroupCreate();
+  if (s_done_bits == NULL) {
+    ESP_LOGE(TAG, "Failed to create boot event group");
+    return ESP_FAIL;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (xTaskCreate(boot_stage_task, stages[i].name, stages[i].stack_size,
+                    (void *)i, TASK_PRIO_BOOT, NULL) != pdPASS) {
+      ESP_LOGE(TAG, "Failed to create boot stage %s", stages[i].name);
+      return ESP_FAIL;
+    }
+  }
+  return ESP_OK;
+}
+
+void boot_profiler_mark(const char *name) {
+  bool first = true;
+
+  portENTER_CRITICAL(&s_mark_lock);
+  for (size_t i = 0; i < s_mark_count; i++) {
+    if (s_marks[i] == name) {
+      first = false;
+      break;
+    }
+  }
+  if (first && s_mark_count < BOOT_MAX_MARKS) {
+    s_marks[s_mark_count++] = name;
+  } else {
+    first = false;
+  }
+  portEXIT_CRITICAL(&s_mark_lock);
+
+  if (first) {
+    ESP_LOGI(TAG, "Milestone %s at %" PRId64 " ms", name,
+             esp_timer_get_time() / 1000);
+  }
+}
@@ -0,0 +1,140 @@
+#include "command_task.h"
+#include "app_config.h"
+#include "config_store.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "event_bus.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "hal_sensors.h"
+#include "mem_layout.h"
+#include "mqtt_topics.h"
+#include "platform_mqtt.h"
+#include "trace.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+static const char *TAG = "COMMAND_TASK";
+
+void app_command_ack(const command_t *cmd, command_status_t status) {
+  struct timeval tv_now;
+  gettimeofday(&tv_now, NULL);
+  event_t event = {.type = EVENT_TYPE_COMMAND_ACK};
+  event.data.command_ack = command_make_ack(
+      cmd, status, esp_timer_get_time(),
+      (uint64_t)tv_now.tv_sec * 1000000L + (uint64_t)tv_now.tv_usec);
+  event_bus_post(&event, EVENT_BUS_POST_TIMEOUT_MS);
+}
+
+#if GROWGRID_TRACE
+// Dumps are rare, so the buffer is allocated per request rather than kept.
+static command_status_t dump_trace(trace_target_t target) {
+  if (target == TRACE_TARGET_UART) {
+    trace_dump_uart();
+    return COMMAND_STATUS_OK;
+  }
+
+  size_t size = trace_dump_size();
+  uint8_t *buf = malloc(size);
+  if (buf == NULL) {
+    ESP_LOGE(TAG, "No memory for a %u byte trace dump", (unsigned)size);
+    return COMMAND_STATUS_FAILED;
+  }
+  size_t len = trace_dump(buf, size);
+  esp_err_t err = ESP_FAIL;
+  if (len > 0) {
+    err = platform_mqtt_publish(MQTT_TOPIC_CLASS_STATE,
+                                mqtt_topics_get()->trace, (const char *)buf,
+                                (int)len);
+  }
+  free(buf);
+  return err == ESP_OK ? COMMAND_STATUS_OK : COMMAND_STATUS_FAILED;
+}
+#endif
+
+// Consumers pick up the new settings on their own, see config_store.h.
+static command_status_t store_settings(const command_t *cmd) {
+  esp_err_t err = ESP_FAIL;
+  switch (cmd->type) {
+  case COMMAND_TYPE_SAMPLING:
+    err = config_store_set(CONFIG_KEY_SAMPLE_INTERVAL,
+                           (uint8_t)cmd->args.sampling.sensor,
+                           (int32_t)cmd->args.sampling.interval_ms);
+    break;
+  case COMMAND_TYPE_CALIBRATE: {
+    int dry, wet;
+    err = hal_sensors_calibrate_soil(cmd->args.calibrate.point, &dry, &wet);
+    if (err == ESP_OK) {
+      err = config_store_set(CONFIG_KEY_SOIL_DRY, 0, dry);
+    }
+    if (err == ESP_OK) {
+      err = config_store_set(CONFIG_KEY_SOIL_WET, 0, wet);
+    }
+    break;
+  }
+  case COMMAND_TYPE_TELEMETRY:
+    // The window of summary mode is kept while in raw mode.
+    if (cmd->args.telemetry.mode == TELEMETRY_MODE_SUMMARY) {
+      err = config_store_set(CONFIG_KEY_TELEMETRY_WINDOW, 0,
+                             (int32_t)(cmd->args.telemetry.window_s * 1000));
+    } else {
+      err = ESP_OK;
+    }
+    if (err == ESP_OK) {
+      err = config_store_set(CONFIG_KEY_TELEMETRY_MODE, 0,
+                             (int32_t)cmd->args.telemetry.mode);
+    }
+    break;
+  default:
+    break;
+  }
+  return err == ESP_OK ? COMMAND_STATUS_OK : COMMAND_STATUS_FAILED;
+}
+
+static void command_task(void *pvParameters) {
+  QueueHandle_t event_queue = event_bus_subscribe();
+  if (event_queue == NULL) {
+    ESP_LOGE(TAG, "Failed to subscribe to event bus");
+    vTaskDelete(NULL);
+  }
+  ESP_LOGI(TAG, "Command task started");
+
+  while (1) {
+    event_t event;
+    if (xQueueReceive(event_queue, &event, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    TRACE_INSTANT(EVENT_RECEIVE, event.trace_span, event.type);
+    if (event.type != EVENT_TYPE_COMMAND) {
+      continue;
+    }
+
+    const command_t *cmd = &event.data.command;
+    switch (cmd->type) {
+    case COMMAND_TYPE_SAMPLING:
+    case COMMAND_TYPE_CALIBRATE:
+    case COMMAND_TYPE_TELEMETRY:
+      app_command_ack(cmd, store_settings(cmd));
+      break;
+    case COMMAND_TYPE_TRACE:
+#if GROWGRID_TRACE
+      app_command_ack(cmd, dump_trace(cmd->args.trace.target));
+#else
+      app_command_ack(cmd, COMMAND_STATUS_UNSUPPORTED);
+#endif
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+esp_err_t app_command_task_start(void) {
+  if (mem_task_create(MEM_TASK_COMMAND, 0, command_task, "command_task",
+                      NULL, TASK_PRIO_COMMAND, NULL) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create command task");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
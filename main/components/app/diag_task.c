@@ -0,0 +1,202 @@
+#include "diag_task.h"
+#include "app_config.h"
+#include "diag.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mem_layout.h"
+#include "mqtt_topics.h"
+#include "platform_mqtt.h"
+#include "telemetry.h"
+#include <inttypes.h>
+#include <string.h>
+#include <sys/time.h>
+
+static const char *TAG = "DIAG";
+
+typedef struct {
+  TaskHandle_t handle; // NULL marks a free slot
+  uint32_t prev_runtime;
+  bool seen;
+  bool stack_alerted;
+  bool cpu_alerted;
+} task_track_t;
+
+// Only used by the diagnostics task, static to keep its stack small.
+static TaskStatus_t s_status[DIAG_MAX_TASKS];
+static task_track_t s_tracks[DIAG_MAX_TASKS];
+static uint32_t s_prev_total_runtime;
+static bool s_heap_alerted;
+static bool s_frag_alerted;
+// A line per task and the heap line with the device tags and '\n' each,
+// snprintf needs room for the terminator.
+#define DIAG_TAGGED_LINE_MAX                                                   \
+  (DIAG_LINE_MAX + sizeof(((mqtt_topics_t *)0)->lp_tags))
+static char s_payload[(DIAG_MAX_TASKS + 1) * DIAG_TAGGED_LINE_MAX + 1];
+
+static void publish_alert(const char *alarm, const char *subject,
+                          uint32_t value, uint32_t threshold, bool active) {
+  if (active) {
+    ESP_LOGW(TAG, "Alert %s on %s: %" PRIu32 " (threshold %" PRIu32 ")",
+             alarm, subject, value, threshold);
+  } else {
+    ESP_LOGI(TAG, "Alert %s on %s cleared", alarm, subject);
+  }
+
+  char payload[160];
+  int len = diag_format_alert_json(alarm, subject, value, threshold, active,
+                                   payload, sizeof(payload));
+  if (len > 0) {
+    platform_mqtt_publish(MQTT_TOPIC_CLASS_ALARM, mqtt_topics_get()->alarm,
+                          payload, len);
+  }
+}
+
+// Raises an alert once when the condition starts and clears it once when it
+// ends, instead of repeating it every interval.
+static void update_alert(bool *alerted, bool condition, const char *alarm,
+                         const char *subject, uint32_t value,
+                         uint32_t threshold) {
+  if (condition != *alerted) {
+    *alerted = condition;
+    publish_alert(alarm, subject, value, threshold, condition);
+  }
+}
+
+static task_track_t *track_for(TaskHandle_t handle) {
+  task_track_t *free_slot = NULL;
+  for (int i = 0; i < DIAG_MAX_TASKS; i++) {
+    if (s_tracks[i].handle == handle) {
+      return &s_tracks[i];
+    }
+    if (s_tracks[i].handle == NULL && free_slot == NULL) {
+      free_slot = &s_tracks[i];
+    }
+  }
+  if (free_slot != NULL) {
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->handle = handle;
+  }
+  return free_slot;
+}
+
+static int append_line(int len, int n) {
+  if (n < 0 || len + n + 1 >= (int)sizeof(s_payload)) {
+    return -1;
+  }
+  s_payload[len + n] = '\n';
+  return len + n + 1;
+}
+
+static void sample(void) {
+  const char *tags = mqtt_topics_get()->lp_tags;
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  uint64_t now_us = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+  int len = 0;
+
+  configRUN_TIME_COUNTER_TYPE total_runtime;
+  UBaseType_t count =
+      uxTaskGetSystemState(s_status, DIAG_MAX_TASKS, &total_runtime);
+  if (count == 0) {
+    ESP_LOGW(TAG, "More than %d tasks, task stats skipped", DIAG_MAX_TASKS);
+  }
+  uint32_t total_delta = (uint32_t)total_runtime - s_prev_total_runtime;
+  s_prev_total_runtime = (uint32_t)total_runtime;
+
+  for (int i = 0; i < DIAG_MAX_TASKS; i++) {
+    s_tracks[i].seen = false;
+  }
+
+  for (UBaseType_t i = 0; i < count; i++) {
+    const TaskStatus_t *status = &s_status[i];
+    task_track_t *track = track_for(status->xHandle);
+    if (track == NULL) {
+      continue;
+    }
+    bool first = track->prev_runtime == 0;
+    uint32_t runtime = (uint32_t)status->ulRunTimeCounter;
+
+    diag_task_t task = {
+        .cpu_pct = first ? 0.0f
+                         : diag_cpu_pct(runtime - track->prev_runtime,
+                                        total_delta),
+        .stack_free = (uint32_t)status->usStackHighWaterMark,
+    };
+    strncpy(task.name, status->pcTaskName, sizeof(task.name) - 1);
+    track->prev_runtime = runtime;
+    track->seen = true;
+
+    update_alert(&track->stack_alerted,
+                 task.stack_free < DIAG_STACK_ALERT_BYTES, "stack_low",
+                 task.name, task.stack_free, DIAG_STACK_ALERT_BYTES);
+    // The idle task is supposed to take whatever is left.
+    if (strncmp(task.name, "IDLE", 4) != 0) {
+      update_alert(&track->cpu_alerted, task.cpu_pct > DIAG_CPU_ALERT_PCT,
+                   "cpu_high", task.name, (uint32_t)task.cpu_pct,
+                   DIAG_CPU_ALERT_PCT);
+    }
+
+    if (len >= 0) {
+      len = append_line(len, diag_format_task_line_protocol(
+                                 &task, tags, now_us, s_payload + len,
+                                 sizeof(s_payload) - len));
+    }
+  }
+
+  // Slots of deleted tasks are reused.
+  for (int i = 0; i < DIAG_MAX_TASKS; i++) {
+    if (!s_tracks[i].seen) {
+      s_tracks[i].handle = NULL;
+    }
+  }
+
+  diag_heap_t heap = {
+      .free_bytes = heap_caps_get_free_size(MALLOC_CAP_8BIT),
+      .largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+      .min_free_bytes = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+  };
+  uint32_t frag_pct = diag_heap_fragmentation_pct(&heap);
+  ESP_LOGI(TAG,
+           "Heap free %" PRIu32 " (min %" PRIu32 "), largest block %" PRIu32
+           ", fragmentation %" PRIu32 "%%",
+           heap.free_bytes, heap.min_free_bytes, heap.largest_block,
+           frag_pct);
+  update_alert(&s_heap_alerted, heap.min_free_bytes < DIAG_HEAP_ALERT_BYTES,
+               "heap_low", "heap", heap.min_free_bytes, DIAG_HEAP_ALERT_BYTES);
+  update_alert(&s_frag_alerted, frag_pct > DIAG_FRAG_ALERT_PCT, "heap_frag",
+               "heap", frag_pct, DIAG_FRAG_ALERT_PCT);
+
+  if (len >= 0) {
+    len = append_line(len, diag_format_heap_line_protocol(
+                               &heap, tags, now_us, s_payload + len,
+                               sizeof(s_payload) - len));
+  }
+  if (len < 0) {
+    ESP_LOGE(TAG, "Diagnostics payload too large");
+    return;
+  }
+  // Points without a valid clock would land at 1970.
+  if (now_us >= TELEMETRY_MIN_VALID_TIMESTAMP_US) {
+    platform_mqtt_publish(MQTT_TOPIC_CLASS_TELEMETRY, mqtt_topics_get()->diag,
+                          s_payload, len);
+  }
+}
+
+static void diag_task(void *pvParameters) {
+  TickType_t last_wake_time = xTaskGetTickCount();
+  while (1) {
+    sample();
+    vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(DIAG_INTERVAL_MS));
+  }
+}
+
+esp_err_t app_diag_task_start(void) {
+  if (mem_task_create(MEM_TASK_DIAG, 0, diag_task, "diag_task", NULL,
+                      TASK_PRIO_DIAG, NULL) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create diag task");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
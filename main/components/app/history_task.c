@@ -0,0 +1,336 @@
+#include "history_task.h"
+#include "app_config.h"
+#include "command_task.h"
+#include "dlog.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "event_bus.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "history.h"
+#include "mem_layout.h"
+#include "mqtt_topics.h"
+#include "platform_mqtt.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "tsdb.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+static const char *TAG = "HISTORY";
+
+typedef struct {
+  float sum;
+  uint32_t count;
+} mean_t;
+
+// Written by the history task only, read by any task, see history.h.
+static history_t s_history;
+
+// A history reply in progress. Its pages are published between events, so
+// samples keep being consumed while the broker paces a long reply.
+typedef struct {
+  bool active;
+  command_t cmd;
+  uint32_t seq;
+  uint32_t sent;
+  bool more; // time_s and value hold the next point
+  uint32_t time_s;
+  float value;
+  int len; // Page in s_reply waiting for room in the outbox, 0 if none
+  bool last;
+  int64_t deadline_us;
+} reply_t;
+
+// The store must not be written while a query reads it, so an interval
+// finished during a reply waits here. The reply takes less than an
+// interval, so there is at most one.
+_Static_assert(HISTORY_REPLY_TIMEOUT_MS < HISTORY_LOG_INTERVAL_S * 1000,
+               "A reply must not outlast a log interval");
+typedef struct {
+  uint32_t time_s;
+  uint32_t channels; // Bit per channel with a value
+  float values[TELEMETRY_CHANNEL_COUNT];
+} pending_t;
+
+// Only used by the history task, static to keep its stack small. Without a
+// usable partition s_db stays zeroed and the flash log is off.
+static tsdb_t s_db;
+static tsdb_query_t s_query;
+static reply_t s_answer;
+static char s_reply[HISTORY_REPLY_BYTES];
+static mean_t s_means[TELEMETRY_CHANNEL_COUNT];
+static pending_t s_pending;
+static uint32_t s_interval_s; // Start of the interval being averaged
+static uint32_t s_logged_s;   // Start of the last interval logged
+
+static bool partition_read(void *ctx, uint32_t offset, void *buf, size_t len) {
+  return esp_partition_read(ctx, offset, buf, len) == ESP_OK;
+}
+
+static bool partition_write(void *ctx, uint32_t offset, const void *buf,
+                            size_t len) {
+  return esp_partition_write(ctx, offset, buf, len) == ESP_OK;
+}
+
+static bool partition_erase(void *ctx, uint32_t offset) {
+  return esp_partition_erase_range(ctx, offset, TSDB_SECTOR_BYTES) == ESP_OK;
+}
+
+static uint32_t now_s(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint32_t)tv.tv_sec;
+}
+
+static bool log_enabled(void) { return s_db.sectors != 0; }
+
+static void write_pending(void) {
+  if (s_pending.channels == 0 || s_answer.active) {
+    return;
+  }
+  for (int i = 0; i < TELEMETRY_CHANNEL_COUNT; i++) {
+    if ((s_pending.channels & (1u << i)) != 0 &&
+        !tsdb_append(&s_db, i, s_pending.time_s, s_pending.values[i])) {
+      DLOG_W(TAG, "Point of channel %d not logged", i);
+    }
+  }
+  s_pending.channels = 0;
+}
+
+// Means are rounded to what the sensors resolve, so a steady channel repeats
+// its value and costs a single bit per point.
+static void log_interval(void) {
+  if (s_pending.channels != 0) {
+    DLOG_W(TAG, "Interval %" PRIu32 " not logged", s_pending.time_s);
+  }
+  s_pending = (pending_t){.time_s = s_interval_s};
+  for (int i = 0; i < TELEMETRY_CHANNEL_COUNT; i++) {
+    mean_t *mean = &s_means[i];
+    if (mean->count == 0) {
+      continue;
+    }
+    float resolution = telemetry_channel_resolution(i);
+    s_pending.values[i] =
+        roundf(mean->sum / mean->count / resolution) * resolution;
+    s_pending.channels |= 1u << i;
+    *mean = (mean_t){0};
+  }
+  s_logged_s = s_interval_s;
+  write_pending();
+}
+
+static void handle_sensor_data(const sensor_data_t *data) {
+  telemetry_point_t points[TELEMETRY_MAX_POINTS_PER_SAMPLE];
+  int count = telemetry_points_from_sensor_data(data, points);
+  for (int i = 0; i < count; i++) {
+    history_append(&s_history, points[i].channel,
+                   (uint32_t)(points[i].timestamp_us / 1000000),
+                   points[i].value);
+  }
+
+  if (!log_enabled() ||
+      data->timestamp_us < TELEMETRY_MIN_VALID_TIMESTAMP_US) {
+    return;
+  }
+  uint32_t time_s = (uint32_t)(data->timestamp_us / 1000000);
+  uint32_t interval_s = time_s - time_s % HISTORY_LOG_INTERVAL_S;
+  if (interval_s <= s_logged_s) {
+    return;
+  }
+  if (interval_s != s_interval_s) {
+    if (s_interval_s != 0) {
+      log_interval();
+    }
+    s_interval_s = interval_s;
+  }
+
+  for (int i = 0; i < count; i++) {
+    s_means[points[i].channel].sum += points[i].value;
+    s_means[points[i].channel].count++;
+  }
+}
+
+static void start_reply(const command_t *cmd) {
+  if (!log_enabled() || s_answer.active) {
+    app_command_ack(cmd, COMMAND_STATUS_FAILED);
+    return;
+  }
+  const history_command_t *args = &cmd->args.history;
+  tsdb_query_begin(&s_db, &s_query, args->channel, args->from_s, args->to_s,
+                   (uint32_t)args->step_min * 60);
+  s_answer = (reply_t){
+      .active = true,
+      .cmd = *cmd,
+      .deadline_us = esp_timer_get_time() + HISTORY_REPLY_TIMEOUT_MS * 1000LL,
+  };
+  s_answer.more = tsdb_query_next(&s_query, &s_answer.time_s, &s_answer.value);
+}
+
+// Pages are filled up to the room needed for the closing fields.
+static void fill_page(void) {
+  static const size_t tail_room = 48;
+  const command_t *cmd = &s_answer.cmd;
+  const history_command_t *args = &cmd->args.history;
+  int len = snprintf(s_reply, sizeof(s_reply),
+                     "{\"id\":%" PRIu32 ",\"channel\":\"%s\","
+                     "\"step_min\":%u,\"seq\":%" PRIu32 ",\"points\":[",
+                     cmd->id, telemetry_channel_name(args->channel),
+                     args->step_min, s_answer.seq);
+  bool first = true;
+  while (s_answer.more && s_answer.sent < HISTORY_REPLY_MAX_POINTS) {
+    int n = snprintf(s_reply + len, sizeof(s_reply) - tail_room - len,
+                     "%s[%" PRIu32 ",%g]", first ? "" : ",", s_answer.time_s,
+                     (double)s_answer.value);
+    if (n < 0 || (size_t)n >= sizeof(s_reply) - tail_room - len) {
+      break;
+    }
+    len += n;
+    first = false;
+    s_answer.sent++;
+    s_answer.more =
+        tsdb_query_next(&s_query, &s_answer.time_s, &s_answer.value);
+  }
+
+  bool cut = s_answer.more && s_answer.sent == HISTORY_REPLY_MAX_POINTS;
+  s_answer.last = !s_answer.more || cut;
+  if (cut) {
+    len += snprintf(s_reply + len, sizeof(s_reply) - len,
+                    "],\"last\":true,\"next\":%" PRIu32 "}",
+                    s_answer.time_s);
+  } else {
+    len += snprintf(s_reply + len, sizeof(s_reply) - len, "],\"last\":%s}",
+                    s_answer.last ? "true" : "false");
+  }
+  s_answer.len = len;
+}
+
+static void finish_reply(command_status_t status) {
+  s_answer.active = false;
+  app_command_ack(&s_answer.cmd, status);
+  write_pending();
+}
+
+// Publishes the next page if the outbox has room, without waiting for it.
+// Returns whether another page is ready right away.
+static bool continue_reply(void) {
+  const command_t *cmd = &s_answer.cmd;
+  if (s_answer.len == 0) {
+    fill_page();
+  }
+  esp_err_t err = platform_mqtt_publish_backlog(mqtt_topics_get()->history,
+                                                s_reply, s_answer.len, 0);
+  if (err == ESP_ERR_TIMEOUT &&
+      esp_timer_get_time() < s_answer.deadline_us) {
+    return false;
+  }
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "History reply %" PRIu32 " stopped at page %" PRIu32,
+             cmd->id, s_answer.seq);
+    finish_reply(COMMAND_STATUS_FAILED);
+    return false;
+  }
+  if (!s_answer.last) {
+    s_answer.seq++;
+    s_answer.len = 0;
+    return true;
+  }
+
+  ESP_LOGI(TAG,
+           "History reply %" PRIu32 ": %" PRIu32 " points in %" PRIu32
+           " pages, %" PRIu32 " records read, %" PRIu32 " corrupt",
+           cmd->id, s_answer.sent, s_answer.seq + 1, s_query.records_read,
+           s_query.corrupt);
+  finish_reply(COMMAND_STATUS_OK);
+  return false;
+}
+
+// Without a reply in progress the task only wakes for events and the log
+// interval. During one it polls the outbox while it is full.
+static TickType_t next_wakeup(bool page_ready) {
+  if (!s_answer.active) {
+    return pdMS_TO_TICKS(HISTORY_LOG_INTERVAL_S * 1000);
+  }
+  return page_ready ? 0 : pdMS_TO_TICKS(HISTORY_REPLY_POLL_MS);
+}
+
+static void history_task(void *pvParameters) {
+  QueueHandle_t event_queue = event_bus_subscribe();
+  if (event_queue == NULL) {
+    ESP_LOGE(TAG, "Failed to subscribe to event bus");
+    vTaskDelete(NULL);
+  }
+  ESP_LOGI(TAG, "History task started");
+
+  bool page_ready = false;
+  while (1) {
+    event_t event;
+    if (xQueueReceive(event_queue, &event, next_wakeup(page_ready)) ==
+        pdTRUE) {
+      TRACE_INSTANT(EVENT_RECEIVE, event.trace_span, event.type);
+      if (event.type == EVENT_TYPE_SENSOR_DATA) {
+        handle_sensor_data(&event.data.sensor_data);
+      } else if (event.type == EVENT_TYPE_COMMAND &&
+                 event.data.command.type == COMMAND_TYPE_HISTORY) {
+        // Points of the interval in progress are not in the reply.
+        start_reply(&event.data.command);
+      }
+    }
+    // One page per event at most, so events keep being consumed.
+    page_ready = s_answer.active && continue_reply();
+
+    // Sensors sampling slower than the interval must not hold it open.
+    uint32_t now = now_s();
+    if (s_interval_s != 0 && now >= s_interval_s + HISTORY_LOG_INTERVAL_S) {
+      log_interval();
+      s_interval_s = 0;
+    }
+    if (log_enabled() && !s_answer.active && now > HISTORY_FLUSH_AGE_S &&
+        !tsdb_flush(&s_db, now - HISTORY_FLUSH_AGE_S)) {
+      DLOG_W(TAG, "Flushing history failed");
+    }
+  }
+}
+
+static void mount_log(void) {
+  const esp_partition_t *partition = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+      HISTORY_PARTITION_LABEL);
+  if (partition == NULL) {
+    ESP_LOGE(TAG, "No '%s' partition, history not logged to flash",
+             HISTORY_PARTITION_LABEL);
+    return;
+  }
+
+  const tsdb_flash_t flash = {
+      .ctx = (void *)partition,
+      .size = partition->size,
+      .read = partition_read,
+      .write = partition_write,
+      .erase = partition_erase,
+  };
+  if (!tsdb_mount(&s_db, &flash)) {
+    ESP_LOGE(TAG, "Partition of %" PRIu32 " bytes not usable",
+             partition->size);
+    return;
+  }
+  ESP_LOGI(TAG, "History mounted, %u sectors, head %u", s_db.sectors,
+           s_db.head);
+}
+
+const history_t *app_history_get(void) { return &s_history; }
+
+esp_err_t app_history_task_start(void) {
+  history_init(&s_history);
+  mount_log();
+
+  if (mem_task_create(MEM_TASK_HISTORY, 0, history_task, "history_task",
+                      NULL, TASK_PRIO_HISTORY, NULL) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create history task");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
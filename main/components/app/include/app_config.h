@@ -1,23 +1,176 @@
 #pragma once
 
 // Task Priorities
+#define TASK_PRIO_EVENT_DISTRIBUTOR 10
 #define TASK_PRIO_PUMP_CONTROL 10
+#define TASK_PRIO_COMMAND 8
+#define TASK_PRIO_BOOT 5
+#define TASK_PRIO_LOW_POWER 5
+#define TASK_PRIO_DIAG 2
+#define TASK_PRIO_HISTORY 2
+#define TASK_PRIO_HTTP_API 3 // Also the HTTP server task
 #define TASK_PRIO_MQTT_MANGER 6
-#define TASK_PRIO_TEMP_SENSOR 4
-#define TASK_PRIO_LIGHT_SENSOR 4
-#define TASK_PRIO_SOIL_SENSOR 4
+#define TASK_PRIO_SENSOR 4 // One task per sensor in sensor_registry.h
+#define TASK_PRIO_LOG 1
+#define TASK_PRIO_CONFIG_COMMIT 1
 
 // Task Stack Sizes
+#define TASK_STACK_EVENT_DISTRIBUTOR 4096
 #define TASK_STACK_PUMP_CONTROL 4096
+#define TASK_STACK_COMMAND 4096
+#define TASK_STACK_BOOT 4096
+#define TASK_STACK_LOW_POWER 6144
+#define TASK_STACK_DIAG 4096
+#define TASK_STACK_HISTORY 4096
+#define TASK_STACK_HTTP_API 3072
 #define TASK_STACK_MQTT_PUBLISHER 4096
-#define TASK_STACK_TEMP_SENSOR 4096
-#define TASK_STACK_LIGHT_SENSOR 4096
-#define TASK_STACK_SOIL_SENSOR 4096
+#define TASK_STACK_SENSOR 4096
+#define TASK_STACK_LOG 3072
+#define TASK_STACK_CONFIG_COMMIT 3072
 
 // Sensor Reading Intervals
+// Defaults until changed with the `sampling` command, see config_store.h.
 #define TEMP_SENSOR_READ_INTERVAL_MS 5000
 #define LIGHT_SENSOR_READ_INTERVAL_MS 5000
 #define SOIL_SENSOR_READ_INTERVAL_MS 5000
 
+// Sensor Health
+// See sensor_health.h, the plausibility limits of each sensor are
+// SENSOR_CHECKS in sensor_registry.h. A failed sensor is retried at twice
+// the previous delay, starting from its sampling interval, up to the
+// maximum.
+#define SENSOR_HEALTH_FAIL_AFTER 3
+#define SENSOR_HEALTH_RECOVER_AFTER 3
+#define SENSOR_HEALTH_REINIT_EVERY 4
+#define SENSOR_HEALTH_BACKOFF_MAX_MS 300000
+
+// Derived Metrics
+// Lux per µmol/m²/s of photosynthetic photon flux, about 54 for sunlight and
+// 70-80 for white LED grow lights. Light samples further apart than the gap
+// are not integrated into the DLI.
+#define DLI_LUX_PER_PPFD 54
+#define DLI_MAX_GAP_MS 600000
+
+// Time
+// Boot waits this long for the first SNTP sync, the low-power mode only for
+// what is left of its radio-on window.
+#define SNTP_SYNC_TIMEOUT_MS 30000
+
+// Settings
+// Quiet time after the last change of a setting before the settings are
+// written to NVS, see config_store.h.
+#define CONFIG_COMMIT_DELAY_MS 5000
+
+// History
+// Telemetry kept in the flash partition of that name, see history_task.h.
+// Points of the same channel are written together, a point waits in RAM for
+// at most the flush age, which is what a power cut can lose.
+#define HISTORY_PARTITION_LABEL "history"
+#define HISTORY_LOG_INTERVAL_S 60
+#define HISTORY_FLUSH_AGE_S 3600
+#define HISTORY_REPLY_BYTES 1024
+#define HISTORY_REPLY_MAX_POINTS 4096
+// A reply is published page by page between events, polling the outbox
+// while it is full, and fails if it takes longer than the timeout.
+#define HISTORY_REPLY_TIMEOUT_MS 30000
+#define HISTORY_REPLY_POLL_MS 20
+
+// Pump Control
+// Used until rules are sent with the `rules` command, see rule_engine.h.
+#define PUMP_DEFAULT_RULES                                                     \
+  "on if soil_moisture < 30 reset 35;pump max_run_s=120 min_off_s=600"
+// Longest sleep of the pump control task without events. Run limits and
+// predicted pulses wake it on time, the time windows have minute
+// resolution.
+#define PUMP_CONTROL_TICK_MS 60000
+
+// Predictive Irrigation
+// Used with a `predict` rule, see irrigation.h. The demand coefficients
+// make a 28 °C afternoon at 40 klux dry about twice as fast as 20 °C in
+// the dark.
+#define IRRIGATION_CONFIG                                                      \
+  {                                                                            \
+      .bin_s = 900,                                                            \
+      .memory_shift = 5,                                                       \
+      .min_bins = 8,                                                           \
+      .demand_ref_dc = 200,                                                    \
+      .demand_temp_q8 = 13,                                                    \
+      .demand_klux_q8 = 5,                                                     \
+      .settle_s = 1800,                                                        \
+      .min_pulse_s = 5,                                                        \
+      .max_pulse_s = 60,                                                       \
+      .default_pulse_s = 20,                                                   \
+  }
+
 // Event Bus
 #define EVENT_BUS_POST_TIMEOUT_MS 100
+#define EVENT_BUS_QUEUE_SIZE 32
+#define EVENT_BUS_MAX_SUBSCRIBERS 6
+
+// Static Allocation
+// Set by `idf.py -DGROWGRID_STATIC_ALLOC=ON build`, see mem_layout.h.
+#ifndef GROWGRID_STATIC_ALLOC
+#define GROWGRID_STATIC_ALLOC 0
+#endif
+#define MEM_STATIC_BUDGET_BYTES (64 * 1024)
+
+// Event Recording
+// Set by `idf.py -DGROWGRID_EVENT_RECORD=ON build`, see event_recorder.h.
+#ifndef GROWGRID_EVENT_RECORD
+#define GROWGRID_EVENT_RECORD 0
+#endif
+#define EVENT_RECORD_CHUNK_BYTES 1024
+#define EVENT_RECORD_FLUSH_MS 60000
+
+// Local HTTP API
+// Set by `idf.py -DGROWGRID_HTTP_API=ON build`, see platform_http.h. Two
+// sockets beyond the event streams are kept for state requests.
+#ifndef GROWGRID_HTTP_API
+#define GROWGRID_HTTP_API 0
+#endif
+#define HTTP_API_PORT 80
+#define HTTP_API_MAX_CLIENTS 3
+#define HTTP_API_MAX_SOCKETS (HTTP_API_MAX_CLIENTS + 2)
+#define HTTP_API_FRAMES 8
+#define HTTP_API_FRAME_BYTES 224
+#define HTTP_API_STATE_BYTES 1024
+#define HTTP_API_KEEPALIVE_MS 15000
+
+// Wi-Fi Reconnect
+#define WIFI_RECONNECT_BASE_MS 500
+#define WIFI_RECONNECT_MAX_MS 60000
+
+// MQTT Publishing
+#define MQTT_OUTBOX_LIMIT_BYTES (16 * 1024)
+#define MQTT_TELEMETRY_HIGH_WATER_BYTES (MQTT_OUTBOX_LIMIT_BYTES * 3 / 4)
+#define MQTT_QOS_TELEMETRY 0
+#define MQTT_QOS_STATE 1
+#define MQTT_QOS_ALARM 1
+#define MQTT_QOS_BACKLOG 1
+#define MQTT_BATCH_PAYLOAD_BYTES 1024
+#define MQTT_INFLIGHT_TRACK_MAX 16
+#define MQTT_TELEMETRY_FORMAT TELEMETRY_FORMAT_LINE_PROTOCOL
+// Defaults until changed with the `telemetry` command.
+#define MQTT_TELEMETRY_MODE TELEMETRY_MODE_RAW
+#define MQTT_TELEMETRY_WINDOW_MS 60000
+
+// Low-Power Mode
+// Replaces the always-on tasks with timer wakeups from deep sleep, samples
+// are kept in RTC memory and uploaded in bursts.
+#define LOW_POWER_MODE_ENABLED 0
+#define LOW_POWER_SAMPLE_INTERVAL_MS 60000
+#define LOW_POWER_UPLOAD_INTERVAL_MS (15 * 60 * 1000)
+#define LOW_POWER_RADIO_TIMEOUT_MS 20000
+
+// Diagnostics
+// Needs CONFIG_FREERTOS_USE_TRACE_FACILITY and
+// CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.
+#define DIAG_INTERVAL_MS 30000
+#define DIAG_MAX_TASKS 24
+#define DIAG_STACK_ALERT_BYTES 512
+#define DIAG_HEAP_ALERT_BYTES (24 * 1024)
+#define DIAG_FRAG_ALERT_PCT 70
+#define DIAG_CPU_ALERT_PCT 80
+
+// Device Identity
+#define DEVICE_DEFAULT_SITE "default"
@@ -0,0 +1,45 @@
+#pragma once
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define BOOT_MAX_STAGES 16
+#define BOOT_STAGE(index) (1u << (index))
+
+typedef esp_err_t (*boot_stage_fn_t)(void *ctx);
+
+/**
+ * One init step. A stage starts as soon as every stage in `deps` finished
+ * successfully, independent stages run concurrently. If a dependency failed
+ * the stage is skipped.
+ */
+typedef struct {
+  const char *name;
+  boot_stage_fn_t fn;
+  uint32_t deps; // BOOT_STAGE() bits of stages that must finish first
+  uint32_t stack_size;
+} boot_stage_t;
+
+/**
+ * @brief Runs a boot graph in the background.
+ *
+ * Spawns one short-lived task per stage and returns immediately. Each stage
+ * logs its start and end time since power-on, and a summary is logged when
+ * the last stage is done.
+ *
+ * @param stages Stage table, must stay valid until boot is complete.
+ * @param count Number of stages, at most BOOT_MAX_STAGES.
+ * @param ctx Passed to every stage function, must stay valid as well.
+ * @return ESP_OK if all stage tasks were created.
+ */
+esp_err_t boot_run(const boot_stage_t *stages, size_t count, void *ctx);
+
+/**
+ * @brief Logs a boot milestone (e.g. "first_sample") once.
+ *
+ * Later calls with the same name are ignored, so this is cheap to leave in
+ * hot paths.
+ *
+ * @param name A string literal identifying the milestone.
+ */
+void boot_profiler_mark(const char *name);
@@ -0,0 +1,25 @@
+#pragma once
+#include "command.h"
+#include "esp_err.h"
+
+/**
+ * @brief Starts the command task.
+ *
+ * This task executes sampling, calibration and telemetry mode commands from
+ * the event bus and acknowledges them. Pump and rules commands are executed
+ * by the pump control task, history queries by the history task.
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t app_command_task_start(void);
+
+/**
+ * @brief Posts the acknowledgement for an executed command to the event bus.
+ *
+ * Call this right after executing the command so the reported latency
+ * covers the execution itself.
+ *
+ * @param cmd The command that was executed.
+ * @param status The execution result.
+ */
+void app_command_ack(const command_t *cmd, command_status_t status);
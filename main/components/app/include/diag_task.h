@@ -0,0 +1,15 @@
+#pragma once
+#include "esp_err.h"
+
+/**
+ * @brief Starts the diagnostics task.
+ *
+ * Every DIAG_INTERVAL_MS the task samples CPU load and stack high-water mark
+ * of every FreeRTOS task plus free heap, largest free block and minimum free
+ * heap, and publishes them as line protocol on the device's diag topic.
+ * Crossing a DIAG_*_ALERT threshold publishes an alert on the alarm topic,
+ * and another one when the condition clears.
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t app_diag_task_start(void);
@@ -0,0 +1,32 @@
+#pragma once
+#include "esp_err.h"
+#include "history.h"
+
+/**
+ * @brief Mounts the history partition and starts the history task.
+ *
+ * The task keeps the recent telemetry of every channel in RAM, see
+ * app_history_get, including samples taken before the clock was set.
+ *
+ * It also keeps a per-minute mean of every channel in the "history" flash
+ * partition, see tsdb.h, and answers `history` commands with the stored
+ * points of a time range, raw or downsampled to `step_min`. Replies are
+ * published in pages on the device's history topic as
+ * `{"id":..,"channel":..,"step_min":..,"seq":..,"points":[[unix_s,v],..],
+ * "last":..}`. A reply cut at HISTORY_REPLY_MAX_POINTS ends with `"next"`,
+ * the time to continue from. A `history` command arriving while a reply is
+ * published fails, as does a reply not done within HISTORY_REPLY_TIMEOUT_MS.
+ * Samples taken before the clock was set are not logged to flash. Without a
+ * usable partition only the flash log is off and `history` commands fail.
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t app_history_task_start(void);
+
+/**
+ * @brief Returns the recent telemetry, for reading from any task.
+ *
+ * Filled by the history task, see history.h for how to read it. Valid once
+ * app_history_task_start returned.
+ */
+const history_t *app_history_get(void);
@@ -0,0 +1,20 @@
+#pragma once
+#include "esp_err.h"
+#include "storage.h"
+
+/**
+ * @brief Runs one wake of the duty-cycled low-power mode.
+ *
+ * Used instead of the boot graph when LOW_POWER_MODE_ENABLED is set. Every
+ * wake samples all sensors into a buffer in RTC memory; every
+ * LOW_POWER_UPLOAD_INTERVAL_MS (or when the buffer is nearly full) Wi-Fi and
+ * MQTT are raised to upload the buffer in one burst together with the wake
+ * and radio-on counters. The device then goes back to deep sleep until the
+ * next sample is due.
+ *
+ * @param creds Credentials, must stay valid until the device sleeps.
+ * @param identity Site and device name for the topics.
+ * @return ESP_OK if the task was started.
+ */
+esp_err_t app_low_power_start(const credentials_t *creds,
+                              const device_identity_t *identity);
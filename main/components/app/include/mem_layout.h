@@ -0,0 +1,100 @@
+#pragma once
+#include "app_config.h"
+#include "dlog.h"
+#include "event_bus.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include <stddef.h>
+
+/**
+ * Memory layout of every long-lived task and queue.
+ *
+ * With GROWGRID_STATIC_ALLOC the stacks, task control blocks and queue
+ * storage are generated from these tables as static arrays and handed to the
+ * *Static FreeRTOS APIs, so nothing is taken from the heap after boot.
+ * Without it the same calls allocate from the heap.
+ *
+ * The owning component is part of each generated symbol name, which is how
+ * tools/ram_budget.py charges the storage to that component. Boot stage
+ * tasks are not listed, they exit once boot is done.
+ */
+
+// X(component, id, count, stack_bytes)
+#define MEM_LAYOUT_TASKS(X)                                                    \
+  X(platform, EVENT_DISTRIBUTOR, 1, TASK_STACK_EVENT_DISTRIBUTOR)              \
+  X(platform, MQTT_PUBLISHER, 1, TASK_STACK_MQTT_PUBLISHER)                    \
+  X(app, SENSOR, SENSOR_DATA_TYPE_COUNT, TASK_STACK_SENSOR)                    \
+  X(app, PUMP_CONTROL, 1, TASK_STACK_PUMP_CONTROL)                             \
+  X(app, COMMAND, 1, TASK_STACK_COMMAND)                                       \
+  X(app, DIAG, 1, TASK_STACK_DIAG)                                             \
+  X(app, HISTORY, 1, TASK_STACK_HISTORY)                                       \
+  X(storage, CONFIG_COMMIT, 1, TASK_STACK_CONFIG_COMMIT)                       \
+  MEM_LAYOUT_HTTP_API_TASK_(X)                                                 \
+  MEM_LAYOUT_DLOG_TASK_(X)
+
+// The task feeding the HTTP server only exists in GROWGRID_HTTP_API builds.
+#if GROWGRID_HTTP_API
+#define MEM_LAYOUT_HTTP_API_TASK_(X)                                           \
+  X(platform, HTTP_API, 1, TASK_STACK_HTTP_API)
+#else
+#define MEM_LAYOUT_HTTP_API_TASK_(X)
+#endif
+
+// The log formatter only exists when some component defers its logging.
+#if GROWGRID_DLOG
+#define MEM_LAYOUT_DLOG_TASK_(X) X(dlog, LOG, 1, TASK_STACK_LOG)
+#else
+#define MEM_LAYOUT_DLOG_TASK_(X)
+#endif
+
+// X(component, id, count, length, item_size)
+#define MEM_LAYOUT_QUEUES(X)                                                   \
+  X(platform, EVENT_BUS, 1, EVENT_BUS_QUEUE_SIZE, sizeof(event_t))             \
+  X(platform, EVENT_SUBSCRIBER, EVENT_BUS_MAX_SUBSCRIBERS,                     \
+    EVENT_BUS_QUEUE_SIZE, sizeof(event_t))
+
+typedef enum {
+#define MEM_TASK_ID_(component, id, count, stack) MEM_TASK_##id,
+  MEM_LAYOUT_TASKS(MEM_TASK_ID_)
+#undef MEM_TASK_ID_
+  MEM_TASK_COUNT,
+} mem_task_t;
+
+typedef enum {
+#define MEM_QUEUE_ID_(component, id, count, length, size) MEM_QUEUE_##id,
+  MEM_LAYOUT_QUEUES(MEM_QUEUE_ID_)
+#undef MEM_QUEUE_ID_
+  MEM_QUEUE_COUNT,
+} mem_queue_t;
+
+// Total of stacks, control blocks and queue storage in the layout.
+#define MEM_TASK_BYTES_(component, id, count, stack)                           \
+  +(count) * ((stack) + sizeof(StaticTask_t))
+#define MEM_QUEUE_BYTES_(component, id, count, length, size)                   \
+  +(count) * ((length) * (size) + sizeof(StaticQueue_t))
+#define MEM_LAYOUT_BYTES                                                       \
+  (0 MEM_LAYOUT_TASKS(MEM_TASK_BYTES_) MEM_LAYOUT_QUEUES(MEM_QUEUE_BYTES_))
+
+/**
+ * @brief Creates a task from the layout, like xTaskCreate.
+ *
+ * @param id The layout entry, which also provides the stack size.
+ * @param index Slot within the entry, below its count.
+ * @return pdPASS on success.
+ */
+BaseType_t mem_task_create(mem_task_t id, size_t index, TaskFunction_t fn,
+                           const char *name, void *arg, UBaseType_t priority,
+                           TaskHandle_t *handle);
+
+/**
+ * @brief Creates a queue from the layout, like xQueueCreate.
+ *
+ * A queue created from a static slot may be deleted and created again from
+ * the same slot.
+ *
+ * @param id The layout entry, which also provides length and item size.
+ * @param index Slot within the entry, below its count.
+ * @return The queue, or NULL on failure.
+ */
+QueueHandle_t mem_queue_create(mem_queue_t id, size_t index);
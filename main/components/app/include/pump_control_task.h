@@ -4,7 +4,10 @@
 /**
  * @brief Starts the pump control task.
  *
- * This task listens for soil moisture events and controls the pump accordingly.
+ * This task feeds sensor events and the time of day into the rule engine
+ * and the irrigation model, and switches the pump on their decisions. It
+ * also executes pump and rules commands, rules come from NVS or
+ * PUMP_DEFAULT_RULES.
  *
  * @return ESP_OK on success.
  */
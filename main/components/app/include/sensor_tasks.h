@@ -1,5 +1,6 @@
 #pragma once
 #include "esp_err.h"
+#include "growgrid_types.h"
 
 /**
  * @brief Starts the sensor reading tasks.
@@ -0,0 +1,226 @@
+#include "low_power.h"
+#include "app_config.h"
+#include "config_store.h"
+#include "derived_metrics.h"
+#include "duty_cycle.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "event_bus.h"
+#include "hal_i2c.h"
+#include "hal_sensors.h"
+#include "mqtt_topics.h"
+#include "platform_mqtt.h"
+#include "platform_sntp.h"
+#include "platform_wifi.h"
+#include "telemetry.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+static const char *TAG = "LOW_POWER";
+
+#define UPLOAD_CHUNK_POINTS 32
+
+// Survive deep sleep, reinitialized on every cold boot.
+RTC_DATA_ATTR static duty_cycle_t s_duty;
+RTC_DATA_ATTR static duty_buffer_t s_buffer;
+RTC_DATA_ATTR static dli_t s_dli;
+
+static const credentials_t *s_creds;
+static device_identity_t s_identity;
+
+// The RTC keeps system time running through deep sleep, esp_timer does not.
+static int64_t wall_clock_us(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static uint32_t remaining_ms(int64_t deadline_us) {
+  int64_t left = deadline_us - esp_timer_get_time();
+  return left > 0 ? (uint32_t)(left / 1000) : 0;
+}
+
+static void store_sample(const sensor_data_t *data) {
+  telemetry_point_t points[TELEMETRY_MAX_POINTS_PER_SAMPLE];
+  int count = telemetry_points_from_sensor_data(data, points);
+  for (int i = 0; i < count; i++) {
+    duty_cycle_store(&s_duty, &s_buffer, &points[i]);
+  }
+}
+
+static void take_samples(int64_t now_us) {
+  if (hal_i2c_init() != ESP_OK || hal_sensors_init() != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to initialize sensors");
+    return;
+  }
+  const config_t *config = config_store_get();
+  if (config->soil_dry_raw != 0) {
+    hal_sensors_set_soil_calibration(config->soil_dry_raw,
+                                     config->soil_wet_raw);
+  }
+
+  for (int i = 0; i < SENSOR_DATA_TYPE_COUNT; i++) {
+    sensor_data_t data = {.timestamp_us = (uint64_t)now_us,
+                          .type = (sensor_data_type_t)i};
+    if (hal_sensors_read(data.type, &data.payload) != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to read %s", sensor_name(data.type));
+      continue;
+    }
+    if (data.type == SENSOR_DATA_TYPE_LIGHT) {
+      data.payload.light.dli =
+          dli_add(&s_dli, data.timestamp_us, dli_local_day(data.timestamp_us),
+                  data.payload.light.lux);
+    }
+    store_sample(&data);
+  }
+}
+
+// After a cold boot the clock starts at 1970 until SNTP sets it. Everything
+// sampled and scheduled before that is moved by the step. Returns whether
+// the clock is set, points with an unset clock cannot be published.
+static bool sync_clock(int64_t deadline_us) {
+  int64_t wall_before = wall_clock_us();
+  int64_t mono_before = esp_timer_get_time();
+  platform_sntp_init(s_creds->ntp_server, remaining_ms(deadline_us));
+
+  int64_t wall_after = wall_clock_us();
+  if (wall_after < (int64_t)TELEMETRY_MIN_VALID_TIMESTAMP_US) {
+    return false;
+  }
+  if (wall_before < (int64_t)TELEMETRY_MIN_VALID_TIMESTAMP_US) {
+    int64_t step = wall_after - wall_before -
+                   (esp_timer_get_time() - mono_before);
+    duty_cycle_shift(&s_duty, &s_buffer, step);
+  }
+  return true;
+}
+
+static bool wait_mqtt_connected(int64_t deadline_us) {
+  while (!platform_mqtt_is_connected()) {
+    if (esp_timer_get_time() >= deadline_us) {
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(50));
+  }
+  return true;
+}
+
+static void publish_power_state(void) {
+  const duty_cycle_stats_t *stats = &s_duty.stats;
+  char payload[224];
+  int len = snprintf(
+      payload, sizeof(payload),
+      "{\"wakes\":%" PRIu32 ",\"samples\":%" PRIu32 ",\"dropped\":%" PRIu32
+      ",\"uploads\":%" PRIu32 ",\"upload_failures\":%" PRIu32
+      ",\"radio_on_ms\":%" PRIu64 ",\"last_radio_on_ms\":%" PRIu32
+      ",\"buffered\":%u}",
+      stats->wakes, stats->samples, stats->dropped, stats->uploads,
+      stats->upload_failures, stats->radio_on_us / 1000,
+      stats->last_radio_on_ms, (unsigned)s_buffer.count);
+  platform_mqtt_publish(MQTT_TOPIC_CLASS_STATE, mqtt_topics_get()->power_state,
+                        payload, len);
+}
+
+static esp_err_t publish_buffer(int64_t deadline_us) {
+  telemetry_point_t points[UPLOAD_CHUNK_POINTS];
+
+  for (size_t i = 0; i < s_buffer.count; i += UPLOAD_CHUNK_POINTS) {
+    int n = 0;
+    while (n < UPLOAD_CHUNK_POINTS && i + n < s_buffer.count) {
+      duty_buffer_get(&s_buffer, i + n, &points[n]);
+      n++;
+    }
+    esp_err_t err =
+        platform_mqtt_publish_batch(points, n, remaining_ms(deadline_us));
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+  return ESP_OK;
+}
+
+static void upload(void) {
+  int64_t radio_start_us = esp_timer_get_time();
+  int64_t deadline_us = radio_start_us + LOW_POWER_RADIO_TIMEOUT_MS * 1000LL;
+  bool ok = false;
+
+  ESP_ERROR_CHECK(event_bus_init());
+  ESP_ERROR_CHECK(event_bus_start_distributor());
+  ESP_ERROR_CHECK(mqtt_topics_init(s_identity.site, s_identity.device));
+  ESP_ERROR_CHECK(
+      platform_wifi_start_sta(s_creds->wifi_ssid, s_creds->wifi_pass));
+
+  if (platform_wifi_wait_connected(remaining_ms(deadline_us)) != ESP_OK) {
+    ESP_LOGW(TAG, "No Wi-Fi connection");
+  } else if (!sync_clock(deadline_us)) {
+    ESP_LOGW(TAG, "Clock not set, points cannot be timestamped");
+  } else {
+    platform_mqtt_init(s_creds->mqtt_broker, s_creds->mqtt_user,
+                       s_creds->mqtt_pass);
+    if (wait_mqtt_connected(deadline_us)) {
+      ESP_LOGI(TAG, "Uploading %u buffered points", (unsigned)s_buffer.count);
+      publish_power_state();
+      ok = publish_buffer(deadline_us) == ESP_OK &&
+           platform_mqtt_flush(remaining_ms(deadline_us)) == ESP_OK;
+    }
+  }
+
+  if (!ok) {
+    ESP_LOGW(TAG, "Upload incomplete, keeping %u points for the next one",
+             (unsigned)s_buffer.count);
+  }
+  // Deep sleep follows right away, so this is the whole radio-on window.
+  duty_cycle_uploaded(&s_duty, &s_buffer, ok,
+                      esp_timer_get_time() - radio_start_us, wall_clock_us());
+}
+
+static void low_power_task(void *pvParameters) {
+  int64_t now = wall_clock_us();
+  if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER) {
+    const duty_cycle_config_t config = {
+        .sample_interval_ms = LOW_POWER_SAMPLE_INTERVAL_MS,
+        .upload_interval_ms = LOW_POWER_UPLOAD_INTERVAL_MS,
+    };
+    duty_cycle_init(&s_duty, &config, now);
+    duty_buffer_reset(&s_buffer);
+    // Samples are a whole interval apart here.
+    dli_init(&s_dli, DLI_LUX_PER_PPFD,
+             DLI_MAX_GAP_MS > 2 * LOW_POWER_SAMPLE_INTERVAL_MS
+                 ? DLI_MAX_GAP_MS
+                 : 2 * LOW_POWER_SAMPLE_INTERVAL_MS);
+  }
+
+  unsigned actions = duty_cycle_wake(&s_duty, &s_buffer, now);
+  if (actions & DUTY_ACTION_SAMPLE) {
+    take_samples(now);
+    duty_cycle_sampled(&s_duty, now);
+  }
+  if (actions & DUTY_ACTION_UPLOAD) {
+    upload();
+  }
+
+  int64_t sleep_us = duty_cycle_sleep_us(&s_duty, wall_clock_us());
+  ESP_LOGI(TAG,
+           "Wake %" PRIu32 " done (%u buffered, %" PRIu64
+           " ms radio on since boot), sleeping %" PRId64 " ms",
+           s_duty.stats.wakes, (unsigned)s_buffer.count,
+           s_duty.stats.radio_on_us / 1000, sleep_us / 1000);
+  esp_sleep_enable_timer_wakeup(sleep_us > 0 ? (uint64_t)sleep_us : 1000);
+  esp_deep_sleep_start();
+}
+
+esp_err_t app_low_power_start(const credentials_t *creds,
+                              const device_identity_t *identity) {
+  s_creds = creds;
+  s_identity = *identity;
+
+  if (xTaskCreate(low_power_task, "low_power", TASK_STACK_LOW_POWER, NULL,
+                  TASK_PRIO_LOW_POWER, NULL) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create low power task");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
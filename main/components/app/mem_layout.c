@@ -0,0 +1,104 @@
+#include "mem_layout.h"
+#include "esp_log.h"
+
+static const char *TAG = "MEM_LAYOUT";
+
+typedef struct {
+  size_t count;
+  uint32_t stack_bytes;
+#if GROWGRID_STATIC_ALLOC
+  StackType_t *stacks;
+  StaticTask_t *tcbs;
+#endif
+} mem_task_slot_t;
+
+typedef struct {
+  size_t count;
+  UBaseType_t length;
+  UBaseType_t item_size;
+#if GROWGRID_STATIC_ALLOC
+  uint8_t *storage;
+  StaticQueue_t *queues;
+#endif
+} mem_queue_slot_t;
+
+#if GROWGRID_STATIC_ALLOC
+
+_Static_assert(MEM_LAYOUT_BYTES <= MEM_STATIC_BUDGET_BYTES,
+               "Static memory layout exceeds MEM_STATIC_BUDGET_BYTES");
+
+#define MEM_TASK_STORAGE_(component, id, count, stack)                         \
+  static StackType_t s_mem_##component##__##id##_stack[(count) * (stack) /    \
+                                                        sizeof(StackType_t)]; \
+  static StaticTask_t s_mem_##component##__##id##_tcb[count];
+MEM_LAYOUT_TASKS(MEM_TASK_STORAGE_)
+#undef MEM_TASK_STORAGE_
+
+#define MEM_QUEUE_STORAGE_(component, id, count, length, size)                 \
+  static uint8_t s_mem_##component##__##id##_storage[(count) * (length) *     \
+                                                      (size)];                 \
+  static StaticQueue_t s_mem_##component##__##id##_queue[count];
+MEM_LAYOUT_QUEUES(MEM_QUEUE_STORAGE_)
+#undef MEM_QUEUE_STORAGE_
+
+#define MEM_TASK_SLOT_(component, id, count, stack)                            \
+  [MEM_TASK_##id] = {(count), (stack), s_mem_##component##__##id##_stack,      \
+                     s_mem_##component##__##id##_tcb},
+#define MEM_QUEUE_SLOT_(component, id, count, length, size)                    \
+  [MEM_QUEUE_##id] = {(count), (length), (size),                               \
+                      s_mem_##component##__##id##_storage,                     \
+                      s_mem_##component##__##id##_queue},
+
+#else
+
+#define MEM_TASK_SLOT_(component, id, count, stack)                            \
+  [MEM_TASK_##id] = {(count), (stack)},
+#define MEM_QUEUE_SLOT_(component, id, count, length, size)                    \
+  [MEM_QUEUE_##id] = {(count), (length), (size)},
+
+#endif
+
+static const mem_task_slot_t s_tasks[MEM_TASK_COUNT] = {
+    MEM_LAYOUT_TASKS(MEM_TASK_SLOT_)};
+static const mem_queue_slot_t s_queues[MEM_QUEUE_COUNT] = {
+    MEM_LAYOUT_QUEUES(MEM_QUEUE_SLOT_)};
+
+#undef MEM_TASK_SLOT_
+#undef MEM_QUEUE_SLOT_
+
+BaseType_t mem_task_create(mem_task_t id, size_t index, TaskFunction_t fn,
+                           const char *name, void *arg, UBaseType_t priority,
+                           TaskHandle_t *handle) {
+  const mem_task_slot_t *slot = &s_tasks[id];
+  if (index >= slot->count) {
+    ESP_LOGE(TAG, "Task slot %u out of range", (unsigned)index);
+    return pdFAIL;
+  }
+  uint32_t depth = slot->stack_bytes / sizeof(StackType_t);
+#if GROWGRID_STATIC_ALLOC
+  TaskHandle_t task =
+      xTaskCreateStatic(fn, name, depth, arg, priority,
+                        slot->stacks + index * depth, &slot->tcbs[index]);
+  if (handle != NULL) {
+    *handle = task;
+  }
+  return task != NULL ? pdPASS : pdFAIL;
+#else
+  return xTaskCreate(fn, name, depth, arg, priority, handle);
+#endif
+}
+
+QueueHandle_t mem_queue_create(mem_queue_t id, size_t index) {
+  const mem_queue_slot_t *slot = &s_queues[id];
+  if (index >= slot->count) {
+    ESP_LOGE(TAG, "Queue slot %u out of range", (unsigned)index);
+    return NULL;
+  }
+#if GROWGRID_STATIC_ALLOC
+  uint8_t *storage = slot->storage + index * slot->length * slot->item_size;
+  return xQueueCreateStatic(slot->length, slot->item_size, storage,
+                            &slot->queues[index]);
+#else
+  return xQueueCreate(slot->length, slot->item_size);
+#endif
+}
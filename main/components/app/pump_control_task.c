@@ -1,45 +1,220 @@
 #include "pump_control_task.h"
 #include "app_config.h"
+#include "command_task.h"
+#include "dlog.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "event_bus.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-// #include "hal_pump.h"
-// #include "pump_logic.h"
+#include "freertos/timers.h"
+#include "hal_pump.h"
+#include "mem_layout.h"
+#include "pump_control.h"
+#include "storage.h"
+#include "trace.h"
+#include <inttypes.h>
+#include <string.h>
+#include <sys/time.h>
 
 static const char *TAG = "PUMP_CONTROL_TASK";
 
+// Ends a timed pump run, started by a command or a predicted pulse. Only
+// switches the pump off on time: its state lags the commands queued for the
+// timer task, so the run is tracked by its deadline in s_ctrl.
+static TimerHandle_t s_timed_run_timer;
+
+static rule_program_t s_program;
+static pump_control_t s_ctrl;
+
+static int64_t wall_clock_us(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void timed_run_timeout(TimerHandle_t timer) {
+  DLOG_I(TAG, "Timed pump run finished, turning pump OFF");
+  hal_pump_off();
+}
+
+static void start_timed_run(uint32_t duration_s) {
+  xTimerChangePeriod(s_timed_run_timer, pdMS_TO_TICKS(duration_s * 1000), 0);
+}
+
+// Switches the pump off unless the timer already has. It lags the deadline
+// by the timer task's latency at most.
+static void end_timed_run(void) {
+  if (xTimerIsTimerActive(s_timed_run_timer)) {
+    xTimerStop(s_timed_run_timer, 0);
+    hal_pump_off();
+  }
+}
+
+// Falls back to the default rules when none are stored.
+static void load_rules(void) {
+  char src[RULE_SOURCE_MAX_LEN];
+  size_t len = sizeof(src);
+  int line = 0;
+  if (storage_read_rules(src, &len) != ESP_OK ||
+      rule_compile(src, len, &s_program, &line) != RULE_COMPILE_OK) {
+    if (line > 0) {
+      ESP_LOGE(TAG, "Stored rules fail in statement %d, using defaults",
+               line);
+    }
+    rule_compile(PUMP_DEFAULT_RULES, strlen(PUMP_DEFAULT_RULES), &s_program,
+                 NULL);
+  }
+  ESP_LOGI(TAG, "Loaded %u rules with %u conditions",
+           (unsigned)s_program.rule_count,
+           (unsigned)s_program.condition_count);
+}
+
+static void handle_pump_command(const command_t *cmd) {
+  const pump_command_t *pump = &cmd->args.pump;
+  esp_err_t err;
+
+  if (pump->on) {
+    ESP_LOGI(TAG, "Command %" PRIu32 ": pump ON for %" PRIu32 " s", cmd->id,
+             pump->duration_s);
+    err = hal_pump_on();
+    if (err == ESP_OK) {
+      start_timed_run(pump->duration_s);
+      pump_control_timed_run(&s_ctrl, pump->duration_s, esp_timer_get_time());
+    }
+  } else {
+    ESP_LOGI(TAG, "Command %" PRIu32 ": pump OFF", cmd->id);
+    xTimerStop(s_timed_run_timer, 0);
+    err = hal_pump_off();
+    if (err == ESP_OK) {
+      pump_control_stopped(&s_ctrl, esp_timer_get_time());
+    }
+  }
+
+  app_command_ack(cmd, err == ESP_OK ? COMMAND_STATUS_OK
+                                     : COMMAND_STATUS_FAILED);
+}
+
+// The MQTT task has already checked and stored the new rules.
+static void handle_rules_command(const command_t *cmd) {
+  load_rules();
+  pump_control_reload(&s_ctrl, &s_program);
+  app_command_ack(cmd, COMMAND_STATUS_OK);
+}
+
+static void handle_sensor_health(const sensor_health_event_data_t *health) {
+  if (!pump_control_sensor_health(&s_ctrl, health->sensor, health->state)) {
+    return;
+  }
+  if (s_ctrl.soil_ok) {
+    ESP_LOGI(TAG, "Soil sensor ok, soil rules resume with its next sample");
+  } else {
+    ESP_LOGW(TAG, "Soil sensor %s, soil rules suspended",
+             sensor_health_state_name(health->state));
+  }
+}
+
+static void apply_decision(void) {
+  int64_t now_us = esp_timer_get_time();
+  pump_control_decision_t decision = pump_control_step(&s_ctrl, now_us);
+  if (decision.run_ended) {
+    end_timed_run();
+  }
+
+  switch (decision.action) {
+  case PUMP_CONTROL_START:
+    ESP_LOGI(TAG, "Rules turn pump ON");
+    if (hal_pump_on() != ESP_OK) {
+      pump_control_stopped(&s_ctrl, now_us);
+    }
+    break;
+  case PUMP_CONTROL_STOP:
+    ESP_LOGI(TAG, "Rules turn pump OFF");
+    hal_pump_off();
+    break;
+  case PUMP_CONTROL_PULSE:
+    ESP_LOGI(TAG,
+             "Crossing %" PRIu32 "%% in %" PRIu32 " s, pulsing for %u s",
+             s_program.predict_below_pct, decision.plan.crossing_in_s,
+             (unsigned)decision.plan.pulse_s);
+    if (hal_pump_on() == ESP_OK) {
+      start_timed_run(decision.plan.pulse_s);
+    } else {
+      pump_control_stopped(&s_ctrl, now_us);
+    }
+    break;
+  case PUMP_CONTROL_NONE:
+    break;
+  }
+}
+
+// Sleeps until the next decision is due at the latest, so an idle zone wakes
+// the task about once per PUMP_CONTROL_TICK_MS instead of polling. Rounded
+// up by a tick, so it does not wake just before the end of a timed run.
+static TickType_t next_wakeup(void) {
+  uint32_t wait_ms = pump_control_next_check_ms(&s_ctrl, esp_timer_get_time());
+  if (wait_ms > PUMP_CONTROL_TICK_MS) {
+    wait_ms = PUMP_CONTROL_TICK_MS;
+  }
+  return pdMS_TO_TICKS(wait_ms) + 1;
+}
+
 static void pump_control_task(void *pvParameters) {
   QueueHandle_t event_queue = event_bus_subscribe();
   if (event_queue == NULL) {
     ESP_LOGE(TAG, "Failed to subscribe to event bus");
     vTaskDelete(NULL);
   }
+  static const irrigation_config_t irrigation_config = IRRIGATION_CONFIG;
+  load_rules();
+  pump_control_init(&s_ctrl, &s_program, &irrigation_config,
+                    esp_timer_get_time());
   ESP_LOGI(TAG, "Pump control task started");
 
   while (1) {
     event_t event;
-    if (xQueueReceive(event_queue, &event, portMAX_DELAY) == pdTRUE) {
-      if (event.type == EVENT_TYPE_SENSOR_DATA &&
-          event.data.sensor_data.type == SENSOR_DATA_TYPE_SOIL_MOISTURE) {
-        int moisture = event.data.sensor_data.payload.soil_moisture.percent;
-        ESP_LOGI(TAG, "Received soil moisture: %d%%", moisture);
-        // if (pump_logic_should_start(moisture)) {
-        //   ESP_LOGI(TAG, "Moisture is low, turning pump ON");
-        //   hal_pump_on();
-        // } else {
-        //   ESP_LOGI(TAG, "Moisture is sufficient, turning pump OFF");
-        //   hal_pump_off();
-        // }
+    if (xQueueReceive(event_queue, &event, next_wakeup()) == pdTRUE) {
+      TRACE_INSTANT(EVENT_RECEIVE, event.trace_span, event.type);
+      if (event.type == EVENT_TYPE_COMMAND &&
+          event.data.command.type == COMMAND_TYPE_PUMP) {
+        handle_pump_command(&event.data.command);
+      } else if (event.type == EVENT_TYPE_COMMAND &&
+                 event.data.command.type == COMMAND_TYPE_RULES) {
+        handle_rules_command(&event.data.command);
+      } else if (event.type == EVENT_TYPE_SENSOR_DATA) {
+        pump_control_sensor_data(&s_ctrl, &event.data.sensor_data,
+                                 esp_timer_get_time());
+      } else if (event.type == EVENT_TYPE_SENSOR_HEALTH) {
+        handle_sensor_health(&event.data.sensor_health);
+      } else if (event.type == EVENT_TYPE_PUMP_STATE_CHANGE) {
+        pump_control_pump_state(&s_ctrl, event.data.pump_state.is_on,
+                                esp_timer_get_time());
       }
     }
+    pump_control_set_wall_clock(&s_ctrl, wall_clock_us());
+    apply_decision();
   }
 }
 
 esp_err_t app_pump_control_task_start(void) {
-  if (xTaskCreate(pump_control_task, "pump_control_task",
-                  TASK_STACK_PUMP_CONTROL, NULL, TASK_PRIO_PUMP_CONTROL,
-                  NULL) != pdPASS) {
+  // The period is replaced by the requested duration on every timed run.
+#if GROWGRID_STATIC_ALLOC
+  static StaticTimer_t timer_buffer;
+  s_timed_run_timer =
+      xTimerCreateStatic("pump_timed_run", pdMS_TO_TICKS(1000), pdFALSE,
+                         NULL, timed_run_timeout, &timer_buffer);
+#else
+  s_timed_run_timer = xTimerCreate("pump_timed_run", pdMS_TO_TICKS(1000),
+                                   pdFALSE, NULL, timed_run_timeout);
+#endif
+  if (s_timed_run_timer == NULL) {
+    ESP_LOGE(TAG, "Failed to create timed run timer");
+    return ESP_FAIL;
+  }
+
+  if (mem_task_create(MEM_TASK_PUMP_CONTROL, 0, pump_control_task,
+                      "pump_control_task", NULL, TASK_PRIO_PUMP_CONTROL,
+                      NULL) != pdPASS) {
     ESP_LOGE(TAG, "Failed to create pump control task");
     return ESP_FAIL;
   }
@@ -1,111 +1,194 @@
 #include "sensor_tasks.h"
 #include "app_config.h"
+#include "boot.h"
+#include "config_store.h"
+#include "derived_metrics.h"
+#include "dlog.h"
 #include "esp_log.h"
 #include "event_bus.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "growgrid_types.h"
 #include "hal_sensors.h"
+#include "mem_layout.h"
+#include "sensor_health.h"
+#include "trace.h"
 #include <sys/time.h>
 
 static const char *TAG = "SENSOR_TASKS";
 
-static void temp_humidity_sensor_task(void *pvParameters) {
-  TickType_t last_wake_time = xTaskGetTickCount();
-  ESP_LOGI(TAG, "Temperature & Humidity sensor task started");
+// Task names, FreeRTOS keeps the first configMAX_TASK_NAME_LEN - 1 chars.
+static const char *const s_task_names[SENSOR_DATA_TYPE_COUNT] = {
+#define SENSOR_TASK_NAME_(ID, name, ...) [SENSOR_DATA_TYPE_##ID] = #name,
+    SENSOR_REGISTRY(SENSOR_TASK_NAME_)
+#undef SENSOR_TASK_NAME_
+};
 
-  while (1) {
-    event_t event;
-    temp_humidity_data_t temp_hum_data;
-    struct timeval tv_now;
+// One reader per checked payload member.
+#define SENSOR_CHECK_VALUE_(ID, name, member, ...)                             \
+  static float value_##name##_##member(const sensor_data_payload_t *payload) { \
+    return (float)payload->name.member;                                        \
+  }
+SENSOR_CHECKS(SENSOR_CHECK_VALUE_)
+#undef SENSOR_CHECK_VALUE_
 
-    if (hal_sensors_read_temp_humidity(&temp_hum_data) == ESP_OK) {
-      gettimeofday(&tv_now, NULL);
-      event.type = EVENT_TYPE_SENSOR_DATA;
-      event.data.sensor_data.type = SENSOR_DATA_TYPE_TEMP_HUMIDITY;
-      event.data.sensor_data.payload.temp_humidity = temp_hum_data;
-      event.data.sensor_data.timestamp_us =
-          (uint64_t)tv_now.tv_sec * 1000000L + (uint64_t)tv_now.tv_usec;
-      event_bus_post(&event, pdMS_TO_TICKS(EVENT_BUS_POST_TIMEOUT_MS));
-    } else {
-      ESP_LOGE(TAG, "Failed to read temperature/humidity");
+typedef struct {
+  sensor_data_type_t sensor;
+  float (*value)(const sensor_data_payload_t *payload);
+  sensor_health_config_t config;
+} sensor_check_t;
+
+#define HEALTH_DEFAULTS                                                        \
+  .memory_shift = 4, .warmup = 12, .jump_confirm = 3,                          \
+  .fail_after = SENSOR_HEALTH_FAIL_AFTER,                                      \
+  .recover_after = SENSOR_HEALTH_RECOVER_AFTER,                                \
+  .reinit_every = SENSOR_HEALTH_REINIT_EVERY
+
+static const sensor_check_t s_checks[SENSOR_CHECK_COUNT] = {
+#define SENSOR_CHECK_(ID, name, member, lo, hi, floor, sigma, stuck)           \
+  {SENSOR_DATA_TYPE_##ID,                                                      \
+   value_##name##_##member,                                                    \
+   {.min = (lo),                                                               \
+    .max = (hi),                                                               \
+    .jump_floor = (floor),                                                     \
+    .jump_sigma = (sigma),                                                     \
+    .stuck_samples = (stuck),                                                  \
+    HEALTH_DEFAULTS}},
+    SENSOR_CHECKS(SENSOR_CHECK_)
+#undef SENSOR_CHECK_
+};
+
+// Only touched by the sensor's own task. What is reported per sensor is
+// the worst state of its checks.
+static sensor_health_t s_health[SENSOR_CHECK_COUNT];
+static sensor_health_event_data_t s_reported[SENSOR_DATA_TYPE_COUNT];
+// Only touched by the light sensor task.
+static dli_t s_dli;
+
+// Reports the worst state of the sensor's checks if it changed.
+static void report_health(sensor_data_type_t sensor) {
+  sensor_health_event_data_t worst = {.sensor = sensor};
+  for (int i = 0; i < SENSOR_CHECK_COUNT; i++) {
+    if (s_checks[i].sensor == sensor && s_health[i].state > worst.state) {
+      worst.state = (sensor_health_state_t)s_health[i].state;
+      worst.fault = (sensor_fault_t)s_health[i].fault;
     }
-    vTaskDelayUntil(&last_wake_time,
-                    pdMS_TO_TICKS(TEMP_SENSOR_READ_INTERVAL_MS));
   }
-}
+  sensor_health_event_data_t *reported = &s_reported[sensor];
+  if (worst.state == reported->state && worst.fault == reported->fault) {
+    return;
+  }
+  *reported = worst;
 
-static void light_sensor_task(void *pvParameters) {
-  TickType_t last_wake_time = xTaskGetTickCount();
-  ESP_LOGI(TAG, "Light sensor task started");
+  if (worst.state == SENSOR_HEALTH_OK) {
+    ESP_LOGI(TAG, "Sensor %s is ok again", sensor_name(sensor));
+  } else {
+    ESP_LOGW(TAG, "Sensor %s is %s (%s)", sensor_name(sensor),
+             sensor_health_state_name(worst.state),
+             sensor_fault_name(worst.fault));
+  }
+  event_t event = {.type = EVENT_TYPE_SENSOR_HEALTH};
+  event.data.sensor_health = worst;
+  event_bus_post(&event, EVENT_BUS_POST_TIMEOUT_MS);
+}
 
-  while (1) {
-    event_t event;
-    light_data_t light_data;
-    struct timeval tv_now;
+// Derived values that depend on earlier samples are added here, before the
+// sample is posted. The stateless ones (VPD, dew point) are computed when a
+// sample is split into telemetry points.
+static void derive(sensor_data_t *data) {
+  if (data->type == SENSOR_DATA_TYPE_LIGHT) {
+    data->payload.light.dli =
+        dli_add(&s_dli, data->timestamp_us,
+                dli_local_day(data->timestamp_us), data->payload.light.lux);
+  }
+}
 
-    if (hal_sensors_read_light(&light_data) == ESP_OK) {
-      gettimeofday(&tv_now, NULL);
-      event.type = EVENT_TYPE_SENSOR_DATA;
-      event.data.sensor_data.type = SENSOR_DATA_TYPE_LIGHT;
-      event.data.sensor_data.payload.light = light_data;
-      event.data.sensor_data.timestamp_us =
-          (uint64_t)tv_now.tv_sec * 1000000L + (uint64_t)tv_now.tv_usec;
-      event_bus_post(&event, pdMS_TO_TICKS(EVENT_BUS_POST_TIMEOUT_MS));
+// Posts the sample if the read worked and every checked value is
+// plausible, and returns the delay until the next attempt. A failing sensor
+// backs off on its own, the other tasks keep their cadence.
+static uint32_t finish_read(sensor_data_type_t sensor, esp_err_t err,
+                            event_t *event) {
+  // All checks of a sensor see the same read errors, so its first one
+  // decides about re-initialising and the retry delay.
+  const sensor_health_t *first = NULL;
+  bool plausible = true;
+  for (int i = 0; i < SENSOR_CHECK_COUNT; i++) {
+    if (s_checks[i].sensor != sensor) {
+      continue;
+    }
+    sensor_health_t *health = &s_health[i];
+    if (first == NULL) {
+      first = health;
+    }
+    if (err == ESP_OK) {
+      float value = s_checks[i].value(&event->data.sensor_data.payload);
+      plausible &= sensor_health_check(health, value, NULL) ==
+                   SENSOR_FAULT_NONE;
     } else {
-      ESP_LOGE(TAG, "Failed to read light");
+      sensor_health_read_failed(health);
     }
-    vTaskDelayUntil(&last_wake_time,
-                    pdMS_TO_TICKS(LIGHT_SENSOR_READ_INTERVAL_MS));
   }
+
+  if (err == ESP_OK && plausible) {
+    derive(&event->data.sensor_data);
+    event_bus_post(event, EVENT_BUS_POST_TIMEOUT_MS);
+    boot_profiler_mark("first_sample");
+  } else if (err != ESP_OK) {
+    DLOG_D(TAG, "Failed to read sensor %s: %s", sensor_name(sensor),
+           esp_err_to_name(err));
+  }
+  report_health(sensor);
+  if (err != ESP_OK && sensor_health_reinit_due(first)) {
+    err = hal_sensors_reinit(sensor);
+    ESP_LOGW(TAG, "Re-initialized sensor %s: %s", sensor_name(sensor),
+             esp_err_to_name(err));
+  }
+  // Read on every cycle, a `sampling` command applies after the current one.
+  uint32_t interval_ms = config_store_get()->sample_interval_ms[sensor];
+  return sensor_health_retry_ms(first, interval_ms,
+                                SENSOR_HEALTH_BACKOFF_MAX_MS);
 }
 
-static void soil_moisture_sensor_task(void *pvParameters) {
+// One instance per sensor, the argument is its type.
+static void sensor_task(void *pvParameters) {
+  sensor_data_type_t sensor = (sensor_data_type_t)(uintptr_t)pvParameters;
   TickType_t last_wake_time = xTaskGetTickCount();
-  ESP_LOGI(TAG, "Soil Moisture sensor task started");
+  ESP_LOGI(TAG, "Sensor task %s started", sensor_name(sensor));
 
   while (1) {
-    event_t event;
-    soil_moisture_data_t soil_data;
-    struct timeval tv_now;
+    event_t event = {.type = EVENT_TYPE_SENSOR_DATA};
+    sensor_data_t *data = &event.data.sensor_data;
+    data->type = sensor;
+
+    event.trace_span = TRACE_SPAN_NEW();
+    TRACE_BEGIN(SENSOR_READ, event.trace_span, sensor);
+    esp_err_t err = hal_sensors_read(sensor, &data->payload);
+    TRACE_END(SENSOR_READ, event.trace_span, err);
 
-    if (hal_sensors_read_soil_moisture(&soil_data) == ESP_OK) {
+    if (err == ESP_OK) {
+      struct timeval tv_now;
       gettimeofday(&tv_now, NULL);
-      event.type = EVENT_TYPE_SENSOR_DATA;
-      event.data.sensor_data.type = SENSOR_DATA_TYPE_SOIL_MOISTURE;
-      event.data.sensor_data.payload.soil_moisture = soil_data;
-      event.data.sensor_data.timestamp_us =
+      data->timestamp_us =
           (uint64_t)tv_now.tv_sec * 1000000L + (uint64_t)tv_now.tv_usec;
-      event_bus_post(&event, pdMS_TO_TICKS(EVENT_BUS_POST_TIMEOUT_MS));
-    } else {
-      ESP_LOGE(TAG, "Failed to read soil moisture");
     }
-    vTaskDelayUntil(&last_wake_time,
-                    pdMS_TO_TICKS(SOIL_SENSOR_READ_INTERVAL_MS));
+    uint32_t delay_ms = finish_read(sensor, err, &event);
+    vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(delay_ms));
   }
 }
 
 esp_err_t app_sensor_tasks_start(void) {
-  if (xTaskCreate(temp_humidity_sensor_task, "temp_humidity_sensor_task",
-                  TASK_STACK_TEMP_SENSOR, NULL, TASK_PRIO_TEMP_SENSOR,
-                  NULL) != pdPASS) {
-    ESP_LOGE(TAG, "Failed to create temp_humidity_sensor_task");
-    return ESP_FAIL;
+  for (int i = 0; i < SENSOR_CHECK_COUNT; i++) {
+    sensor_health_init(&s_health[i], &s_checks[i].config);
   }
+  dli_init(&s_dli, DLI_LUX_PER_PPFD, DLI_MAX_GAP_MS);
 
-  if (xTaskCreate(light_sensor_task, "light_sensor_task",
-                  TASK_STACK_LIGHT_SENSOR, NULL, TASK_PRIO_LIGHT_SENSOR,
-                  NULL) != pdPASS) {
-    ESP_LOGE(TAG, "Failed to create light_sensor_task");
-    return ESP_FAIL;
-  }
-
-  if (xTaskCreate(soil_moisture_sensor_task, "soil_moisture_sensor_task",
-                  TASK_STACK_SOIL_SENSOR, NULL, TASK_PRIO_SOIL_SENSOR,
-                  NULL) != pdPASS) {
-    ESP_LOGE(TAG, "Failed to create soil_moisture_sensor_task");
-    return ESP_FAIL;
+  for (int i = 0; i < SENSOR_DATA_TYPE_COUNT; i++) {
+    if (mem_task_create(MEM_TASK_SENSOR, i, sensor_task, s_task_names[i],
+                        (void *)(uintptr_t)i, TASK_PRIO_SENSOR,
+                        NULL) != pdPASS) {
+      ESP_LOGE(TAG, "Failed to create sensor task %s", s_task_names[i]);
+      return ESP_FAIL;
+    }
   }
-
   return ESP_OK;
 }
@@ -0,0 +1,359 @@
+#include "command.h"
+#include "telemetry.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *const s_type_names[] = {
+    [COMMAND_TYPE_PUMP] = "pump",
+    [COMMAND_TYPE_SAMPLING] = "sampling",
+    [COMMAND_TYPE_CALIBRATE] = "calibrate",
+    [COMMAND_TYPE_TELEMETRY] = "telemetry",
+    [COMMAND_TYPE_TRACE] = "trace",
+    [COMMAND_TYPE_RULES] = "rules",
+    [COMMAND_TYPE_HISTORY] = "history",
+    [COMMAND_TYPE_UNKNOWN] = "unknown",
+};
+
+static const char *const s_status_names[] = {
+    [COMMAND_STATUS_OK] = "ok",
+    [COMMAND_STATUS_INVALID] = "invalid",
+    [COMMAND_STATUS_UNSUPPORTED] = "unsupported",
+    [COMMAND_STATUS_FAILED] = "failed",
+};
+
+// A token is a view into the payload, never a copy.
+typedef struct {
+  const char *ptr;
+  size_t len;
+} token_t;
+
+static bool token_equals(token_t tok, const char *str) {
+  return tok.len == strlen(str) && memcmp(tok.ptr, str, tok.len) == 0;
+}
+
+static bool token_to_u64(token_t tok, uint64_t *out) {
+  if (tok.len == 0 || tok.len > 19) {
+    return false;
+  }
+  uint64_t value = 0;
+  for (size_t i = 0; i < tok.len; i++) {
+    if (tok.ptr[i] < '0' || tok.ptr[i] > '9') {
+      return false;
+    }
+    value = value * 10 + (uint64_t)(tok.ptr[i] - '0');
+  }
+  *out = value;
+  return true;
+}
+
+static bool token_to_u32(token_t tok, uint32_t *out) {
+  uint64_t value;
+  if (!token_to_u64(tok, &value) || value > UINT32_MAX) {
+    return false;
+  }
+  *out = (uint32_t)value;
+  return true;
+}
+
+static const char *skip_ws(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+    p++;
+  }
+  return p;
+}
+
+// Reads a string (without quotes) or a bare scalar. Escapes are not
+// supported, none of the accepted keys or values need them.
+static const char *read_token(const char *p, const char *end, token_t *tok) {
+  if (p < end && *p == '"') {
+    const char *start = ++p;
+    while (p < end && *p != '"') {
+      if (*p == '\\') {
+        return NULL;
+      }
+      p++;
+    }
+    if (p == end) {
+      return NULL;
+    }
+    *tok = (token_t){start, (size_t)(p - start)};
+    return p + 1;
+  }
+  const char *start = p;
+  while (p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\t' &&
+         *p != '\r' && *p != '\n') {
+    p++;
+  }
+  *tok = (token_t){start, (size_t)(p - start)};
+  return tok->len > 0 ? p : NULL;
+}
+
+typedef struct {
+  bool has_on;
+  bool on;
+  bool has_duration;
+  uint32_t duration_s;
+  bool has_interval;
+  uint32_t interval_ms;
+  bool has_window;
+  uint32_t window_s;
+  bool has_from;
+  uint32_t from_s;
+  bool has_to;
+  uint32_t to_s;
+  uint32_t step_min;
+  token_t sensor;
+  token_t point;
+  token_t mode;
+  token_t target;
+  token_t rules;
+  token_t channel;
+} command_fields_t;
+
+static bool apply_field(token_t key, token_t value, command_t *cmd,
+                        command_fields_t *fields) {
+  if (token_equals(key, "id")) {
+    return token_to_u32(value, &cmd->id);
+  }
+  if (token_equals(key, "ts")) {
+    return token_to_u64(value, &cmd->sent_us);
+  }
+  if (token_equals(key, "on")) {
+    fields->has_on = true;
+    fields->on = token_equals(value, "true");
+    return fields->on || token_equals(value, "false");
+  }
+  if (token_equals(key, "duration_s")) {
+    fields->has_duration = true;
+    return token_to_u32(value, &fields->duration_s);
+  }
+  if (token_equals(key, "interval_ms")) {
+    fields->has_interval = true;
+    return token_to_u32(value, &fields->interval_ms);
+  }
+  if (token_equals(key, "window_s")) {
+    fields->has_window = true;
+    return token_to_u32(value, &fields->window_s);
+  }
+  if (token_equals(key, "from")) {
+    fields->has_from = true;
+    return token_to_u32(value, &fields->from_s);
+  }
+  if (token_equals(key, "to")) {
+    fields->has_to = true;
+    return token_to_u32(value, &fields->to_s);
+  }
+  if (token_equals(key, "step_min")) {
+    return token_to_u32(value, &fields->step_min);
+  }
+  if (token_equals(key, "channel")) {
+    fields->channel = value;
+    return true;
+  }
+  if (token_equals(key, "mode")) {
+    fields->mode = value;
+    return true;
+  }
+  if (token_equals(key, "sensor")) {
+    fields->sensor = value;
+    return true;
+  }
+  if (token_equals(key, "point")) {
+    fields->point = value;
+    return true;
+  }
+  if (token_equals(key, "target")) {
+    fields->target = value;
+    return true;
+  }
+  if (token_equals(key, "rules")) {
+    fields->rules = value;
+    return true;
+  }
+  // Unknown keys are ignored so senders can add metadata.
+  return true;
+}
+
+static bool parse_fields(const char *p, const char *end, command_t *cmd,
+                         command_fields_t *fields) {
+  p = skip_ws(p, end);
+  if (p == end || *p++ != '{') {
+    return false;
+  }
+  p = skip_ws(p, end);
+  if (p < end && *p == '}') {
+    return true;
+  }
+
+  while (p < end) {
+    token_t key;
+    token_t value;
+    p = skip_ws(p, end);
+    if (p == end || *p != '"' || (p = read_token(p, end, &key)) == NULL) {
+      return false;
+    }
+    p = skip_ws(p, end);
+    if (p == end || *p++ != ':') {
+      return false;
+    }
+    p = skip_ws(p, end);
+    if ((p = read_token(p, end, &value)) == NULL ||
+        !apply_field(key, value, cmd, fields)) {
+      return false;
+    }
+    p = skip_ws(p, end);
+    if (p == end) {
+      return false;
+    }
+    if (*p == '}') {
+      return true;
+    }
+    if (*p++ != ',') {
+      return false;
+    }
+  }
+  return false;
+}
+
+command_status_t command_parse(const char *name, size_t name_len,
+                               const char *payload, size_t payload_len,
+                               command_t *cmd) {
+  memset(cmd, 0, sizeof(*cmd));
+  cmd->type = COMMAND_TYPE_UNKNOWN;
+  token_t name_tok = {name, name_len};
+  command_fields_t fields = {0};
+
+  bool parsed = parse_fields(payload, payload + payload_len, cmd, &fields);
+
+  if (token_equals(name_tok, "pump")) {
+    cmd->type = COMMAND_TYPE_PUMP;
+  } else if (token_equals(name_tok, "sampling")) {
+    cmd->type = COMMAND_TYPE_SAMPLING;
+  } else if (token_equals(name_tok, "calibrate")) {
+    cmd->type = COMMAND_TYPE_CALIBRATE;
+  } else if (token_equals(name_tok, "telemetry")) {
+    cmd->type = COMMAND_TYPE_TELEMETRY;
+  } else if (token_equals(name_tok, "trace")) {
+    cmd->type = COMMAND_TYPE_TRACE;
+  } else if (token_equals(name_tok, "rules")) {
+    cmd->type = COMMAND_TYPE_RULES;
+  } else if (token_equals(name_tok, "history")) {
+    cmd->type = COMMAND_TYPE_HISTORY;
+  } else {
+    return COMMAND_STATUS_UNSUPPORTED;
+  }
+
+  if (!parsed) {
+    return COMMAND_STATUS_INVALID;
+  }
+
+  switch (cmd->type) {
+  case COMMAND_TYPE_PUMP:
+    if (!fields.has_on) {
+      return COMMAND_STATUS_INVALID;
+    }
+    if (fields.on && (!fields.has_duration || fields.duration_s == 0 ||
+                      fields.duration_s > COMMAND_PUMP_MAX_DURATION_S)) {
+      return COMMAND_STATUS_INVALID;
+    }
+    cmd->args.pump.on = fields.on;
+    cmd->args.pump.duration_s = fields.on ? fields.duration_s : 0;
+    break;
+  case COMMAND_TYPE_SAMPLING:
+    if (!fields.has_interval ||
+        fields.interval_ms < COMMAND_SAMPLING_MIN_INTERVAL_MS ||
+        fields.interval_ms > COMMAND_SAMPLING_MAX_INTERVAL_MS ||
+        !sensor_from_name(fields.sensor.ptr, fields.sensor.len,
+                          &cmd->args.sampling.sensor)) {
+      return COMMAND_STATUS_INVALID;
+    }
+    cmd->args.sampling.interval_ms = fields.interval_ms;
+    break;
+  case COMMAND_TYPE_CALIBRATE:
+    if (token_equals(fields.point, "dry")) {
+      cmd->args.calibrate.point = CALIBRATION_POINT_DRY;
+    } else if (token_equals(fields.point, "wet")) {
+      cmd->args.calibrate.point = CALIBRATION_POINT_WET;
+    } else {
+      return COMMAND_STATUS_INVALID;
+    }
+    break;
+  case COMMAND_TYPE_TELEMETRY:
+    if (token_equals(fields.mode, "raw")) {
+      cmd->args.telemetry.mode = TELEMETRY_MODE_RAW;
+    } else if (token_equals(fields.mode, "summary") && fields.has_window &&
+               fields.window_s >= COMMAND_TELEMETRY_MIN_WINDOW_S &&
+               fields.window_s <= COMMAND_TELEMETRY_MAX_WINDOW_S) {
+      cmd->args.telemetry.mode = TELEMETRY_MODE_SUMMARY;
+      cmd->args.telemetry.window_s = fields.window_s;
+    } else {
+      return COMMAND_STATUS_INVALID;
+    }
+    break;
+  case COMMAND_TYPE_TRACE:
+    if (token_equals(fields.target, "mqtt")) {
+      cmd->args.trace.target = TRACE_TARGET_MQTT;
+    } else if (token_equals(fields.target, "uart")) {
+      cmd->args.trace.target = TRACE_TARGET_UART;
+    } else {
+      return COMMAND_STATUS_INVALID;
+    }
+    break;
+  case COMMAND_TYPE_RULES:
+    // Room for the NUL when it is stored and read back.
+    if (fields.rules.len == 0 || fields.rules.len >= RULE_SOURCE_MAX_LEN) {
+      return COMMAND_STATUS_INVALID;
+    }
+    cmd->args.rules.offset = (uint16_t)(fields.rules.ptr - payload);
+    cmd->args.rules.len = (uint16_t)fields.rules.len;
+    break;
+  case COMMAND_TYPE_HISTORY: {
+    telemetry_channel_t channel;
+    if (!fields.has_from || !fields.has_to || fields.from_s > fields.to_s ||
+        fields.step_min > COMMAND_HISTORY_MAX_STEP_MIN ||
+        !telemetry_channel_from_name(fields.channel.ptr, fields.channel.len,
+                                     &channel)) {
+      return COMMAND_STATUS_INVALID;
+    }
+    cmd->args.history.from_s = fields.from_s;
+    cmd->args.history.to_s = fields.to_s;
+    cmd->args.history.step_min = (uint16_t)fields.step_min;
+    cmd->args.history.channel = (uint8_t)channel;
+    break;
+  }
+  case COMMAND_TYPE_UNKNOWN:
+    return COMMAND_STATUS_UNSUPPORTED;
+  }
+  return COMMAND_STATUS_OK;
+}
+
+static uint32_t clamp_u32(uint64_t value) {
+  return value > UINT32_MAX ? UINT32_MAX : (uint32_t)value;
+}
+
+command_ack_t command_make_ack(const command_t *cmd, command_status_t status,
+                               int64_t now_us, uint64_t wall_now_us) {
+  command_ack_t ack = {.id = cmd->id, .type = cmd->type, .status = status};
+  if (now_us > cmd->received_us) {
+    ack.device_latency_us = clamp_u32((uint64_t)(now_us - cmd->received_us));
+  }
+  if (cmd->sent_us != 0 && wall_now_us > cmd->sent_us) {
+    ack.e2e_latency_us = clamp_u32(wall_now_us - cmd->sent_us);
+  }
+  return ack;
+}
+
+const char *command_type_name(command_type_t type) {
+  return s_type_names[type];
+}
+
+int command_format_ack(const command_ack_t *ack, char *buf, size_t size) {
+  int len = snprintf(buf, size,
+                     "{\"id\":%" PRIu32 ",\"cmd\":\"%s\",\"status\":\"%s\","
+                     "\"device_us\":%" PRIu32 ",\"e2e_us\":%" PRIu32 "}",
+                     ack->id, command_type_name(ack->type),
+                     s_status_names[ack->status], ack->device_latency_us,
+                     ack->e2e_latency_us);
+  return (len < 0 || (size_t)len >= size) ? -1 : len;
+}
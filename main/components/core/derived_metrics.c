@@ -0,0 +1,111 @@
+#include "derived_metrics.h"
+#include "telemetry.h"
+#include <string.h>
+#include <time.h>
+
+#define TABLE_STEP_CC 100
+#define TABLE_LEN                                                              \
+  ((DERIVED_TEMP_MAX_CC - DERIVED_TEMP_MIN_CC) / TABLE_STEP_CC + 1)
+#define HUMIDITY_MAX_CPCT 10000
+
+// 610.94 * exp(17.625 * t / (t + 243.04)) in Pa, for t = -40..60 °C.
+static const uint16_t s_saturation_pa[TABLE_LEN] = {
+    19,    21,    23,    26,    29,    31,    35,    38,    42,    46,
+    51,    56,    62,    68,    74,    81,    89,    97,    106,   115,
+    126,   137,   149,   162,   176,   192,   208,   226,   245,   265,
+    287,   310,   335,   362,   391,   422,   455,   490,   528,   568,
+    611,   657,   705,   757,   813,   872,   934,   1001,  1071,  1146,
+    1226,  1311,  1400,  1495,  1596,  1702,  1815,  1934,  2060,  2193,
+    2333,  2482,  2639,  2804,  2978,  3162,  3355,  3559,  3774,  3999,
+    4237,  4486,  4749,  5024,  5314,  5618,  5936,  6271,  6622,  6989,
+    7375,  7778,  8201,  8643,  9106,  9590,  10097, 10626, 11179, 11757,
+    12361, 12991, 13648, 14334, 15050, 15796, 16574, 17384, 18228, 19108,
+    20023,
+};
+
+static int32_t clamp(int32_t value, int32_t min, int32_t max) {
+  return value < min ? min : value > max ? max : value;
+}
+
+int32_t derived_saturation_pa(int32_t temp_cc) {
+  int32_t offset =
+      clamp(temp_cc, DERIVED_TEMP_MIN_CC, DERIVED_TEMP_MAX_CC) -
+      DERIVED_TEMP_MIN_CC;
+  int32_t i = offset / TABLE_STEP_CC;
+  int32_t frac = offset % TABLE_STEP_CC;
+  if (frac == 0) {
+    return s_saturation_pa[i];
+  }
+  int32_t lo = s_saturation_pa[i];
+  return lo + ((s_saturation_pa[i + 1] - lo) * frac + TABLE_STEP_CC / 2) /
+                  TABLE_STEP_CC;
+}
+
+// Table index whose entry is the last one below the vapour pressure (in
+// 0.01 Pa), searching up to the air temperature's entry.
+static int32_t dew_point_index(int32_t vapour_cpa, int32_t hi) {
+  int32_t lo = 0;
+  while (hi - lo > 1) {
+    int32_t mid = (lo + hi) / 2;
+    if (s_saturation_pa[mid] * 100 < vapour_cpa) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+void derived_climate(int32_t temp_cc, int32_t humidity_cpct,
+                     derived_climate_t *out) {
+  int32_t saturation = derived_saturation_pa(temp_cc);
+  // In 0.01 Pa, so dry and cold air keeps its resolution for the dew point.
+  int32_t vapour = saturation * clamp(humidity_cpct, 0, HUMIDITY_MAX_CPCT) /
+                   100;
+  out->vpd_pa = saturation - (vapour + 50) / 100;
+
+  if (vapour <= s_saturation_pa[0] * 100) {
+    out->dew_point_cc = DERIVED_TEMP_MIN_CC;
+    return;
+  }
+  // The dew point is at most the air temperature.
+  int32_t top = (clamp(temp_cc, DERIVED_TEMP_MIN_CC, DERIVED_TEMP_MAX_CC) -
+                 DERIVED_TEMP_MIN_CC) / TABLE_STEP_CC + 1;
+  int32_t i = dew_point_index(vapour, top < TABLE_LEN ? top : TABLE_LEN - 1);
+  int32_t below = s_saturation_pa[i] * 100;
+  int32_t span = s_saturation_pa[i + 1] * 100 - below;
+  int32_t dew_cc = DERIVED_TEMP_MIN_CC + i * TABLE_STEP_CC +
+                   ((vapour - below) * TABLE_STEP_CC + span / 2) / span;
+  out->dew_point_cc = clamp(dew_cc, DERIVED_TEMP_MIN_CC, DERIVED_TEMP_MAX_CC);
+}
+
+void dli_init(dli_t *dli, uint16_t lux_per_ppfd, uint32_t max_gap_ms) {
+  memset(dli, 0, sizeof(*dli));
+  dli->lux_per_ppfd = lux_per_ppfd;
+  dli->max_gap_ms = max_gap_ms;
+}
+
+int32_t dli_local_day(uint64_t timestamp_us) {
+  if (timestamp_us < TELEMETRY_MIN_VALID_TIMESTAMP_US) {
+    return 0;
+  }
+  time_t t = (time_t)(timestamp_us / 1000000);
+  struct tm local;
+  localtime_r(&t, &local);
+  return local.tm_year * 1000 + local.tm_yday;
+}
+
+float dli_add(dli_t *dli, uint64_t time_us, int32_t day, uint32_t lux) {
+  if (day != dli->day) {
+    dli->day = day;
+    dli->lux_ms = 0;
+  } else if (dli->last_us != 0 && time_us > dli->last_us &&
+             time_us - dli->last_us <= (uint64_t)dli->max_gap_ms * 1000) {
+    uint64_t dt_ms = (time_us - dli->last_us) / 1000;
+    dli->lux_ms += ((uint64_t)dli->last_lux + lux) * dt_ms / 2;
+  }
+  dli->last_us = time_us;
+  dli->last_lux = lux;
+  // lux * ms / (lux per µmol/m²/s) is nmol/m².
+  return (float)(dli->lux_ms / dli->lux_per_ppfd) / 1e9f;
+}
@@ -0,0 +1,72 @@
+#include "diag.h"
+#include <inttypes.h>
+#include <stdio.h>
+
+float diag_cpu_pct(uint32_t task_delta, uint32_t total_delta) {
+  if (total_delta == 0) {
+    return 0.0f;
+  }
+  return 100.0f * (float)task_delta / (float)total_delta;
+}
+
+uint32_t diag_heap_fragmentation_pct(const diag_heap_t *heap) {
+  if (heap->free_bytes == 0) {
+    return 0;
+  }
+  return 100 - (uint32_t)((uint64_t)heap->largest_block * 100 /
+                          heap->free_bytes);
+}
+
+static int check_fit(int len, size_t size) {
+  return (len < 0 || (size_t)len >= size) ? -1 : len;
+}
+
+// Task names may contain spaces ("Tmr Svc"), which end a tag value in line
+// protocol unless escaped.
+static void escape_tag(char *dst, size_t size, const char *src) {
+  size_t n = 0;
+  for (; *src != '\0' && n + 2 < size; src++) {
+    if (*src == ' ' || *src == ',' || *src == '=') {
+      dst[n++] = '\\';
+    }
+    dst[n++] = *src;
+  }
+  dst[n] = '\0';
+}
+
+int diag_format_task_line_protocol(const diag_task_t *task, const char *tags,
+                                   uint64_t timestamp_us, char *buf,
+                                   size_t size) {
+  char name[DIAG_TASK_NAME_LEN * 2];
+  escape_tag(name, sizeof(name), task->name);
+  int len = snprintf(buf, size,
+                     "diag_task,%s,task=%s cpu_pct=%.2f,stack_free=%" PRIu32
+                     "i %" PRIu64 "000",
+                     tags, name, task->cpu_pct, task->stack_free,
+                     timestamp_us);
+  return check_fit(len, size);
+}
+
+int diag_format_heap_line_protocol(const diag_heap_t *heap, const char *tags,
+                                   uint64_t timestamp_us, char *buf,
+                                   size_t size) {
+  int len = snprintf(buf, size,
+                     "diag_heap,%s free=%" PRIu32 "i,largest_block=%" PRIu32
+                     "i,min_free=%" PRIu32 "i,frag_pct=%" PRIu32
+                     "i %" PRIu64 "000",
+                     tags, heap->free_bytes, heap->largest_block,
+                     heap->min_free_bytes, diag_heap_fragmentation_pct(heap),
+                     timestamp_us);
+  return check_fit(len, size);
+}
+
+int diag_format_alert_json(const char *alarm, const char *subject,
+                           uint32_t value, uint32_t threshold, bool active,
+                           char *buf, size_t size) {
+  int len = snprintf(buf, size,
+                     "{\"alarm\":\"%s\",\"subject\":\"%s\",\"value\":%" PRIu32
+                     ",\"threshold\":%" PRIu32 ",\"active\":%s}",
+                     alarm, subject, value, threshold,
+                     active ? "true" : "false");
+  return check_fit(len, size);
+}
@@ -0,0 +1,105 @@
+#include "duty_cycle.h"
+#include <string.h>
+
+void duty_cycle_init(duty_cycle_t *duty, const duty_cycle_config_t *config,
+                     int64_t now_us) {
+  memset(duty, 0, sizeof(*duty));
+  duty->config = *config;
+  duty->next_sample_us = now_us;
+  // Upload right away so a fresh device shows up and gets its clock set.
+  duty->next_upload_us = now_us;
+}
+
+unsigned duty_cycle_wake(duty_cycle_t *duty, const duty_buffer_t *buffer,
+                         int64_t now_us) {
+  unsigned actions = DUTY_ACTION_NONE;
+  duty->stats.wakes++;
+
+  if (now_us >= duty->next_sample_us) {
+    actions |= DUTY_ACTION_SAMPLE;
+  }
+  if (now_us >= duty->next_upload_us ||
+      buffer->count + TELEMETRY_CHANNEL_COUNT > DUTY_BUFFER_CAPACITY) {
+    actions |= DUTY_ACTION_UPLOAD;
+  }
+  return actions;
+}
+
+void duty_cycle_store(duty_cycle_t *duty, duty_buffer_t *buffer,
+                      const telemetry_point_t *point) {
+  if (duty_buffer_push(buffer, point)) {
+    duty->stats.samples++;
+  } else {
+    duty->stats.dropped++;
+  }
+}
+
+void duty_cycle_sampled(duty_cycle_t *duty, int64_t now_us) {
+  int64_t interval_us = (int64_t)duty->config.sample_interval_ms * 1000;
+  duty->next_sample_us += interval_us;
+  if (duty->next_sample_us <= now_us) {
+    duty->next_sample_us = now_us + interval_us;
+  }
+}
+
+void duty_cycle_uploaded(duty_cycle_t *duty, duty_buffer_t *buffer, bool ok,
+                         int64_t radio_on_us, int64_t now_us) {
+  duty->stats.radio_on_us += radio_on_us;
+  duty->stats.last_radio_on_ms = (uint32_t)(radio_on_us / 1000);
+  if (ok) {
+    duty->stats.uploads++;
+    duty_buffer_reset(buffer);
+  } else {
+    duty->stats.upload_failures++;
+  }
+  duty->next_upload_us =
+      now_us + (int64_t)duty->config.upload_interval_ms * 1000;
+}
+
+int64_t duty_cycle_sleep_us(const duty_cycle_t *duty, int64_t now_us) {
+  int64_t next = duty->next_sample_us < duty->next_upload_us
+                     ? duty->next_sample_us
+                     : duty->next_upload_us;
+  return next > now_us ? next - now_us : 0;
+}
+
+void duty_cycle_shift(duty_cycle_t *duty, duty_buffer_t *buffer,
+                      int64_t delta_us) {
+  duty->next_sample_us += delta_us;
+  duty->next_upload_us += delta_us;
+  buffer->base_us += delta_us;
+}
+
+void duty_buffer_reset(duty_buffer_t *buffer) {
+  buffer->base_us = 0;
+  buffer->count = 0;
+}
+
+bool duty_buffer_push(duty_buffer_t *buffer, const telemetry_point_t *point) {
+  if (buffer->count >= DUTY_BUFFER_CAPACITY) {
+    return false;
+  }
+  if (buffer->count == 0) {
+    buffer->base_us = (int64_t)point->timestamp_us;
+  }
+
+  int64_t offset_s = ((int64_t)point->timestamp_us - buffer->base_us) / 1000000;
+  if (offset_s < 0 || offset_s > UINT16_MAX) {
+    return false;
+  }
+
+  duty_record_t *rec = &buffer->records[buffer->count++];
+  rec->offset_s = (uint16_t)offset_s;
+  rec->channel = (uint8_t)point->channel;
+  rec->value = point->value;
+  return true;
+}
+
+void duty_buffer_get(const duty_buffer_t *buffer, size_t index,
+                     telemetry_point_t *point) {
+  const duty_record_t *rec = &buffer->records[index];
+  point->timestamp_us =
+      (uint64_t)(buffer->base_us + (int64_t)rec->offset_s * 1000000);
+  point->channel = (telemetry_channel_t)rec->channel;
+  point->value = rec->value;
+}
@@ -0,0 +1,147 @@
+#include "history.h"
+#include <string.h>
+
+static const struct {
+  uint32_t step_s;
+  uint32_t points;
+} s_tiers[HISTORY_TIER_COUNT] = {
+#define HISTORY_TIER_(id, step, count) [HISTORY_TIER_##id] = {(step), (count)},
+    HISTORY_TIERS(HISTORY_TIER_)
+#undef HISTORY_TIER_
+};
+
+_Static_assert(sizeof(history_t) <= HISTORY_MAX_BYTES,
+               "history tiers exceed HISTORY_MAX_BYTES");
+
+void history_init(history_t *history) {
+  memset(history, 0, sizeof(*history));
+  for (int c = 0; c < TELEMETRY_CHANNEL_COUNT; c++) {
+    history->resolution[c] = telemetry_channel_resolution(c);
+    int16_t *values = history->values[c];
+    for (int i = 0; i < HISTORY_CHANNEL_POINTS; i++) {
+      values[i] = HISTORY_NO_VALUE;
+    }
+    for (int t = 0; t < HISTORY_TIER_COUNT; t++) {
+      history_ring_t *ring = &history->rings[c][t];
+      ring->values = values;
+      ring->times_s = s_tiers[t].step_s == 0 ? history->times_s[c] : NULL;
+      ring->step_s = s_tiers[t].step_s;
+      ring->capacity = s_tiers[t].points;
+      values += s_tiers[t].points;
+    }
+  }
+}
+
+// A reader that saw any slot written after the fence also sees `reserved`,
+// see history_view_first_valid.
+static void reserve(history_ring_t *ring, uint32_t end) {
+  __atomic_store_n(&ring->reserved, end, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void publish(history_ring_t *ring, uint32_t end) {
+  __atomic_store_n(&ring->seq, end, __ATOMIC_RELEASE);
+}
+
+static int16_t quantize(float units) {
+  if (units >= INT16_MAX) {
+    return INT16_MAX;
+  }
+  // INT16_MIN is HISTORY_NO_VALUE.
+  if (units <= INT16_MIN + 1) {
+    return INT16_MIN + 1;
+  }
+  return (int16_t)(units + (units < 0 ? -0.5f : 0.5f));
+}
+
+// Writes entry n of a stepped ring, after blanks for the steps without
+// samples since the newest entry. A gap longer than the ring only blanks
+// the ring once.
+static void put_step(history_ring_t *ring, uint32_t n, int16_t value) {
+  uint32_t blank = n - ring->seq;
+  if (blank > ring->capacity) {
+    blank = ring->capacity;
+  }
+  reserve(ring, n + 1);
+  for (uint32_t i = n - blank; i < n; i++) {
+    ring->values[i % ring->capacity] = HISTORY_NO_VALUE;
+  }
+  ring->values[n % ring->capacity] = value;
+  publish(ring, n + 1);
+}
+
+// Adds `count` samples summing to `sum` at time_s to the stepped tier and
+// cascades every step it closes into the next one.
+static void add_to_tier(history_t *history, telemetry_channel_t channel,
+                        int tier, uint32_t time_s, float sum,
+                        uint32_t count) {
+  history_ring_t *ring = &history->rings[channel][tier];
+  uint32_t n = time_s / ring->step_s;
+  if (ring->open && n == ring->open_n) {
+    ring->open_sum += sum;
+    ring->open_count += count;
+    return;
+  }
+  if ((ring->open && n < ring->open_n) || n < ring->seq) {
+    history->stats.dropped++;
+    return;
+  }
+
+  if (ring->open) {
+    put_step(ring, ring->open_n,
+             quantize(ring->open_sum / (float)ring->open_count));
+    if (tier + 1 < HISTORY_TIER_COUNT) {
+      add_to_tier(history, channel, tier + 1, ring->open_n * ring->step_s,
+                  ring->open_sum, ring->open_count);
+    }
+  }
+  ring->open = true;
+  ring->open_n = n;
+  ring->open_sum = sum;
+  ring->open_count = count;
+}
+
+void history_append(history_t *history, telemetry_channel_t channel,
+                    uint32_t time_s, float value) {
+  if (channel < 0 || channel >= TELEMETRY_CHANNEL_COUNT) {
+    return;
+  }
+  int16_t units = quantize(value / history->resolution[channel]);
+  history_ring_t *raw = &history->rings[channel][HISTORY_TIER_RAW];
+  uint32_t n = raw->seq;
+  reserve(raw, n + 1);
+  raw->values[n % raw->capacity] = units;
+  raw->times_s[n % raw->capacity] = time_s;
+  publish(raw, n + 1);
+  history->stats.appended++;
+
+  if (HISTORY_TIER_COUNT > 1) {
+    add_to_tier(history, channel, HISTORY_TIER_RAW + 1, time_s, units, 1);
+  }
+}
+
+void history_view(const history_t *history, telemetry_channel_t channel,
+                  history_tier_t tier, history_view_t *view) {
+  const history_ring_t *ring = &history->rings[channel][tier];
+  uint32_t end = __atomic_load_n(&ring->seq, __ATOMIC_ACQUIRE);
+  *view = (history_view_t){
+      .ring = ring,
+      .resolution = history->resolution[channel],
+      .first = end > ring->capacity ? end - ring->capacity : 0,
+      .end = end,
+  };
+}
+
+uint32_t history_view_first_valid(const history_view_t *view) {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  uint32_t reserved = __atomic_load_n(&view->ring->reserved, __ATOMIC_RELAXED);
+  // Writing entry n may overwrite entry n - capacity.
+  if (reserved <= view->ring->capacity) {
+    return view->first;
+  }
+  uint32_t intact = reserved - view->ring->capacity;
+  if (intact >= view->end) {
+    return view->end;
+  }
+  return intact > view->first ? intact : view->first;
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include "growgrid_types.h"
+#include "rule_engine.h"
+#include "telemetry_window.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define COMMAND_PUMP_MAX_DURATION_S 600
+#define COMMAND_SAMPLING_MIN_INTERVAL_MS 1000
+#define COMMAND_SAMPLING_MAX_INTERVAL_MS 3600000
+#define COMMAND_TELEMETRY_MIN_WINDOW_S 10
+#define COMMAND_TELEMETRY_MAX_WINDOW_S 3600
+// A day, the longest step a history reply is downsampled to.
+#define COMMAND_HISTORY_MAX_STEP_MIN 1440
+
+typedef enum {
+  COMMAND_TYPE_PUMP,
+  COMMAND_TYPE_SAMPLING,
+  COMMAND_TYPE_CALIBRATE,
+  COMMAND_TYPE_TELEMETRY,
+  COMMAND_TYPE_TRACE,
+  COMMAND_TYPE_RULES,
+  COMMAND_TYPE_HISTORY,
+  COMMAND_TYPE_UNKNOWN,
+} command_type_t;
+
+typedef enum {
+  COMMAND_STATUS_OK,
+  COMMAND_STATUS_INVALID,     // Malformed payload or value out of range
+  COMMAND_STATUS_UNSUPPORTED, // Unknown command name
+  COMMAND_STATUS_FAILED,      // Valid, but executing it failed
+} command_status_t;
+
+typedef enum {
+  CALIBRATION_POINT_DRY,
+  CALIBRATION_POINT_WET,
+} calibration_point_t;
+
+typedef enum {
+  TRACE_TARGET_MQTT,
+  TRACE_TARGET_UART,
+} trace_target_t;
+
+typedef struct {
+  bool on;
+  uint32_t duration_s; // Only used when on, pump is switched off afterwards
+} pump_command_t;
+
+typedef struct {
+  sensor_data_type_t sensor;
+  uint32_t interval_ms;
+} sampling_command_t;
+
+typedef struct {
+  calibration_point_t point;
+} calibrate_command_t;
+
+typedef struct {
+  telemetry_mode_t mode;
+  uint32_t window_s; // Only used in summary mode
+} telemetry_command_t;
+
+typedef struct {
+  trace_target_t target;
+} trace_command_t;
+
+// The rule source stays in the payload, it has to be consumed before the
+// receive buffer is reused.
+typedef struct {
+  uint16_t offset; // Into the payload
+  uint16_t len;
+} rules_command_t;
+
+typedef struct {
+  uint32_t from_s; // Unix seconds
+  uint32_t to_s;
+  uint16_t step_min; // 0 returns the stored points
+  uint8_t channel;   // telemetry_channel_t, narrow to keep command_t small
+} history_command_t;
+
+typedef struct {
+  uint32_t id;          // Chosen by the sender, echoed in the ack
+  uint64_t sent_us;     // Sender wall clock in unix µs, 0 if not given
+  int64_t received_us;  // Device monotonic time when the command arrived
+  command_type_t type;
+  union {
+    pump_command_t pump;
+    sampling_command_t sampling;
+    calibrate_command_t calibrate;
+    telemetry_command_t telemetry;
+    trace_command_t trace;
+    rules_command_t rules;
+    history_command_t history;
+  } args;
+} command_t;
+
+typedef struct {
+  uint32_t id;
+  command_type_t type;
+  command_status_t status;
+  uint32_t device_latency_us; // Receive to execution on the device
+  uint32_t e2e_latency_us;    // Sender timestamp to execution, 0 if unknown
+} command_ack_t;
+
+/**
+ * @brief Parses a command straight out of the MQTT receive buffer.
+ *
+ * Neither buffer needs to be NUL-terminated and nothing is copied or
+ * allocated. The payload is a flat JSON object, for example
+ * `{"id":7,"ts":1700000000000000,"on":true,"duration_s":30}` for `pump`,
+ * `{"id":8,"sensor":"soil_moisture","interval_ms":10000}` for `sampling` and
+ * `{"id":9,"point":"dry"}` for `calibrate`,
+ * `{"id":10,"mode":"summary","window_s":60}` for `telemetry`,
+ * `{"id":11,"target":"mqtt"}` for `trace`,
+ * `{"id":12,"rules":"on if soil_moisture < 30 reset 35;pump min_off_s=600"}`
+ * for `rules` and
+ * `{"id":13,"channel":"temperature","from":1700000000,"to":1700086400,
+ * "step_min":60}` for `history`. Values are range-checked, rules are only
+ * checked for length.
+ *
+ * @param name Command name (the last topic level).
+ * @param payload The payload bytes.
+ * @param[out] cmd Parsed command. `id` is filled in as far as it could be
+ *             read, even on failure, so a negative ack can be sent.
+ * @return COMMAND_STATUS_OK on success.
+ */
+command_status_t command_parse(const char *name, size_t name_len,
+                               const char *payload, size_t payload_len,
+                               command_t *cmd);
+
+/**
+ * @brief Builds the ack for an executed (or rejected) command.
+ *
+ * @param now_us Device monotonic time at execution.
+ * @param wall_now_us Device wall clock in unix µs. The end-to-end latency is
+ *        only reported when the sender set `ts` and the clocks agree on the
+ *        order of events (i.e. SNTP has synced).
+ */
+command_ack_t command_make_ack(const command_t *cmd, command_status_t status,
+                               int64_t now_us, uint64_t wall_now_us);
+
+/**
+ * @brief Returns the command name for a type, as used in topics and acks.
+ */
+const char *command_type_name(command_type_t type);
+
+/**
+ * @brief Serializes an ack as a JSON object.
+ *
+ * @return The payload length, or -1 if it did not fit into the buffer.
+ */
+int command_format_ack(const command_ack_t *ack, char *buf, size_t size);
@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * Grower metrics derived from the raw sensor values on the device.
+ *
+ * Vapour pressure deficit and dew point follow the Magnus formula
+ * (Alduchov & Eskridge coefficients), read from a table of the saturation
+ * vapour pressure per °C and interpolated linearly in integer arithmetic.
+ * The C6 has no FPU. Dew point inverts the same table with a binary search,
+ * so no logarithm is needed either. Over -40..60 °C the deficit is within
+ * 6 Pa of the formula (3.2 Pa up to 40 °C), the dew point within 0.1 °C
+ * above -20 °C.
+ *
+ * The daily light integral converts illuminance to photosynthetic photon
+ * flux with a fixed lux per µmol/m²/s factor and integrates it over the
+ * local day with the trapezoidal rule.
+ */
+
+// Table range, inputs outside are clamped.
+#define DERIVED_TEMP_MIN_CC (-4000)
+#define DERIVED_TEMP_MAX_CC 6000
+
+/**
+ * @brief Returns the saturation vapour pressure in Pa.
+ *
+ * @param temp_cc Temperature in 0.01 °C.
+ */
+int32_t derived_saturation_pa(int32_t temp_cc);
+
+typedef struct {
+  int32_t vpd_pa;       // Vapour pressure deficit in Pa
+  int32_t dew_point_cc; // In 0.01 °C, at least DERIVED_TEMP_MIN_CC
+} derived_climate_t;
+
+/**
+ * @brief Derives the climate metrics of a temperature/humidity sample.
+ *
+ * @param temp_cc Air temperature in 0.01 °C.
+ * @param humidity_cpct Relative humidity in 0.01 %, clamped to 0..100 %.
+ */
+void derived_climate(int32_t temp_cc, int32_t humidity_cpct,
+                     derived_climate_t *out);
+
+typedef struct {
+  uint16_t lux_per_ppfd; // Lux per µmol/m²/s, about 54 for sunlight
+  uint32_t max_gap_ms;   // Longer gaps between samples are not integrated
+  int32_t day;           // Local day being integrated, see dli_add
+  uint64_t last_us;
+  uint32_t last_lux;
+  uint64_t lux_ms; // Integral of the illuminance over the day
+} dli_t;
+
+/**
+ * @brief Starts a new integral.
+ */
+void dli_init(dli_t *dli, uint16_t lux_per_ppfd, uint32_t max_gap_ms);
+
+/**
+ * @brief Returns a day number for dli_add that changes at local midnight,
+ * 0 for timestamps before the clock was set.
+ */
+int32_t dli_local_day(uint64_t timestamp_us);
+
+/**
+ * @brief Adds a light sample and returns the integral of the day so far.
+ *
+ * @param time_us Sample time. Going backwards or jumping by more than the
+ *        maximum gap (e.g. on clock sync) only restarts the interpolation.
+ * @param day Any number that changes at local midnight, the integral
+ *        restarts when it does. See dli_local_day.
+ * @param lux Illuminance of the sample.
+ * @return Daily light integral in mol/m²/day.
+ */
+float dli_add(dli_t *dli, uint64_t time_us, int32_t day, uint32_t lux);
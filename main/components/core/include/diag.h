@@ -0,0 +1,70 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DIAG_TASK_NAME_LEN 16
+// Longest line of a task or heap sample without the device tags.
+#define DIAG_LINE_MAX 120
+
+typedef struct {
+  char name[DIAG_TASK_NAME_LEN];
+  float cpu_pct;        // Share of CPU time over the last interval
+  uint32_t stack_free;  // Lowest free stack since the task started, bytes
+} diag_task_t;
+
+typedef struct {
+  uint32_t free_bytes;
+  uint32_t largest_block;
+  uint32_t min_free_bytes; // Lowest free heap since boot
+} diag_heap_t;
+
+/**
+ * @brief Returns the share of a task's run time in the interval, in percent.
+ *
+ * Both deltas are taken with unsigned subtraction, so one wrap of the 32-bit
+ * run-time counter within the interval is handled.
+ */
+float diag_cpu_pct(uint32_t task_delta, uint32_t total_delta);
+
+/**
+ * @brief Returns how much of the free heap is not usable as one block.
+ *
+ * 0 means all free memory is contiguous, values near 100 mean large
+ * allocations fail even though plenty is free.
+ */
+uint32_t diag_heap_fragmentation_pct(const diag_heap_t *heap);
+
+/**
+ * @brief Serializes a task sample as one InfluxDB line protocol line:
+ * `diag_task,<tags>,task=<name> cpu_pct=..,stack_free=..i <timestamp_ns>`.
+ *
+ * @param tags Pre-escaped device tag set, the task name is escaped here.
+ * @return The line length, or -1 if it did not fit into the buffer.
+ */
+int diag_format_task_line_protocol(const diag_task_t *task, const char *tags,
+                                   uint64_t timestamp_us, char *buf,
+                                   size_t size);
+
+/**
+ * @brief Serializes a heap sample as one InfluxDB line protocol line:
+ * `diag_heap,<tags> free=..i,largest_block=..i,min_free=..i,frag_pct=..i`.
+ *
+ * @return The line length, or -1 if it did not fit into the buffer.
+ */
+int diag_format_heap_line_protocol(const diag_heap_t *heap, const char *tags,
+                                   uint64_t timestamp_us, char *buf,
+                                   size_t size);
+
+/**
+ * @brief Serializes a threshold alert as
+ * `{"alarm","subject","value","threshold","active"}`.
+ *
+ * @param alarm Alert name such as "stack_low".
+ * @param subject What the alert is about, e.g. the task name or "heap".
+ * @param active false when the condition cleared again.
+ * @return The payload length, or -1 if it did not fit into the buffer.
+ */
+int diag_format_alert_json(const char *alarm, const char *subject,
+                           uint32_t value, uint32_t threshold, bool active,
+                           char *buf, size_t size);
@@ -0,0 +1,129 @@
+#pragma once
+#include "telemetry.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Scheduling and buffering of the duty-cycled low-power mode.
+ *
+ * The device wakes on a timer, samples into a compact buffer that survives
+ * sleep, and only raises the radio every upload interval (or when the buffer
+ * runs full) to send everything in one burst. Nothing here touches hardware
+ * or reads a clock: every call takes the current time, so the logic runs the
+ * same on the device and on the linux target with a simulated clock.
+ */
+
+#ifndef DUTY_BUFFER_CAPACITY
+#define DUTY_BUFFER_CAPACITY 256
+#endif
+
+typedef enum {
+  DUTY_ACTION_NONE = 0,
+  DUTY_ACTION_SAMPLE = 1 << 0,
+  DUTY_ACTION_UPLOAD = 1 << 1,
+} duty_action_t;
+
+typedef struct {
+  uint32_t sample_interval_ms;
+  uint32_t upload_interval_ms;
+} duty_cycle_config_t;
+
+typedef struct {
+  uint32_t wakes;           // Timer wakeups, including the cold boot
+  uint32_t samples;         // Points stored in the buffer
+  uint32_t dropped;         // Points lost to a full buffer
+  uint32_t uploads;         // Bursts the broker acknowledged
+  uint32_t upload_failures; // Bursts that timed out, buffer kept
+  uint64_t radio_on_us;     // Wi-Fi up time summed over all bursts
+  uint32_t last_radio_on_ms;
+} duty_cycle_stats_t;
+
+typedef struct {
+  duty_cycle_config_t config;
+  int64_t next_sample_us;
+  int64_t next_upload_us;
+  duty_cycle_stats_t stats;
+} duty_cycle_t;
+
+// 8 bytes per point instead of the 16 of telemetry_point_t: timestamps are
+// stored as seconds after the buffer's base time.
+typedef struct {
+  uint16_t offset_s;
+  uint8_t channel;
+  float value;
+} duty_record_t;
+
+typedef struct {
+  int64_t base_us;
+  uint16_t count;
+  duty_record_t records[DUTY_BUFFER_CAPACITY];
+} duty_buffer_t;
+
+/**
+ * @brief Starts a fresh schedule. The first wake samples and uploads.
+ */
+void duty_cycle_init(duty_cycle_t *duty, const duty_cycle_config_t *config,
+                     int64_t now_us);
+
+/**
+ * @brief Counts a wakeup and returns what is due.
+ *
+ * An upload is also due ahead of schedule once the buffer cannot take
+ * another full round of samples.
+ *
+ * @return A mask of duty_action_t.
+ */
+unsigned duty_cycle_wake(duty_cycle_t *duty, const duty_buffer_t *buffer,
+                         int64_t now_us);
+
+/**
+ * @brief Stores a point, counting it as sampled or dropped.
+ */
+void duty_cycle_store(duty_cycle_t *duty, duty_buffer_t *buffer,
+                      const telemetry_point_t *point);
+
+/**
+ * @brief Schedules the next sample. Missed samples are skipped, not caught up.
+ */
+void duty_cycle_sampled(duty_cycle_t *duty, int64_t now_us);
+
+/**
+ * @brief Accounts a burst and schedules the next one.
+ *
+ * The buffer is only cleared when the broker acknowledged everything, a
+ * failed burst is retried with the next one.
+ */
+void duty_cycle_uploaded(duty_cycle_t *duty, duty_buffer_t *buffer, bool ok,
+                         int64_t radio_on_us, int64_t now_us);
+
+/**
+ * @brief Returns how long to sleep until the next action, 0 if one is due.
+ */
+int64_t duty_cycle_sleep_us(const duty_cycle_t *duty, int64_t now_us);
+
+/**
+ * @brief Moves the schedule and the buffered timestamps by a clock step,
+ * e.g. the first SNTP sync after a cold boot.
+ */
+void duty_cycle_shift(duty_cycle_t *duty, duty_buffer_t *buffer,
+                      int64_t delta_us);
+
+/**
+ * @brief Resets the buffer.
+ */
+void duty_buffer_reset(duty_buffer_t *buffer);
+
+/**
+ * @brief Appends a point.
+ *
+ * @return false if the buffer is full or the point is more than 18 hours
+ *         after the first one.
+ */
+bool duty_buffer_push(duty_buffer_t *buffer, const telemetry_point_t *point);
+
+/**
+ * @brief Expands the record at index back into a point.
+ */
+void duty_buffer_get(const duty_buffer_t *buffer, size_t index,
+                     telemetry_point_t *point);
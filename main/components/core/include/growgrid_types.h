@@ -1,10 +1,13 @@
 #pragma once
+#include "sensor_registry.h"
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef enum {
-  SENSOR_DATA_TYPE_TEMP_HUMIDITY,
-  SENSOR_DATA_TYPE_LIGHT,
-  SENSOR_DATA_TYPE_SOIL_MOISTURE,
+#define SENSOR_TYPE_ID_(ID, ...) SENSOR_DATA_TYPE_##ID,
+  SENSOR_REGISTRY(SENSOR_TYPE_ID_)
+#undef SENSOR_TYPE_ID_
 } sensor_data_type_t;
 
 typedef struct {
@@ -14,6 +17,7 @@ typedef struct {
 
 typedef struct {
   uint32_t lux;
+  float dli; // Daily light integral so far, filled in by the sensor task
 } light_data_t;
 
 typedef struct {
@@ -21,9 +25,9 @@ typedef struct {
 } soil_moisture_data_t;
 
 typedef union {
-  temp_humidity_data_t temp_humidity;
-  light_data_t light;
-  soil_moisture_data_t soil_moisture;
+#define SENSOR_PAYLOAD_(ID, name, type, ...) type name;
+  SENSOR_REGISTRY(SENSOR_PAYLOAD_)
+#undef SENSOR_PAYLOAD_
 } sensor_data_payload_t;
 
 typedef struct {
@@ -31,3 +35,17 @@ typedef struct {
   sensor_data_type_t type;
   sensor_data_payload_t payload;
 } sensor_data_t;
+
+/**
+ * @brief Returns the name of a sensor, "unknown" if out of range.
+ */
+const char *sensor_name(sensor_data_type_t sensor);
+
+/**
+ * @brief Looks up a sensor by name.
+ *
+ * @param name Not necessarily terminated.
+ * @return true if a sensor has that name.
+ */
+bool sensor_from_name(const char *name, size_t len,
+                      sensor_data_type_t *sensor);
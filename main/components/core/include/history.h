@@ -0,0 +1,151 @@
+#pragma once
+#include "telemetry.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Recent telemetry in RAM at several resolutions, for consumers on the
+ * device.
+ *
+ * Every channel has one ring per tier. The raw tier keeps the latest
+ * samples with their times. Each further tier keeps fixed steps of the
+ * unix time line, entry n covering n * step_s up to the next, filled with
+ * the means of the tier below: a step is closed and cascades up when the
+ * first point of a later one arrives, so the newest step of a tier is not
+ * visible before that. An append writes one entry per tier a step closes
+ * in. Steps without samples hold HISTORY_NO_VALUE, samples older than the
+ * open step of a tier are dropped there.
+ *
+ * Values are stored as int16_t in units of the channel's resolution, see
+ * telemetry_channel_resolution. A tier takes points * 2 bytes per channel,
+ * the raw tier another 4 per point for the time. The whole store must fit
+ * HISTORY_MAX_BYTES, which is checked at compile time.
+ *
+ * One task appends, any number of tasks read without a lock and without
+ * copying. The number of an entry never changes while it moves through its
+ * ring. A reader takes a history_view_t, reads entries in place, then asks
+ * history_view_first_valid which of them the writer may have overwritten
+ * meanwhile and discards those. Readers never wait for the writer.
+ *
+ * Times are unix seconds as stamped on the samples.
+ */
+
+// Points per channel of each tier, the spans are at a 5 s sample interval.
+#ifndef HISTORY_RAW_POINTS
+#define HISTORY_RAW_POINTS 120 // 10 minutes
+#endif
+#ifndef HISTORY_MINUTE_POINTS
+#define HISTORY_MINUTE_POINTS 1440 // 24 hours
+#endif
+#ifndef HISTORY_QUARTER_POINTS
+#define HISTORY_QUARTER_POINTS 672 // 7 days
+#endif
+#ifndef HISTORY_MAX_BYTES
+#define HISTORY_MAX_BYTES (40 * 1024)
+#endif
+
+// X(id, step_s, points), from fine to coarse. The first tier is raw.
+#define HISTORY_TIERS(X)                                                       \
+  X(RAW, 0, HISTORY_RAW_POINTS)                                                \
+  X(MINUTE, 60, HISTORY_MINUTE_POINTS)                                         \
+  X(QUARTER, 900, HISTORY_QUARTER_POINTS)
+
+#define HISTORY_NO_VALUE INT16_MIN
+
+typedef enum {
+#define HISTORY_TIER_ID_(id, step_s, points) HISTORY_TIER_##id,
+  HISTORY_TIERS(HISTORY_TIER_ID_)
+#undef HISTORY_TIER_ID_
+  HISTORY_TIER_COUNT,
+} history_tier_t;
+
+#define HISTORY_POINTS_(id, step_s, points) +(points)
+#define HISTORY_CHANNEL_POINTS (0 HISTORY_TIERS(HISTORY_POINTS_))
+
+typedef struct {
+  int16_t *values;   // Entry n is at n % capacity
+  uint32_t *times_s; // Raw tier only, NULL in stepped tiers
+  uint32_t step_s;
+  uint32_t capacity;
+  uint32_t seq;      // One past the newest entry
+  uint32_t reserved; // One past the newest entry being written
+  // The open step, stepped tiers only. Sums are in resolution units.
+  bool open;
+  uint32_t open_n;
+  uint32_t open_count;
+  float open_sum;
+} history_ring_t;
+
+typedef struct {
+  uint32_t appended;
+  uint32_t dropped; // Per tier, samples older than its open step
+} history_stats_t;
+
+typedef struct {
+  history_ring_t rings[TELEMETRY_CHANNEL_COUNT][HISTORY_TIER_COUNT];
+  int16_t values[TELEMETRY_CHANNEL_COUNT][HISTORY_CHANNEL_POINTS];
+  uint32_t times_s[TELEMETRY_CHANNEL_COUNT][HISTORY_RAW_POINTS];
+  float resolution[TELEMETRY_CHANNEL_COUNT];
+  history_stats_t stats;
+} history_t;
+
+/**
+ * A reader's snapshot of one ring: entries first to end - 1 were written
+ * when it was taken.
+ */
+typedef struct {
+  const history_ring_t *ring;
+  float resolution;
+  uint32_t first;
+  uint32_t end;
+} history_view_t;
+
+/**
+ * @brief Empties the store.
+ */
+void history_init(history_t *history);
+
+/**
+ * @brief Appends a sample, only from the writer task.
+ *
+ * Values beyond what int16_t holds at the channel's resolution are clamped.
+ */
+void history_append(history_t *history, telemetry_channel_t channel,
+                    uint32_t time_s, float value);
+
+/**
+ * @brief Takes a snapshot of a ring for reading.
+ */
+void history_view(const history_t *history, telemetry_channel_t channel,
+                  history_tier_t tier, history_view_t *view);
+
+/**
+ * @brief Returns the first entry of a view that was not overwritten since
+ * the view was taken.
+ *
+ * Call it after reading, entries before it may be torn.
+ */
+uint32_t history_view_first_valid(const history_view_t *view);
+
+/**
+ * @brief Returns entry n of a view, NAN for a step without samples.
+ */
+static inline float history_view_value(const history_view_t *view,
+                                       uint32_t n) {
+  int16_t value = view->ring->values[n % view->ring->capacity];
+  return value == HISTORY_NO_VALUE ? NAN : value * view->resolution;
+}
+
+/**
+ * @brief Returns the time of entry n of a view, the start of its step in
+ * stepped tiers.
+ */
+static inline uint32_t history_view_time(const history_view_t *view,
+                                         uint32_t n) {
+  const history_ring_t *ring = view->ring;
+  if (ring->times_s != NULL) {
+    return ring->times_s[n % ring->capacity];
+  }
+  return n * ring->step_s;
+}
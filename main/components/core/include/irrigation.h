@@ -0,0 +1,125 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Predictive irrigation for one zone (a soil sensor and the pump that
+ * waters it).
+ *
+ * Soil moisture samples are averaged into bins, and the bins are fitted
+ * with an exponentially weighted least-squares line, updated in O(1) per
+ * bin. The x axis is not wall time but "demand time": seconds weighted by
+ * the evaporative demand of the current temperature and light, so the fit
+ * gives a dry-down rate per unit of demand that holds on hot and cold days
+ * alike. From it the model predicts when the zone crosses a threshold, and
+ * schedules a pulse early enough for the water to arrive in time.
+ *
+ * Every finished pump run is reported back. The rise it caused, measured
+ * once the water has settled, gives the moisture gained per pump second
+ * that sizes the next pulse, and shifts the fitted line so the dry-down
+ * rate survives the step.
+ *
+ * Everything is integer fixed-point and lives in the struct, nothing reads
+ * a clock: every call takes the current time, so recorded traces give the
+ * same results on the linux target.
+ */
+
+// Moisture in percent as Q16.16.
+#define IRRIGATION_Q16(percent) ((int32_t)(percent) * 65536)
+
+typedef struct {
+  uint32_t bin_s;           // Samples are averaged over bins this long
+  uint8_t memory_shift;     // The fit weighs roughly the last 2^shift bins
+  uint8_t min_bins;         // Bins before the rate is trusted
+  int16_t demand_ref_dc;    // Temperature of demand 1.0, in 0.1 °C
+  int16_t demand_temp_q8;   // Demand change per °C, Q8
+  int16_t demand_klux_q8;   // Demand change per 1000 lux, Q8
+  uint32_t settle_s;        // Time for a pulse to reach the sensor
+  uint16_t min_pulse_s;
+  uint16_t max_pulse_s;
+  uint16_t default_pulse_s; // Until a pulse response has been seen
+} irrigation_config_t;
+
+typedef struct {
+  irrigation_config_t config;
+  uint32_t last_s; // Time up to which demand has been integrated
+  uint16_t demand_q8;
+  // Current bin
+  uint32_t bin_start_s;
+  uint32_t bin_sum;
+  uint16_t bin_count;
+  // Weighted fit of moisture over demand time. Only the distance of the
+  // current demand time to the weighted mean is kept, so nothing grows.
+  int64_t lag_q8;   // Demand seconds since the weighted mean, Q8
+  int32_t mean_q16; // Weighted mean moisture
+  int64_t sxx;
+  int64_t sxy;
+  uint16_t bins;
+  // Pulse response
+  bool settling;
+  uint32_t settle_until_s;
+  uint16_t pulse_s;
+  int32_t gain_q16; // Moisture per pump second, 0 until measured
+} irrigation_model_t;
+
+typedef struct {
+  uint32_t crossing_in_s; // Until the threshold is crossed
+  uint32_t start_in_s;    // Until the pulse has to start, 0 if due
+  uint16_t pulse_s;
+} irrigation_plan_t;
+
+/**
+ * @brief Resets the model.
+ *
+ * @param now_s Current time in seconds, on any monotonic clock.
+ */
+void irrigation_model_init(irrigation_model_t *model,
+                           const irrigation_config_t *config, uint32_t now_s);
+
+/**
+ * @brief Updates the evaporative demand from the latest climate reading.
+ *
+ * @param temp_dc Air temperature in 0.1 °C.
+ * @param lux Illuminance.
+ */
+void irrigation_model_set_climate(irrigation_model_t *model, uint32_t now_s,
+                                  int16_t temp_dc, uint32_t lux);
+
+/**
+ * @brief Adds a soil moisture sample.
+ */
+void irrigation_model_add_moisture(irrigation_model_t *model, uint32_t now_s,
+                                   int percent);
+
+/**
+ * @brief Reports a finished pump run, whatever started it.
+ *
+ * @param now_s Time the pump stopped.
+ */
+void irrigation_model_pulse(irrigation_model_t *model, uint32_t now_s,
+                            uint32_t duration_s);
+
+/**
+ * @brief Predicts the threshold crossing and plans the pulse for it.
+ *
+ * @param below_pct Threshold the zone must not dry below.
+ * @param target_pct Moisture a pulse should restore.
+ * @return false while the rate is not trusted yet, the zone is not drying
+ *         or a pulse is still settling.
+ */
+bool irrigation_model_plan(const irrigation_model_t *model, uint32_t now_s,
+                           uint8_t below_pct, uint8_t target_pct,
+                           irrigation_plan_t *plan);
+
+/**
+ * @brief Returns the fitted moisture change per demand hour, Q16.
+ *
+ * Negative while drying, 0 until the rate is trusted.
+ */
+int32_t irrigation_model_rate_q16(const irrigation_model_t *model);
+
+/**
+ * @brief Returns the fitted moisture at the current time, Q16.
+ */
+int32_t irrigation_model_level_q16(const irrigation_model_t *model,
+                                   uint32_t now_s);
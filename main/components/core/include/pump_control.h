@@ -0,0 +1,128 @@
+#pragma once
+#include "growgrid_types.h"
+#include "irrigation.h"
+#include "rule_engine.h"
+#include "sensor_health.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The control step of one zone: sensor samples and the time of day go into
+ * the rule engine and the irrigation model, the step decides when the pump
+ * is switched and tracks timed runs, started by a command or a predicted
+ * pulse. The rules rest while a timed run is active.
+ *
+ * Nothing here touches the pump or reads a clock: every call takes the
+ * current time on a monotonic clock, and the caller switches the pump on
+ * the decisions. So the pump control task and the replay of a recording on
+ * the linux target run the same logic.
+ *
+ * The irrigation model learns from the pump state changes that are
+ * reported, i.e. from what the pump actually did, whatever started it.
+ */
+
+typedef enum {
+  PUMP_CONTROL_NONE,
+  PUMP_CONTROL_START, // The rules start the pump
+  PUMP_CONTROL_STOP,  // The rules stop the pump
+  PUMP_CONTROL_PULSE, // A predicted pulse starts a timed run
+} pump_control_action_t;
+
+typedef struct {
+  pump_control_action_t action;
+  bool run_ended;         // A timed run is over, the pump must be off
+  irrigation_plan_t plan; // Of a PUMP_CONTROL_PULSE
+} pump_control_decision_t;
+
+typedef struct {
+  rule_engine_t engine;
+  irrigation_model_t model;
+  int16_t temp_dc;
+  uint32_t lux;
+  // Cleared while the soil sensor is not healthy. Its samples are ignored
+  // then, so neither the rules on soil moisture nor predictions start the
+  // pump on bad data.
+  bool soil_ok;
+  int64_t run_end_us;  // End of the timed run, 0 if none is active
+  uint32_t pulse_in_s; // Until the next predicted pulse, UINT32_MAX if none
+  bool pump_running;   // Last reported pump state
+  uint32_t pump_on_s;  // When it was reported on
+} pump_control_t;
+
+/**
+ * @brief Resets the zone with the pump off.
+ *
+ * @param program Rules, must outlive the control.
+ * @param now_us Current time on any monotonic clock.
+ */
+void pump_control_init(pump_control_t *ctrl, const rule_program_t *program,
+                       const irrigation_config_t *config, int64_t now_us);
+
+/**
+ * @brief Switches to new rules, keeping the pump state and the last known
+ * values.
+ */
+void pump_control_reload(pump_control_t *ctrl, const rule_program_t *program);
+
+/**
+ * @brief Feeds the time of day of the wall clock into the rules.
+ *
+ * Ignored until the clock is set.
+ */
+void pump_control_set_wall_clock(pump_control_t *ctrl, int64_t wall_us);
+
+/**
+ * @brief Feeds a sensor sample.
+ *
+ * @return false if it was ignored because the soil sensor is not healthy.
+ */
+bool pump_control_sensor_data(pump_control_t *ctrl, const sensor_data_t *data,
+                              int64_t now_us);
+
+/**
+ * @brief Reports a sensor health change. A soil sensor that is not ok is
+ * forgotten by the rules until it recovers.
+ *
+ * @return true if the soil sensor changed between ok and not ok.
+ */
+bool pump_control_sensor_health(pump_control_t *ctrl,
+                                sensor_data_type_t sensor,
+                                sensor_health_state_t state);
+
+/**
+ * @brief Reports that the pump was switched, by whatever means. Every
+ * finished run teaches the irrigation model the pulse response.
+ */
+void pump_control_pump_state(pump_control_t *ctrl, bool on, int64_t now_us);
+
+/**
+ * @brief Tells the control that the pump was started for a timed run, e.g.
+ * by a command.
+ */
+void pump_control_timed_run(pump_control_t *ctrl, uint32_t duration_s,
+                            int64_t now_us);
+
+/**
+ * @brief Tells the control that the pump is off outside of the step, e.g. by
+ * a command, or that switching it on as decided failed.
+ */
+void pump_control_stopped(pump_control_t *ctrl, int64_t now_us);
+
+/**
+ * @brief Decides whether the pump has to be switched.
+ *
+ * Call after every event and when pump_control_next_check_ms says so. The
+ * state is updated as if the decision was carried out.
+ */
+pump_control_decision_t pump_control_step(pump_control_t *ctrl,
+                                          int64_t now_us);
+
+/**
+ * @brief Returns the milliseconds until the step could decide differently
+ * without an event, UINT32_MAX if nothing is pending.
+ *
+ * The end of a timed run is exact, run limits and predicted pulses are
+ * checked at least one second apart.
+ */
+uint32_t pump_control_next_check_ms(const pump_control_t *ctrl,
+                                    int64_t now_us);
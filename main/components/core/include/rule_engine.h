@@ -0,0 +1,219 @@
+#pragma once
+#include "growgrid_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Declarative pump rules, compiled into a table and evaluated incrementally.
+ *
+ * The source is one statement per line (or separated by ';'), `#` starts a
+ * comment:
+ *
+ *   on if soil_moisture < 30 reset 35 and time 06:00-22:00
+ *   inhibit if temperature < 5 reset 7
+ *   inhibit if vpd < 0.4 reset 0.5
+ *   pump max_run_s=120 min_off_s=600
+ *   predict below=30 target=40
+ *
+ * An `on` rule asks for the pump, an `inhibit` rule vetoes it. A rule holds
+ * while all of its conditions hold. `< a reset b` becomes true below a and
+ * false again above b, `> a reset b` the other way round, without `reset`
+ * there is no hysteresis. `time HH:MM-HH:MM` is a local time window and may
+ * wrap around midnight. `pump` sets the run-time limit and the pause after
+ * every stop, 0 disables either. `predict` hands soil moisture to the
+ * predictive irrigation model (see irrigation.h), which pulses ahead of the
+ * zone drying below the threshold; the rules still act as a backstop and
+ * their inhibits and pause apply to the pulses.
+ *
+ * Every threshold is an edge in a per-signal table sorted by value, with a
+ * cursor at the current value. A new reading walks the cursor over the
+ * edges it crosses and only re-evaluates their conditions, and each rule
+ * keeps a count of its false conditions, so the cost of an update depends
+ * on the thresholds crossed, not on the number of rules.
+ */
+
+#ifndef RULE_MAX_RULES
+#define RULE_MAX_RULES 32
+#endif
+#ifndef RULE_MAX_CONDITIONS
+#define RULE_MAX_CONDITIONS 64
+#endif
+#define RULE_MAX_EDGES (RULE_MAX_CONDITIONS * 2)
+// Longest source accepted from MQTT and stored in NVS, including the NUL.
+#define RULE_SOURCE_MAX_LEN 512
+
+// The sensor signals share the order of telemetry_channel_t.
+typedef enum {
+  RULE_SIGNAL_TEMPERATURE,
+  RULE_SIGNAL_HUMIDITY,
+  RULE_SIGNAL_LIGHT,
+  RULE_SIGNAL_SOIL_MOISTURE,
+  RULE_SIGNAL_VPD,
+  RULE_SIGNAL_DEW_POINT,
+  RULE_SIGNAL_DLI,
+  RULE_SIGNAL_TIME_OF_DAY, // Minutes since local midnight
+  RULE_SIGNAL_COUNT,
+} rule_signal_t;
+
+typedef enum {
+  RULE_ACTION_PUMP_ON,
+  RULE_ACTION_PUMP_INHIBIT,
+  RULE_ACTION_COUNT,
+} rule_action_t;
+
+typedef enum {
+  RULE_CONDITION_BELOW,
+  RULE_CONDITION_ABOVE,
+  RULE_CONDITION_WINDOW,
+} rule_condition_kind_t;
+
+typedef enum {
+  RULE_COMPILE_OK,
+  RULE_COMPILE_SYNTAX,    // Unknown word, bad number or missing part
+  RULE_COMPILE_RANGE,     // Reset on the wrong side, time out of range
+  RULE_COMPILE_TOO_LARGE, // More rules or conditions than the table holds
+} rule_compile_status_t;
+
+typedef enum {
+  RULE_DECISION_NONE,
+  RULE_DECISION_START,
+  RULE_DECISION_STOP,
+} rule_decision_t;
+
+typedef struct {
+  float set;   // Crossing it makes the condition true, window start
+  float reset; // Crossing it makes the condition false, window end
+  uint8_t kind;
+  uint8_t signal;
+  uint16_t rule;
+} rule_condition_t;
+
+typedef struct {
+  uint8_t action;
+  uint8_t condition_count;
+} rule_t;
+
+typedef struct {
+  float value;
+  uint16_t condition;
+} rule_edge_t;
+
+typedef struct {
+  rule_condition_t conditions[RULE_MAX_CONDITIONS];
+  rule_t rules[RULE_MAX_RULES];
+  // Sorted by signal, then value. The edges of signal s are
+  // edges[edge_start[s]] up to edges[edge_start[s + 1]].
+  rule_edge_t edges[RULE_MAX_EDGES];
+  uint16_t edge_start[RULE_SIGNAL_COUNT + 1];
+  uint16_t condition_count;
+  uint16_t rule_count;
+  uint32_t max_run_s;
+  uint32_t min_off_s;
+  uint32_t predict_below_pct; // 0 without a predict statement
+  uint32_t predict_target_pct;
+} rule_program_t;
+
+typedef struct {
+  const rule_program_t *program;
+  float values[RULE_SIGNAL_COUNT];
+  uint32_t known_signals; // Bit per signal that has reported a value
+  // First edge of each signal that is not below its value.
+  uint16_t cursor[RULE_SIGNAL_COUNT];
+  bool condition_state[RULE_MAX_CONDITIONS];
+  uint8_t false_count[RULE_MAX_RULES];
+  uint16_t active[RULE_ACTION_COUNT];
+  bool pump_on;
+  bool has_stopped;
+  uint32_t started_s;
+  uint32_t stopped_s;
+} rule_engine_t;
+
+/**
+ * @brief Compiles rule source into a program.
+ *
+ * The source does not need to be NUL-terminated.
+ *
+ * @param[out] error_line 1-based line (or statement) of the first error,
+ *             0 on success. May be NULL.
+ * @return RULE_COMPILE_OK on success, the program is unusable otherwise.
+ */
+rule_compile_status_t rule_compile(const char *src, size_t len,
+                                   rule_program_t *program, int *error_line);
+
+/**
+ * @brief Binds an engine to a compiled program and resets all state.
+ *
+ * Conditions on a signal that has not reported yet are false. The program
+ * must outlive the engine.
+ */
+void rule_engine_init(rule_engine_t *engine, const rule_program_t *program);
+
+/**
+ * @brief Feeds a new value of a signal.
+ *
+ * @return true if the set of active rules changed.
+ */
+bool rule_engine_update(rule_engine_t *engine, rule_signal_t signal,
+                        float value);
+
+/**
+ * @brief Feeds every value of a sensor sample.
+ *
+ * @return true if the set of active rules changed.
+ */
+bool rule_engine_update_sensor_data(rule_engine_t *engine,
+                                    const sensor_data_t *data);
+
+/**
+ * @brief Forgets the value of a signal, e.g. because its sensor failed.
+ *
+ * Its conditions turn false as if it had never reported, until the next
+ * update.
+ *
+ * @return true if the set of active rules changed.
+ */
+bool rule_engine_forget(rule_engine_t *engine, rule_signal_t signal);
+
+/**
+ * @brief Switches to a new program, keeping the pump state and the last
+ * known values. Conditions inside their hysteresis band start out false.
+ */
+void rule_engine_reload(rule_engine_t *engine, const rule_program_t *program);
+
+/**
+ * @brief Decides whether the pump has to be switched.
+ *
+ * Call after updates and periodically, the run-time limit and the pause
+ * are only enforced here. The pump state is updated as if the decision
+ * was carried out.
+ *
+ * @param now_s Monotonic time in seconds.
+ */
+rule_decision_t rule_engine_pump(rule_engine_t *engine, uint32_t now_s);
+
+/**
+ * @brief Returns whether the pump may be started outside of the rules now,
+ * i.e. it is off, nothing inhibits it and the pause after the last stop is
+ * over.
+ */
+bool rule_engine_may_start(const rule_engine_t *engine, uint32_t now_s);
+
+/**
+ * @brief Returns the seconds until the run-time limit or the pause could
+ * change the decision without a new value, UINT32_MAX if neither applies.
+ */
+uint32_t rule_engine_next_check_s(const rule_engine_t *engine,
+                                  uint32_t now_s);
+
+/**
+ * @brief Tells the engine that the pump was switched outside of the rules,
+ * e.g. by a manual command, so the limits are applied from then on.
+ */
+void rule_engine_set_pump(rule_engine_t *engine, bool on, uint32_t now_s);
+
+/**
+ * @brief Returns the number of active rules for an action.
+ */
+uint16_t rule_engine_active(const rule_engine_t *engine,
+                            rule_action_t action);
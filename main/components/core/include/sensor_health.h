@@ -0,0 +1,105 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Fault detection for one value of a sensor, fed with every read attempt.
+ *
+ * A read that fails is a hard fault. A reading that arrives can still be
+ * implausible: outside the range the sensor can measure, identical for
+ * longer than real noise allows (stuck-at), or a jump far outside the
+ * recent spread. The spread comes from an exponentially weighted mean and
+ * variance, updated in O(1) with the accepted readings only. A jump that
+ * repeats at the same level is a real change and re-seeds the statistics.
+ *
+ * The state is OK, SUSPECT while readings arrive but are rejected (or have
+ * not been good for long enough yet), or FAILED once reads keep failing.
+ * A failed sensor is retried with exponential backoff, and its driver
+ * re-initialised every few retries.
+ *
+ * Nothing here touches hardware or reads a clock, so the same logic runs on
+ * the linux target.
+ */
+
+typedef enum {
+  SENSOR_HEALTH_OK,
+  SENSOR_HEALTH_SUSPECT,
+  SENSOR_HEALTH_FAILED,
+} sensor_health_state_t;
+
+typedef enum {
+  SENSOR_FAULT_NONE,
+  SENSOR_FAULT_READ_ERROR,
+  SENSOR_FAULT_RANGE,
+  SENSOR_FAULT_STUCK,
+  SENSOR_FAULT_JUMP,
+} sensor_fault_t;
+
+typedef struct {
+  float min; // Plausible range, readings outside it are rejected
+  float max;
+  float jump_floor;       // Changes up to this are never jumps
+  float jump_sigma;       // Jumps exceed this many deviations, 0 disables
+  uint16_t stuck_samples; // Identical readings that count as stuck, 0 disables
+  uint8_t memory_shift;   // Statistics weigh roughly the last 2^shift readings
+  uint8_t warmup;         // Readings before jumps are checked
+  uint8_t jump_confirm;   // Jumps to the same level accepted as a real change
+  uint8_t fail_after;     // Read errors in a row before the sensor fails
+  uint8_t recover_after;  // Good readings in a row before it is OK again
+  uint8_t reinit_every;   // Failed retries between driver re-initialisations
+} sensor_health_config_t;
+
+typedef struct {
+  sensor_health_config_t config;
+  uint8_t state;
+  uint8_t fault; // Last fault seen, kept until the sensor is OK again
+  uint16_t errors;
+  uint16_t good;
+  uint16_t same;
+  uint8_t jumps;
+  uint8_t samples; // Accepted readings, saturates at warmup
+  float last;
+  float jump_value;
+  float mean;
+  float var;
+} sensor_health_t;
+
+/**
+ * @brief Resets the health of a sensor to OK without statistics.
+ */
+void sensor_health_init(sensor_health_t *health,
+                        const sensor_health_config_t *config);
+
+/**
+ * @brief Checks a reading and updates the state.
+ *
+ * @param[out] changed Set to whether the state or fault changed. May be NULL.
+ * @return SENSOR_FAULT_NONE if the reading may be used.
+ */
+sensor_fault_t sensor_health_check(sensor_health_t *health, float value,
+                                   bool *changed);
+
+/**
+ * @brief Records a failed read.
+ *
+ * @return true if the state or fault changed.
+ */
+bool sensor_health_read_failed(sensor_health_t *health);
+
+/**
+ * @brief Returns whether the driver should be re-initialised before the
+ * next attempt: on failing and then every reinit_every retries.
+ */
+bool sensor_health_reinit_due(const sensor_health_t *health);
+
+/**
+ * @brief Returns the delay until the next read attempt.
+ *
+ * The sampling interval, doubled for every retry of a failed sensor up to
+ * max_ms.
+ */
+uint32_t sensor_health_retry_ms(const sensor_health_t *health,
+                                uint32_t interval_ms, uint32_t max_ms);
+
+const char *sensor_health_state_name(sensor_health_state_t state);
+const char *sensor_fault_name(sensor_fault_t fault);
@@ -0,0 +1,58 @@
+#pragma once
+
+/**
+ * Every sensor of the device, in one table.
+ *
+ * The sensor type enum and sample payload (growgrid_types.h), the sensor
+ * names used in commands and topics, the acquisition tasks with their
+ * sampling intervals, and the dispatch tables of the HAL, telemetry and
+ * event log code are all generated from it and indexed by the sensor type.
+ * Adding a sensor is a row here and in SENSOR_CHECKS plus its payload
+ * struct and the per-sensor functions the tables expect:
+ * hal_sensors_read_<name>() and configure_<name>() in the HAL,
+ * points_<name>() in telemetry.c and encode_<name>()/decode_<name>() in
+ * event_log.c. A missing one fails the build, not a switch at runtime.
+ *
+ * X(ID, name, payload type, interval_ms)
+ *
+ * ID            Suffix of SENSOR_DATA_TYPE_<ID>. The order is the wire value
+ *               in the event log, so rows are only ever appended.
+ * name          Payload member, name in commands and topics, task name.
+ * interval_ms   Default sampling interval from app_config.h, changed at
+ *               runtime by the sampling command and kept in config_store.h.
+ */
+#define SENSOR_REGISTRY(X)                                                     \
+  X(TEMP_HUMIDITY, temp_humidity, temp_humidity_data_t,                        \
+    TEMP_SENSOR_READ_INTERVAL_MS)                                              \
+  X(LIGHT, light, light_data_t, LIGHT_SENSOR_READ_INTERVAL_MS)                 \
+  X(SOIL_MOISTURE, soil_moisture, soil_moisture_data_t,                        \
+    SOIL_SENSOR_READ_INTERVAL_MS)
+
+/**
+ * Every quantity that sensor_health.h checks, at least one per sensor. A
+ * reading is only used if all quantities of its sensor pass.
+ *
+ * X(ID, name, member, min, max, jump_floor, jump_sigma, stuck_samples)
+ *
+ * member        Payload member of the sensor's row above.
+ * min, max      Plausible range: the BMP280 range, beyond direct sunlight,
+ *               and for soil down to well below the dry calibration, which
+ *               means the probe is out of the soil.
+ * jump_floor    Changes up to this are never jumps.
+ * jump_sigma    Jumps exceed this many deviations, 0 disables them. Clouds,
+ *               grow lights and humidifiers step at any time. Watering
+ *               steps are confirmed by the readings after them.
+ * stuck_samples Identical readings that count as stuck, 0 disables it. Real
+ *               air never repeats to 0.01 for 10 minutes, and a humidity
+ *               pinned at 100 % means condensation on the sensor.
+ */
+#define SENSOR_CHECKS(X)                                                       \
+  X(TEMP_HUMIDITY, temp_humidity, temperature, -40, 85, 3, 6, 120)             \
+  X(TEMP_HUMIDITY, temp_humidity, humidity, 0, 100, 0, 0, 120)                 \
+  X(LIGHT, light, lux, 0, 120000, 0, 0, 0)                                     \
+  X(SOIL_MOISTURE, soil_moisture, percent, -10, 100, 15, 6, 0)
+
+// Number of rows, usable in #if and array sizes.
+#define SENSOR_REGISTRY_COUNT_(...) +1
+#define SENSOR_DATA_TYPE_COUNT (0 SENSOR_REGISTRY(SENSOR_REGISTRY_COUNT_))
+#define SENSOR_CHECK_COUNT (0 SENSOR_CHECKS(SENSOR_REGISTRY_COUNT_))
@@ -0,0 +1,91 @@
+#pragma once
+#include "growgrid_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+  TELEMETRY_CHANNEL_TEMPERATURE,
+  TELEMETRY_CHANNEL_HUMIDITY,
+  TELEMETRY_CHANNEL_LIGHT,
+  TELEMETRY_CHANNEL_SOIL_MOISTURE,
+  // Derived on the device, see derived_metrics.h
+  TELEMETRY_CHANNEL_VPD,       // kPa
+  TELEMETRY_CHANNEL_DEW_POINT, // °C
+  TELEMETRY_CHANNEL_DLI,       // mol/m²/day
+  TELEMETRY_CHANNEL_COUNT,
+} telemetry_channel_t;
+
+typedef enum {
+  TELEMETRY_FORMAT_JSON,
+  TELEMETRY_FORMAT_LINE_PROTOCOL,
+} telemetry_format_t;
+
+/**
+ * A single scalar reading. Sensor events carrying more than one quantity
+ * (temperature and humidity) are split into one point per channel, together
+ * with the quantities derived from them.
+ */
+typedef struct {
+  uint64_t timestamp_us;
+  telemetry_channel_t channel;
+  float value;
+} telemetry_point_t;
+
+#define TELEMETRY_MAX_POINTS_PER_SAMPLE 4
+
+// 2024-01-01T00:00:00Z. Samples stamped earlier were taken before SNTP synced
+// the clock and would land at 1970 in the database.
+#define TELEMETRY_MIN_VALID_TIMESTAMP_US 1704067200000000ULL
+
+/**
+ * @brief Returns the channel name used for topics and Influx measurements.
+ */
+const char *telemetry_channel_name(telemetry_channel_t channel);
+
+/**
+ * @brief Looks up a channel by name.
+ *
+ * @param name Not necessarily terminated.
+ * @return true if a channel has that name.
+ */
+bool telemetry_channel_from_name(const char *name, size_t len,
+                                 telemetry_channel_t *channel);
+
+/**
+ * @brief Returns the step values of a channel are rounded to when stored.
+ *
+ * About what the sensor resolves, coarse enough that the full range of the
+ * channel fits an int16_t in these units.
+ */
+float telemetry_channel_resolution(telemetry_channel_t channel);
+
+/**
+ * @brief Splits a sensor sample into per-channel points.
+ *
+ * @param data The sensor sample.
+ * @param[out] points Array of at least TELEMETRY_MAX_POINTS_PER_SAMPLE points.
+ * @return The number of points written.
+ */
+int telemetry_points_from_sensor_data(const sensor_data_t *data,
+                                      telemetry_point_t *points);
+
+/**
+ * @brief Serializes a point as `{"value":..,"timestamp_us":..}`.
+ *
+ * @return The payload length, or -1 if it did not fit into the buffer.
+ */
+int telemetry_format_json(const telemetry_point_t *point, char *buf,
+                          size_t size);
+
+/**
+ * @brief Serializes a point as one InfluxDB line protocol line.
+ *
+ * The line is `<channel>[,<tags>] value=<v> <timestamp_ns>` without a
+ * trailing newline, so the measurement and field match what the Telegraf
+ * JSON path produces.
+ *
+ * @param tags Pre-escaped tag set such as "device=abc", or NULL.
+ * @return The line length, or -1 if it did not fit into the buffer.
+ */
+int telemetry_format_line_protocol(const telemetry_point_t *point,
+                                   const char *tags, char *buf, size_t size);
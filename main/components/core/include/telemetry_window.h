@@ -0,0 +1,76 @@
+#pragma once
+#include "telemetry.h"
+#include <stdbool.h>
+
+typedef enum {
+  TELEMETRY_MODE_RAW,     // Every sample is published
+  TELEMETRY_MODE_SUMMARY, // One summary per channel and window
+} telemetry_mode_t;
+
+/**
+ * Running statistics of one channel in the current window (Welford).
+ */
+typedef struct {
+  uint64_t window_start_us;
+  uint32_t count;
+  float min;
+  float max;
+  float mean;
+  float m2; // Sum of squared deviations from the mean
+} telemetry_window_t;
+
+typedef struct {
+  uint64_t window_start_us;
+  telemetry_channel_t channel;
+  uint32_t count;
+  float min;
+  float max;
+  float mean;
+  float stddev; // Sample standard deviation, 0 for a single sample
+} telemetry_summary_t;
+
+typedef struct {
+  uint64_t window_us;
+  telemetry_window_t channels[TELEMETRY_CHANNEL_COUNT];
+} telemetry_aggregator_t;
+
+/**
+ * @brief Resets all channels and sets the window length.
+ *
+ * Windows are tumbling and aligned to multiples of the window length on the
+ * sample clock, so devices with the same setting produce aligned summaries.
+ */
+void telemetry_aggregator_init(telemetry_aggregator_t *agg,
+                               uint32_t window_ms);
+
+/**
+ * @brief Adds a point in O(1).
+ *
+ * @param[out] summary Filled in when the point starts a new window and the
+ *             previous window of its channel had samples.
+ * @return true if a summary was emitted.
+ */
+bool telemetry_aggregator_add(telemetry_aggregator_t *agg,
+                              const telemetry_point_t *point,
+                              telemetry_summary_t *summary);
+
+/**
+ * @brief Serializes a summary as
+ * `{"count","min","max","mean","stddev","timestamp_us"}`.
+ *
+ * @return The payload length, or -1 if it did not fit into the buffer.
+ */
+int telemetry_format_summary_json(const telemetry_summary_t *summary,
+                                  char *buf, size_t size);
+
+/**
+ * @brief Serializes a summary as one InfluxDB line protocol line.
+ *
+ * Uses the channel measurement with count/min/max/mean/stddev fields,
+ * timestamped with the window start.
+ *
+ * @return The line length, or -1 if it did not fit into the buffer.
+ */
+int telemetry_format_summary_line_protocol(const telemetry_summary_t *summary,
+                                           const char *tags, char *buf,
+                                           size_t size);
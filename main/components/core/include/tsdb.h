@@ -0,0 +1,169 @@
+#pragma once
+#include "telemetry.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Append-only time-series store in a flash partition.
+ *
+ * Points are compressed per channel as in Facebook's Gorilla: timestamps as
+ * the delta of their delta, values as the XOR with the previous value, both
+ * as variable-length bit fields. A regular series of repeating values costs
+ * 2 bits per point. Each channel fills a chunk in RAM that is appended to
+ * flash as one record when it is full, or earlier by tsdb_flush to bound
+ * what a power loss takes.
+ *
+ * The partition is a ring of sectors. A sector starts with a header holding
+ * a sequence number that finds the newest sector at mount, then records
+ * follow back to back. When the ring is full the oldest sector is erased and
+ * its records are gone. The time range of every sector is kept in RAM,
+ * rebuilt from the record headers at mount, so a range query only reads the
+ * headers of the sectors it overlaps and decodes only its channel's records.
+ *
+ * Times are unix seconds. Nothing here reads a clock or touches hardware:
+ * flash goes through tsdb_flash_t, so the store runs the same on the device
+ * and on the linux target with a simulated partition.
+ */
+
+#define TSDB_SECTOR_BYTES 4096
+#ifndef TSDB_MAX_SECTORS
+#define TSDB_MAX_SECTORS 256
+#endif
+// Compressed bytes of one chunk, i.e. the data of the largest record.
+#define TSDB_CHUNK_BYTES 248
+
+/**
+ * A flash partition. Erased bytes read 0xFF and writes can only clear bits,
+ * so every byte is written once between two erases.
+ */
+typedef struct {
+  void *ctx;
+  uint32_t size; // Bytes, a multiple of TSDB_SECTOR_BYTES
+  bool (*read)(void *ctx, uint32_t offset, void *buf, size_t len);
+  bool (*write)(void *ctx, uint32_t offset, const void *buf, size_t len);
+  bool (*erase)(void *ctx, uint32_t offset); // The sector at offset
+} tsdb_flash_t;
+
+// A channel's points not yet written to flash.
+typedef struct {
+  uint8_t data[TSDB_CHUNK_BYTES];
+  uint16_t bits; // Used of data
+  uint16_t count;
+  uint32_t first_s;
+  uint32_t last_s; // Kept after a flush, appends may not go back in time
+  uint32_t delta_s;
+  uint32_t value;   // Bits of the last float
+  uint8_t lead;     // Leading zeros of the last XOR window
+  uint8_t trail;    // Trailing zeros of the last XOR window
+} tsdb_chunk_t;
+
+typedef struct {
+  uint32_t min_s; // UINT32_MAX if the sector holds no records
+  uint32_t max_s;
+} tsdb_span_t;
+
+typedef struct {
+  uint32_t points;        // Appended since mount
+  uint32_t rejected;      // Appends older than the channel's last point
+  uint32_t records;       // Written since mount
+  uint32_t erases;
+  uint64_t encoded_bytes; // Compressed point data written
+  uint64_t flash_bytes;   // Everything written, with headers and padding
+} tsdb_stats_t;
+
+typedef struct {
+  tsdb_flash_t flash;
+  uint16_t sectors;
+  uint16_t head;         // Sector being written
+  uint32_t head_seq;     // Sequence number of the head, 0 if none yet
+  uint32_t write_offset; // Next record in the head sector
+  tsdb_span_t spans[TSDB_MAX_SECTORS];
+  tsdb_chunk_t chunks[TELEMETRY_CHANNEL_COUNT];
+  tsdb_stats_t stats;
+} tsdb_t;
+
+// Walks one channel's records, see tsdb_query_begin.
+typedef struct {
+  tsdb_t *db;
+  telemetry_channel_t channel;
+  uint32_t from_s;
+  uint32_t to_s;
+  uint32_t step_s;
+  uint16_t visited; // Sectors, from the oldest
+  uint32_t offset;  // Next record header in the current sector
+  bool in_ram;      // Reading the copy of the open chunk
+  bool done;
+  uint8_t data[TSDB_CHUNK_BYTES];
+  // Decoder state of the current record.
+  uint16_t pos;
+  uint16_t limit;
+  uint16_t left;
+  uint32_t time_s;
+  uint32_t delta_s;
+  uint32_t value;
+  uint8_t lead;
+  uint8_t trail;
+  // Bucket of a downsampled query.
+  bool has_bucket;
+  uint32_t bucket_s;
+  uint32_t bucket_count;
+  double bucket_sum;
+  uint32_t records_read; // Records decoded, for benchmarks
+  uint32_t corrupt;      // Records skipped for a bad CRC
+} tsdb_query_t;
+
+/**
+ * @brief Finds the newest sector and rebuilds the time index.
+ *
+ * Reads every sector and record header once. A blank or foreign partition
+ * mounts as empty, its sectors are erased as the ring reaches them.
+ *
+ * @return false if the partition has fewer than two sectors or more than
+ *         TSDB_MAX_SECTORS.
+ */
+bool tsdb_mount(tsdb_t *db, const tsdb_flash_t *flash);
+
+/**
+ * @brief Appends a point to its channel's chunk.
+ *
+ * Writes the chunk to flash first if the point does not fit.
+ *
+ * @return false if the point is older than the channel's last one, or the
+ *         full chunk could not be written.
+ */
+bool tsdb_append(tsdb_t *db, telemetry_channel_t channel, uint32_t time_s,
+                 float value);
+
+/**
+ * @brief Writes the chunks whose first point is older than a time.
+ *
+ * Every record costs a header, so flushing often trades write
+ * amplification for less data at risk. UINT32_MAX flushes everything, e.g.
+ * before a restart.
+ *
+ * @return false if a write failed, the chunk is kept then.
+ */
+bool tsdb_flush(tsdb_t *db, uint32_t older_than_s);
+
+/**
+ * @brief Starts a range query of one channel, including unflushed points.
+ *
+ * @param from_s First second of the range.
+ * @param to_s Last second of the range.
+ * @param step_s 0 returns every point, otherwise the mean of each step,
+ *               stamped with the step's start. Steps are aligned to
+ *               multiples of their length.
+ */
+void tsdb_query_begin(tsdb_t *db, tsdb_query_t *query,
+                      telemetry_channel_t channel, uint32_t from_s,
+                      uint32_t to_s, uint32_t step_s);
+
+/**
+ * @brief Returns the next point of a query in time order.
+ *
+ * The store must not be written to while a query is in progress.
+ *
+ * @return false at the end of the range.
+ */
+bool tsdb_query_next(tsdb_query_t *query, uint32_t *time_s, float *value);
@@ -0,0 +1,182 @@
+#include "irrigation.h"
+#include <string.h>
+
+#define DEMAND_ONE_Q8 256
+#define DEMAND_MIN_Q8 (DEMAND_ONE_Q8 / 4)
+#define DEMAND_MAX_Q8 (DEMAND_ONE_Q8 * 4)
+#define SECONDS_PER_HOUR 3600
+// Predictions further out are reported as this, nothing is due anyway.
+#define CROSSING_MAX_S (7 * 24 * 3600)
+
+// Division rounds towards zero, so negative values shrink like positive
+// ones (unlike an arithmetic shift).
+static int64_t scale_down(int64_t value, uint8_t shift) {
+  return value / ((int64_t)1 << shift);
+}
+
+void irrigation_model_init(irrigation_model_t *model,
+                           const irrigation_config_t *config, uint32_t now_s) {
+  memset(model, 0, sizeof(*model));
+  model->config = *config;
+  model->last_s = now_s;
+  model->demand_q8 = DEMAND_ONE_Q8;
+}
+
+static void advance(irrigation_model_t *model, uint32_t now_s) {
+  model->lag_q8 += (int64_t)model->demand_q8 * (now_s - model->last_s);
+  model->last_s = now_s;
+}
+
+void irrigation_model_set_climate(irrigation_model_t *model, uint32_t now_s,
+                                  int16_t temp_dc, uint32_t lux) {
+  advance(model, now_s);
+  const irrigation_config_t *config = &model->config;
+  int32_t demand =
+      DEMAND_ONE_Q8 +
+      (int32_t)(temp_dc - config->demand_ref_dc) * config->demand_temp_q8 / 10 +
+      (int32_t)(lux / 1000) * config->demand_klux_q8;
+  if (demand < DEMAND_MIN_Q8) {
+    demand = DEMAND_MIN_Q8;
+  } else if (demand > DEMAND_MAX_Q8) {
+    demand = DEMAND_MAX_Q8;
+  }
+  model->demand_q8 = (uint16_t)demand;
+}
+
+int32_t irrigation_model_rate_q16(const irrigation_model_t *model) {
+  if (model->bins < model->config.min_bins || model->sxx <= 0) {
+    return 0;
+  }
+  return (int32_t)(model->sxy * SECONDS_PER_HOUR / model->sxx);
+}
+
+int32_t irrigation_model_level_q16(const irrigation_model_t *model,
+                                   uint32_t now_s) {
+  int64_t lag_s = (model->lag_q8 + (int64_t)model->demand_q8 *
+                                       (now_s - model->last_s)) /
+                  DEMAND_ONE_Q8;
+  return model->mean_q16 +
+         (int32_t)(irrigation_model_rate_q16(model) * lag_s /
+                   SECONDS_PER_HOUR);
+}
+
+// Exponentially weighted update of the means and (co)variances, with the
+// deviations taken from the old means.
+static void fit_bin(irrigation_model_t *model, int32_t level_q16) {
+  uint8_t shift = model->config.memory_shift;
+  if (model->bins == 0) {
+    model->mean_q16 = level_q16;
+    model->lag_q8 = 0;
+    model->bins = 1;
+    return;
+  }
+  int64_t dx = model->lag_q8 / DEMAND_ONE_Q8;
+  int64_t dy = level_q16 - model->mean_q16;
+  model->mean_q16 += (int32_t)scale_down(dy, shift);
+  model->lag_q8 -= scale_down(model->lag_q8, shift);
+  model->sxx += scale_down(dx * dx, shift);
+  model->sxx -= scale_down(model->sxx, shift);
+  model->sxy += scale_down(dx * dy, shift);
+  model->sxy -= scale_down(model->sxy, shift);
+  if (model->bins < UINT16_MAX) {
+    model->bins++;
+  }
+}
+
+// The first full bin after a pulse has settled measures its effect against
+// the line continued through the pulse.
+static void finish_pulse(irrigation_model_t *model, int32_t level_q16,
+                         uint32_t now_s) {
+  int32_t rise = level_q16 - irrigation_model_level_q16(model, now_s);
+  model->settling = false;
+  if (rise <= 0 || model->bins < 2) {
+    // Nothing arrived (or there is no line yet), restart the fit from here.
+    model->bins = 0;
+    fit_bin(model, level_q16);
+    return;
+  }
+  int32_t gain = rise / model->pulse_s;
+  model->gain_q16 = model->gain_q16 == 0
+                        ? gain
+                        : model->gain_q16 + (gain - model->gain_q16) / 4;
+  model->mean_q16 += rise;
+}
+
+static void close_bin(irrigation_model_t *model, uint32_t now_s) {
+  int32_t level_q16 = (int32_t)(((int64_t)model->bin_sum * 65536) /
+                                model->bin_count);
+  if (!model->settling) {
+    fit_bin(model, level_q16);
+  } else if (model->bin_start_s >= model->settle_until_s) {
+    finish_pulse(model, level_q16, now_s);
+  }
+  model->bin_sum = 0;
+  model->bin_count = 0;
+}
+
+void irrigation_model_add_moisture(irrigation_model_t *model, uint32_t now_s,
+                                   int percent) {
+  advance(model, now_s);
+  if (model->bin_count > 0 &&
+      now_s - model->bin_start_s >= model->config.bin_s) {
+    close_bin(model, now_s);
+  }
+  if (model->bin_count == 0) {
+    model->bin_start_s = now_s;
+  }
+  model->bin_sum += (uint32_t)(percent < 0 ? 0 : percent);
+  model->bin_count++;
+}
+
+void irrigation_model_pulse(irrigation_model_t *model, uint32_t now_s,
+                            uint32_t duration_s) {
+  advance(model, now_s);
+  if (duration_s == 0) {
+    return;
+  }
+  // The bin in progress mixes samples from before and during the run.
+  model->bin_sum = 0;
+  model->bin_count = 0;
+  model->settling = true;
+  model->settle_until_s = now_s + model->config.settle_s;
+  model->pulse_s = (uint16_t)(duration_s > UINT16_MAX ? UINT16_MAX
+                                                      : duration_s);
+}
+
+bool irrigation_model_plan(const irrigation_model_t *model, uint32_t now_s,
+                           uint8_t below_pct, uint8_t target_pct,
+                           irrigation_plan_t *plan) {
+  const irrigation_config_t *config = &model->config;
+  int32_t rate = irrigation_model_rate_q16(model);
+  if (model->settling || rate >= 0) {
+    return false;
+  }
+
+  int64_t drop = (int64_t)irrigation_model_level_q16(model, now_s) -
+                 IRRIGATION_Q16(below_pct);
+  // Moisture per hour at the current demand is rate * demand / 256.
+  int64_t crossing_s =
+      drop <= 0 ? 0
+                : drop * SECONDS_PER_HOUR * DEMAND_ONE_Q8 /
+                      (-(int64_t)rate * model->demand_q8);
+  if (crossing_s > CROSSING_MAX_S) {
+    crossing_s = CROSSING_MAX_S;
+  }
+  plan->crossing_in_s = (uint32_t)crossing_s;
+  plan->start_in_s = plan->crossing_in_s > config->settle_s
+                         ? plan->crossing_in_s - config->settle_s
+                         : 0;
+
+  uint32_t pulse = config->default_pulse_s;
+  if (model->gain_q16 > 0 && target_pct > below_pct) {
+    pulse = (uint32_t)(IRRIGATION_Q16(target_pct - below_pct) /
+                       model->gain_q16);
+  }
+  if (pulse < config->min_pulse_s) {
+    pulse = config->min_pulse_s;
+  } else if (pulse > config->max_pulse_s) {
+    pulse = config->max_pulse_s;
+  }
+  plan->pulse_s = (uint16_t)pulse;
+  return true;
+}
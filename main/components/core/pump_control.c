@@ -0,0 +1,159 @@
+#include "pump_control.h"
+#include "telemetry.h"
+#include <string.h>
+#include <time.h>
+
+static uint32_t seconds(int64_t now_us) {
+  return (uint32_t)(now_us / 1000000);
+}
+
+void pump_control_init(pump_control_t *ctrl, const rule_program_t *program,
+                       const irrigation_config_t *config, int64_t now_us) {
+  memset(ctrl, 0, sizeof(*ctrl));
+  rule_engine_init(&ctrl->engine, program);
+  irrigation_model_init(&ctrl->model, config, seconds(now_us));
+  ctrl->soil_ok = true;
+  ctrl->pulse_in_s = UINT32_MAX;
+}
+
+void pump_control_reload(pump_control_t *ctrl, const rule_program_t *program) {
+  rule_engine_reload(&ctrl->engine, program);
+}
+
+void pump_control_set_wall_clock(pump_control_t *ctrl, int64_t wall_us) {
+  if (wall_us < (int64_t)TELEMETRY_MIN_VALID_TIMESTAMP_US) {
+    return;
+  }
+  time_t t = (time_t)(wall_us / 1000000);
+  struct tm local;
+  localtime_r(&t, &local);
+  rule_engine_update(&ctrl->engine, RULE_SIGNAL_TIME_OF_DAY,
+                     (float)(local.tm_hour * 60 + local.tm_min));
+}
+
+bool pump_control_sensor_data(pump_control_t *ctrl, const sensor_data_t *data,
+                              int64_t now_us) {
+  uint32_t now = seconds(now_us);
+  if (data->type == SENSOR_DATA_TYPE_SOIL_MOISTURE && !ctrl->soil_ok) {
+    return false;
+  }
+  rule_engine_update_sensor_data(&ctrl->engine, data);
+  switch (data->type) {
+  case SENSOR_DATA_TYPE_TEMP_HUMIDITY:
+    ctrl->temp_dc = (int16_t)(data->payload.temp_humidity.temperature * 10);
+    irrigation_model_set_climate(&ctrl->model, now, ctrl->temp_dc, ctrl->lux);
+    break;
+  case SENSOR_DATA_TYPE_LIGHT:
+    ctrl->lux = data->payload.light.lux;
+    irrigation_model_set_climate(&ctrl->model, now, ctrl->temp_dc, ctrl->lux);
+    break;
+  case SENSOR_DATA_TYPE_SOIL_MOISTURE:
+    irrigation_model_add_moisture(&ctrl->model, now,
+                                  data->payload.soil_moisture.percent);
+    break;
+  }
+  return true;
+}
+
+bool pump_control_sensor_health(pump_control_t *ctrl,
+                                sensor_data_type_t sensor,
+                                sensor_health_state_t state) {
+  if (sensor != SENSOR_DATA_TYPE_SOIL_MOISTURE ||
+      ctrl->soil_ok == (state == SENSOR_HEALTH_OK)) {
+    return false;
+  }
+  ctrl->soil_ok = state == SENSOR_HEALTH_OK;
+  if (!ctrl->soil_ok) {
+    rule_engine_forget(&ctrl->engine, RULE_SIGNAL_SOIL_MOISTURE);
+  }
+  return true;
+}
+
+void pump_control_pump_state(pump_control_t *ctrl, bool on, int64_t now_us) {
+  uint32_t now = seconds(now_us);
+  if (on && !ctrl->pump_running) {
+    ctrl->pump_on_s = now;
+  } else if (!on && ctrl->pump_running) {
+    irrigation_model_pulse(&ctrl->model, now, now - ctrl->pump_on_s);
+  }
+  ctrl->pump_running = on;
+}
+
+void pump_control_timed_run(pump_control_t *ctrl, uint32_t duration_s,
+                            int64_t now_us) {
+  ctrl->run_end_us = now_us + (int64_t)duration_s * 1000000;
+  rule_engine_set_pump(&ctrl->engine, true, seconds(now_us));
+}
+
+void pump_control_stopped(pump_control_t *ctrl, int64_t now_us) {
+  ctrl->run_end_us = 0;
+  rule_engine_set_pump(&ctrl->engine, false, seconds(now_us));
+}
+
+// Pulses ahead of the predicted crossing, the rules stay the backstop.
+static bool plan_pulse(pump_control_t *ctrl, uint32_t now,
+                       irrigation_plan_t *plan) {
+  const rule_program_t *program = ctrl->engine.program;
+  ctrl->pulse_in_s = UINT32_MAX;
+  if (program->predict_below_pct == 0 || !ctrl->soil_ok ||
+      !rule_engine_may_start(&ctrl->engine, now) ||
+      !irrigation_model_plan(&ctrl->model, now,
+                             (uint8_t)program->predict_below_pct,
+                             (uint8_t)program->predict_target_pct, plan)) {
+    return false;
+  }
+  if (plan->start_in_s > 0) {
+    ctrl->pulse_in_s = plan->start_in_s;
+    return false;
+  }
+  return true;
+}
+
+pump_control_decision_t pump_control_step(pump_control_t *ctrl,
+                                          int64_t now_us) {
+  pump_control_decision_t decision = {.action = PUMP_CONTROL_NONE};
+  uint32_t now = seconds(now_us);
+  if (ctrl->run_end_us != 0) {
+    if (now_us < ctrl->run_end_us) {
+      return decision;
+    }
+    decision.run_ended = true;
+    pump_control_stopped(ctrl, now_us);
+  }
+
+  switch (rule_engine_pump(&ctrl->engine, now)) {
+  case RULE_DECISION_START:
+    decision.action = PUMP_CONTROL_START;
+    break;
+  case RULE_DECISION_STOP:
+    decision.action = PUMP_CONTROL_STOP;
+    break;
+  case RULE_DECISION_NONE:
+    if (plan_pulse(ctrl, now, &decision.plan)) {
+      decision.action = PUMP_CONTROL_PULSE;
+      pump_control_timed_run(ctrl, decision.plan.pulse_s, now_us);
+    }
+    break;
+  }
+  return decision;
+}
+
+uint32_t pump_control_next_check_ms(const pump_control_t *ctrl,
+                                    int64_t now_us) {
+  uint32_t wait_s = rule_engine_next_check_s(&ctrl->engine, seconds(now_us));
+  if (ctrl->pulse_in_s < wait_s) {
+    wait_s = ctrl->pulse_in_s;
+  }
+  uint64_t wait_ms = UINT32_MAX;
+  if (wait_s != UINT32_MAX) {
+    wait_ms = (uint64_t)(wait_s > 0 ? wait_s : 1) * 1000;
+  }
+  if (ctrl->run_end_us != 0) {
+    int64_t left_us = ctrl->run_end_us - now_us;
+    uint64_t left_ms = left_us > 0 ? (uint64_t)(left_us + 999) / 1000 : 0;
+    if (left_ms < wait_ms) {
+      wait_ms = left_ms;
+    }
+  }
+  return wait_ms < UINT32_MAX ? (uint32_t)wait_ms : UINT32_MAX;
+}
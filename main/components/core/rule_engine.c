@@ -0,0 +1,561 @@
+#include "rule_engine.h"
+#include "telemetry.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Sensor readings are fed by telemetry channel.
+static_assert((int)RULE_SIGNAL_DLI == (int)TELEMETRY_CHANNEL_DLI &&
+                  (int)RULE_SIGNAL_TIME_OF_DAY == (int)TELEMETRY_CHANNEL_COUNT,
+              "rule signals must match the telemetry channels");
+
+#define MINUTES_PER_DAY (24 * 60)
+
+static const char *const s_signal_names[] = {
+    [RULE_SIGNAL_TEMPERATURE] = "temperature",
+    [RULE_SIGNAL_HUMIDITY] = "humidity",
+    [RULE_SIGNAL_LIGHT] = "light",
+    [RULE_SIGNAL_SOIL_MOISTURE] = "soil_moisture",
+    [RULE_SIGNAL_VPD] = "vpd",
+    [RULE_SIGNAL_DEW_POINT] = "dew_point",
+    [RULE_SIGNAL_DLI] = "dli",
+    [RULE_SIGNAL_TIME_OF_DAY] = "time",
+};
+
+// A token is a view into the source, never a copy.
+typedef struct {
+  const char *ptr;
+  size_t len;
+} token_t;
+
+typedef struct {
+  const char *p;
+  const char *end;
+} lexer_t;
+
+static bool token_equals(token_t tok, const char *str) {
+  return tok.len == strlen(str) && memcmp(tok.ptr, str, tok.len) == 0;
+}
+
+// Words and numbers run up to whitespace or an operator, the operators
+// `<`, `>` and `=` are tokens of their own. Returns false at the end.
+static bool next_token(lexer_t *lex, token_t *tok) {
+  while (lex->p < lex->end && (*lex->p == ' ' || *lex->p == '\t' ||
+                               *lex->p == '\r')) {
+    lex->p++;
+  }
+  if (lex->p == lex->end) {
+    return false;
+  }
+  const char *start = lex->p;
+  if (*lex->p == '<' || *lex->p == '>' || *lex->p == '=') {
+    lex->p++;
+  } else {
+    while (lex->p < lex->end && *lex->p != ' ' && *lex->p != '\t' &&
+           *lex->p != '\r' && *lex->p != '<' && *lex->p != '>' &&
+           *lex->p != '=') {
+      lex->p++;
+    }
+  }
+  *tok = (token_t){start, (size_t)(lex->p - start)};
+  return true;
+}
+
+static bool token_to_float(token_t tok, float *out) {
+  size_t i = 0;
+  bool negative = tok.len > 0 && tok.ptr[0] == '-';
+  if (negative) {
+    i++;
+  }
+  float value = 0;
+  float scale = 0;
+  bool digits = false;
+  for (; i < tok.len; i++) {
+    char c = tok.ptr[i];
+    if (c == '.' && scale == 0) {
+      scale = 1;
+    } else if (c >= '0' && c <= '9') {
+      if (scale > 0) {
+        scale /= 10;
+        value += (float)(c - '0') * scale;
+      } else {
+        value = value * 10 + (float)(c - '0');
+      }
+      digits = true;
+    } else {
+      return false;
+    }
+  }
+  *out = negative ? -value : value;
+  return digits;
+}
+
+static bool token_to_u32(token_t tok, uint32_t *out) {
+  if (tok.len == 0 || tok.len > 9) {
+    return false;
+  }
+  uint32_t value = 0;
+  for (size_t i = 0; i < tok.len; i++) {
+    if (tok.ptr[i] < '0' || tok.ptr[i] > '9') {
+      return false;
+    }
+    value = value * 10 + (uint32_t)(tok.ptr[i] - '0');
+  }
+  *out = value;
+  return true;
+}
+
+// HH:MM as minutes since midnight, 24:00 is allowed as a window end.
+static bool parse_clock(const char *p, int *minutes) {
+  for (int i = 0; i < 5; i++) {
+    if (i == 2 ? p[i] != ':' : (p[i] < '0' || p[i] > '9')) {
+      return false;
+    }
+  }
+  int hours = (p[0] - '0') * 10 + (p[1] - '0');
+  int mins = (p[3] - '0') * 10 + (p[4] - '0');
+  *minutes = hours * 60 + mins;
+  return mins < 60 && *minutes <= MINUTES_PER_DAY;
+}
+
+static rule_compile_status_t parse_window(token_t tok,
+                                          rule_condition_t *cond) {
+  int start;
+  int end;
+  if (tok.len != 11 || tok.ptr[5] != '-') {
+    return RULE_COMPILE_SYNTAX;
+  }
+  if (!parse_clock(tok.ptr, &start) || !parse_clock(tok.ptr + 6, &end) ||
+      start == MINUTES_PER_DAY) {
+    return RULE_COMPILE_RANGE;
+  }
+  cond->kind = RULE_CONDITION_WINDOW;
+  cond->signal = RULE_SIGNAL_TIME_OF_DAY;
+  cond->set = (float)start;
+  cond->reset = (float)(end % MINUTES_PER_DAY);
+  return RULE_COMPILE_OK;
+}
+
+// <signal> < a [reset b], <signal> > a [reset b] or time HH:MM-HH:MM.
+static rule_compile_status_t parse_condition(lexer_t *lex,
+                                             rule_condition_t *cond) {
+  token_t tok;
+  if (!next_token(lex, &tok)) {
+    return RULE_COMPILE_SYNTAX;
+  }
+  int signal = -1;
+  for (int s = 0; s < RULE_SIGNAL_COUNT; s++) {
+    if (token_equals(tok, s_signal_names[s])) {
+      signal = s;
+    }
+  }
+  if (signal < 0 || !next_token(lex, &tok)) {
+    return RULE_COMPILE_SYNTAX;
+  }
+  if (signal == RULE_SIGNAL_TIME_OF_DAY) {
+    return parse_window(tok, cond);
+  }
+
+  cond->signal = (uint8_t)signal;
+  if (token_equals(tok, "<")) {
+    cond->kind = RULE_CONDITION_BELOW;
+  } else if (token_equals(tok, ">")) {
+    cond->kind = RULE_CONDITION_ABOVE;
+  } else {
+    return RULE_COMPILE_SYNTAX;
+  }
+  if (!next_token(lex, &tok) || !token_to_float(tok, &cond->set)) {
+    return RULE_COMPILE_SYNTAX;
+  }
+  cond->reset = cond->set;
+
+  lexer_t peek = *lex;
+  if (next_token(&peek, &tok) && token_equals(tok, "reset")) {
+    if (!next_token(&peek, &tok) || !token_to_float(tok, &cond->reset)) {
+      return RULE_COMPILE_SYNTAX;
+    }
+    *lex = peek;
+  }
+  bool reset_ok = cond->kind == RULE_CONDITION_BELOW
+                      ? cond->reset >= cond->set
+                      : cond->reset <= cond->set;
+  return reset_ok ? RULE_COMPILE_OK : RULE_COMPILE_RANGE;
+}
+
+// on|inhibit if <condition> [and <condition>]...
+static rule_compile_status_t parse_rule(lexer_t *lex, rule_action_t action,
+                                        rule_program_t *program) {
+  if (program->rule_count == RULE_MAX_RULES) {
+    return RULE_COMPILE_TOO_LARGE;
+  }
+  token_t tok;
+  if (!next_token(lex, &tok) || !token_equals(tok, "if")) {
+    return RULE_COMPILE_SYNTAX;
+  }
+  uint16_t index = program->rule_count;
+  rule_t *rule = &program->rules[index];
+  *rule = (rule_t){.action = (uint8_t)action};
+
+  bool more;
+  do {
+    if (program->condition_count == RULE_MAX_CONDITIONS ||
+        rule->condition_count == UINT8_MAX) {
+      return RULE_COMPILE_TOO_LARGE;
+    }
+    rule_condition_t *cond = &program->conditions[program->condition_count];
+    rule_compile_status_t status = parse_condition(lex, cond);
+    if (status != RULE_COMPILE_OK) {
+      return status;
+    }
+    cond->rule = index;
+    program->condition_count++;
+    rule->condition_count++;
+    more = next_token(lex, &tok);
+  } while (more && token_equals(tok, "and"));
+
+  if (more) {
+    return RULE_COMPILE_SYNTAX;
+  }
+  program->rule_count++;
+  return RULE_COMPILE_OK;
+}
+
+// key=N pairs, each key is one of names and stored in the matching value.
+static rule_compile_status_t parse_settings(lexer_t *lex,
+                                            const char *const *names,
+                                            uint32_t *const *values,
+                                            int count) {
+  token_t key;
+  token_t tok;
+  while (next_token(lex, &key)) {
+    uint32_t *value = NULL;
+    for (int i = 0; i < count; i++) {
+      if (token_equals(key, names[i])) {
+        value = values[i];
+      }
+    }
+    if (value == NULL || !next_token(lex, &tok) || !token_equals(tok, "=") ||
+        !next_token(lex, &tok) || !token_to_u32(tok, value)) {
+      return RULE_COMPILE_SYNTAX;
+    }
+  }
+  return RULE_COMPILE_OK;
+}
+
+// pump [max_run_s=N] [min_off_s=N]
+static rule_compile_status_t parse_pump(lexer_t *lex,
+                                        rule_program_t *program) {
+  static const char *const names[] = {"max_run_s", "min_off_s"};
+  uint32_t *const values[] = {&program->max_run_s, &program->min_off_s};
+  return parse_settings(lex, names, values, 2);
+}
+
+// predict below=N target=N
+static rule_compile_status_t parse_predict(lexer_t *lex,
+                                           rule_program_t *program) {
+  static const char *const names[] = {"below", "target"};
+  uint32_t *const values[] = {&program->predict_below_pct,
+                              &program->predict_target_pct};
+  rule_compile_status_t status = parse_settings(lex, names, values, 2);
+  if (status != RULE_COMPILE_OK) {
+    return status;
+  }
+  if (program->predict_below_pct == 0 ||
+      program->predict_target_pct <= program->predict_below_pct ||
+      program->predict_target_pct > 100) {
+    return RULE_COMPILE_RANGE;
+  }
+  return RULE_COMPILE_OK;
+}
+
+static rule_compile_status_t parse_statement(const char *p, const char *end,
+                                             rule_program_t *program) {
+  lexer_t lex = {p, end};
+  token_t tok;
+  if (!next_token(&lex, &tok)) {
+    return RULE_COMPILE_OK;
+  }
+  if (token_equals(tok, "on")) {
+    return parse_rule(&lex, RULE_ACTION_PUMP_ON, program);
+  }
+  if (token_equals(tok, "inhibit")) {
+    return parse_rule(&lex, RULE_ACTION_PUMP_INHIBIT, program);
+  }
+  if (token_equals(tok, "pump")) {
+    return parse_pump(&lex, program);
+  }
+  if (token_equals(tok, "predict")) {
+    return parse_predict(&lex, program);
+  }
+  return RULE_COMPILE_SYNTAX;
+}
+
+static int compare_edges(const void *a, const void *b) {
+  const rule_edge_t *x = a;
+  const rule_edge_t *y = b;
+  return (x->value > y->value) - (x->value < y->value);
+}
+
+// Groups the edges by signal and sorts each group by value.
+static void build_edges(rule_program_t *program) {
+  uint16_t count = 0;
+  for (int s = 0; s < RULE_SIGNAL_COUNT; s++) {
+    program->edge_start[s] = count;
+    for (uint16_t c = 0; c < program->condition_count; c++) {
+      const rule_condition_t *cond = &program->conditions[c];
+      if (cond->signal != s) {
+        continue;
+      }
+      program->edges[count++] = (rule_edge_t){cond->set, c};
+      if (cond->reset != cond->set) {
+        program->edges[count++] = (rule_edge_t){cond->reset, c};
+      }
+    }
+    qsort(&program->edges[program->edge_start[s]],
+          count - program->edge_start[s], sizeof(rule_edge_t),
+          compare_edges);
+  }
+  program->edge_start[RULE_SIGNAL_COUNT] = count;
+}
+
+rule_compile_status_t rule_compile(const char *src, size_t len,
+                                   rule_program_t *program, int *error_line) {
+  memset(program, 0, sizeof(*program));
+  const char *end = src + len;
+  int line = 1;
+  rule_compile_status_t status = RULE_COMPILE_OK;
+
+  for (const char *p = src; p < end && status == RULE_COMPILE_OK; line++) {
+    const char *stmt_end = p;
+    while (stmt_end < end && *stmt_end != '\n' && *stmt_end != ';' &&
+           *stmt_end != '#') {
+      stmt_end++;
+    }
+    status = parse_statement(p, stmt_end, program);
+    if (stmt_end < end && *stmt_end == '#') {
+      while (stmt_end < end && *stmt_end != '\n') {
+        stmt_end++;
+      }
+    }
+    p = stmt_end + 1;
+  }
+
+  if (status == RULE_COMPILE_OK) {
+    build_edges(program);
+  }
+  if (error_line != NULL) {
+    *error_line = status == RULE_COMPILE_OK ? 0 : line - 1;
+  }
+  return status;
+}
+
+void rule_engine_init(rule_engine_t *engine, const rule_program_t *program) {
+  memset(engine, 0, sizeof(*engine));
+  engine->program = program;
+  for (uint16_t r = 0; r < program->rule_count; r++) {
+    engine->false_count[r] = program->rules[r].condition_count;
+  }
+}
+
+static bool evaluate(const rule_condition_t *cond, float value, bool state) {
+  switch (cond->kind) {
+  case RULE_CONDITION_BELOW:
+    return value < cond->set ? true : value > cond->reset ? false : state;
+  case RULE_CONDITION_ABOVE:
+    return value > cond->set ? true : value < cond->reset ? false : state;
+  case RULE_CONDITION_WINDOW:
+    if (cond->set <= cond->reset) {
+      // An equal start and end is the whole day.
+      return cond->set == cond->reset ||
+             (value >= cond->set && value < cond->reset);
+    }
+    return value >= cond->set || value < cond->reset;
+  }
+  return false;
+}
+
+static bool set_condition(rule_engine_t *engine, uint16_t index, bool next) {
+  const rule_condition_t *cond = &engine->program->conditions[index];
+  if (next == engine->condition_state[index]) {
+    return false;
+  }
+  engine->condition_state[index] = next;
+
+  uint8_t *false_count = &engine->false_count[cond->rule];
+  uint16_t *active =
+      &engine->active[engine->program->rules[cond->rule].action];
+  if (next) {
+    if (--*false_count == 0) {
+      (*active)++;
+    }
+  } else {
+    if ((*false_count)++ == 0) {
+      (*active)--;
+    }
+  }
+  return true;
+}
+
+// Idempotent, so a condition reached through both of its edges is fine.
+static bool refresh_condition(rule_engine_t *engine, uint16_t index,
+                              float value) {
+  const rule_condition_t *cond = &engine->program->conditions[index];
+  return set_condition(engine, index,
+                       evaluate(cond, value, engine->condition_state[index]));
+}
+
+// First edge of [lo, hi) whose value is not below the key.
+static uint16_t lower_bound(const rule_edge_t *edges, uint16_t lo,
+                            uint16_t hi, float key) {
+  while (lo < hi) {
+    uint16_t mid = (uint16_t)(lo + (hi - lo) / 2);
+    if (edges[mid].value < key) {
+      lo = (uint16_t)(mid + 1);
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+bool rule_engine_update(rule_engine_t *engine, rule_signal_t signal,
+                        float value) {
+  const rule_program_t *program = engine->program;
+  const rule_edge_t *edges = program->edges;
+  uint16_t begin = program->edge_start[signal];
+  uint16_t end = program->edge_start[signal + 1];
+  uint16_t pos = engine->cursor[signal];
+  float old = engine->values[signal];
+  bool changed = false;
+
+  // Only a threshold between the old and the new value can flip a
+  // condition, including one the old value sat exactly on. The cursor
+  // stays at the first edge not below the value, so the walk touches just
+  // the crossed edges.
+  if ((engine->known_signals & (1u << signal)) == 0) {
+    for (uint16_t e = begin; e < end; e++) {
+      changed |= refresh_condition(engine, edges[e].condition, value);
+    }
+    pos = lower_bound(edges, begin, end, value);
+  } else if (value >= old) {
+    while (pos < end && edges[pos].value <= value) {
+      changed |= refresh_condition(engine, edges[pos++].condition, value);
+    }
+    while (pos > begin && edges[pos - 1].value >= value) {
+      pos--;
+    }
+  } else {
+    for (uint16_t e = pos; e < end && edges[e].value == old; e++) {
+      changed |= refresh_condition(engine, edges[e].condition, value);
+    }
+    while (pos > begin && edges[pos - 1].value >= value) {
+      changed |= refresh_condition(engine, edges[--pos].condition, value);
+    }
+  }
+
+  engine->cursor[signal] = pos;
+  engine->values[signal] = value;
+  engine->known_signals |= 1u << signal;
+  return changed;
+}
+
+bool rule_engine_update_sensor_data(rule_engine_t *engine,
+                                    const sensor_data_t *data) {
+  telemetry_point_t points[TELEMETRY_MAX_POINTS_PER_SAMPLE];
+  int count = telemetry_points_from_sensor_data(data, points);
+  bool changed = false;
+  for (int i = 0; i < count; i++) {
+    changed |= rule_engine_update(engine, (rule_signal_t)points[i].channel,
+                                  points[i].value);
+  }
+  return changed;
+}
+
+bool rule_engine_forget(rule_engine_t *engine, rule_signal_t signal) {
+  const rule_program_t *program = engine->program;
+  bool changed = false;
+  for (uint16_t e = program->edge_start[signal];
+       e < program->edge_start[signal + 1]; e++) {
+    changed |= set_condition(engine, program->edges[e].condition, false);
+  }
+  engine->known_signals &= ~(1u << signal);
+  return changed;
+}
+
+void rule_engine_reload(rule_engine_t *engine,
+                        const rule_program_t *program) {
+  rule_engine_t old = *engine;
+  rule_engine_init(engine, program);
+  engine->pump_on = old.pump_on;
+  engine->has_stopped = old.has_stopped;
+  engine->started_s = old.started_s;
+  engine->stopped_s = old.stopped_s;
+  for (int s = 0; s < RULE_SIGNAL_COUNT; s++) {
+    if (old.known_signals & (1u << s)) {
+      rule_engine_update(engine, (rule_signal_t)s, old.values[s]);
+    }
+  }
+}
+
+bool rule_engine_may_start(const rule_engine_t *engine, uint32_t now_s) {
+  return !engine->pump_on &&
+         engine->active[RULE_ACTION_PUMP_INHIBIT] == 0 &&
+         (!engine->has_stopped ||
+          now_s - engine->stopped_s >= engine->program->min_off_s);
+}
+
+rule_decision_t rule_engine_pump(rule_engine_t *engine, uint32_t now_s) {
+  const rule_program_t *program = engine->program;
+  bool want = engine->active[RULE_ACTION_PUMP_ON] > 0 &&
+              engine->active[RULE_ACTION_PUMP_INHIBIT] == 0;
+
+  if (engine->pump_on) {
+    bool expired = program->max_run_s > 0 &&
+                   now_s - engine->started_s >= program->max_run_s;
+    if (!want || expired) {
+      rule_engine_set_pump(engine, false, now_s);
+      return RULE_DECISION_STOP;
+    }
+  } else if (want && rule_engine_may_start(engine, now_s)) {
+    rule_engine_set_pump(engine, true, now_s);
+    return RULE_DECISION_START;
+  }
+  return RULE_DECISION_NONE;
+}
+
+uint32_t rule_engine_next_check_s(const rule_engine_t *engine,
+                                  uint32_t now_s) {
+  const rule_program_t *program = engine->program;
+  uint32_t limit_s;
+  uint32_t since_s;
+  if (engine->pump_on && program->max_run_s > 0) {
+    limit_s = program->max_run_s;
+    since_s = engine->started_s;
+  } else if (!engine->pump_on && engine->has_stopped &&
+             engine->active[RULE_ACTION_PUMP_ON] > 0) {
+    limit_s = program->min_off_s;
+    since_s = engine->stopped_s;
+  } else {
+    return UINT32_MAX;
+  }
+  uint32_t elapsed_s = now_s - since_s;
+  return elapsed_s >= limit_s ? 0 : limit_s - elapsed_s;
+}
+
+void rule_engine_set_pump(rule_engine_t *engine, bool on, uint32_t now_s) {
+  if (on == engine->pump_on) {
+    return;
+  }
+  engine->pump_on = on;
+  if (on) {
+    engine->started_s = now_s;
+  } else {
+    engine->stopped_s = now_s;
+    engine->has_stopped = true;
+  }
+}
+
+uint16_t rule_engine_active(const rule_engine_t *engine,
+                            rule_action_t action) {
+  return engine->active[action];
+}
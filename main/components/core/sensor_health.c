@@ -0,0 +1,164 @@
+#include "sensor_health.h"
+#include <math.h>
+#include <string.h>
+
+#define RETRY_MAX_SHIFT 16
+
+void sensor_health_init(sensor_health_t *health,
+                        const sensor_health_config_t *config) {
+  memset(health, 0, sizeof(*health));
+  health->config = *config;
+  health->state = SENSOR_HEALTH_OK;
+  health->last = NAN;
+}
+
+// Exponentially weighted mean and variance (West's update), so a sensor
+// that drifts slowly never looks like it jumps.
+static void accept(sensor_health_t *health, float value) {
+  if (health->samples == 0) {
+    health->mean = value;
+    health->var = 0;
+  } else {
+    float alpha = 1.0f / (float)(1u << health->config.memory_shift);
+    float diff = value - health->mean;
+    health->mean += alpha * diff;
+    health->var = (1 - alpha) * (health->var + alpha * diff * diff);
+  }
+  if (health->samples < health->config.warmup) {
+    health->samples++;
+  }
+}
+
+static sensor_fault_t classify(sensor_health_t *health, float value) {
+  const sensor_health_config_t *config = &health->config;
+  // Written so that NaN is out of range too.
+  if (!(value >= config->min && value <= config->max)) {
+    return SENSOR_FAULT_RANGE;
+  }
+
+  if (value == health->last) {
+    if (health->same < UINT16_MAX) {
+      health->same++;
+    }
+  } else {
+    health->same = 0;
+  }
+  health->last = value;
+  if (config->stuck_samples > 0 && health->same + 1 >= config->stuck_samples) {
+    return SENSOR_FAULT_STUCK;
+  }
+
+  if (config->jump_sigma > 0 && health->samples >= config->warmup &&
+      config->warmup > 0) {
+    float diff = value - health->mean;
+    if (fabsf(diff) > config->jump_floor &&
+        diff * diff > config->jump_sigma * config->jump_sigma * health->var) {
+      if (health->jumps > 0 &&
+          fabsf(value - health->jump_value) <= config->jump_floor) {
+        health->jumps++;
+      } else {
+        health->jumps = 1;
+        health->jump_value = value;
+      }
+      if (health->jumps < config->jump_confirm) {
+        return SENSOR_FAULT_JUMP;
+      }
+      // The new level holds, start over from it.
+      health->samples = 0;
+    }
+  }
+  health->jumps = 0;
+  return SENSOR_FAULT_NONE;
+}
+
+sensor_fault_t sensor_health_check(sensor_health_t *health, float value,
+                                   bool *changed) {
+  uint8_t old_state = health->state;
+  uint8_t old_fault = health->fault;
+  sensor_fault_t fault = classify(health, value);
+  health->errors = 0;
+
+  if (fault != SENSOR_FAULT_NONE) {
+    health->good = 0;
+    health->state = SENSOR_HEALTH_SUSPECT;
+    health->fault = (uint8_t)fault;
+  } else {
+    accept(health, value);
+    if (health->good < UINT16_MAX) {
+      health->good++;
+    }
+    if (health->state != SENSOR_HEALTH_OK &&
+        health->good >= health->config.recover_after) {
+      health->state = SENSOR_HEALTH_OK;
+      health->fault = SENSOR_FAULT_NONE;
+    } else if (health->state == SENSOR_HEALTH_FAILED) {
+      health->state = SENSOR_HEALTH_SUSPECT;
+    }
+  }
+
+  if (changed != NULL) {
+    *changed = health->state != old_state || health->fault != old_fault;
+  }
+  return fault;
+}
+
+bool sensor_health_read_failed(sensor_health_t *health) {
+  uint8_t old_state = health->state;
+  if (health->errors < UINT16_MAX) {
+    health->errors++;
+  }
+  health->good = 0;
+  if (health->state != SENSOR_HEALTH_FAILED &&
+      health->errors >= health->config.fail_after) {
+    health->state = SENSOR_HEALTH_FAILED;
+    health->fault = SENSOR_FAULT_READ_ERROR;
+  }
+  return health->state != old_state;
+}
+
+bool sensor_health_reinit_due(const sensor_health_t *health) {
+  const sensor_health_config_t *config = &health->config;
+  return health->state == SENSOR_HEALTH_FAILED && config->reinit_every > 0 &&
+         (health->errors - config->fail_after) % config->reinit_every == 0;
+}
+
+uint32_t sensor_health_retry_ms(const sensor_health_t *health,
+                                uint32_t interval_ms, uint32_t max_ms) {
+  if (health->state != SENSOR_HEALTH_FAILED) {
+    return interval_ms;
+  }
+  uint32_t shift = health->errors - health->config.fail_after + 1u;
+  if (shift > RETRY_MAX_SHIFT) {
+    shift = RETRY_MAX_SHIFT;
+  }
+  uint64_t delay_ms = (uint64_t)interval_ms << shift;
+  return delay_ms > max_ms ? max_ms : (uint32_t)delay_ms;
+}
+
+const char *sensor_health_state_name(sensor_health_state_t state) {
+  switch (state) {
+  case SENSOR_HEALTH_OK:
+    return "ok";
+  case SENSOR_HEALTH_SUSPECT:
+    return "suspect";
+  case SENSOR_HEALTH_FAILED:
+    return "failed";
+  }
+  return "unknown";
+}
+
+const char *sensor_fault_name(sensor_fault_t fault) {
+  switch (fault) {
+  case SENSOR_FAULT_NONE:
+    return "none";
+  case SENSOR_FAULT_READ_ERROR:
+    return "read_error";
+  case SENSOR_FAULT_RANGE:
+    return "range";
+  case SENSOR_FAULT_STUCK:
+    return "stuck";
+  case SENSOR_FAULT_JUMP:
+    return "jump";
+  }
+  return "unknown";
+}
@@ -0,0 +1,26 @@
+#include "growgrid_types.h"
+#include <string.h>
+
+static const char *const s_names[SENSOR_DATA_TYPE_COUNT] = {
+#define SENSOR_NAME_(ID, name, ...) [SENSOR_DATA_TYPE_##ID] = #name,
+    SENSOR_REGISTRY(SENSOR_NAME_)
+#undef SENSOR_NAME_
+};
+
+const char *sensor_name(sensor_data_type_t sensor) {
+  if (sensor < 0 || sensor >= SENSOR_DATA_TYPE_COUNT) {
+    return "unknown";
+  }
+  return s_names[sensor];
+}
+
+bool sensor_from_name(const char *name, size_t len,
+                      sensor_data_type_t *sensor) {
+  for (int i = 0; i < SENSOR_DATA_TYPE_COUNT; i++) {
+    if (strlen(s_names[i]) == len && memcmp(s_names[i], name, len) == 0) {
+      *sensor = (sensor_data_type_t)i;
+      return true;
+    }
+  }
+  return false;
+}
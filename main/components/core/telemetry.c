@@ -0,0 +1,135 @@
+#include "telemetry.h"
+#include "derived_metrics.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *const s_channel_names[TELEMETRY_CHANNEL_COUNT] = {
+    [TELEMETRY_CHANNEL_TEMPERATURE] = "temperature",
+    [TELEMETRY_CHANNEL_HUMIDITY] = "humidity",
+    [TELEMETRY_CHANNEL_LIGHT] = "light",
+    [TELEMETRY_CHANNEL_SOIL_MOISTURE] = "soil_moisture",
+    [TELEMETRY_CHANNEL_VPD] = "vpd",
+    [TELEMETRY_CHANNEL_DEW_POINT] = "dew_point",
+    [TELEMETRY_CHANNEL_DLI] = "dli",
+};
+
+static const float s_channel_resolutions[TELEMETRY_CHANNEL_COUNT] = {
+    [TELEMETRY_CHANNEL_TEMPERATURE] = 0.1f,
+    [TELEMETRY_CHANNEL_HUMIDITY] = 0.1f,
+    [TELEMETRY_CHANNEL_LIGHT] = 10.0f,
+    [TELEMETRY_CHANNEL_SOIL_MOISTURE] = 1.0f,
+    [TELEMETRY_CHANNEL_VPD] = 0.01f,
+    [TELEMETRY_CHANNEL_DEW_POINT] = 0.1f,
+    [TELEMETRY_CHANNEL_DLI] = 0.01f,
+};
+
+// Rounded to 0.01 °C and 0.01 %, the sensors resolve less.
+static int32_t to_centi(float value) {
+  return (int32_t)(value * 100 + (value < 0 ? -0.5f : 0.5f));
+}
+
+const char *telemetry_channel_name(telemetry_channel_t channel) {
+  if (channel < 0 || channel >= TELEMETRY_CHANNEL_COUNT) {
+    return "unknown";
+  }
+  return s_channel_names[channel];
+}
+
+bool telemetry_channel_from_name(const char *name, size_t len,
+                                 telemetry_channel_t *channel) {
+  for (int i = 0; i < TELEMETRY_CHANNEL_COUNT; i++) {
+    if (strlen(s_channel_names[i]) == len &&
+        memcmp(s_channel_names[i], name, len) == 0) {
+      *channel = (telemetry_channel_t)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+float telemetry_channel_resolution(telemetry_channel_t channel) {
+  if (channel < 0 || channel >= TELEMETRY_CHANNEL_COUNT) {
+    return 1.0f;
+  }
+  return s_channel_resolutions[channel];
+}
+
+static int points_temp_humidity(const sensor_data_t *data,
+                                telemetry_point_t *points) {
+  const temp_humidity_data_t *th = &data->payload.temp_humidity;
+  derived_climate_t climate;
+  derived_climate(to_centi(th->temperature), to_centi(th->humidity), &climate);
+  points[0] = (telemetry_point_t){.timestamp_us = data->timestamp_us,
+                                  .channel = TELEMETRY_CHANNEL_TEMPERATURE,
+                                  .value = th->temperature};
+  points[1] = (telemetry_point_t){.timestamp_us = data->timestamp_us,
+                                  .channel = TELEMETRY_CHANNEL_HUMIDITY,
+                                  .value = th->humidity};
+  points[2] = (telemetry_point_t){.timestamp_us = data->timestamp_us,
+                                  .channel = TELEMETRY_CHANNEL_VPD,
+                                  .value = (float)climate.vpd_pa / 1000};
+  points[3] = (telemetry_point_t){.timestamp_us = data->timestamp_us,
+                                  .channel = TELEMETRY_CHANNEL_DEW_POINT,
+                                  .value = (float)climate.dew_point_cc / 100};
+  return 4;
+}
+
+static int points_light(const sensor_data_t *data, telemetry_point_t *points) {
+  points[0] = (telemetry_point_t){.timestamp_us = data->timestamp_us,
+                                  .channel = TELEMETRY_CHANNEL_LIGHT,
+                                  .value = (float)data->payload.light.lux};
+  points[1] = (telemetry_point_t){.timestamp_us = data->timestamp_us,
+                                  .channel = TELEMETRY_CHANNEL_DLI,
+                                  .value = data->payload.light.dli};
+  return 2;
+}
+
+static int points_soil_moisture(const sensor_data_t *data,
+                                telemetry_point_t *points) {
+  points[0] = (telemetry_point_t){
+      .timestamp_us = data->timestamp_us,
+      .channel = TELEMETRY_CHANNEL_SOIL_MOISTURE,
+      .value = (float)data->payload.soil_moisture.percent};
+  return 1;
+}
+
+typedef int (*points_fn_t)(const sensor_data_t *data,
+                           telemetry_point_t *points);
+
+static const points_fn_t s_points[SENSOR_DATA_TYPE_COUNT] = {
+#define SENSOR_POINTS_(ID, name, ...) [SENSOR_DATA_TYPE_##ID] = points_##name,
+    SENSOR_REGISTRY(SENSOR_POINTS_)
+#undef SENSOR_POINTS_
+};
+
+int telemetry_points_from_sensor_data(const sensor_data_t *data,
+                                      telemetry_point_t *points) {
+  // Recordings may come from firmware with more sensors.
+  if (data->type < 0 || data->type >= SENSOR_DATA_TYPE_COUNT) {
+    return 0;
+  }
+  return s_points[data->type](data, points);
+}
+
+static int check_fit(int len, size_t size) {
+  return (len < 0 || (size_t)len >= size) ? -1 : len;
+}
+
+int telemetry_format_json(const telemetry_point_t *point, char *buf,
+                          size_t size) {
+  int len = snprintf(buf, size, "{\"value\":%.6g,\"timestamp_us\":%" PRIu64 "}",
+                     point->value, point->timestamp_us);
+  return check_fit(len, size);
+}
+
+int telemetry_format_line_protocol(const telemetry_point_t *point,
+                                   const char *tags, char *buf, size_t size) {
+  // Always written as a float field: the JSON path stores floats too, and
+  // Influx rejects points that change a field's type.
+  int len = snprintf(buf, size, "%s%s%s value=%.6g %" PRIu64 "000",
+                     telemetry_channel_name(point->channel),
+                     tags != NULL ? "," : "", tags != NULL ? tags : "",
+                     point->value, point->timestamp_us);
+  return check_fit(len, size);
+}
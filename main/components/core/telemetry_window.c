@@ -0,0 +1,88 @@
+#include "telemetry_window.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+void telemetry_aggregator_init(telemetry_aggregator_t *agg,
+                               uint32_t window_ms) {
+  memset(agg, 0, sizeof(*agg));
+  agg->window_us = (uint64_t)window_ms * 1000;
+}
+
+static void window_summarize(const telemetry_window_t *win,
+                             telemetry_channel_t channel,
+                             telemetry_summary_t *summary) {
+  summary->window_start_us = win->window_start_us;
+  summary->channel = channel;
+  summary->count = win->count;
+  summary->min = win->min;
+  summary->max = win->max;
+  summary->mean = win->mean;
+  summary->stddev = win->count > 1 ? sqrtf(win->m2 / (win->count - 1)) : 0.0f;
+}
+
+bool telemetry_aggregator_add(telemetry_aggregator_t *agg,
+                              const telemetry_point_t *point,
+                              telemetry_summary_t *summary) {
+  telemetry_window_t *win = &agg->channels[point->channel];
+  uint64_t start = point->timestamp_us - point->timestamp_us % agg->window_us;
+  bool emitted = false;
+
+  if (win->count > 0 && start != win->window_start_us) {
+    window_summarize(win, point->channel, summary);
+    emitted = true;
+    win->count = 0;
+  }
+
+  float x = point->value;
+  if (win->count == 0) {
+    win->window_start_us = start;
+    win->count = 1;
+    win->min = x;
+    win->max = x;
+    win->mean = x;
+    win->m2 = 0.0f;
+    return emitted;
+  }
+
+  win->count++;
+  if (x < win->min) {
+    win->min = x;
+  }
+  if (x > win->max) {
+    win->max = x;
+  }
+  float delta = x - win->mean;
+  win->mean += delta / (float)win->count;
+  win->m2 += delta * (x - win->mean);
+  return emitted;
+}
+
+static int check_fit(int len, size_t size) {
+  return (len < 0 || (size_t)len >= size) ? -1 : len;
+}
+
+int telemetry_format_summary_json(const telemetry_summary_t *summary,
+                                  char *buf, size_t size) {
+  int len = snprintf(buf, size,
+                     "{\"count\":%" PRIu32 ",\"min\":%.6g,\"max\":%.6g,"
+                     "\"mean\":%.6g,\"stddev\":%.6g,\"timestamp_us\":%" PRIu64
+                     "}",
+                     summary->count, summary->min, summary->max, summary->mean,
+                     summary->stddev, summary->window_start_us);
+  return check_fit(len, size);
+}
+
+int telemetry_format_summary_line_protocol(const telemetry_summary_t *summary,
+                                           const char *tags, char *buf,
+                                           size_t size) {
+  int len = snprintf(
+      buf, size,
+      "%s%s%s count=%" PRIu32 "i,min=%.6g,max=%.6g,mean=%.6g,stddev=%.6g "
+      "%" PRIu64 "000",
+      telemetry_channel_name(summary->channel), tags != NULL ? "," : "",
+      tags != NULL ? tags : "", summary->count, summary->min, summary->max,
+      summary->mean, summary->stddev, summary->window_start_us);
+  return check_fit(len, size);
+}
@@ -0,0 +1,540 @@
+#include "tsdb.h"
+#include <string.h>
+
+#define SECTOR_MAGIC 0x53544747 // "GGTS"
+#define NO_WINDOW 0xFF
+#define ERASED_LEN 0xFFFF
+
+typedef struct {
+  uint32_t magic;
+  uint32_t seq;
+} sector_header_t;
+
+// Followed by `len` bytes of point data, padded to 4 bytes.
+typedef struct {
+  uint16_t len; // ERASED_LEN where nothing was written yet
+  uint8_t channel;
+  uint8_t reserved;
+  uint16_t count;
+  uint16_t crc; // CRC-16 of the header with crc 0 and the data
+  uint32_t first_s;
+  uint32_t last_s;
+} record_header_t;
+
+_Static_assert(sizeof(record_header_t) == 16, "record header is 16 bytes");
+_Static_assert(TSDB_CHUNK_BYTES * 8 <= UINT16_MAX, "chunk bits fit 16 bits");
+
+static uint32_t align4(uint32_t len) { return (len + 3) & ~3u; }
+
+static uint16_t crc16(uint16_t crc, const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)(data[i] << 8);
+    for (int b = 0; b < 8; b++) {
+      crc = crc & 0x8000 ? (uint16_t)((crc << 1) ^ 0x1021) : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static uint16_t record_crc(const record_header_t *header,
+                           const uint8_t *data) {
+  record_header_t copy = *header;
+  copy.crc = 0;
+  uint16_t crc = crc16(0xFFFF, (const uint8_t *)&copy, sizeof(copy));
+  return crc16(crc, data, header->len);
+}
+
+// Bits are written and read MSB first. Chunks start zeroed.
+static void put_bits(uint8_t *buf, uint16_t *pos, uint64_t code,
+                     unsigned len) {
+  while (len > 0) {
+    unsigned free = 8 - (*pos & 7);
+    unsigned n = len < free ? len : free;
+    uint8_t part = (uint8_t)((code >> (len - n)) & ((1u << n) - 1));
+    buf[*pos >> 3] |= (uint8_t)(part << (free - n));
+    *pos += n;
+    len -= n;
+  }
+}
+
+static bool get_bits(tsdb_query_t *q, unsigned len, uint32_t *out) {
+  if (q->pos + len > q->limit) {
+    return false;
+  }
+  uint32_t value = 0;
+  while (len > 0) {
+    unsigned avail = 8 - (q->pos & 7);
+    unsigned n = len < avail ? len : avail;
+    uint8_t byte = q->data[q->pos >> 3];
+    value = (value << n) | ((byte >> (avail - n)) & ((1u << n) - 1));
+    q->pos += n;
+    len -= n;
+  }
+  *out = value;
+  return true;
+}
+
+static uint32_t float_bits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+// Gorilla's buckets: 0 is one bit, then 7, 9 and 12 bit ranges, then all
+// 32 bits.
+static unsigned encode_dod(int32_t dod, uint64_t *code) {
+  if (dod == 0) {
+    *code = 0;
+    return 1;
+  }
+  if (dod >= -63 && dod <= 64) {
+    *code = (0x2ull << 7) | (uint64_t)(dod + 63);
+    return 2 + 7;
+  }
+  if (dod >= -255 && dod <= 256) {
+    *code = (0x6ull << 9) | (uint64_t)(dod + 255);
+    return 3 + 9;
+  }
+  if (dod >= -2047 && dod <= 2048) {
+    *code = (0xEull << 12) | (uint64_t)(dod + 2047);
+    return 4 + 12;
+  }
+  *code = (0xFull << 32) | (uint32_t)dod;
+  return 4 + 32;
+}
+
+// A repeated value is one bit. Otherwise the XOR's meaningful bits follow,
+// reusing the previous window of leading and trailing zeros if they fit
+// into it, else with a new window of 5 bits each for the leading zeros and
+// the length.
+static unsigned encode_value(const tsdb_chunk_t *chunk, uint32_t value,
+                             uint64_t *code, uint8_t *lead, uint8_t *trail) {
+  uint32_t x = value ^ chunk->value;
+  if (x == 0) {
+    *code = 0;
+    return 1;
+  }
+  unsigned l = (unsigned)__builtin_clz(x);
+  unsigned t = (unsigned)__builtin_ctz(x);
+  if (l > 31) {
+    l = 31;
+  }
+  if (chunk->lead != NO_WINDOW && l >= chunk->lead && t >= chunk->trail) {
+    unsigned n = 32 - chunk->lead - chunk->trail;
+    *code = (0x2ull << n) | (x >> chunk->trail);
+    return 2 + n;
+  }
+  unsigned n = 32 - l - t;
+  *lead = (uint8_t)l;
+  *trail = (uint8_t)t;
+  *code = (((0x3ull << 10) | (l << 5) | (n - 1)) << n) | (x >> t);
+  return 2 + 10 + n;
+}
+
+static void chunk_reset(tsdb_chunk_t *chunk) {
+  uint32_t last_s = chunk->last_s;
+  memset(chunk, 0, sizeof(*chunk));
+  chunk->last_s = last_s;
+  chunk->lead = NO_WINDOW;
+}
+
+// Returns false if the point does not fit, the chunk is unchanged then.
+static bool chunk_add(tsdb_chunk_t *chunk, uint32_t time_s, float value) {
+  uint32_t bits = float_bits(value);
+  if (chunk->count == 0) {
+    put_bits(chunk->data, &chunk->bits, bits, 32);
+    chunk->first_s = time_s;
+    chunk->last_s = time_s;
+    chunk->value = bits;
+    chunk->count = 1;
+    return true;
+  }
+
+  uint32_t delta = time_s - chunk->last_s;
+  int64_t dod = (int64_t)delta - chunk->delta_s;
+  if (dod < INT32_MIN || dod > INT32_MAX || chunk->count == UINT16_MAX) {
+    return false;
+  }
+  uint64_t time_code;
+  uint64_t value_code;
+  uint8_t lead = chunk->lead;
+  uint8_t trail = chunk->trail;
+  unsigned time_len = encode_dod((int32_t)dod, &time_code);
+  unsigned value_len = encode_value(chunk, bits, &value_code, &lead, &trail);
+  if (chunk->bits + time_len + value_len > TSDB_CHUNK_BYTES * 8) {
+    return false;
+  }
+  put_bits(chunk->data, &chunk->bits, time_code, time_len);
+  put_bits(chunk->data, &chunk->bits, value_code, value_len);
+  chunk->last_s = time_s;
+  chunk->delta_s = delta;
+  chunk->value = bits;
+  chunk->lead = lead;
+  chunk->trail = trail;
+  chunk->count++;
+  return true;
+}
+
+static uint32_t sector_offset(uint16_t sector) {
+  return (uint32_t)sector * TSDB_SECTOR_BYTES;
+}
+
+static void span_add(tsdb_span_t *span, uint32_t first_s, uint32_t last_s) {
+  if (first_s < span->min_s) {
+    span->min_s = first_s;
+  }
+  if (last_s > span->max_s) {
+    span->max_s = last_s;
+  }
+}
+
+// Reads the record header at offset of a sector. Returns false at the end of
+// the sector's records, i.e. at erased flash or a header that cannot be
+// right. A header cut short leaves erased bytes, so a last_s of all ones is
+// one of those.
+static bool read_record(tsdb_t *db, uint16_t sector, uint32_t offset,
+                        record_header_t *header) {
+  if (offset + sizeof(*header) > TSDB_SECTOR_BYTES ||
+      !db->flash.read(db->flash.ctx, sector_offset(sector) + offset,
+                      header, sizeof(*header))) {
+    return false;
+  }
+  return header->len != ERASED_LEN && header->len > 0 &&
+         header->len <= TSDB_CHUNK_BYTES &&
+         offset + sizeof(*header) + header->len <= TSDB_SECTOR_BYTES &&
+         header->count > 0 && header->first_s <= header->last_s &&
+         header->last_s != UINT32_MAX;
+}
+
+// Indexes the records of a sector and returns the offset after the last
+// one. A sector that ended in a bad header is closed for writing.
+static uint32_t scan_sector(tsdb_t *db, uint16_t sector) {
+  uint32_t offset = sizeof(sector_header_t);
+  record_header_t header = {.len = ERASED_LEN};
+  while (read_record(db, sector, offset, &header)) {
+    span_add(&db->spans[sector], header.first_s, header.last_s);
+    if (header.channel < TELEMETRY_CHANNEL_COUNT &&
+        header.last_s > db->chunks[header.channel].last_s) {
+      db->chunks[header.channel].last_s = header.last_s;
+    }
+    offset += sizeof(header) + align4(header.len);
+  }
+  if (offset + sizeof(header) <= TSDB_SECTOR_BYTES &&
+      header.len != ERASED_LEN) {
+    return TSDB_SECTOR_BYTES;
+  }
+  return offset;
+}
+
+bool tsdb_mount(tsdb_t *db, const tsdb_flash_t *flash) {
+  memset(db, 0, sizeof(*db));
+  db->flash = *flash;
+  uint32_t sectors = flash->size / TSDB_SECTOR_BYTES;
+  if (sectors < 2 || sectors > TSDB_MAX_SECTORS) {
+    return false;
+  }
+  db->sectors = (uint16_t)sectors;
+  for (int i = 0; i < TELEMETRY_CHANNEL_COUNT; i++) {
+    chunk_reset(&db->chunks[i]);
+  }
+
+  // Without a valid sector the first record starts sector 0.
+  db->head = db->sectors - 1;
+  db->write_offset = TSDB_SECTOR_BYTES;
+  for (uint16_t s = 0; s < db->sectors; s++) {
+    db->spans[s] = (tsdb_span_t){UINT32_MAX, 0};
+    sector_header_t header;
+    if (!flash->read(flash->ctx, sector_offset(s), &header,
+                     sizeof(header)) ||
+        header.magic != SECTOR_MAGIC || header.seq == UINT32_MAX) {
+      continue;
+    }
+    uint32_t end = scan_sector(db, s);
+    if (header.seq > db->head_seq) {
+      db->head_seq = header.seq;
+      db->head = s;
+      db->write_offset = end;
+    }
+  }
+  return true;
+}
+
+// Erases the sector after the head, dropping its records, and makes it the
+// head.
+static bool start_sector(tsdb_t *db) {
+  uint16_t next = (uint16_t)((db->head + 1) % db->sectors);
+  uint32_t offset = sector_offset(next);
+  db->spans[next] = (tsdb_span_t){UINT32_MAX, 0};
+  if (!db->flash.erase(db->flash.ctx, offset)) {
+    return false;
+  }
+  db->stats.erases++;
+  sector_header_t header = {SECTOR_MAGIC, db->head_seq + 1};
+  if (!db->flash.write(db->flash.ctx, offset, &header, sizeof(header))) {
+    return false;
+  }
+  db->stats.flash_bytes += sizeof(header);
+  db->head = next;
+  db->head_seq++;
+  db->write_offset = sizeof(header);
+  return true;
+}
+
+static bool flush_chunk(tsdb_t *db, telemetry_channel_t channel) {
+  tsdb_chunk_t *chunk = &db->chunks[channel];
+  if (chunk->count == 0) {
+    return true;
+  }
+  record_header_t header = {
+      .len = (uint16_t)((chunk->bits + 7) / 8),
+      .channel = (uint8_t)channel,
+      .count = chunk->count,
+      .first_s = chunk->first_s,
+      .last_s = chunk->last_s,
+  };
+  header.crc = record_crc(&header, chunk->data);
+  uint32_t size = sizeof(header) + align4(header.len);
+  if (db->write_offset + size > TSDB_SECTOR_BYTES && !start_sector(db)) {
+    return false;
+  }
+
+  // The header goes first: a cut after it leaves a record that fails its
+  // CRC but still says where the next one starts.
+  uint32_t offset = sector_offset(db->head) + db->write_offset;
+  bool ok = db->flash.write(db->flash.ctx, offset, &header, sizeof(header)) &&
+            db->flash.write(db->flash.ctx, offset + sizeof(header),
+                            chunk->data, align4(header.len));
+  if (!ok) {
+    // Whatever made it to flash cannot be overwritten.
+    db->write_offset = TSDB_SECTOR_BYTES;
+    return false;
+  }
+  db->write_offset += size;
+  span_add(&db->spans[db->head], header.first_s, header.last_s);
+  db->stats.records++;
+  db->stats.encoded_bytes += header.len;
+  db->stats.flash_bytes += size;
+  chunk_reset(chunk);
+  return true;
+}
+
+bool tsdb_append(tsdb_t *db, telemetry_channel_t channel, uint32_t time_s,
+                 float value) {
+  if (channel < 0 || channel >= TELEMETRY_CHANNEL_COUNT) {
+    return false;
+  }
+  tsdb_chunk_t *chunk = &db->chunks[channel];
+  if (time_s < chunk->last_s) {
+    db->stats.rejected++;
+    return false;
+  }
+  if (!chunk_add(chunk, time_s, value)) {
+    if (!flush_chunk(db, channel)) {
+      return false;
+    }
+    chunk_add(chunk, time_s, value);
+  }
+  db->stats.points++;
+  return true;
+}
+
+bool tsdb_flush(tsdb_t *db, uint32_t older_than_s) {
+  bool ok = true;
+  for (int i = 0; i < TELEMETRY_CHANNEL_COUNT; i++) {
+    const tsdb_chunk_t *chunk = &db->chunks[i];
+    if (chunk->count > 0 &&
+        (older_than_s == UINT32_MAX || chunk->first_s < older_than_s)) {
+      ok &= flush_chunk(db, (telemetry_channel_t)i);
+    }
+  }
+  return ok;
+}
+
+void tsdb_query_begin(tsdb_t *db, tsdb_query_t *query,
+                      telemetry_channel_t channel, uint32_t from_s,
+                      uint32_t to_s, uint32_t step_s) {
+  memset(query, 0, sizeof(*query));
+  query->db = db;
+  query->channel = channel;
+  query->from_s = from_s;
+  query->to_s = to_s;
+  query->step_s = step_s;
+  query->offset = sizeof(sector_header_t);
+  query->done = channel < 0 || channel >= TELEMETRY_CHANNEL_COUNT ||
+                from_s > to_s;
+}
+
+static void start_decoding(tsdb_query_t *q, uint16_t len, uint16_t count,
+                           uint32_t first_s) {
+  q->pos = 0;
+  q->limit = (uint16_t)(len * 8);
+  q->left = count;
+  q->time_s = first_s;
+  q->delta_s = 0;
+  q->lead = NO_WINDOW;
+  q->records_read++;
+}
+
+// Loads the next record of the channel that overlaps the range, oldest
+// first, and the open chunk after the last one.
+static bool next_record(tsdb_query_t *q) {
+  tsdb_t *db = q->db;
+  while (q->visited < db->sectors) {
+    // The oldest sector follows the head.
+    uint16_t sector = (uint16_t)((db->head + 1 + q->visited) % db->sectors);
+    const tsdb_span_t *span = &db->spans[sector];
+    record_header_t header;
+    if (span->min_s > q->to_s || span->max_s < q->from_s ||
+        !read_record(db, sector, q->offset, &header)) {
+      q->visited++;
+      q->offset = sizeof(sector_header_t);
+      continue;
+    }
+    q->offset += sizeof(header) + align4(header.len);
+    if (header.channel != q->channel || header.last_s < q->from_s) {
+      continue;
+    }
+    if (header.first_s > q->to_s) {
+      // A channel's records are in time order.
+      return false;
+    }
+    if (!db->flash.read(db->flash.ctx,
+                        sector_offset(sector) + q->offset -
+                            align4(header.len),
+                        q->data, header.len) ||
+        record_crc(&header, q->data) != header.crc) {
+      q->corrupt++;
+      continue;
+    }
+    start_decoding(q, header.len, header.count, header.first_s);
+    return true;
+  }
+
+  const tsdb_chunk_t *chunk = &db->chunks[q->channel];
+  if (q->in_ram || chunk->count == 0 || chunk->first_s > q->to_s ||
+      chunk->last_s < q->from_s) {
+    return false;
+  }
+  q->in_ram = true;
+  memcpy(q->data, chunk->data, sizeof(q->data));
+  start_decoding(q, (uint16_t)((chunk->bits + 7) / 8), chunk->count,
+                 chunk->first_s);
+  return true;
+}
+
+static bool decode_point(tsdb_query_t *q) {
+  uint32_t v;
+  q->left--;
+  // The first point's time is in the header, its value is raw.
+  if (q->pos == 0) {
+    return get_bits(q, 32, &q->value);
+  }
+
+  // Delta of delta, prefix 0, 10, 110, 1110 or 1111.
+  static const uint8_t widths[] = {7, 9, 12, 32};
+  unsigned bucket = 0;
+  while (bucket < 4) {
+    if (!get_bits(q, 1, &v)) {
+      return false;
+    }
+    if (v == 0) {
+      break;
+    }
+    bucket++;
+  }
+  int32_t dod = 0;
+  if (bucket > 0) {
+    unsigned width = widths[bucket - 1];
+    if (!get_bits(q, width, &v)) {
+      return false;
+    }
+    dod = width == 32 ? (int32_t)v : (int32_t)v - ((1 << (width - 1)) - 1);
+  }
+  q->delta_s += (uint32_t)dod;
+  q->time_s += q->delta_s;
+
+  if (!get_bits(q, 1, &v)) {
+    return false;
+  }
+  if (v == 0) {
+    return true;
+  }
+  if (!get_bits(q, 1, &v)) {
+    return false;
+  }
+  if (v == 1) {
+    uint32_t lead;
+    uint32_t len;
+    if (!get_bits(q, 5, &lead) || !get_bits(q, 5, &len)) {
+      return false;
+    }
+    q->lead = (uint8_t)lead;
+    q->trail = (uint8_t)(32 - lead - (len + 1));
+  } else if (q->lead == NO_WINDOW) {
+    return false;
+  }
+  unsigned n = 32 - q->lead - q->trail;
+  if (!get_bits(q, n, &v)) {
+    return false;
+  }
+  q->value ^= v << q->trail;
+  return true;
+}
+
+// The next point of the range, undownsampled.
+static bool next_point(tsdb_query_t *q, uint32_t *time_s, float *value) {
+  while (!q->done) {
+    if (q->left == 0 && !next_record(q)) {
+      q->done = true;
+      break;
+    }
+    if (!decode_point(q)) {
+      q->corrupt++;
+      q->left = 0;
+      continue;
+    }
+    if (q->time_s > q->to_s) {
+      q->done = true;
+      break;
+    }
+    if (q->time_s >= q->from_s) {
+      *time_s = q->time_s;
+      memcpy(value, &q->value, sizeof(*value));
+      return true;
+    }
+  }
+  return false;
+}
+
+bool tsdb_query_next(tsdb_query_t *query, uint32_t *time_s, float *value) {
+  if (query->step_s == 0) {
+    return next_point(query, time_s, value);
+  }
+
+  uint32_t t;
+  float v;
+  while (next_point(query, &t, &v)) {
+    uint32_t bucket_s = t - t % query->step_s;
+    if (query->has_bucket && bucket_s != query->bucket_s) {
+      *time_s = query->bucket_s;
+      *value = (float)(query->bucket_sum / query->bucket_count);
+      query->bucket_s = bucket_s;
+      query->bucket_sum = v;
+      query->bucket_count = 1;
+      return true;
+    }
+    if (!query->has_bucket) {
+      query->has_bucket = true;
+      query->bucket_s = bucket_s;
+    }
+    query->bucket_sum += v;
+    query->bucket_count++;
+  }
+  if (query->has_bucket) {
+    query->has_bucket = false;
+    *time_s = query->bucket_s;
+    *value = (float)(query->bucket_sum / query->bucket_count);
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,177 @@
+#include "dlog.h"
+
+#if GROWGRID_DLOG
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <inttypes.h>
+
+static const char *TAG = "DLOG";
+
+typedef struct {
+  const dlog_site_t *site;
+  uint32_t time_ms;
+  uint32_t suppressed; // A summary of the site's last window if not 0
+  uintptr_t args[DLOG_MAX_ARGS];
+} dlog_record_t;
+
+// Filled by any task, emptied by the formatter. Copying a few words under a
+// spinlock is as short as a lock-free ring would make it.
+static dlog_record_t s_ring[DLOG_RING_RECORDS];
+static uint32_t s_head; // Records written, the slot is head % size
+static uint32_t s_tail; // Records formatted
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static dlog_site_t *s_sites;
+static dlog_stats_t s_stats;
+static uint32_t s_dropped_reported;
+static TaskHandle_t s_task;
+
+static const char s_level_letters[] = {
+    [ESP_LOG_NONE] = 'N',  [ESP_LOG_ERROR] = 'E', [ESP_LOG_WARN] = 'W',
+    [ESP_LOG_INFO] = 'I',  [ESP_LOG_DEBUG] = 'D', [ESP_LOG_VERBOSE] = 'V',
+};
+
+// Called with the lock held. Returns whether the ring was empty, i.e. the
+// formatter has to be woken.
+static bool push(const dlog_site_t *site, uint32_t now_ms,
+                 uint32_t suppressed, const uintptr_t *args) {
+  if (s_head - s_tail == DLOG_RING_RECORDS) {
+    s_stats.dropped++;
+    return false;
+  }
+  dlog_record_t *rec = &s_ring[s_head % DLOG_RING_RECORDS];
+  rec->site = site;
+  rec->time_ms = now_ms;
+  rec->suppressed = suppressed;
+  for (int i = 0; i < DLOG_MAX_ARGS; i++) {
+    rec->args[i] = args != NULL ? args[i] : 0;
+  }
+  bool was_empty = s_head == s_tail;
+  s_head++;
+  s_stats.written++;
+  return was_empty;
+}
+
+// Called with the lock held. Starts a new window of the site if the current
+// one is over, queueing the summary of what it suppressed.
+static bool roll_window(dlog_site_t *site, uint32_t now_ms) {
+  if (now_ms - site->window_ms < DLOG_RATE_WINDOW_MS) {
+    return false;
+  }
+  bool wake = false;
+  if (site->suppressed > 0) {
+    wake = push(site, now_ms, site->suppressed, NULL);
+    site->suppressed = 0;
+  }
+  site->window_ms = now_ms;
+  site->burst = 0;
+  return wake;
+}
+
+void dlog_write(dlog_site_t *site, const uintptr_t *args) {
+  uint32_t now_ms = esp_log_timestamp();
+
+  portENTER_CRITICAL(&s_lock);
+  if (!site->listed) {
+    site->listed = true;
+    site->next = s_sites;
+    s_sites = site;
+    site->window_ms = now_ms;
+  }
+  bool wake = roll_window(site, now_ms);
+  if (site->burst >= DLOG_RATE_BURST) {
+    site->suppressed++;
+    s_stats.suppressed++;
+  } else {
+    site->burst++;
+    wake |= push(site, now_ms, 0, args);
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  // Only a record into an empty ring wakes the formatter, it drains the rest.
+  if (wake && s_task != NULL) {
+    xTaskNotifyGive(s_task);
+  }
+}
+
+static void format_record(const dlog_record_t *rec) {
+  const dlog_site_t *site = rec->site;
+  const char *tag = *site->tag;
+  char letter = s_level_letters[site->level];
+  if (rec->suppressed > 0) {
+    esp_log_write((esp_log_level_t)site->level, tag,
+                  "%c (%" PRIu32 ") %s: suppressed %" PRIu32 " x \"%s\"\n",
+                  letter, rec->time_ms, tag, rec->suppressed, site->fmt);
+    return;
+  }
+  char line[DLOG_LINE_BYTES];
+  // Unused arguments are passed too, printf ignores them.
+  snprintf(line, sizeof(line), site->fmt, rec->args[0], rec->args[1],
+           rec->args[2], rec->args[3]);
+  esp_log_write((esp_log_level_t)site->level, tag,
+                "%c (%" PRIu32 ") %s: %s\n", letter, rec->time_ms, tag, line);
+}
+
+static void drain(void) {
+  for (;;) {
+    dlog_record_t rec;
+    portENTER_CRITICAL(&s_lock);
+    bool empty = s_head == s_tail;
+    if (!empty) {
+      rec = s_ring[s_tail % DLOG_RING_RECORDS];
+      s_tail++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (empty) {
+      return;
+    }
+    format_record(&rec);
+  }
+}
+
+// Sites that went quiet while suppressing never roll their window
+// themselves.
+static void roll_quiet_sites(void) {
+  uint32_t now_ms = esp_log_timestamp();
+  portENTER_CRITICAL(&s_lock);
+  dlog_site_t *site = s_sites;
+  portEXIT_CRITICAL(&s_lock);
+  // Sites are only ever added at the head, the rest of the list is stable.
+  for (; site != NULL; site = site->next) {
+    portENTER_CRITICAL(&s_lock);
+    if (site->suppressed > 0) {
+      roll_window(site, now_ms);
+    }
+    portEXIT_CRITICAL(&s_lock);
+  }
+}
+
+static void report_dropped(void) {
+  portENTER_CRITICAL(&s_lock);
+  uint32_t dropped = s_stats.dropped - s_dropped_reported;
+  s_dropped_reported = s_stats.dropped;
+  portEXIT_CRITICAL(&s_lock);
+  if (dropped > 0) {
+    ESP_LOGW(TAG, "Ring full, %" PRIu32 " records dropped", dropped);
+  }
+}
+
+void dlog_task(void *arg) {
+  s_task = xTaskGetCurrentTaskHandle();
+  while (1) {
+    drain();
+    roll_quiet_sites();
+    drain();
+    report_dropped();
+    // The timeout ends the windows of sites that went quiet.
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DLOG_RATE_WINDOW_MS));
+  }
+}
+
+void dlog_get_stats(dlog_stats_t *stats) {
+  portENTER_CRITICAL(&s_lock);
+  *stats = s_stats;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+#endif
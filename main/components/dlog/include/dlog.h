@@ -0,0 +1,132 @@
+#pragma once
+#include "esp_log.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Deferred logging for hot paths.
+ *
+ * A DLOG_* call site owns a static descriptor with its level, tag and format
+ * string. Logging copies a pointer to the descriptor and the raw arguments
+ * into a ring, which a low-priority task formats and writes to the console
+ * later, stamped with the time of the call. The caller never runs printf and
+ * needs no stack for it.
+ *
+ * Every call site is rate limited on its own: after DLOG_RATE_BURST records
+ * in a DLOG_RATE_WINDOW_MS window further calls are only counted, and the
+ * formatter prints one "suppressed N" summary per call site when the window
+ * is over. Records that find the ring full are counted and reported by the
+ * formatter as well.
+ *
+ * Arguments are stored as uintptr_t, so only integers, pointers and strings
+ * that outlive the call (literals, topics built at init, esp_err_to_name())
+ * may be passed, at most DLOG_MAX_ARGS of them. Floats and 64-bit integers
+ * are not supported. Call sites must run in a task, not in an ISR.
+ *
+ * Deferring is switched per component with the GROWGRID_DLOG_COMPONENTS
+ * CMake list, e.g. idf.py -DGROWGRID_DLOG_COMPONENTS="platform" build. In
+ * the other components, and without the list, the macros are plain
+ * ESP_LOG* calls without rate limiting.
+ */
+
+#ifndef GROWGRID_DLOG
+#define GROWGRID_DLOG 0
+#endif
+// Set for the components in GROWGRID_DLOG_COMPONENTS only.
+#ifndef GROWGRID_DLOG_DEFER
+#define GROWGRID_DLOG_DEFER 0
+#endif
+
+#define DLOG_MAX_ARGS 4
+// Records in the ring, a power of two.
+#define DLOG_RING_RECORDS 64
+#define DLOG_RATE_BURST 5
+#define DLOG_RATE_WINDOW_MS 10000
+// Longer messages are cut.
+#define DLOG_LINE_BYTES 160
+
+typedef struct dlog_site {
+  const char *fmt;
+  const char *const *tag; // The caller's TAG, which is not a constant
+  uint8_t level;          // esp_log_level_t
+  // Rate limit state, guarded by the ring lock.
+  bool listed;
+  uint8_t burst;
+  uint32_t window_ms;
+  uint32_t suppressed;
+  struct dlog_site *next; // Sites seen so far, for the summaries
+} dlog_site_t;
+
+#if GROWGRID_DLOG && GROWGRID_DLOG_DEFER
+
+#define DLOG_CAT_(a, b) a##b
+#define DLOG_CAT(a, b) DLOG_CAT_(a, b)
+#define DLOG_NARGS_(...) DLOG_NARGS_N_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_N_(_0, _1, _2, _3, _4, n, ...) n
+#define DLOG_ARG_(x) ((uintptr_t)(x))
+#define DLOG_ARGS_0_()
+#define DLOG_ARGS_1_(a) DLOG_ARG_(a)
+#define DLOG_ARGS_2_(a, b) DLOG_ARG_(a), DLOG_ARG_(b)
+#define DLOG_ARGS_3_(a, b, c) DLOG_ARG_(a), DLOG_ARG_(b), DLOG_ARG_(c)
+#define DLOG_ARGS_4_(a, b, c, d)                                               \
+  DLOG_ARG_(a), DLOG_ARG_(b), DLOG_ARG_(c), DLOG_ARG_(d)
+
+// The unevaluated printf keeps the compiler's format checks. Levels above
+// LOG_LOCAL_LEVEL compile to nothing as with ESP_LOG*, the runtime level of
+// the tag is applied by the formatter.
+#define DLOG_AT_(lvl, tag_, fmt_, ...)                                         \
+  do {                                                                         \
+    if ((lvl) <= LOG_LOCAL_LEVEL) {                                            \
+      static dlog_site_t dlog_site_ = {                                        \
+          .fmt = (fmt_), .tag = &(tag_), .level = (lvl)};                      \
+      const uintptr_t dlog_args_[DLOG_MAX_ARGS] = {DLOG_CAT(                   \
+          DLOG_ARGS_, DLOG_CAT(DLOG_NARGS_(__VA_ARGS__), _))(__VA_ARGS__)};    \
+      (void)sizeof(printf(fmt_, ##__VA_ARGS__));                               \
+      dlog_write(&dlog_site_, dlog_args_);                                     \
+    }                                                                          \
+  } while (0)
+
+#define DLOG_E(tag, fmt, ...) DLOG_AT_(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define DLOG_W(tag, fmt, ...) DLOG_AT_(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define DLOG_I(tag, fmt, ...) DLOG_AT_(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define DLOG_D(tag, fmt, ...) DLOG_AT_(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+
+#else
+
+#define DLOG_E(tag, fmt, ...) ESP_LOGE(tag, fmt, ##__VA_ARGS__)
+#define DLOG_W(tag, fmt, ...) ESP_LOGW(tag, fmt, ##__VA_ARGS__)
+#define DLOG_I(tag, fmt, ...) ESP_LOGI(tag, fmt, ##__VA_ARGS__)
+#define DLOG_D(tag, fmt, ...) ESP_LOGD(tag, fmt, ##__VA_ARGS__)
+
+#endif
+
+#if GROWGRID_DLOG
+
+typedef struct {
+  uint32_t written;    // Records put into the ring
+  uint32_t suppressed; // Calls dropped by the rate limit
+  uint32_t dropped;    // Records lost to a full ring
+} dlog_stats_t;
+
+/**
+ * @brief Rate limits and queues one record, used by the DLOG_* macros.
+ *
+ * @param args DLOG_MAX_ARGS arguments, unused ones are 0.
+ */
+void dlog_write(dlog_site_t *site, const uintptr_t *args);
+
+/**
+ * @brief Formats the queued records, never returns.
+ *
+ * Created by the application at a low priority. Records queued before it
+ * runs wait in the ring.
+ */
+void dlog_task(void *arg);
+
+/**
+ * @brief Returns the counters since boot.
+ */
+void dlog_get_stats(dlog_stats_t *stats);
+
+#endif
@@ -74,6 +74,16 @@ esp_err_t soil_sensor_read_percent(soil_sensor_handle_t sensor, int *percent);
  */
 void soil_sensor_set_calibration(soil_sensor_handle_t sensor, int dry, int wet);
 
+/**
+ * @brief Get the calibration values of the sensor
+ *
+ * param[in] sensor handle
+ * param[out] dry (maximum) value
+ * param[out] wet (minimum) value
+ */
+void soil_sensor_get_calibration(soil_sensor_handle_t sensor, int *dry,
+                                 int *wet);
+
 /**
  * @brief   delete soil handle_t
  *
@@ -2,14 +2,47 @@
 #include "board.h"
 #include "esp_err.h"
 #include "esp_log.h"
-#include "map_value.h"
+#include "soil_moisture.h"
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 static const char *TAG = "SOIL";
 
+#if GROWGRID_STATIC_ALLOC
+// Static allocation build: devices come from a fixed pool, see mem_layout.h.
+#define SOIL_SENSOR_MAX_DEVICES 1
+static soil_sensor_dev_t s_devices[SOIL_SENSOR_MAX_DEVICES];
+static bool s_device_used[SOIL_SENSOR_MAX_DEVICES];
+
+static soil_sensor_dev_t *device_alloc(void) {
+  for (int i = 0; i < SOIL_SENSOR_MAX_DEVICES; i++) {
+    if (!s_device_used[i]) {
+      s_device_used[i] = true;
+      memset(&s_devices[i], 0, sizeof(s_devices[i]));
+      return &s_devices[i];
+    }
+  }
+  return NULL;
+}
+
+static void device_free(soil_sensor_dev_t *sens) {
+  s_device_used[sens - s_devices] = false;
+}
+#else
+static soil_sensor_dev_t *device_alloc(void) {
+  return (soil_sensor_dev_t *)calloc(1, sizeof(soil_sensor_dev_t));
+}
+
+static void device_free(soil_sensor_dev_t *sens) { free(sens); }
+#endif
+
 soil_sensor_handle_t soil_sensor_create(soil_sensor_config_t const config) {
-  soil_sensor_dev_t *sens =
-      (soil_sensor_dev_t *)calloc(1, sizeof(soil_sensor_dev_t));
+  soil_sensor_dev_t *sens = device_alloc();
+  if (sens == NULL) {
+    ESP_LOGE(TAG, "No memory for soil sensor");
+    return NULL;
+  }
 
   sens->config = config;
   sens->min = 0;
@@ -78,10 +111,7 @@ esp_err_t soil_sensor_read_percent(soil_sensor_handle_t sensor, int *percent) {
     ESP_LOGE(TAG, "Error reading raw value");
     return err;
   }
-  *percent = map_value(raw, sens->min, sens->max, 100, 0);
-  if (*percent > 100) {
-    *percent = 100;
-  }
+  *percent = soil_moisture_percent(raw, sens->min, sens->max);
 
   return ESP_OK;
 }
@@ -93,12 +123,19 @@ void soil_sensor_set_calibration(soil_sensor_handle_t sensor, int dry,
   sens->min = wet;
 }
 
+void soil_sensor_get_calibration(soil_sensor_handle_t sensor, int *dry,
+                                 int *wet) {
+  soil_sensor_dev_t *sens = (soil_sensor_dev_t *)sensor;
+  *dry = sens->max;
+  *wet = sens->min;
+}
+
 esp_err_t soil_sensor_delete(soil_sensor_handle_t *sensor) {
   if (*sensor == NULL) {
     return ESP_OK;
   }
   soil_sensor_dev_t *sens = (soil_sensor_dev_t *)(*sensor);
-  free(sens);
+  device_free(sens);
   *sensor = NULL;
   return ESP_OK;
 }
@@ -11,24 +11,41 @@ static bmp280_t s_bmp280_dev;
 static tsl2561_t s_tsl2561_dev;
 static soil_sensor_handle_t s_soil_sensor_handle;
 
+static bmp280_params_t s_bmp280_params = {
+    .mode = BMP280_MODE_NORMAL,
+    .filter = BMP280_FILTER_OFF,
+    .oversampling_pressure = BMP280_SKIPPED,
+    .oversampling_temperature = BMP280_STANDARD,
+    .oversampling_humidity = BMP280_STANDARD,
+    .standby = BMP280_STANDBY_250};
+
+// Soft-resets the device and writes its configuration.
+static esp_err_t configure_temp_humidity(void) {
+  return bmp280_init(&s_bmp280_dev, &s_bmp280_params);
+}
+
+static esp_err_t configure_light(void) {
+  esp_err_t err =
+      tsl2561_set_integration_time(&s_tsl2561_dev, TSL2561_INTEGRATION_402MS);
+  if (err != ESP_OK) {
+    return err;
+  }
+  return tsl2561_init(&s_tsl2561_dev);
+}
+
+// The ADC has no device state that could get lost.
+static esp_err_t configure_soil_moisture(void) { return ESP_OK; }
+
 esp_err_t hal_sensors_init(void) {
   // Init BME280
-  bmp280_params_t params = {.mode = BMP280_MODE_NORMAL,
-                            .filter = BMP280_FILTER_OFF,
-                            .oversampling_pressure = BMP280_SKIPPED,
-                            .oversampling_temperature = BMP280_STANDARD,
-                            .oversampling_humidity = BMP280_STANDARD,
-                            .standby = BMP280_STANDBY_250};
   ESP_ERROR_CHECK(bmp280_init_desc(&s_bmp280_dev, BMP280_I2C_ADDRESS_0,
                                    I2C_PORT, I2C_SDA_PIN, I2C_SCL_PIN));
-  ESP_ERROR_CHECK(bmp280_init(&s_bmp280_dev, &params));
+  ESP_ERROR_CHECK(configure_temp_humidity());
 
   // Init TSL2561
   ESP_ERROR_CHECK(tsl2561_init_desc(&s_tsl2561_dev, TSL2561_I2C_ADDR_FLOAT,
                                     I2C_PORT, I2C_SDA_PIN, I2C_SCL_PIN));
-  ESP_ERROR_CHECK(
-      tsl2561_set_integration_time(&s_tsl2561_dev, TSL2561_INTEGRATION_402MS));
-  ESP_ERROR_CHECK(tsl2561_init(&s_tsl2561_dev));
+  ESP_ERROR_CHECK(configure_light());
 
   // Init Soil Sensor
   soil_sensor_config_t soil_cfg = {.adc_pin = SOIL_ADC_CHANNEL,
@@ -62,3 +79,68 @@ esp_err_t hal_sensors_read_light(light_data_t *data) {
 esp_err_t hal_sensors_read_soil_moisture(soil_moisture_data_t *data) {
   return soil_sensor_read_percent(s_soil_sensor_handle, &data->percent);
 }
+
+// Takes the whole payload, so all reads fit one dispatch table.
+#define SENSOR_READ_(ID, name, type, ...)                                      \
+  static esp_err_t read_##name(sensor_data_payload_t *payload) {               \
+    return hal_sensors_read_##name(&payload->name);                            \
+  }
+SENSOR_REGISTRY(SENSOR_READ_)
+#undef SENSOR_READ_
+
+typedef struct {
+  esp_err_t (*read)(sensor_data_payload_t *payload);
+  esp_err_t (*configure)(void);
+} sensor_driver_t;
+
+static const sensor_driver_t s_drivers[SENSOR_DATA_TYPE_COUNT] = {
+#define SENSOR_DRIVER_(ID, name, ...)                                          \
+  [SENSOR_DATA_TYPE_##ID] = {read_##name, configure_##name},
+    SENSOR_REGISTRY(SENSOR_DRIVER_)
+#undef SENSOR_DRIVER_
+};
+
+esp_err_t hal_sensors_read(sensor_data_type_t sensor,
+                           sensor_data_payload_t *payload) {
+  if (sensor < 0 || sensor >= SENSOR_DATA_TYPE_COUNT) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  return s_drivers[sensor].read(payload);
+}
+
+esp_err_t hal_sensors_reinit(sensor_data_type_t sensor) {
+  if (sensor < 0 || sensor >= SENSOR_DATA_TYPE_COUNT) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  return s_drivers[sensor].configure();
+}
+
+esp_err_t hal_sensors_calibrate_soil(calibration_point_t point, int *dry,
+                                     int *wet) {
+  int raw;
+  esp_err_t err = soil_sensor_read_raw(s_soil_sensor_handle, &raw);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  soil_sensor_get_calibration(s_soil_sensor_handle, dry, wet);
+  if (point == CALIBRATION_POINT_DRY) {
+    *dry = raw;
+  } else {
+    *wet = raw;
+  }
+  if (*dry <= *wet) {
+    ESP_LOGE(TAG, "Rejected soil calibration dry=%d wet=%d", *dry, *wet);
+    return ESP_ERR_INVALID_STATE;
+  }
+  return hal_sensors_set_soil_calibration(*dry, *wet);
+}
+
+esp_err_t hal_sensors_set_soil_calibration(int dry, int wet) {
+  if (dry <= wet) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  soil_sensor_set_calibration(s_soil_sensor_handle, dry, wet);
+  ESP_LOGI(TAG, "Soil calibration set to dry=%d wet=%d", dry, wet);
+  return ESP_OK;
+}
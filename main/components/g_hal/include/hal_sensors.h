@@ -1,4 +1,5 @@
 #pragma once
+#include "command.h"
 #include "esp_err.h"
 #include "growgrid_types.h"
 
@@ -8,6 +9,26 @@
  */
 esp_err_t hal_sensors_init(void);
 
+/**
+ * @brief Re-initializes a sensor after it stopped responding.
+ *
+ * Resets and reconfigures the device. The I2C bus itself is shared with
+ * the other sensors and left alone.
+ *
+ * @param sensor The sensor to re-initialize.
+ * @return ESP_OK on success, the bus error otherwise.
+ */
+esp_err_t hal_sensors_reinit(sensor_data_type_t sensor);
+
+/**
+ * @brief Reads any sensor of the registry into its payload member.
+ * @param sensor The sensor to read.
+ * @param[out] payload Sample payload, only the sensor's member is written.
+ * @return ESP_OK on success.
+ */
+esp_err_t hal_sensors_read(sensor_data_type_t sensor,
+                           sensor_data_payload_t *payload);
+
 /**
  * @brief Reads temperature and humidity.
  * @param[out] data Pointer to a struct to store the data.
@@ -28,3 +49,28 @@ esp_err_t hal_sensors_read_light(light_data_t *data);
  * @return ESP_OK on success.
  */
 esp_err_t hal_sensors_read_soil_moisture(soil_moisture_data_t *data);
+
+/**
+ * @brief Calibrates the soil sensor at the current reading.
+ *
+ * The probe has to sit in completely dry (or saturated) soil. The raw
+ * reading becomes the new 0% (or 100%) point.
+ *
+ * @param point Which end of the range to set.
+ * @param[out] dry The raw reading of 0% after the calibration.
+ * @param[out] wet The raw reading of 100% after the calibration.
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if the result would be an
+ *         empty range.
+ */
+esp_err_t hal_sensors_calibrate_soil(calibration_point_t point, int *dry,
+                                     int *wet);
+
+/**
+ * @brief Sets the soil calibration, e.g. one stored by an earlier
+ * hal_sensors_calibrate_soil.
+ *
+ * @param dry The raw reading of 0%.
+ * @param wet The raw reading of 100%.
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for an empty range.
+ */
+esp_err_t hal_sensors_set_soil_calibration(int dry, int wet);
@@ -1,6 +1,11 @@
 #include "event_bus.h"
+#include "app_config.h"
+#include "dlog.h"
 #include "esp_log.h"
+#include "event_recorder.h"
 #include "freertos/semphr.h"
+#include "mem_layout.h"
+#include "trace.h"
 #include <string.h>
 
 /**
@@ -8,30 +13,37 @@
  * https://docs.espressif.com/projects/esp-idf/en/stable/esp32/api-reference/system/esp_event.html
  */
 
-#define MAX_SUBSCRIBERS 10
-#define EVENT_BUS_QUEUE_SIZE 32
-
 static const char *TAG = "EVENT_BUS";
 
-static QueueHandle_t s_subscriber_queues[MAX_SUBSCRIBERS];
+static QueueHandle_t s_subscriber_queues[EVENT_BUS_MAX_SUBSCRIBERS];
 static SemaphoreHandle_t s_subscriber_list_mutex;
 static QueueHandle_t s_event_bus_queue;
+#if GROWGRID_STATIC_ALLOC
+static StaticSemaphore_t s_subscriber_list_mutex_buffer;
+#endif
 
 static void event_distributor_task(void *arg) {
   event_t event;
   while (1) {
     if (xQueueReceive(s_event_bus_queue, &event, portMAX_DELAY) == pdTRUE) {
+      TRACE_BEGIN(EVENT_DISTRIBUTE, event.trace_span, event.type);
+#if GROWGRID_EVENT_RECORD
+      event_recorder_add(&event);
+#endif
+      int delivered = 0;
       if (xSemaphoreTake(s_subscriber_list_mutex, portMAX_DELAY) == pdTRUE) {
-        for (int i = 0; i < MAX_SUBSCRIBERS; i++) {
+        for (int i = 0; i < EVENT_BUS_MAX_SUBSCRIBERS; i++) {
           if (s_subscriber_queues[i] != NULL) {
             if (xQueueSend(s_subscriber_queues[i], &event, 0) != pdTRUE) {
-              ESP_LOGW(TAG,
-                       "Subscriber queue full, event dropped for a subscriber");
+              DLOG_W(TAG, "Subscriber queue %d full, event dropped", i);
+            } else {
+              delivered++;
             }
           }
         }
         xSemaphoreGive(s_subscriber_list_mutex);
       }
+      TRACE_END(EVENT_DISTRIBUTE, event.trace_span, delivered);
     }
   }
 }
@@ -39,13 +51,18 @@ static void event_distributor_task(void *arg) {
 esp_err_t event_bus_init(void) {
   memset(s_subscriber_queues, 0, sizeof(s_subscriber_queues));
 
+#if GROWGRID_STATIC_ALLOC
+  s_subscriber_list_mutex =
+      xSemaphoreCreateMutexStatic(&s_subscriber_list_mutex_buffer);
+#else
   s_subscriber_list_mutex = xSemaphoreCreateMutex();
+#endif
   if (s_subscriber_list_mutex == NULL) {
     ESP_LOGE(TAG, "Failed to create subscriber list mutex");
     return ESP_FAIL;
   }
 
-  s_event_bus_queue = xQueueCreate(EVENT_BUS_QUEUE_SIZE, sizeof(event_t));
+  s_event_bus_queue = mem_queue_create(MEM_QUEUE_EVENT_BUS, 0);
   if (s_event_bus_queue == NULL) {
     ESP_LOGE(TAG, "Failed to create event bus queue");
     vSemaphoreDelete(s_subscriber_list_mutex);
@@ -57,8 +74,9 @@ esp_err_t event_bus_init(void) {
 }
 
 esp_err_t event_bus_start_distributor(void) {
-  if (xTaskCreate(event_distributor_task, "event_distributor", 4096, NULL, 10,
-                  NULL) != pdPASS) {
+  if (mem_task_create(MEM_TASK_EVENT_DISTRIBUTOR, 0, event_distributor_task,
+                      "event_distributor", NULL, TASK_PRIO_EVENT_DISTRIBUTOR,
+                      NULL) != pdPASS) {
     ESP_LOGE(TAG, "Failed to create event distributor task");
     return ESP_FAIL;
   }
@@ -67,11 +85,14 @@ esp_err_t event_bus_start_distributor(void) {
 }
 
 esp_err_t event_bus_post(const event_t *event, uint32_t timeout_ms) {
+  TRACE_BEGIN(EVENT_POST, event->trace_span, event->type);
   if (xQueueSend(s_event_bus_queue, event, pdMS_TO_TICKS(timeout_ms)) !=
       pdTRUE) {
-    ESP_LOGW(TAG, "Event bus queue full, event dropped");
+    TRACE_END(EVENT_POST, event->trace_span, ESP_ERR_TIMEOUT);
+    DLOG_W(TAG, "Event bus queue full, event dropped");
     return ESP_ERR_TIMEOUT;
   }
+  TRACE_END(EVENT_POST, event->trace_span, ESP_OK);
   return ESP_OK;
 }
 
@@ -79,9 +100,9 @@ QueueHandle_t event_bus_subscribe(void) {
   QueueHandle_t new_queue = NULL;
 
   if (xSemaphoreTake(s_subscriber_list_mutex, portMAX_DELAY) == pdTRUE) {
-    for (int i = 0; i < MAX_SUBSCRIBERS; i++) {
+    for (int i = 0; i < EVENT_BUS_MAX_SUBSCRIBERS; i++) {
       if (s_subscriber_queues[i] == NULL) {
-        new_queue = xQueueCreate(EVENT_BUS_QUEUE_SIZE, sizeof(event_t));
+        new_queue = mem_queue_create(MEM_QUEUE_EVENT_SUBSCRIBER, i);
         if (new_queue == NULL) {
           ESP_LOGE(TAG, "Failed to create subscriber queue");
           break;
@@ -102,7 +123,7 @@ QueueHandle_t event_bus_subscribe(void) {
 
 void event_bus_unsubscribe(QueueHandle_t queue) {
   if (xSemaphoreTake(s_subscriber_list_mutex, portMAX_DELAY) == pdTRUE) {
-    for (int i = 0; i < MAX_SUBSCRIBERS; i++) {
+    for (int i = 0; i < EVENT_BUS_MAX_SUBSCRIBERS; i++) {
       if (s_subscriber_queues[i] == queue) {
         vQueueDelete(s_subscriber_queues[i]);
         s_subscriber_queues[i] = NULL;
@@ -0,0 +1,366 @@
+#include "event_log.h"
+#include <string.h>
+
+// Payload of a sensor sample: u8 type, zigzag varint timestamp delta, values.
+#define SENSOR_PAYLOAD_MAX_BYTES (1 + 10 + 8)
+
+_Static_assert(sizeof(command_t) <= UINT8_MAX &&
+                   sizeof(command_ack_t) <= UINT8_MAX,
+               "Command structs must fit the u8 payload length");
+
+static size_t put_varint(uint8_t *out, uint64_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+  return n;
+}
+
+static bool get_varint(const uint8_t *data, size_t len, size_t *pos,
+                       uint64_t *value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && *pos < len; shift += 7) {
+    uint8_t byte = data[(*pos)++];
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static void put_u16(uint8_t *out, uint16_t value) {
+  out[0] = (uint8_t)value;
+  out[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t *out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+static void put_u64(uint8_t *out, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    out[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+static uint32_t get_u32(const uint8_t *in) {
+  return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 |
+         (uint32_t)in[3] << 24;
+}
+
+static uint64_t get_u64(const uint8_t *in) {
+  return (uint64_t)get_u32(in) | (uint64_t)get_u32(in + 4) << 32;
+}
+
+static void put_f32(uint8_t *out, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  put_u32(out, bits);
+}
+
+static float get_f32(const uint8_t *in) {
+  uint32_t bits = get_u32(in);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+void event_log_writer_begin(event_log_writer_t *writer, uint8_t *buf,
+                            size_t size, uint32_t seq, uint64_t base_us) {
+  *writer = (event_log_writer_t){
+      .buf = buf,
+      .size = size,
+      .len = EVENT_LOG_CHUNK_HEADER_BYTES,
+      .last_us = base_us,
+  };
+  memcpy(buf, EVENT_LOG_MAGIC, 4);
+  buf[4] = EVENT_LOG_VERSION;
+  buf[5] = 0;
+  put_u16(buf + 6, 0);
+  put_u32(buf + 8, seq);
+  put_u64(buf + 12, base_us);
+}
+
+// Values of each sensor's samples, at most the 8 bytes that
+// SENSOR_PAYLOAD_MAX_BYTES leaves for them.
+static size_t encode_temp_humidity(const sensor_data_payload_t *p,
+                                   uint8_t *out) {
+  put_f32(out, p->temp_humidity.temperature);
+  put_f32(out + 4, p->temp_humidity.humidity);
+  return 8;
+}
+
+static size_t encode_light(const sensor_data_payload_t *p, uint8_t *out) {
+  return put_varint(out, p->light.lux);
+}
+
+static size_t encode_soil_moisture(const sensor_data_payload_t *p,
+                                   uint8_t *out) {
+  return put_varint(out, zigzag(p->soil_moisture.percent));
+}
+
+// The values must fill the record exactly.
+static bool decode_temp_humidity(const uint8_t *p, size_t len, size_t pos,
+                                 sensor_data_payload_t *out) {
+  if (len - pos != 8) {
+    return false;
+  }
+  out->temp_humidity.temperature = get_f32(p + pos);
+  out->temp_humidity.humidity = get_f32(p + pos + 4);
+  return true;
+}
+
+static bool decode_light(const uint8_t *p, size_t len, size_t pos,
+                         sensor_data_payload_t *out) {
+  uint64_t value;
+  if (!get_varint(p, len, &pos, &value)) {
+    return false;
+  }
+  out->light.lux = (uint32_t)value;
+  return pos == len;
+}
+
+static bool decode_soil_moisture(const uint8_t *p, size_t len, size_t pos,
+                                 sensor_data_payload_t *out) {
+  uint64_t value;
+  if (!get_varint(p, len, &pos, &value)) {
+    return false;
+  }
+  out->soil_moisture.percent = (int)unzigzag(value);
+  return pos == len;
+}
+
+typedef struct {
+  size_t (*encode)(const sensor_data_payload_t *p, uint8_t *out);
+  bool (*decode)(const uint8_t *p, size_t len, size_t pos,
+                 sensor_data_payload_t *out);
+} sensor_codec_t;
+
+static const sensor_codec_t s_codecs[SENSOR_DATA_TYPE_COUNT] = {
+#define SENSOR_CODEC_(ID, name, ...)                                           \
+  [SENSOR_DATA_TYPE_##ID] = {encode_##name, decode_##name},
+    SENSOR_REGISTRY(SENSOR_CODEC_)
+#undef SENSOR_CODEC_
+};
+
+static size_t encode_sensor_data(event_log_writer_t *writer,
+                                 const sensor_data_t *data, uint8_t *out) {
+  size_t n = 0;
+  out[n++] = (uint8_t)data->type;
+  n += put_varint(out + n, zigzag((int64_t)(data->timestamp_us -
+                                            writer->last_sample_us)));
+  writer->last_sample_us = data->timestamp_us;
+  if (data->type >= 0 && data->type < SENSOR_DATA_TYPE_COUNT) {
+    n += s_codecs[data->type].encode(&data->payload, out + n);
+  }
+  return n;
+}
+
+bool event_log_writer_add(event_log_writer_t *writer, const event_t *event,
+                          uint64_t time_us) {
+  if (writer->size - writer->len < EVENT_LOG_RECORD_MAX_BYTES ||
+      writer->count == UINT16_MAX) {
+    return false;
+  }
+  uint8_t *out = writer->buf + writer->len;
+  size_t n = put_varint(out, time_us - writer->last_us);
+  out[n++] = (uint8_t)event->type;
+  uint8_t *payload = out + n + 1;
+  size_t payload_len = 0;
+
+  switch (event->type) {
+  case EVENT_TYPE_SENSOR_DATA:
+    payload_len = encode_sensor_data(writer, &event->data.sensor_data, payload);
+    break;
+  case EVENT_TYPE_PUMP_STATE_CHANGE:
+    payload[0] = event->data.pump_state.is_on;
+    payload_len = 1;
+    break;
+  case EVENT_TYPE_COMMAND:
+    payload_len = sizeof(command_t);
+    memcpy(payload, &event->data.command, payload_len);
+    break;
+  case EVENT_TYPE_COMMAND_ACK:
+    payload_len = sizeof(command_ack_t);
+    memcpy(payload, &event->data.command_ack, payload_len);
+    break;
+  case EVENT_TYPE_SENSOR_HEALTH:
+    payload[0] = (uint8_t)event->data.sensor_health.sensor;
+    payload[1] = (uint8_t)event->data.sensor_health.state;
+    payload[2] = (uint8_t)event->data.sensor_health.fault;
+    payload_len = 3;
+    break;
+  case EVENT_TYPE_CONFIG_CHANGED:
+    payload[0] = (uint8_t)event->data.config_changed.key;
+    payload[1] = event->data.config_changed.index;
+    payload_len = 2;
+    break;
+  default:
+    break;
+  }
+  out[n] = (uint8_t)payload_len;
+
+  writer->len += n + 1 + payload_len;
+  writer->count++;
+  writer->last_us = time_us;
+  return true;
+}
+
+size_t event_log_writer_finish(event_log_writer_t *writer) {
+  put_u16(writer->buf + 6, writer->count);
+  return writer->len;
+}
+
+void event_log_reader_init(event_log_reader_t *reader, const uint8_t *data,
+                           size_t len) {
+  *reader = (event_log_reader_t){.data = data, .len = len};
+}
+
+static esp_err_t read_chunk_header(event_log_reader_t *r) {
+  const uint8_t *h = r->data + r->pos;
+  if (r->len - r->pos < EVENT_LOG_CHUNK_HEADER_BYTES ||
+      memcmp(h, EVENT_LOG_MAGIC, 4) != 0) {
+    return ESP_ERR_INVALID_RESPONSE;
+  }
+  if (h[4] != EVENT_LOG_VERSION) {
+    return ESP_ERR_INVALID_VERSION;
+  }
+  uint16_t count = (uint16_t)(h[6] | h[7] << 8);
+  uint32_t seq = get_u32(h + 8);
+  uint64_t base_us = get_u64(h + 12);
+  r->pos += EVENT_LOG_CHUNK_HEADER_BYTES;
+
+  if (r->started && (seq == 0 || base_us + r->offset_us < r->last_us)) {
+    // The device rebooted, its clock started over.
+    r->offset_us = r->last_us - base_us;
+  } else if (r->started && seq > r->next_seq) {
+    r->lost_chunks += seq - r->next_seq;
+  }
+  r->started = true;
+  r->next_seq = seq + 1;
+  r->chunks++;
+  r->chunk_records = count;
+  r->chunk_us = base_us;
+  r->last_sample_us = 0;
+  return ESP_OK;
+}
+
+static bool decode_sensor_data(event_log_reader_t *r, const uint8_t *p,
+                               size_t len, sensor_data_t *data) {
+  size_t pos = 1;
+  uint64_t delta;
+  if (len < 1 || !get_varint(p, len, &pos, &delta)) {
+    return false;
+  }
+  data->type = (sensor_data_type_t)p[0];
+  data->timestamp_us = r->last_sample_us + (uint64_t)unzigzag(delta);
+  r->last_sample_us = data->timestamp_us;
+
+  if (data->type < 0 || data->type >= SENSOR_DATA_TYPE_COUNT) {
+    return false;
+  }
+  return s_codecs[data->type].decode(p, len, pos, &data->payload);
+}
+
+esp_err_t event_log_reader_next(event_log_reader_t *r, event_t *event,
+                                uint64_t *time_us) {
+  for (;;) {
+    while (r->chunk_records == 0) {
+      if (r->pos == r->len) {
+        return ESP_ERR_NOT_FOUND;
+      }
+      esp_err_t err = read_chunk_header(r);
+      if (err != ESP_OK) {
+        return err;
+      }
+    }
+
+    uint64_t delta;
+    if (!get_varint(r->data, r->len, &r->pos, &delta) ||
+        r->len - r->pos < 2) {
+      return ESP_ERR_INVALID_RESPONSE;
+    }
+    uint8_t type = r->data[r->pos];
+    size_t payload_len = r->data[r->pos + 1];
+    const uint8_t *payload = r->data + r->pos + 2;
+    if (r->len - r->pos - 2 < payload_len) {
+      return ESP_ERR_INVALID_RESPONSE;
+    }
+    r->pos += 2 + payload_len;
+    r->chunk_records--;
+    r->chunk_us += delta;
+    r->last_us = r->chunk_us + r->offset_us;
+
+    memset(event, 0, sizeof(*event));
+    event->type = (event_type_t)type;
+    bool ok;
+    switch (type) {
+    case EVENT_TYPE_SENSOR_DATA:
+      // The record length is known, so a sample of an unknown sensor type
+      // or size is skipped like any other record.
+      ok = decode_sensor_data(r, payload, payload_len,
+                              &event->data.sensor_data);
+      break;
+    case EVENT_TYPE_WIFI_CONNECTED:
+    case EVENT_TYPE_WIFI_DISCONNECTED:
+    case EVENT_TYPE_MQTT_CONNECTED:
+      ok = true;
+      break;
+    case EVENT_TYPE_PUMP_STATE_CHANGE:
+      ok = payload_len == 1;
+      if (ok) {
+        event->data.pump_state.is_on = payload[0] != 0;
+      }
+      break;
+    case EVENT_TYPE_COMMAND:
+      ok = payload_len == sizeof(command_t);
+      if (ok) {
+        memcpy(&event->data.command, payload, payload_len);
+      }
+      break;
+    case EVENT_TYPE_COMMAND_ACK:
+      ok = payload_len == sizeof(command_ack_t);
+      if (ok) {
+        memcpy(&event->data.command_ack, payload, payload_len);
+      }
+      break;
+    case EVENT_TYPE_SENSOR_HEALTH:
+      ok = payload_len == 3;
+      if (ok) {
+        event->data.sensor_health.sensor = (sensor_data_type_t)payload[0];
+        event->data.sensor_health.state = (sensor_health_state_t)payload[1];
+        event->data.sensor_health.fault = (sensor_fault_t)payload[2];
+      }
+      break;
+    case EVENT_TYPE_CONFIG_CHANGED:
+      ok = payload_len == 2;
+      if (ok) {
+        event->data.config_changed.key = (config_key_t)payload[0];
+        event->data.config_changed.index = payload[1];
+      }
+      break;
+    default:
+      ok = false;
+      break;
+    }
+    if (ok) {
+      *time_us = r->last_us;
+      return ESP_OK;
+    }
+    r->skipped++;
+  }
+}
@@ -0,0 +1,82 @@
+#include "event_recorder.h"
+#include "app_config.h"
+
+#if GROWGRID_EVENT_RECORD
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "event_log.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "EVENT_RECORDER";
+
+static uint8_t s_chunk[EVENT_RECORD_CHUNK_BYTES];
+static event_log_writer_t s_writer;
+static event_recorder_sink_t s_sink;
+static SemaphoreHandle_t s_lock;
+static uint32_t s_seq;
+static int64_t s_chunk_start_us;
+#if GROWGRID_STATIC_ALLOC
+static StaticSemaphore_t s_lock_buffer;
+#endif
+
+// Caller holds s_lock.
+static void emit_chunk(void) {
+  if (s_writer.count > 0) {
+    s_sink(s_chunk, event_log_writer_finish(&s_writer));
+    s_seq++;
+  }
+  s_writer.count = 0;
+}
+
+esp_err_t event_recorder_start(event_recorder_sink_t sink) {
+#if GROWGRID_STATIC_ALLOC
+  s_lock = xSemaphoreCreateMutexStatic(&s_lock_buffer);
+#else
+  s_lock = xSemaphoreCreateMutex();
+#endif
+  if (s_lock == NULL) {
+    ESP_LOGE(TAG, "Failed to create recorder lock");
+    return ESP_FAIL;
+  }
+  s_sink = sink;
+  ESP_LOGI(TAG, "Recording events in %d byte chunks",
+           EVENT_RECORD_CHUNK_BYTES);
+  return ESP_OK;
+}
+
+void event_recorder_add(const event_t *event) {
+  if (s_sink == NULL) {
+    return;
+  }
+  int64_t now = esp_timer_get_time();
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  if (s_writer.count > 0 &&
+      now - s_chunk_start_us >= (int64_t)EVENT_RECORD_FLUSH_MS * 1000) {
+    emit_chunk();
+  }
+  if (s_writer.count == 0) {
+    event_log_writer_begin(&s_writer, s_chunk, sizeof(s_chunk), s_seq,
+                           (uint64_t)now);
+    s_chunk_start_us = now;
+  }
+  if (!event_log_writer_add(&s_writer, event, (uint64_t)now)) {
+    emit_chunk();
+    event_log_writer_begin(&s_writer, s_chunk, sizeof(s_chunk), s_seq,
+                           (uint64_t)now);
+    s_chunk_start_us = now;
+    event_log_writer_add(&s_writer, event, (uint64_t)now);
+  }
+  xSemaphoreGive(s_lock);
+}
+
+void event_recorder_flush(void) {
+  if (s_sink == NULL) {
+    return;
+  }
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  emit_chunk();
+  xSemaphoreGive(s_lock);
+}
+
+#endif
@@ -1,9 +1,12 @@
 #pragma once
 
+#include "command.h"
+#include "config_store.h"
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "growgrid_types.h"
+#include "sensor_health.h"
 
 /**
  * All of this will soon change to the official esp event loop library
@@ -16,17 +19,39 @@ typedef enum {
   EVENT_TYPE_WIFI_DISCONNECTED,
   EVENT_TYPE_MQTT_CONNECTED,
   EVENT_TYPE_PUMP_STATE_CHANGE,
+  EVENT_TYPE_COMMAND,
+  EVENT_TYPE_COMMAND_ACK,
+  EVENT_TYPE_SENSOR_HEALTH,
+  EVENT_TYPE_CONFIG_CHANGED,
 } event_type_t;
 
 typedef struct {
   bool is_on;
 } pump_state_event_data_t;
 
+// Posted when a sensor changes state or fault, see sensor_health.h.
+typedef struct {
+  sensor_data_type_t sensor;
+  sensor_health_state_t state;
+  sensor_fault_t fault;
+} sensor_health_event_data_t;
+
+// Posted after a setting changed, the value is in config_store_get().
+typedef struct {
+  config_key_t key;
+  uint8_t index;
+} config_changed_event_data_t;
+
 typedef struct {
   event_type_t type;
+  uint16_t trace_span; // See trace.h, 0 when not traced
   union {
     sensor_data_t sensor_data;
     pump_state_event_data_t pump_state;
+    command_t command;
+    command_ack_t command_ack;
+    sensor_health_event_data_t sensor_health;
+    config_changed_event_data_t config_changed;
   } data;
 } event_t;
 
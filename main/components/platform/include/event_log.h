@@ -0,0 +1,106 @@
+#pragma once
+#include "esp_err.h"
+#include "event_bus.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Compact binary recording of the events crossing the bus.
+ *
+ * A recording is a sequence of self-contained chunks, so chunks published
+ * one by one can simply be concatenated into a file on the host. All fields
+ * are little endian:
+ *
+ *   chunk   "GGEV", u8 version, u8 reserved, u16 record count, u32 sequence,
+ *           u64 base time (µs since boot)
+ *   record  varint time delta (µs), u8 event type, u8 payload length,
+ *           payload
+ *
+ * Record times are deltas to the previous record, the first to the chunk
+ * base. Sensor samples store their own timestamp as a zigzag varint delta to
+ * the previous sample of the chunk, followed by the values (light samples
+ * without their DLI, it is derived from the lux values). Sensor health
+ * changes are three bytes: sensor, state and fault, setting changes two: key
+ * and index. Commands and acks store the struct as is, a reader whose struct
+ * size differs skips them. Unknown event and sensor types are skipped as
+ * well, so newer recordings still replay on older firmware.
+ */
+
+#define EVENT_LOG_MAGIC "GGEV"
+#define EVENT_LOG_VERSION 1
+#define EVENT_LOG_CHUNK_HEADER_BYTES 20
+
+// Upper bound of one encoded record.
+#define EVENT_LOG_RECORD_MAX_BYTES (10 + 2 + sizeof(command_t))
+
+typedef struct {
+  uint8_t *buf;
+  size_t size;
+  size_t len;
+  uint16_t count;
+  uint64_t last_us;
+  uint64_t last_sample_us;
+} event_log_writer_t;
+
+typedef struct {
+  const uint8_t *data;
+  size_t len;
+  size_t pos;
+  uint16_t chunk_records; // Left to read in the current chunk
+  uint64_t chunk_us; // Time of the previous record, recording clock
+  uint64_t last_sample_us;
+  uint64_t offset_us; // Keeps the timeline monotonic across reboots
+  uint64_t last_us;
+  bool started;
+  uint32_t next_seq;
+  uint32_t chunks;
+  uint32_t lost_chunks; // Sequence gaps, e.g. chunks dropped by the outbox
+  uint32_t skipped;     // Records of unknown types or sizes
+} event_log_reader_t;
+
+/**
+ * @brief Starts a new chunk in @p buf.
+ *
+ * @param seq Chunk sequence number, consecutive per boot.
+ * @param base_us Time of the chunk start, normally of its first record.
+ */
+void event_log_writer_begin(event_log_writer_t *writer, uint8_t *buf,
+                            size_t size, uint32_t seq, uint64_t base_us);
+
+/**
+ * @brief Appends an event.
+ *
+ * @param time_us When the event crossed the bus, at or after the previous
+ *        record.
+ * @return false if the chunk is full, the record is not added then.
+ */
+bool event_log_writer_add(event_log_writer_t *writer, const event_t *event,
+                          uint64_t time_us);
+
+/**
+ * @brief Completes the chunk header.
+ *
+ * @return The chunk length in bytes.
+ */
+size_t event_log_writer_finish(event_log_writer_t *writer);
+
+/**
+ * @brief Starts reading a recording of one or more chunks.
+ */
+void event_log_reader_init(event_log_reader_t *reader, const uint8_t *data,
+                           size_t len);
+
+/**
+ * @brief Decodes the next event.
+ *
+ * @param[out] event The event, with trace_span cleared.
+ * @param[out] time_us Position on the recording's timeline. It is monotonic:
+ *             a chunk from a later boot continues where the previous one
+ *             ended.
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND at the end of the recording,
+ *         ESP_ERR_INVALID_VERSION for chunks of an unknown version,
+ *         ESP_ERR_INVALID_RESPONSE if the data is corrupt.
+ */
+esp_err_t event_log_reader_next(event_log_reader_t *reader, event_t *event,
+                                uint64_t *time_us);
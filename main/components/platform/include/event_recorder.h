@@ -0,0 +1,37 @@
+#pragma once
+#include "esp_err.h"
+#include "event_bus.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Records every event the distributor hands out into event_log chunks.
+ *
+ * Only built with idf.py -DGROWGRID_EVENT_RECORD=ON. A chunk is handed to
+ * the sink once it is full or its first record is EVENT_RECORD_FLUSH_MS old.
+ * The app publishes the chunks on the device's events topic, replay/ feeds
+ * them back into the bus on the linux target.
+ */
+
+/**
+ * @brief Receives a finished chunk. Runs on the distributor task, so it must
+ * only copy the chunk (e.g. enqueue a publish) and return.
+ */
+typedef void (*event_recorder_sink_t)(const uint8_t *chunk, size_t len);
+
+/**
+ * @brief Starts recording.
+ *
+ * @return ESP_OK on success, ESP_FAIL if the lock could not be created.
+ */
+esp_err_t event_recorder_start(event_recorder_sink_t sink);
+
+/**
+ * @brief Records an event, called by the distributor.
+ */
+void event_recorder_add(const event_t *event);
+
+/**
+ * @brief Hands the current chunk to the sink, e.g. before a reboot.
+ */
+void event_recorder_flush(void);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "esp_err.h"
+#include "telemetry.h"
+
+#define MQTT_TOPIC_MAX_LEN 128
+
+/**
+ * Per-device topic layout, built once at init so the publish path never
+ * formats topic strings:
+ *
+ *   growgrid/<site>/<device>/telemetry/<channel>   JSON telemetry
+ *   growgrid/<site>/<device>/summary/<channel>     JSON window summaries
+ *   growgrid/<site>/<device>/lp                    line protocol telemetry
+ *   growgrid/<site>/<device>/state/pump            pump state
+ *   growgrid/<site>/<device>/state/wifi            reconnect metrics
+ *   growgrid/<site>/<device>/state/power           low-power mode counters
+ *   growgrid/<site>/<device>/state/sensors         sensor health changes
+ *   growgrid/<site>/<device>/diag                  health, line protocol
+ *   growgrid/<site>/<device>/alarm                 threshold alerts
+ *   growgrid/<site>/<device>/trace                 binary trace dumps
+ *   growgrid/<site>/<device>/events                binary event recording
+ *   growgrid/<site>/<device>/history               history query replies
+ *   growgrid/<site>/<device>/cmd/<command>         downlink commands
+ *   growgrid/<site>/<device>/ack                   command acknowledgements
+ *
+ * Subscribers shard by site with growgrid/<site>/# and ingest all devices
+ * with growgrid/+/+/telemetry/+ or growgrid/+/+/lp.
+ */
+typedef struct {
+  char client_id[64];
+  char prefix[MQTT_TOPIC_MAX_LEN];
+  char telemetry[TELEMETRY_CHANNEL_COUNT][MQTT_TOPIC_MAX_LEN];
+  char summary[TELEMETRY_CHANNEL_COUNT][MQTT_TOPIC_MAX_LEN];
+  char line_protocol[MQTT_TOPIC_MAX_LEN];
+  char pump_state[MQTT_TOPIC_MAX_LEN];
+  char wifi_state[MQTT_TOPIC_MAX_LEN];
+  char power_state[MQTT_TOPIC_MAX_LEN];
+  char sensor_state[MQTT_TOPIC_MAX_LEN];
+  char diag[MQTT_TOPIC_MAX_LEN];
+  char alarm[MQTT_TOPIC_MAX_LEN];
+  char trace[MQTT_TOPIC_MAX_LEN];
+  char events[MQTT_TOPIC_MAX_LEN];
+  char history[MQTT_TOPIC_MAX_LEN];
+  char command_filter[MQTT_TOPIC_MAX_LEN]; // "<prefix>/cmd/+"
+  char command_prefix[MQTT_TOPIC_MAX_LEN]; // "<prefix>/cmd/"
+  size_t command_prefix_len;
+  char command_ack[MQTT_TOPIC_MAX_LEN];
+  char lp_tags[80]; // "site=<site>,device=<device>"
+} mqtt_topics_t;
+
+/**
+ * @brief Builds all topics for this device.
+ *
+ * Characters other than [A-Za-z0-9_.-] are replaced by '_' so the names are
+ * safe as topic levels and as unescaped line protocol tag values.
+ *
+ * @param site Site (greenhouse) name.
+ * @param device Device name, unique within the site.
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if a name is empty,
+ *         ESP_ERR_INVALID_SIZE if a topic does not fit.
+ */
+esp_err_t mqtt_topics_init(const char *site, const char *device);
+
+/**
+ * @brief Returns the topics built by mqtt_topics_init.
+ */
+const mqtt_topics_t *mqtt_topics_get(void);
@@ -0,0 +1,36 @@
+#pragma once
+#include "esp_err.h"
+
+/**
+ * Local HTTP API in station mode, for reading the device on site without
+ * the broker.
+ *
+ * Only built with idf.py -DGROWGRID_HTTP_API=ON. Serves
+ *
+ * - `GET /api/state`: the latest value of every channel, the pump, the
+ *   sensor health and the stream counters as one JSON object, from state
+ *   cached in the server.
+ * - `GET /api/events`: a Server-Sent Events stream. It starts with the
+ *   state as a `state` event, then sends a `telemetry` event per sample,
+ *   `pump` and `sensor` events on changes and a comment every
+ *   HTTP_API_KEEPALIVE_MS. Every event carries an `id`, a gap in the ids
+ *   means events were skipped.
+ *
+ * A task subscribed to the event bus updates the cache with every event,
+ * serializes it once into one of HTTP_API_FRAMES frames and hands that to
+ * the server task, which writes the same bytes to every stream. The cache
+ * is copied under a short lock, the clients belong to the server task.
+ * Writes never wait: a client whose socket buffer cannot take a whole frame
+ * is disconnected. With all frames still queued the event's frame is
+ * skipped, the cache still takes it. Streams beyond HTTP_API_MAX_CLIENTS
+ * are refused with 503.
+ */
+
+/**
+ * @brief Starts the HTTP server and the task feeding it.
+ *
+ * @return ESP_OK on success, ESP_FAIL if the server or the task could not
+ * be started.
+ */
+esp_err_t platform_http_start(void);
+
@@ -1,12 +1,40 @@
 #pragma once
 
 #include "esp_err.h"
+#include "telemetry.h"
+#include "telemetry_window.h"
 #include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Topic classes decide QoS and overflow behaviour of a publish.
+ *
+ * Telemetry is high-rate and loss-tolerant (QoS 0, shed first when the outbox
+ * is filling up). State and alarms are low-rate and must arrive (QoS 1).
+ */
+typedef enum {
+  MQTT_TOPIC_CLASS_TELEMETRY,
+  MQTT_TOPIC_CLASS_STATE,
+  MQTT_TOPIC_CLASS_ALARM,
+  MQTT_TOPIC_CLASS_BACKLOG, // Buffered telemetry, QoS 1 so it can be retired
+} mqtt_topic_class_t;
+
+typedef struct {
+  uint32_t enqueued;          // Messages accepted into the outbox
+  uint32_t dropped;           // Messages rejected by the overflow policy
+  uint32_t expired;           // QoS > 0 messages deleted or evicted unacked
+  uint32_t in_flight;         // QoS > 0 messages still waiting for a PUBACK
+  int outbox_bytes;           // Current esp-mqtt outbox size
+  uint32_t puback_rtt_last_ms; // Enqueue to PUBACK of the last acked message
+  uint32_t puback_rtt_avg_ms;  // Moving average (1/8 weight) of the above
+  uint32_t puback_rtt_max_ms;  // Worst round-trip seen since boot
+} platform_mqtt_stats_t;
 
 /**
  * @brief Initializes and starts the MQTT client and the publisher task.
  *
  * The publisher task subscribes to the event bus and publishes sensor data.
+ * mqtt_topics_init must have been called before.
  *
  * @return ESP_OK on success, ESP_FAIL on failure.
  */
@@ -18,3 +46,90 @@ esp_err_t platform_mqtt_init(const char *broker_uri, const char *username, const
  * @return true if connected, false otherwise.
  */
 bool platform_mqtt_is_connected(void);
+
+/**
+ * @brief Enqueues a message without blocking on the network.
+ *
+ * The message is copied into the esp-mqtt outbox and sent by the MQTT task.
+ * Telemetry is dropped while disconnected or once the outbox passes
+ * MQTT_TELEMETRY_HIGH_WATER_BYTES, which keeps the remaining headroom up to
+ * MQTT_OUTBOX_LIMIT_BYTES free for state and alarm messages.
+ *
+ * @param topic Must outlive the call, e.g. a topic from mqtt_topics_get().
+ *        A failed enqueue hands it to the deferred logger (dlog.h), which
+ *        prints it later from its own task.
+ * @return ESP_OK if enqueued, ESP_ERR_NO_MEM if dropped by the overflow
+ *         policy, ESP_ERR_INVALID_STATE if the client is not running.
+ */
+esp_err_t platform_mqtt_publish(mqtt_topic_class_t topic_class,
+                                const char *topic, const char *payload,
+                                int len);
+
+/**
+ * @brief Copies the current publish pipeline counters.
+ *
+ * @param[out] stats Pointer to a struct to store the counters.
+ * @return ESP_OK on success.
+ */
+esp_err_t platform_mqtt_get_stats(platform_mqtt_stats_t *stats);
+
+/**
+ * @brief Selects how sensor data is serialized.
+ *
+ * TELEMETRY_FORMAT_JSON publishes one `{"value","timestamp_us"}` message per
+ * channel on the per-channel telemetry topics. TELEMETRY_FORMAT_LINE_PROTOCOL
+ * publishes ready-to-write InfluxDB lines on the device's lp topic.
+ */
+void platform_mqtt_set_format(telemetry_format_t format);
+
+/**
+ * @brief Switches between raw samples and windowed summaries.
+ *
+ * In TELEMETRY_MODE_SUMMARY each channel is reduced to one
+ * count/min/max/mean/stddev summary per tumbling window, published on the
+ * channel's summary topic (JSON) or as a line with those fields (line
+ * protocol). Switching discards the windows in progress. Called with the
+ * stored settings at init and whenever they change, see config_store.h.
+ *
+ * @param mode The new mode.
+ * @param window_ms Window length, only used in summary mode.
+ */
+void platform_mqtt_set_telemetry_mode(telemetry_mode_t mode,
+                                      uint32_t window_ms);
+
+/**
+ * @brief Publishes buffered points in as few messages as possible.
+ *
+ * Line protocol packs up to MQTT_BATCH_PAYLOAD_BYTES of lines per message,
+ * JSON sends one message per point. Messages go out at QoS 1 and the call
+ * waits whenever the outbox passes MQTT_TELEMETRY_HIGH_WATER_BYTES, so a large
+ * backlog never starves state messages. Points stamped before the clock was
+ * set are skipped.
+ *
+ * @param timeout_ms Upper bound for waiting on the outbox.
+ * @return ESP_OK if everything was enqueued, ESP_ERR_TIMEOUT if the outbox
+ *         did not drain in time, ESP_ERR_INVALID_STATE if not running.
+ */
+esp_err_t platform_mqtt_publish_batch(const telemetry_point_t *points,
+                                      int count, uint32_t timeout_ms);
+
+/**
+ * @brief Publishes one message of a bulk transfer at QoS 1.
+ *
+ * Waits like platform_mqtt_publish_batch while the outbox is past
+ * MQTT_TELEMETRY_HIGH_WATER_BYTES, so long replies are paced by the broker.
+ *
+ * @param topic Must outlive the call, as with platform_mqtt_publish.
+ * @param timeout_ms Upper bound for waiting on the outbox.
+ * @return ESP_OK if enqueued, ESP_ERR_TIMEOUT if the outbox did not drain in
+ *         time, ESP_ERR_INVALID_STATE if not running.
+ */
+esp_err_t platform_mqtt_publish_backlog(const char *topic, const char *payload,
+                                        int len, uint32_t timeout_ms);
+
+/**
+ * @brief Waits until the outbox is empty, i.e. every QoS 1 message was acked.
+ *
+ * @return ESP_OK once empty, ESP_ERR_TIMEOUT otherwise.
+ */
+esp_err_t platform_mqtt_flush(uint32_t timeout_ms);
@@ -1,8 +1,14 @@
 #pragma once
+#include "esp_err.h"
+#include <stdint.h>
 
 /**
  * @brief Initializes SNTP and waits for time synchronization.
- * 
- * This function is blocking and will not return until the time is set.
+ *
+ * SNTP keeps polling the server in the background after a timeout.
+ *
+ * @param server NTP server name.
+ * @param timeout_ms Time to wait for the first sync.
+ * @return ESP_OK once the time is set, ESP_ERR_TIMEOUT otherwise.
  */
-void platform_sntp_init(const char *server);
+esp_err_t platform_sntp_init(const char *server, uint32_t timeout_ms);
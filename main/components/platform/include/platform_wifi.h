@@ -1,12 +1,50 @@
 #pragma once
 #include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+  uint32_t last_connect_ms; // Start or disconnect until the last IP
+  uint32_t last_attempts;   // Connect attempts needed for that
+  bool last_fast_path;      // Whether the cached association was used
+  uint32_t connects;        // Successful connects since boot
+} platform_wifi_stats_t;
 
 /**
  * @brief Initializes and starts the WiFi station.
  *
- * Connects to the AP configured in secrets.h. This is a blocking call.
+ * If NVS holds the BSSID and channel of the last good connect, a directed
+ * connect is tried first, skipping the scan. DHCP starts with a request for
+ * the last address (CONFIG_LWIP_DHCP_RESTORE_LAST_IP), a single exchange
+ * instead of discovering a server. If the directed connect fails the station
+ * falls back to a full scan, then keeps retrying with exponential backoff
+ * and jitter, without giving up.
+ * This is a blocking call that returns once the station has an IP.
  * It will post events to the event bus on connection/disconnection.
  *
  * @return ESP_OK on success, ESP_FAIL on failure.
  */
 esp_err_t platform_wifi_init_sta(const char *ssid, const char *pass);
+
+/**
+ * @brief Starts the WiFi station like platform_wifi_init_sta, without waiting.
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t platform_wifi_start_sta(const char *ssid, const char *pass);
+
+/**
+ * @brief Waits until the station has an IP.
+ *
+ * @param timeout_ms Time to wait, UINT32_MAX waits forever.
+ * @return ESP_OK once connected, ESP_ERR_TIMEOUT otherwise.
+ */
+esp_err_t platform_wifi_wait_connected(uint32_t timeout_ms);
+
+/**
+ * @brief Copies the reconnect metrics of the last connect.
+ *
+ * @param[out] stats Pointer to a struct to store the metrics.
+ * @return ESP_OK on success.
+ */
+esp_err_t platform_wifi_get_stats(platform_wifi_stats_t *stats);
@@ -0,0 +1,87 @@
+#include "mqtt_topics.h"
+#include "esp_log.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "MQTT_TOPICS";
+static mqtt_topics_t s_topics;
+
+static void sanitize(char *dest, size_t size, const char *src) {
+  size_t i = 0;
+  for (; src[i] != '\0' && i < size - 1; i++) {
+    char c = src[i];
+    bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.';
+    dest[i] = ok ? c : '_';
+  }
+  dest[i] = '\0';
+}
+
+static bool build(char *dest, size_t size, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(dest, size, fmt, args);
+  va_end(args);
+  return len > 0 && (size_t)len < size;
+}
+
+esp_err_t mqtt_topics_init(const char *site, const char *device) {
+  if (site == NULL || device == NULL || site[0] == '\0' ||
+      device[0] == '\0') {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  char safe_site[32];
+  char safe_device[32];
+  sanitize(safe_site, sizeof(safe_site), site);
+  sanitize(safe_device, sizeof(safe_device), device);
+
+  mqtt_topics_t *t = &s_topics;
+  bool ok = build(t->client_id, sizeof(t->client_id), "%s-%s", safe_site,
+                  safe_device) &&
+            build(t->prefix, sizeof(t->prefix), "growgrid/%s/%s", safe_site,
+                  safe_device) &&
+            build(t->line_protocol, sizeof(t->line_protocol), "%s/lp",
+                  t->prefix) &&
+            build(t->pump_state, sizeof(t->pump_state), "%s/state/pump",
+                  t->prefix) &&
+            build(t->wifi_state, sizeof(t->wifi_state), "%s/state/wifi",
+                  t->prefix) &&
+            build(t->power_state, sizeof(t->power_state), "%s/state/power",
+                  t->prefix) &&
+            build(t->sensor_state, sizeof(t->sensor_state),
+                  "%s/state/sensors", t->prefix) &&
+            build(t->diag, sizeof(t->diag), "%s/diag", t->prefix) &&
+            build(t->alarm, sizeof(t->alarm), "%s/alarm", t->prefix) &&
+            build(t->trace, sizeof(t->trace), "%s/trace", t->prefix) &&
+            build(t->events, sizeof(t->events), "%s/events", t->prefix) &&
+            build(t->history, sizeof(t->history), "%s/history",
+                  t->prefix) &&
+            build(t->command_filter, sizeof(t->command_filter), "%s/cmd/+",
+                  t->prefix) &&
+            build(t->command_prefix, sizeof(t->command_prefix), "%s/cmd/",
+                  t->prefix) &&
+            build(t->command_ack, sizeof(t->command_ack), "%s/ack",
+                  t->prefix) &&
+            build(t->lp_tags, sizeof(t->lp_tags), "site=%s,device=%s",
+                  safe_site, safe_device);
+  for (int i = 0; ok && i < TELEMETRY_CHANNEL_COUNT; i++) {
+    ok = build(t->telemetry[i], sizeof(t->telemetry[i]), "%s/telemetry/%s",
+               t->prefix, telemetry_channel_name(i)) &&
+         build(t->summary[i], sizeof(t->summary[i]), "%s/summary/%s",
+               t->prefix, telemetry_channel_name(i));
+  }
+
+  t->command_prefix_len = strlen(t->command_prefix);
+
+  if (!ok) {
+    ESP_LOGE(TAG, "Topic for site '%s' device '%s' too long", site, device);
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  ESP_LOGI(TAG, "Topic prefix: %s", t->prefix);
+  return ESP_OK;
+}
+
+const mqtt_topics_t *mqtt_topics_get(void) { return &s_topics; }
@@ -0,0 +1,381 @@
+#include "platform_http.h"
+#include "app_config.h"
+
+#if GROWGRID_HTTP_API
+
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "event_bus.h"
+#include "mem_layout.h"
+#include "platform_mqtt.h"
+#include "telemetry.h"
+#include "trace.h"
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+static const char *TAG = "PLATFORM_HTTP";
+
+typedef enum {
+  CLIENT_FREE,
+  CLIENT_OPEN,
+  CLIENT_CLOSING, // Free once the server has closed the session
+} client_state_t;
+
+typedef struct {
+  client_state_t state;
+  int fd;
+} client_t;
+
+// An event serialized for the streams. The feeder task fills a frame that
+// is not queued and queues it, the server task clears `queued` once the
+// frame is sent.
+typedef struct {
+  bool queued;
+  int len;
+  char text[HTTP_API_FRAME_BYTES];
+} frame_t;
+
+typedef struct {
+  float value;
+  uint64_t timestamp_us; // 0 before the first point
+} latest_t;
+
+typedef struct {
+  latest_t latest[TELEMETRY_CHANNEL_COUNT];
+  bool pump_known;
+  bool pump_on;
+  sensor_health_event_data_t health[SENSOR_DATA_TYPE_COUNT];
+} state_t;
+
+static httpd_handle_t s_server;
+static frame_t s_frames[HTTP_API_FRAMES];
+static uint32_t s_skipped; // Written by the feeder, read by the server task
+// Written by the feeder for every streamed event, also when its frame is
+// skipped, and copied by the server task.
+static state_t s_cache;
+static portMUX_TYPE s_cache_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Only used by the server task.
+static client_t s_clients[HTTP_API_MAX_CLIENTS];
+static uint32_t s_events;
+static uint32_t s_dropped;
+static uint32_t s_refused;
+static char s_state[HTTP_API_STATE_BYTES];
+
+static const char s_stream_head[] = "HTTP/1.1 200 OK\r\n"
+                                    "Content-Type: text/event-stream\r\n"
+                                    "Cache-Control: no-cache\r\n"
+                                    "Access-Control-Allow-Origin: *\r\n"
+                                    "\r\n"
+                                    "retry: 5000\n\n";
+static const char s_keepalive[] = ":\n\n";
+
+// Appends to buf at *len, which turns -1 once the text did not fit.
+static void appendf(char *buf, size_t size, int *len, const char *fmt, ...) {
+  if (*len < 0) {
+    return;
+  }
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buf + *len, size - *len, fmt, args);
+  va_end(args);
+  *len = (n < 0 || (size_t)n >= size - *len) ? -1 : *len + n;
+}
+
+static int count_clients(void) {
+  int count = 0;
+  for (int i = 0; i < HTTP_API_MAX_CLIENTS; i++) {
+    count += s_clients[i].state == CLIENT_OPEN;
+  }
+  return count;
+}
+
+static void format_state(char *buf, size_t size, int *len) {
+  state_t state;
+  portENTER_CRITICAL(&s_cache_lock);
+  state = s_cache;
+  portEXIT_CRITICAL(&s_cache_lock);
+
+  appendf(buf, size, len, "{\"uptime_ms\":%" PRId64 ",\"mqtt\":%s,\"pump\":",
+          esp_timer_get_time() / 1000,
+          platform_mqtt_is_connected() ? "true" : "false");
+  if (state.pump_known) {
+    appendf(buf, size, len, "{\"is_on\":%s}",
+            state.pump_on ? "true" : "false");
+  } else {
+    appendf(buf, size, len, "null");
+  }
+
+  appendf(buf, size, len, ",\"channels\":{");
+  const char *sep = "";
+  for (int i = 0; i < TELEMETRY_CHANNEL_COUNT; i++) {
+    if (state.latest[i].timestamp_us == 0) {
+      continue;
+    }
+    appendf(buf, size, len,
+            "%s\"%s\":{\"value\":%.6g,\"timestamp_us\":%" PRIu64 "}", sep,
+            telemetry_channel_name(i), state.latest[i].value,
+            state.latest[i].timestamp_us);
+    sep = ",";
+  }
+
+  appendf(buf, size, len, "},\"sensors\":{");
+  for (int i = 0; i < SENSOR_DATA_TYPE_COUNT; i++) {
+    appendf(buf, size, len, "%s\"%s\":{\"state\":\"%s\",\"fault\":\"%s\"}",
+            i == 0 ? "" : ",", sensor_name(i),
+            sensor_health_state_name(state.health[i].state),
+            sensor_fault_name(state.health[i].fault));
+  }
+
+  appendf(buf, size, len,
+          "},\"streams\":{\"clients\":%d,\"events\":%" PRIu32
+          ",\"skipped\":%" PRIu32 ",\"dropped\":%" PRIu32
+          ",\"refused\":%" PRIu32 "}}",
+          count_clients(), s_events,
+          __atomic_load_n(&s_skipped, __ATOMIC_RELAXED), s_dropped,
+          s_refused);
+}
+
+// Writes without waiting. A partial write would corrupt the stream, so a
+// client that cannot take the whole frame is disconnected.
+static void send_to_clients(const char *text, int len) {
+  for (int i = 0; i < HTTP_API_MAX_CLIENTS; i++) {
+    client_t *client = &s_clients[i];
+    if (client->state != CLIENT_OPEN) {
+      continue;
+    }
+    if (httpd_socket_send(s_server, client->fd, text, len, MSG_DONTWAIT) !=
+        len) {
+      ESP_LOGW(TAG, "Dropping stream on socket %d", client->fd);
+      client->state = CLIENT_CLOSING;
+      s_dropped++;
+      httpd_sess_trigger_close(s_server, client->fd);
+    }
+  }
+}
+
+// Runs on the server task. A NULL frame sends the keepalive.
+static void send_frame(void *arg) {
+  frame_t *frame = arg;
+  if (frame == NULL) {
+    send_to_clients(s_keepalive, sizeof(s_keepalive) - 1);
+    return;
+  }
+  send_to_clients(frame->text, frame->len);
+  s_events++;
+  __atomic_store_n(&frame->queued, false, __ATOMIC_RELEASE);
+}
+
+static void client_closed(void *ctx) {
+  client_t *client = ctx;
+  client->state = CLIENT_FREE;
+  client->fd = -1;
+}
+
+static esp_err_t state_get_handler(httpd_req_t *req) {
+  int len = 0;
+  format_state(s_state, sizeof(s_state), &len);
+  if (len < 0) {
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR,
+                        "State too long");
+    return ESP_FAIL;
+  }
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  return httpd_resp_send(req, s_state, len);
+}
+
+// Answers with a raw head without a length, the stream is the rest of the
+// connection. The session keeps the client slot until it is closed.
+static esp_err_t events_get_handler(httpd_req_t *req) {
+  client_t *client = NULL;
+  for (int i = 0; i < HTTP_API_MAX_CLIENTS && client == NULL; i++) {
+    if (s_clients[i].state == CLIENT_FREE) {
+      client = &s_clients[i];
+    }
+  }
+  if (client == NULL) {
+    s_refused++;
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "10");
+    return httpd_resp_send(req, "Too many streams", HTTPD_RESP_USE_STRLEN);
+  }
+
+  int len = 0;
+  appendf(s_state, sizeof(s_state), &len, "event: state\ndata: ");
+  format_state(s_state, sizeof(s_state), &len);
+  appendf(s_state, sizeof(s_state), &len, "\n\n");
+  if (len < 0 ||
+      httpd_send(req, s_stream_head, sizeof(s_stream_head) - 1) !=
+          (int)sizeof(s_stream_head) - 1 ||
+      httpd_send(req, s_state, len) != len) {
+    return ESP_FAIL;
+  }
+
+  client->state = CLIENT_OPEN;
+  client->fd = httpd_req_to_sockfd(req);
+  req->sess_ctx = client;
+  req->free_ctx = client_closed;
+  ESP_LOGI(TAG, "Stream opened on socket %d", client->fd);
+  return ESP_OK;
+}
+
+static void update_cache(const event_t *event,
+                         const telemetry_point_t *points, int count) {
+  portENTER_CRITICAL(&s_cache_lock);
+  if (event->type == EVENT_TYPE_SENSOR_DATA) {
+    for (int i = 0; i < count; i++) {
+      s_cache.latest[points[i].channel] =
+          (latest_t){points[i].value, points[i].timestamp_us};
+    }
+  } else if (event->type == EVENT_TYPE_PUMP_STATE_CHANGE) {
+    s_cache.pump_known = true;
+    s_cache.pump_on = event->data.pump_state.is_on;
+  } else if (event->type == EVENT_TYPE_SENSOR_HEALTH &&
+             event->data.sensor_health.sensor < SENSOR_DATA_TYPE_COUNT) {
+    s_cache.health[event->data.sensor_health.sensor] =
+        event->data.sensor_health;
+  }
+  portEXIT_CRITICAL(&s_cache_lock);
+}
+
+// Serializes an event once for every stream, a sample from its points.
+static bool fill_frame(frame_t *frame, const event_t *event,
+                       const telemetry_point_t *points, int count,
+                       uint32_t id) {
+  int len = 0;
+  if (event->type == EVENT_TYPE_SENSOR_DATA) {
+    if (count == 0) {
+      return false;
+    }
+    appendf(frame->text, sizeof(frame->text), &len,
+            "id: %" PRIu32 "\nevent: telemetry\ndata: "
+            "{\"timestamp_us\":%" PRIu64,
+            id, event->data.sensor_data.timestamp_us);
+    for (int i = 0; i < count; i++) {
+      appendf(frame->text, sizeof(frame->text), &len, ",\"%s\":%.6g",
+              telemetry_channel_name(points[i].channel), points[i].value);
+    }
+    appendf(frame->text, sizeof(frame->text), &len, "}\n\n");
+  } else if (event->type == EVENT_TYPE_PUMP_STATE_CHANGE) {
+    appendf(frame->text, sizeof(frame->text), &len,
+            "id: %" PRIu32 "\nevent: pump\ndata: {\"is_on\":%s}\n\n", id,
+            event->data.pump_state.is_on ? "true" : "false");
+  } else if (event->type == EVENT_TYPE_SENSOR_HEALTH) {
+    const sensor_health_event_data_t *health = &event->data.sensor_health;
+    appendf(frame->text, sizeof(frame->text), &len,
+            "id: %" PRIu32 "\nevent: sensor\ndata: {\"sensor\":\"%s\","
+            "\"state\":\"%s\",\"fault\":\"%s\"}\n\n",
+            id, sensor_name(health->sensor),
+            sensor_health_state_name(health->state),
+            sensor_fault_name(health->fault));
+  } else {
+    return false;
+  }
+  if (len < 0) {
+    ESP_LOGW(TAG, "Event %" PRIu32 " does not fit a frame", id);
+    return false;
+  }
+  frame->len = len;
+  return true;
+}
+
+static bool is_streamed(event_type_t type) {
+  return type == EVENT_TYPE_SENSOR_DATA ||
+         type == EVENT_TYPE_PUMP_STATE_CHANGE ||
+         type == EVENT_TYPE_SENSOR_HEALTH;
+}
+
+// Frames are queued in order, so the next one is the oldest. While the
+// server task still holds it, every frame is queued and the event's frame
+// is skipped rather than waiting for the slowest step of the server. The
+// cache takes every event.
+static void http_api_task(void *pvParameters) {
+  QueueHandle_t event_queue = event_bus_subscribe();
+  if (event_queue == NULL) {
+    ESP_LOGE(TAG, "Failed to subscribe to event bus");
+    vTaskDelete(NULL);
+  }
+  ESP_LOGI(TAG, "HTTP API task started");
+
+  uint32_t next_frame = 0;
+  uint32_t next_id = 1;
+  while (1) {
+    event_t event;
+    if (xQueueReceive(event_queue, &event,
+                      pdMS_TO_TICKS(HTTP_API_KEEPALIVE_MS)) != pdTRUE) {
+      httpd_queue_work(s_server, send_frame, NULL);
+      continue;
+    }
+    TRACE_INSTANT(EVENT_RECEIVE, event.trace_span, event.type);
+    if (!is_streamed(event.type)) {
+      continue;
+    }
+    telemetry_point_t points[TELEMETRY_MAX_POINTS_PER_SAMPLE];
+    int count = 0;
+    if (event.type == EVENT_TYPE_SENSOR_DATA) {
+      count = telemetry_points_from_sensor_data(&event.data.sensor_data,
+                                                points);
+    }
+    update_cache(&event, points, count);
+
+    uint32_t id = next_id++;
+    frame_t *frame = &s_frames[next_frame % HTTP_API_FRAMES];
+    if (__atomic_load_n(&frame->queued, __ATOMIC_ACQUIRE)) {
+      __atomic_fetch_add(&s_skipped, 1, __ATOMIC_RELAXED);
+      continue;
+    }
+    if (!fill_frame(frame, &event, points, count, id)) {
+      continue;
+    }
+    __atomic_store_n(&frame->queued, true, __ATOMIC_RELAXED);
+    if (httpd_queue_work(s_server, send_frame, frame) != ESP_OK) {
+      __atomic_store_n(&frame->queued, false, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&s_skipped, 1, __ATOMIC_RELAXED);
+      continue;
+    }
+    next_frame++;
+  }
+}
+
+esp_err_t platform_http_start(void) {
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  config.server_port = HTTP_API_PORT;
+  config.max_open_sockets = HTTP_API_MAX_SOCKETS;
+  config.task_priority = TASK_PRIO_HTTP_API;
+  for (int i = 0; i < HTTP_API_MAX_CLIENTS; i++) {
+    s_clients[i] = (client_t){CLIENT_FREE, -1};
+  }
+
+  if (httpd_start(&s_server, &config) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start HTTP server");
+    return ESP_FAIL;
+  }
+  const httpd_uri_t state_uri = {
+      .uri = "/api/state",
+      .method = HTTP_GET,
+      .handler = state_get_handler,
+  };
+  httpd_register_uri_handler(s_server, &state_uri);
+  const httpd_uri_t events_uri = {
+      .uri = "/api/events",
+      .method = HTTP_GET,
+      .handler = events_get_handler,
+  };
+  httpd_register_uri_handler(s_server, &events_uri);
+
+  if (mem_task_create(MEM_TASK_HTTP_API, 0, http_api_task, "http_api_task",
+                      NULL, TASK_PRIO_HTTP_API, NULL) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create HTTP API task");
+    return ESP_FAIL;
+  }
+  ESP_LOGI(TAG, "HTTP API on port %d, up to %d streams", HTTP_API_PORT,
+           HTTP_API_MAX_CLIENTS);
+  return ESP_OK;
+}
+
+#endif
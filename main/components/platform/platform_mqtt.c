@@ -1,15 +1,186 @@
 #include "platform_mqtt.h"
 #include "app_config.h"
-#include "cJSON.h"
+#include "config_store.h"
+#include "dlog.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "mem_layout.h"
 #include "event_bus.h"
 #include "mqtt_client.h"
+#include "mqtt_topics.h"
+#include "platform_wifi.h"
+#include "rule_engine.h"
+#include "storage.h"
+#include "telemetry.h"
+#include "telemetry_window.h"
+#include "trace.h"
 
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 static const char *TAG = "PLATFORM_MQTT";
 static esp_mqtt_client_handle_t s_client = NULL;
 static bool s_mqtt_connected = false;
+static telemetry_format_t s_format = MQTT_TELEMETRY_FORMAT;
+
+// Set by platform_mqtt_set_telemetry_mode from the stored settings, applied by
+// the publisher task.
+static volatile telemetry_mode_t s_mode = MQTT_TELEMETRY_MODE;
+static volatile uint32_t s_window_ms = MQTT_TELEMETRY_WINDOW_MS;
+static volatile uint32_t s_mode_generation = 1;
+static uint32_t s_aggregator_generation;
+static telemetry_aggregator_t s_aggregator;
+
+static const int s_topic_class_qos[] = {
+    [MQTT_TOPIC_CLASS_TELEMETRY] = MQTT_QOS_TELEMETRY,
+    [MQTT_TOPIC_CLASS_STATE] = MQTT_QOS_STATE,
+    [MQTT_TOPIC_CLASS_ALARM] = MQTT_QOS_ALARM,
+    [MQTT_TOPIC_CLASS_BACKLOG] = MQTT_QOS_BACKLOG,
+};
+
+typedef struct {
+  int msg_id; // 0 marks a free slot
+  int64_t enqueued_us;
+} inflight_entry_t;
+
+// Written by the publisher task and the MQTT task, so guarded by a spinlock.
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static inflight_entry_t s_inflight[MQTT_INFLIGHT_TRACK_MAX];
+static platform_mqtt_stats_t s_stats;
+
+static void inflight_track(int msg_id) {
+  int64_t now = esp_timer_get_time();
+  int slot = 0;
+
+  portENTER_CRITICAL(&s_stats_lock);
+  for (int i = 0; i < MQTT_INFLIGHT_TRACK_MAX; i++) {
+    if (s_inflight[i].msg_id == 0) {
+      slot = i;
+      break;
+    }
+    // Table full: reuse the oldest entry, its ack is most likely lost.
+    if (s_inflight[i].enqueued_us < s_inflight[slot].enqueued_us) {
+      slot = i;
+    }
+  }
+  if (s_inflight[slot].msg_id == 0) {
+    s_stats.in_flight++;
+  } else {
+    // A late ack of the evicted message is ignored, so it counts as lost.
+    s_stats.expired++;
+  }
+  s_inflight[slot].msg_id = msg_id;
+  s_inflight[slot].enqueued_us = now;
+  portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void inflight_complete(int msg_id, bool acked) {
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL(&s_stats_lock);
+  for (int i = 0; i < MQTT_INFLIGHT_TRACK_MAX; i++) {
+    if (s_inflight[i].msg_id != msg_id) {
+      continue;
+    }
+    if (acked) {
+      uint32_t rtt_ms = (uint32_t)((now - s_inflight[i].enqueued_us) / 1000);
+      s_stats.puback_rtt_last_ms = rtt_ms;
+      s_stats.puback_rtt_avg_ms =
+          s_stats.puback_rtt_avg_ms == 0
+              ? rtt_ms
+              : (s_stats.puback_rtt_avg_ms * 7 + rtt_ms) / 8;
+      if (rtt_ms > s_stats.puback_rtt_max_ms) {
+        s_stats.puback_rtt_max_ms = rtt_ms;
+      }
+    } else {
+      s_stats.expired++;
+    }
+    s_inflight[i].msg_id = 0;
+    s_stats.in_flight--;
+    break;
+  }
+  portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void count_publish(bool enqueued) {
+  portENTER_CRITICAL(&s_stats_lock);
+  if (enqueued) {
+    s_stats.enqueued++;
+  } else {
+    s_stats.dropped++;
+  }
+  portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void publish_command_ack(const command_ack_t *ack) {
+  char payload[128];
+  int len = command_format_ack(ack, payload, sizeof(payload));
+  if (len > 0) {
+    platform_mqtt_publish(MQTT_TOPIC_CLASS_STATE,
+                          mqtt_topics_get()->command_ack, payload, len);
+  }
+}
+
+// The rule source only lives in the receive buffer, so it is compiled to
+// check it and stored here. The pump control task loads it from NVS.
+static command_status_t store_rules(const char *payload,
+                                    const rules_command_t *rules) {
+  rule_program_t *program = malloc(sizeof(*program));
+  if (program == NULL) {
+    return COMMAND_STATUS_FAILED;
+  }
+  const char *src = payload + rules->offset;
+  command_status_t status = COMMAND_STATUS_OK;
+  int line;
+  if (rule_compile(src, rules->len, program, &line) != RULE_COMPILE_OK) {
+    ESP_LOGW(TAG, "Rejected rules, error in statement %d", line);
+    status = COMMAND_STATUS_INVALID;
+  } else if (storage_save_rules(src, rules->len) != ESP_OK) {
+    status = COMMAND_STATUS_FAILED;
+  }
+  free(program);
+  return status;
+}
+
+// Runs on the MQTT task: parse straight from the receive buffer and hand the
+// typed command to the bus, execution happens in the owning task.
+static void handle_command(esp_mqtt_event_handle_t event) {
+  int64_t received_us = esp_timer_get_time();
+  const mqtt_topics_t *topics = mqtt_topics_get();
+
+  // Commands are small, fragmented messages are not reassembled.
+  if (event->topic_len <= (int)topics->command_prefix_len ||
+      memcmp(event->topic, topics->command_prefix,
+             topics->command_prefix_len) != 0 ||
+      event->data_len != event->total_data_len) {
+    ESP_LOGW(TAG, "Ignoring message on %.*s", event->topic_len, event->topic);
+    return;
+  }
+
+  event_t cmd_event = {.type = EVENT_TYPE_COMMAND};
+  command_t *cmd = &cmd_event.data.command;
+  command_status_t status = command_parse(
+      event->topic + topics->command_prefix_len,
+      event->topic_len - topics->command_prefix_len, event->data,
+      event->data_len, cmd);
+  cmd->received_us = received_us;
+
+  if (status == COMMAND_STATUS_OK && cmd->type == COMMAND_TYPE_RULES) {
+    status = store_rules(event->data, &cmd->args.rules);
+  }
+  if (status == COMMAND_STATUS_OK &&
+      event_bus_post(&cmd_event, EVENT_BUS_POST_TIMEOUT_MS) != ESP_OK) {
+    status = COMMAND_STATUS_FAILED;
+  }
+  if (status != COMMAND_STATUS_OK) {
+    ESP_LOGW(TAG, "Rejected command %s id=%" PRIu32 " (status %d)",
+             command_type_name(cmd->type), cmd->id, status);
+    command_ack_t ack = {.id = cmd->id, .type = cmd->type, .status = status};
+    publish_command_ack(&ack);
+  }
+}
 
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
                                int32_t event_id, void *event_data) {
@@ -20,16 +191,23 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
     s_mqtt_connected = true;
     event_t mqtt_event = {.type = EVENT_TYPE_MQTT_CONNECTED};
     event_bus_post(&mqtt_event, 0);
-    // esp_mqtt_client_subscribe(s_client, "growgrid/command/pump", 0);
+    esp_mqtt_client_subscribe(s_client, mqtt_topics_get()->command_filter, 1);
     break;
   case MQTT_EVENT_DISCONNECTED:
     ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
     s_mqtt_connected = false;
     break;
+  case MQTT_EVENT_PUBLISHED:
+    inflight_complete(event->msg_id, true);
+    break;
+  case MQTT_EVENT_DELETED:
+    // Expired from the outbox before it was acknowledged. Already counted
+    // as enqueued, so not as dropped. An evicted entry was counted as
+    // expired then.
+    inflight_complete(event->msg_id, false);
+    break;
   case MQTT_EVENT_DATA:
-    ESP_LOGI(TAG, "MQTT_EVENT_DATA");
-    printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
-    printf("DATA=%.*s\r\n", event->data_len, event->data);
+    handle_command(event);
     break;
   case MQTT_EVENT_ERROR:
     ESP_LOGE(TAG, "MQTT_EVENT_ERROR");
@@ -39,60 +217,270 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
   }
 }
 
+esp_err_t platform_mqtt_publish(mqtt_topic_class_t topic_class,
+                                const char *topic, const char *payload,
+                                int len) {
+  if (s_client == NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  int qos = s_topic_class_qos[topic_class];
+
+  // Overflow policy: stale telemetry has no value after a reconnect and is
+  // shed before it can crowd out state and alarm messages.
+  if (topic_class == MQTT_TOPIC_CLASS_TELEMETRY &&
+      (!s_mqtt_connected || esp_mqtt_client_get_outbox_size(s_client) >=
+                                MQTT_TELEMETRY_HIGH_WATER_BYTES)) {
+    count_publish(false);
+    return ESP_ERR_NO_MEM;
+  }
+
+  TRACE_BEGIN(MQTT_ENQUEUE, 0, len);
+  int msg_id = esp_mqtt_client_enqueue(s_client, topic, payload, len, qos, 0,
+                                       true);
+  TRACE_END(MQTT_ENQUEUE, 0, msg_id);
+  if (msg_id < 0) {
+    // -2 means the outbox hit MQTT_OUTBOX_LIMIT_BYTES.
+    DLOG_W(TAG, "Dropped publish to %s (%s)", topic,
+           msg_id == -2 ? "outbox full" : "enqueue failed");
+    count_publish(false);
+    return ESP_ERR_NO_MEM;
+  }
+
+  count_publish(true);
+  if (qos > 0) {
+    inflight_track(msg_id);
+  }
+  return ESP_OK;
+}
+
+esp_err_t platform_mqtt_get_stats(platform_mqtt_stats_t *stats) {
+  portENTER_CRITICAL(&s_stats_lock);
+  *stats = s_stats;
+  portEXIT_CRITICAL(&s_stats_lock);
+  stats->outbox_bytes =
+      s_client != NULL ? esp_mqtt_client_get_outbox_size(s_client) : 0;
+  return ESP_OK;
+}
+
+static void publish_summary(const telemetry_summary_t *summary) {
+  const mqtt_topics_t *topics = mqtt_topics_get();
+  char payload[192];
+  int len;
+
+  if (s_format == TELEMETRY_FORMAT_LINE_PROTOCOL) {
+    len = telemetry_format_summary_line_protocol(summary, topics->lp_tags,
+                                                 payload, sizeof(payload));
+    if (len > 0) {
+      platform_mqtt_publish(MQTT_TOPIC_CLASS_TELEMETRY, topics->line_protocol,
+                            payload, len);
+    }
+    return;
+  }
+
+  len = telemetry_format_summary_json(summary, payload, sizeof(payload));
+  if (len > 0) {
+    platform_mqtt_publish(MQTT_TOPIC_CLASS_TELEMETRY,
+                          topics->summary[summary->channel], payload, len);
+  }
+}
+
+static void publish_points(const telemetry_point_t *points, int count) {
+  const mqtt_topics_t *topics = mqtt_topics_get();
+
+  if (s_format == TELEMETRY_FORMAT_LINE_PROTOCOL) {
+    // All points of a sample go out as one multi-line message.
+    char payload[TELEMETRY_MAX_POINTS_PER_SAMPLE * 96];
+    int len = 0;
+    for (int i = 0; i < count; i++) {
+      int n = telemetry_format_line_protocol(&points[i], topics->lp_tags,
+                                             payload + len,
+                                             sizeof(payload) - len - 1);
+      if (n < 0) {
+        ESP_LOGE(TAG, "Line protocol payload too large");
+        return;
+      }
+      len += n;
+      payload[len++] = '\n';
+    }
+    platform_mqtt_publish(MQTT_TOPIC_CLASS_TELEMETRY, topics->line_protocol,
+                          payload, len);
+    return;
+  }
+
+  for (int i = 0; i < count; i++) {
+    char payload[96];
+    int len = telemetry_format_json(&points[i], payload, sizeof(payload));
+    if (len > 0) {
+      platform_mqtt_publish(MQTT_TOPIC_CLASS_TELEMETRY,
+                            topics->telemetry[points[i].channel], payload,
+                            len);
+    }
+  }
+}
+
+static esp_err_t publish_backlog(const char *topic, const char *payload,
+                                 int len, int64_t deadline_us) {
+  while (esp_mqtt_client_get_outbox_size(s_client) >=
+         MQTT_TELEMETRY_HIGH_WATER_BYTES) {
+    if (esp_timer_get_time() >= deadline_us) {
+      return ESP_ERR_TIMEOUT;
+    }
+    vTaskDelay(pdMS_TO_TICKS(20));
+  }
+  return platform_mqtt_publish(MQTT_TOPIC_CLASS_BACKLOG, topic, payload, len);
+}
+
+esp_err_t platform_mqtt_publish_batch(const telemetry_point_t *points,
+                                      int count, uint32_t timeout_ms) {
+  if (s_client == NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  const mqtt_topics_t *topics = mqtt_topics_get();
+  int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+  esp_err_t err = ESP_OK;
+
+  if (s_format == TELEMETRY_FORMAT_LINE_PROTOCOL) {
+    char payload[MQTT_BATCH_PAYLOAD_BYTES];
+    int len = 0;
+    for (int i = 0; i < count && err == ESP_OK; i++) {
+      if (points[i].timestamp_us < TELEMETRY_MIN_VALID_TIMESTAMP_US) {
+        continue;
+      }
+      int n = telemetry_format_line_protocol(&points[i], topics->lp_tags,
+                                             payload + len,
+                                             sizeof(payload) - len - 1);
+      if (n < 0 && len > 0) {
+        // Message full, send it and start the next one with this point.
+        err = publish_backlog(topics->line_protocol, payload, len,
+                              deadline_us);
+        len = 0;
+        n = telemetry_format_line_protocol(&points[i], topics->lp_tags,
+                                           payload, sizeof(payload) - 1);
+      }
+      if (n < 0) {
+        return ESP_ERR_INVALID_SIZE;
+      }
+      len += n;
+      payload[len++] = '\n';
+    }
+    if (err == ESP_OK && len > 0) {
+      err = publish_backlog(topics->line_protocol, payload, len, deadline_us);
+    }
+    return err;
+  }
+
+  for (int i = 0; i < count && err == ESP_OK; i++) {
+    if (points[i].timestamp_us < TELEMETRY_MIN_VALID_TIMESTAMP_US) {
+      continue;
+    }
+    char payload[96];
+    int len = telemetry_format_json(&points[i], payload, sizeof(payload));
+    if (len > 0) {
+      err = publish_backlog(topics->telemetry[points[i].channel], payload,
+                            len, deadline_us);
+    }
+  }
+  return err;
+}
+
+esp_err_t platform_mqtt_publish_backlog(const char *topic, const char *payload,
+                                        int len, uint32_t timeout_ms) {
+  if (s_client == NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  return publish_backlog(topic, payload, len,
+                         esp_timer_get_time() + (int64_t)timeout_ms * 1000);
+}
+
+esp_err_t platform_mqtt_flush(uint32_t timeout_ms) {
+  if (s_client == NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  // QoS 1 messages stay in the outbox until their PUBACK arrives.
+  int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+  while (esp_mqtt_client_get_outbox_size(s_client) > 0) {
+    if (esp_timer_get_time() >= deadline_us) {
+      return ESP_ERR_TIMEOUT;
+    }
+    vTaskDelay(pdMS_TO_TICKS(20));
+  }
+  return ESP_OK;
+}
+
 static void publish_sensor_data(const sensor_data_t *data) {
-  if (!s_mqtt_connected) {
+  // MQTT may come up before SNTP has set the clock.
+  if (data->timestamp_us < TELEMETRY_MIN_VALID_TIMESTAMP_US) {
     return;
   }
 
-  char topic[128];
-  cJSON *root = NULL;
-  char *payload_str = NULL;
-
-  switch (data->type) {
-  case SENSOR_DATA_TYPE_TEMP_HUMIDITY:
-    root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "value",
-                            data->payload.temp_humidity.temperature);
-    cJSON_AddNumberToObject(root, "timestamp_us", (double)data->timestamp_us);
-    payload_str = cJSON_PrintUnformatted(root);
-    snprintf(topic, sizeof(topic), "growgrid/telemetry/temperature");
-    esp_mqtt_client_publish(s_client, topic, payload_str, 0, 1, 0);
-    free(payload_str);
-    cJSON_Delete(root);
-
-    root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "value",
-                            data->payload.temp_humidity.humidity);
-    cJSON_AddNumberToObject(root, "timestamp_us", (double)data->timestamp_us);
-    payload_str = cJSON_PrintUnformatted(root);
-    snprintf(topic, sizeof(topic), "growgrid/telemetry/humidity");
-    esp_mqtt_client_publish(s_client, topic, payload_str, 0, 1, 0);
-    free(payload_str);
-    cJSON_Delete(root);
-    break;
+  telemetry_point_t points[TELEMETRY_MAX_POINTS_PER_SAMPLE];
+  int count = telemetry_points_from_sensor_data(data, points);
 
-  case SENSOR_DATA_TYPE_LIGHT:
-    root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "value", data->payload.light.lux);
-    cJSON_AddNumberToObject(root, "timestamp_us", (double)data->timestamp_us);
-    payload_str = cJSON_PrintUnformatted(root);
-    snprintf(topic, sizeof(topic), "growgrid/telemetry/light");
-    esp_mqtt_client_publish(s_client, topic, payload_str, 0, 1, 0);
-    free(payload_str);
-    cJSON_Delete(root);
-    break;
+  // Picks up mode changes made from other tasks.
+  if (s_aggregator_generation != s_mode_generation) {
+    s_aggregator_generation = s_mode_generation;
+    telemetry_aggregator_init(&s_aggregator, s_window_ms);
+  }
 
-  case SENSOR_DATA_TYPE_SOIL_MOISTURE:
-    root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "value", data->payload.soil_moisture.percent);
-    cJSON_AddNumberToObject(root, "timestamp_us", (double)data->timestamp_us);
-    payload_str = cJSON_PrintUnformatted(root);
-    snprintf(topic, sizeof(topic), "growgrid/telemetry/soil_moisture");
-    esp_mqtt_client_publish(s_client, topic, payload_str, 0, 1, 0);
-    free(payload_str);
-    cJSON_Delete(root);
-    break;
+  if (s_mode == TELEMETRY_MODE_RAW) {
+    if (s_mqtt_connected) {
+      publish_points(points, count);
+    }
+    return;
   }
+
+  // Windows keep accumulating while offline, only the publish is skipped.
+  for (int i = 0; i < count; i++) {
+    telemetry_summary_t summary;
+    if (telemetry_aggregator_add(&s_aggregator, &points[i], &summary) &&
+        s_mqtt_connected) {
+      publish_summary(&summary);
+    }
+  }
+}
+
+static void publish_pump_state(const pump_state_event_data_t *state) {
+  char payload[32];
+  int len = snprintf(payload, sizeof(payload), "{\"is_on\":%s}",
+                     state->is_on ? "true" : "false");
+  platform_mqtt_publish(MQTT_TOPIC_CLASS_STATE, mqtt_topics_get()->pump_state,
+                        payload, len);
+}
+
+static void publish_sensor_health(const sensor_health_event_data_t *health) {
+  char payload[80];
+  int len = snprintf(payload, sizeof(payload),
+                     "{\"sensor\":\"%s\",\"state\":\"%s\","
+                     "\"fault\":\"%s\"}",
+                     sensor_name(health->sensor),
+                     sensor_health_state_name(health->state),
+                     sensor_fault_name(health->fault));
+  platform_mqtt_publish(MQTT_TOPIC_CLASS_STATE,
+                        mqtt_topics_get()->sensor_state, payload, len);
+}
+
+// Sent on every broker connect, which follows every Wi-Fi reconnect.
+static void publish_wifi_state(void) {
+  platform_wifi_stats_t stats;
+  platform_wifi_get_stats(&stats);
+
+  char payload[112];
+  int len = snprintf(payload, sizeof(payload),
+                     "{\"connect_ms\":%" PRIu32 ",\"attempts\":%" PRIu32
+                     ",\"fast_path\":%s,\"connects\":%" PRIu32 "}",
+                     stats.last_connect_ms, stats.last_attempts,
+                     stats.last_fast_path ? "true" : "false", stats.connects);
+  platform_mqtt_publish(MQTT_TOPIC_CLASS_STATE, mqtt_topics_get()->wifi_state,
+                        payload, len);
+}
+
+static void apply_telemetry_settings(void) {
+  const config_t *config = config_store_get();
+  platform_mqtt_set_telemetry_mode(config->telemetry_mode,
+                                   config->telemetry_window_ms);
 }
 
 static void mqtt_publisher_task(void *pvParameters) {
@@ -107,8 +495,24 @@ static void mqtt_publisher_task(void *pvParameters) {
   while (1) {
     event_t event;
     if (xQueueReceive(event_queue, &event, portMAX_DELAY) == pdTRUE) {
+      TRACE_INSTANT(EVENT_RECEIVE, event.trace_span, event.type);
       if (event.type == EVENT_TYPE_SENSOR_DATA) {
+        TRACE_BEGIN(MQTT_PUBLISH, event.trace_span, event.type);
         publish_sensor_data(&event.data.sensor_data);
+        TRACE_END(MQTT_PUBLISH, event.trace_span, event.type);
+      } else if (event.type == EVENT_TYPE_PUMP_STATE_CHANGE) {
+        publish_pump_state(&event.data.pump_state);
+      } else if (event.type == EVENT_TYPE_COMMAND_ACK) {
+        publish_command_ack(&event.data.command_ack);
+      } else if (event.type == EVENT_TYPE_SENSOR_HEALTH) {
+        publish_sensor_health(&event.data.sensor_health);
+      } else if (event.type == EVENT_TYPE_MQTT_CONNECTED) {
+        publish_wifi_state();
+      } else if (event.type == EVENT_TYPE_CONFIG_CHANGED &&
+                 (event.data.config_changed.key == CONFIG_KEY_TELEMETRY_MODE ||
+                  event.data.config_changed.key ==
+                      CONFIG_KEY_TELEMETRY_WINDOW)) {
+        apply_telemetry_settings();
       }
     }
   }
@@ -118,17 +522,20 @@ esp_err_t platform_mqtt_init(const char *broker_uri, const char *username, const
   esp_mqtt_client_config_t mqtt_cfg = {
       .broker.address.uri = broker_uri,
       .credentials.username = username,
+      .credentials.client_id = mqtt_topics_get()->client_id,
       .credentials.authentication.password = password,
+      .outbox.limit = MQTT_OUTBOX_LIMIT_BYTES,
   };
 
+  apply_telemetry_settings();
   s_client = esp_mqtt_client_init(&mqtt_cfg);
   esp_mqtt_client_register_event(s_client, ESP_EVENT_ANY_ID, mqtt_event_handler,
                                  NULL);
   esp_mqtt_client_start(s_client);
 
-  if (xTaskCreate(mqtt_publisher_task, "mqtt_publisher_task",
-                  TASK_STACK_MQTT_PUBLISHER, NULL, TASK_PRIO_MQTT_MANGER,
-                  NULL) != pdPASS) {
+  if (mem_task_create(MEM_TASK_MQTT_PUBLISHER, 0, mqtt_publisher_task,
+                      "mqtt_publisher_task", NULL, TASK_PRIO_MQTT_MANGER,
+                      NULL) != pdPASS) {
     ESP_LOGE(TAG, "Failed to create MQTT publisher task");
     return ESP_FAIL;
   }
@@ -137,3 +544,14 @@ esp_err_t platform_mqtt_init(const char *broker_uri, const char *username, const
 }
 
 bool platform_mqtt_is_connected(void) { return s_mqtt_connected; }
+
+void platform_mqtt_set_format(telemetry_format_t format) { s_format = format; }
+
+void platform_mqtt_set_telemetry_mode(telemetry_mode_t mode,
+                                      uint32_t window_ms) {
+  s_mode = mode;
+  s_window_ms = window_ms;
+  s_mode_generation++;
+  ESP_LOGI(TAG, "Telemetry mode %s, window %" PRIu32 " ms",
+           mode == TELEMETRY_MODE_RAW ? "raw" : "summary", window_ms);
+}
@@ -10,29 +10,30 @@ static void time_sync_notification_cb(struct timeval *tv) {
   ESP_LOGI(TAG, "Time successfully synchronized");
 }
 
-void platform_sntp_init(const char *server) {
+esp_err_t platform_sntp_init(const char *server, uint32_t timeout_ms) {
   ESP_LOGI(TAG, "Initializing SNTP");
   esp_sntp_setoperatingmode(ESP_SNTP_OPMODE_POLL);
   esp_sntp_setservername(0, server);
   sntp_set_time_sync_notification_cb(time_sync_notification_cb);
   esp_sntp_init();
 
-  time_t now = 0;
-  struct tm timeinfo = {0};
   int retry = 0;
-  const int retry_count = 15;
+  const int retry_count = timeout_ms / 100;
 
+  // Polls in short steps, a sync usually takes one round trip and every
+  // second of radio time counts in the low-power mode.
   while (sntp_get_sync_status() == SNTP_SYNC_STATUS_RESET &&
-         ++retry < retry_count) {
-    ESP_LOGI(TAG, "Waiting for system time to be set... (%d/%d)", retry,
-             retry_count);
-    vTaskDelay(2000 / portTICK_PERIOD_MS);
+         retry < retry_count) {
+    if (++retry % 20 == 0) {
+      ESP_LOGI(TAG, "Waiting for system time to be set... (%d/%d)", retry,
+               retry_count);
+    }
+    vTaskDelay(100 / portTICK_PERIOD_MS);
   }
 
-  if (retry == retry_count) {
+  if (sntp_get_sync_status() == SNTP_SYNC_STATUS_RESET) {
     ESP_LOGE(TAG, "Failed to sync time");
-  } else {
-    time(&now);
-    localtime_r(&now, &timeinfo);
+    return ESP_ERR_TIMEOUT;
   }
+  return ESP_OK;
 }
@@ -1,47 +1,180 @@
 #include "platform_wifi.h"
+#include "app_config.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "event_bus.h"
 #include "freertos/event_groups.h"
+#include "storage.h"
 #include <string.h>
 
 #define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT BIT1
-#define MAX_RETRIES 5
 
 static const char *TAG = "PLATFORM_WIFI";
 static EventGroupHandle_t s_wifi_event_group;
-static int s_retry_num = 0;
+#if GROWGRID_STATIC_ALLOC
+static StaticEventGroup_t s_wifi_event_group_buffer;
+#endif
+static esp_timer_handle_t s_retry_timer;
+static wifi_config_t s_wifi_config;
+
+// Everything below is only touched from the default event loop task.
+static wifi_cache_t s_cache;
+static bool s_cache_valid = false;
+static bool s_fast_path = false; // Directed config to the cached AP
+static bool s_connected = false;
+static uint32_t s_backoff_exp = 0;
+static int64_t s_cycle_start_us;
+static uint32_t s_cycle_attempts;
+
+// Read by other tasks through platform_wifi_get_stats.
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static platform_wifi_stats_t s_stats;
+
+static void apply_full_scan_config(void) {
+  s_wifi_config.sta.bssid_set = false;
+  memset(s_wifi_config.sta.bssid, 0, sizeof(s_wifi_config.sta.bssid));
+  s_wifi_config.sta.channel = 0;
+  s_wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+  esp_wifi_set_config(WIFI_IF_STA, &s_wifi_config);
+}
+
+static void apply_fast_config(void) {
+  s_wifi_config.sta.bssid_set = true;
+  memcpy(s_wifi_config.sta.bssid, s_cache.bssid, sizeof(s_cache.bssid));
+  s_wifi_config.sta.channel = s_cache.channel;
+  s_wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+  esp_wifi_set_config(WIFI_IF_STA, &s_wifi_config);
+}
+
+// Stores the association of a connect. NVS is only written when something
+// changed, most boots reuse the same AP.
+static bool cache_equal(const wifi_cache_t *a, const wifi_cache_t *b) {
+  return memcmp(a->bssid, b->bssid, sizeof(a->bssid)) == 0 &&
+         a->channel == b->channel;
+}
+
+static void update_cache(void) {
+  wifi_ap_record_t ap;
+  if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+    return;
+  }
+
+  wifi_cache_t cache = {.channel = ap.primary};
+  memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+
+  if (s_cache_valid && cache_equal(&cache, &s_cache)) {
+    return;
+  }
+  if (storage_save_wifi_cache(&cache) == ESP_OK) {
+    s_cache = cache;
+    s_cache_valid = true;
+    ESP_LOGI(TAG, "Cached association on channel %d", cache.channel);
+  }
+}
+
+static void connect_attempt(void) {
+  s_cycle_attempts++;
+  esp_wifi_connect();
+}
+
+static void retry_timer_cb(void *arg) { esp_wifi_connect(); }
+
+// Exponential backoff with "equal jitter": half of the delay is fixed, the
+// other half random, so a site full of devices does not retry in lockstep
+// after the AP comes back.
+static void schedule_retry(void) {
+  uint32_t delay_ms = WIFI_RECONNECT_MAX_MS;
+  if (s_backoff_exp < 31 &&
+      (WIFI_RECONNECT_BASE_MS << s_backoff_exp) < WIFI_RECONNECT_MAX_MS) {
+    delay_ms = WIFI_RECONNECT_BASE_MS << s_backoff_exp;
+    s_backoff_exp++;
+  }
+  delay_ms = delay_ms / 2 + esp_random() % (delay_ms / 2 + 1);
+
+  ESP_LOGI(TAG, "Retrying to connect to the AP in %lu ms (attempt %lu)",
+           (unsigned long)delay_ms, (unsigned long)s_cycle_attempts + 1);
+  s_cycle_attempts++;
+  esp_timer_start_once(s_retry_timer, (uint64_t)delay_ms * 1000);
+}
+
+static void on_disconnected(void) {
+  bool was_connected = s_connected;
+  s_connected = false;
+  xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+  if (was_connected) {
+    s_cycle_start_us = esp_timer_get_time();
+    s_cycle_attempts = 0;
+    s_backoff_exp = 0;
+  }
+
+  event_t event = {.type = EVENT_TYPE_WIFI_DISCONNECTED};
+  event_bus_post(&event, 0);
+
+  if (s_fast_path) {
+    // The directed config pins the BSSID, which may not hold anymore. A
+    // cache that never connected is dropped.
+    s_fast_path = false;
+    if (!was_connected) {
+      ESP_LOGW(TAG, "Fast connect failed, falling back to full scan");
+      storage_erase_wifi_cache();
+      s_cache_valid = false;
+    }
+    apply_full_scan_config();
+    connect_attempt();
+    return;
+  }
+
+  schedule_retry();
+}
+
+static void on_got_ip(const ip_event_got_ip_t *ip_event) {
+  ESP_LOGI(TAG, "Got IP address:" IPSTR, IP2STR(&ip_event->ip_info.ip));
+  s_connected = true;
+  s_backoff_exp = 0;
+
+  uint32_t connect_ms =
+      (uint32_t)((esp_timer_get_time() - s_cycle_start_us) / 1000);
+  ESP_LOGI(TAG, "Connected in %lu ms after %lu attempt(s)%s",
+           (unsigned long)connect_ms, (unsigned long)s_cycle_attempts,
+           s_fast_path ? " (fast path)" : "");
+
+  portENTER_CRITICAL(&s_stats_lock);
+  s_stats.last_connect_ms = connect_ms;
+  s_stats.last_attempts = s_cycle_attempts;
+  s_stats.last_fast_path = s_fast_path;
+  s_stats.connects++;
+  portEXIT_CRITICAL(&s_stats_lock);
+
+  update_cache();
+
+  xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+  event_t event = {.type = EVENT_TYPE_WIFI_CONNECTED};
+  event_bus_post(&event, 0);
+}
 
 static void event_handler(void *arg, esp_event_base_t event_base,
                           int32_t event_id, void *event_data) {
   if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-    esp_wifi_connect();
+    s_cycle_start_us = esp_timer_get_time();
+    connect_attempt();
   } else if (event_base == WIFI_EVENT &&
              event_id == WIFI_EVENT_STA_DISCONNECTED) {
-    event_t event = {.type = EVENT_TYPE_WIFI_DISCONNECTED};
-    event_bus_post(&event, 0);
-    if (s_retry_num < MAX_RETRIES) {
-      esp_wifi_connect();
-      s_retry_num++;
-      ESP_LOGI(TAG, "Retrying to connect to the AP");
-    } else {
-      xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-      ESP_LOGE(TAG, "Connect to the AP failed");
-    }
+    on_disconnected();
   } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-    ip_event_got_ip_t *ip_event = (ip_event_got_ip_t *)event_data;
-    ESP_LOGI(TAG, "Got IP address:" IPSTR, IP2STR(&ip_event->ip_info.ip));
-    s_retry_num = 0;
-    xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
-    event_t event = {.type = EVENT_TYPE_WIFI_CONNECTED};
-    event_bus_post(&event, 0);
+    on_got_ip((ip_event_got_ip_t *)event_data);
   }
 }
 
-esp_err_t platform_wifi_init_sta(const char *ssid, const char *pass) {
+esp_err_t platform_wifi_start_sta(const char *ssid, const char *pass) {
+#if GROWGRID_STATIC_ALLOC
+  s_wifi_event_group = xEventGroupCreateStatic(&s_wifi_event_group_buffer);
+#else
   s_wifi_event_group = xEventGroupCreate();
+#endif
 
   ESP_ERROR_CHECK(esp_netif_init());
   ESP_ERROR_CHECK(esp_event_loop_create_default());
@@ -50,6 +183,12 @@ esp_err_t platform_wifi_init_sta(const char *ssid, const char *pass) {
   wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
   ESP_ERROR_CHECK(esp_wifi_init(&cfg));
 
+  const esp_timer_create_args_t retry_timer_args = {
+      .callback = retry_timer_cb,
+      .name = "wifi_retry",
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&retry_timer_args, &s_retry_timer));
+
   esp_event_handler_instance_t instance_any_id;
   esp_event_handler_instance_t instance_got_ip;
   ESP_ERROR_CHECK(esp_event_handler_instance_register(
@@ -57,25 +196,47 @@ esp_err_t platform_wifi_init_sta(const char *ssid, const char *pass) {
   ESP_ERROR_CHECK(esp_event_handler_instance_register(
       IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL, &instance_got_ip));
 
-  wifi_config_t wifi_config = {0};
-  strncpy((char *)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid) - 1);
-  strncpy((char *)wifi_config.sta.password, pass,
-          sizeof(wifi_config.sta.password) - 1);
+  strncpy((char *)s_wifi_config.sta.ssid, ssid,
+          sizeof(s_wifi_config.sta.ssid) - 1);
+  strncpy((char *)s_wifi_config.sta.password, pass,
+          sizeof(s_wifi_config.sta.password) - 1);
   ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-  ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+
+  s_cache_valid = storage_read_wifi_cache(&s_cache) == ESP_OK &&
+                  s_cache.channel != 0;
+  s_fast_path = s_cache_valid;
+  if (s_fast_path) {
+    ESP_LOGI(TAG, "Trying cached association on channel %d", s_cache.channel);
+    apply_fast_config();
+  } else {
+    apply_full_scan_config();
+  }
   ESP_ERROR_CHECK(esp_wifi_start());
+  return ESP_OK;
+}
+
+esp_err_t platform_wifi_wait_connected(uint32_t timeout_ms) {
+  TickType_t ticks =
+      timeout_ms == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+  EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT,
+                                         pdFALSE, pdFALSE, ticks);
+  return (bits & WIFI_CONNECTED_BIT) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t platform_wifi_init_sta(const char *ssid, const char *pass) {
+  ESP_ERROR_CHECK(platform_wifi_start_sta(ssid, pass));
 
   ESP_LOGI(TAG, "platform_wifi_init_sta finished. Waiting for connection...");
 
-  EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                         WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                         pdFALSE, pdFALSE, portMAX_DELAY);
+  // Reconnection never gives up, so this only returns once connected.
+  platform_wifi_wait_connected(UINT32_MAX);
+  ESP_LOGI(TAG, "Connected to AP SSID: %s", ssid);
+  return ESP_OK;
+}
 
-  if (bits & WIFI_CONNECTED_BIT) {
-    ESP_LOGI(TAG, "Connected to AP SSID: %s", ssid);
-    return ESP_OK;
-  } else {
-    ESP_LOGE(TAG, "Failed to connect to SSID: %s", ssid);
-    return ESP_FAIL;
-  }
+esp_err_t platform_wifi_get_stats(platform_wifi_stats_t *stats) {
+  portENTER_CRITICAL(&s_stats_lock);
+  *stats = s_stats;
+  portEXIT_CRITICAL(&s_stats_lock);
+  return ESP_OK;
 }
@@ -128,7 +128,22 @@ static esp_err_t save_post_handler(httpd_req_t *req) {
     url_decode(creds.ntp_server, param_buf);
   }
 
+  device_identity_t identity;
+  memset(&identity, 0, sizeof(device_identity_t));
+
+  if (httpd_query_key_value(buf, "site", param_buf, sizeof(param_buf)) ==
+      ESP_OK) {
+    url_decode(param_buf, param_buf);
+    strncpy(identity.site, param_buf, sizeof(identity.site) - 1);
+  }
+  if (httpd_query_key_value(buf, "device", param_buf, sizeof(param_buf)) ==
+      ESP_OK) {
+    url_decode(param_buf, param_buf);
+    strncpy(identity.device, param_buf, sizeof(identity.device) - 1);
+  }
+
   storage_save_credentials(&creds);
+  storage_save_identity(&identity);
 
   const char *resp_str = "<html><body><h1>Credentials Saved!</h1><p>Device "
                          "will now restart.</p></body></html>";
@@ -162,7 +177,10 @@ static esp_err_t root_get_handler(httpd_req_t *req) {
       "required><br><input type='text' name='mqtt_user' placeholder='MQTT "
       "Username'><br><input type='password' name='mqtt_pass' placeholder='MQTT "
       "Password'><br><h2>NTP Settings</h2><input type='text' name='ntp_server' "
-      "placeholder='pool.ntp.org' required><br><button type='submit'>Save and "
+      "placeholder='pool.ntp.org' required><br><h2>Device Identity</h2><input "
+      "type='text' name='site' placeholder='Site (default)'><br><input "
+      "type='text' name='device' placeholder='Device name (from MAC)'><br>"
+      "<button type='submit'>Save and "
       "Restart</button></form></div></body></html>";
   httpd_resp_send(req, resp_str, strlen(resp_str));
   return ESP_OK;
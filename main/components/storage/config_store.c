@@ -0,0 +1,310 @@
+#include "config_store.h"
+#include "command.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include <stddef.h>
+#include <string.h>
+
+static const char *TAG = "CONFIG_STORE";
+
+#define CONFIG_BLOB_KEY "settings"
+// Room for settings added by newer firmware, which an older one skips.
+#define CONFIG_BLOB_MAX_BYTES 256
+// The soil sensor reads a 12-bit ADC.
+#define SOIL_RAW_MAX 4095
+
+typedef struct {
+  uint16_t version;
+  uint16_t len; // Of the records after the header
+  uint32_t crc; // CRC-32 of the records
+} config_header_t;
+
+// A setting is `count` 32-bit values at `offset` in config_t.
+typedef struct {
+  uint16_t offset;
+  uint8_t count;
+  int32_t min;
+  int32_t max;
+} config_field_t;
+
+#define FIELD_(member, lo, hi)                                                 \
+  {offsetof(config_t, member),                                                 \
+   sizeof(((config_t *)0)->member) / sizeof(int32_t), (lo), (hi)}
+
+static const config_field_t s_fields[] = {
+    [CONFIG_KEY_SAMPLE_INTERVAL] = FIELD_(sample_interval_ms,
+                                          COMMAND_SAMPLING_MIN_INTERVAL_MS,
+                                          COMMAND_SAMPLING_MAX_INTERVAL_MS),
+    [CONFIG_KEY_SOIL_DRY] = FIELD_(soil_dry_raw, 0, SOIL_RAW_MAX),
+    [CONFIG_KEY_SOIL_WET] = FIELD_(soil_wet_raw, 0, SOIL_RAW_MAX),
+    [CONFIG_KEY_TELEMETRY_MODE] = FIELD_(telemetry_mode, TELEMETRY_MODE_RAW,
+                                         TELEMETRY_MODE_SUMMARY),
+    [CONFIG_KEY_TELEMETRY_WINDOW] =
+        FIELD_(telemetry_window_ms, COMMAND_TELEMETRY_MIN_WINDOW_S * 1000,
+               COMMAND_TELEMETRY_MAX_WINDOW_S * 1000),
+};
+#undef FIELD_
+
+#define FIELD_COUNT (sizeof(s_fields) / sizeof(s_fields[0]))
+
+_Static_assert(sizeof(telemetry_mode_t) == sizeof(int32_t),
+               "config_t members must be 32 bits wide");
+_Static_assert(sizeof(config_header_t) + FIELD_COUNT * 2 + sizeof(config_t) <=
+                   CONFIG_BLOB_MAX_BYTES,
+               "CONFIG_BLOB_MAX_BYTES too small");
+
+typedef void (*config_migration_t)(config_t *config);
+
+// s_migrations[v] turns the settings loaded from a version v blob into those
+// of version v + 1. Version 1 is the first schema, so there are none yet.
+static const config_migration_t s_migrations[CONFIG_SCHEMA_VERSION] = {0};
+
+// Changes copy the current settings into the other buffer and publish it, so
+// a reader never sees a value half written.
+static config_t s_buffers[2];
+static const config_t *volatile s_current = &s_buffers[0];
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_dirty; // Guarded by s_lock
+
+static nvs_handle_t s_nvs;
+static esp_timer_handle_t s_commit_timer;
+static uint64_t s_commit_delay_us;
+static config_change_cb_t s_on_change;
+// Commits in config_store_task, the esp_timer task must not wait for flash.
+static TaskHandle_t s_commit_task;
+// Serializes commits of config_store_task and config_store_flush.
+static SemaphoreHandle_t s_commit_lock;
+static StaticSemaphore_t s_commit_lock_buffer;
+static uint32_t s_committed_crc; // Of the blob in NVS, 0 if unknown
+
+static int32_t get_value(const config_t *config, const config_field_t *field,
+                         uint8_t index) {
+  int32_t value;
+  memcpy(&value,
+         (const uint8_t *)config + field->offset + index * sizeof(int32_t),
+         sizeof(value));
+  return value;
+}
+
+static void put_value(config_t *config, const config_field_t *field,
+                      uint8_t index, int32_t value) {
+  memcpy((uint8_t *)config + field->offset + index * sizeof(int32_t), &value,
+         sizeof(value));
+}
+
+// Records in the byte order of the target, which only ever reads its own.
+static size_t serialize(const config_t *config, uint8_t *out) {
+  size_t n = 0;
+  for (size_t key = 0; key < FIELD_COUNT; key++) {
+    const config_field_t *field = &s_fields[key];
+    size_t size = field->count * sizeof(int32_t);
+    out[n++] = (uint8_t)key;
+    out[n++] = field->count;
+    memcpy(out + n, (const uint8_t *)config + field->offset, size);
+    n += size;
+  }
+  return n;
+}
+
+static void apply_records(config_t *config, const uint8_t *records,
+                          size_t len) {
+  size_t n = 0;
+  while (len - n >= 2) {
+    uint8_t key = records[n];
+    uint8_t count = records[n + 1];
+    n += 2;
+    if (len - n < count * sizeof(int32_t)) {
+      ESP_LOGW(TAG, "Truncated record of key %u", key);
+      return;
+    }
+    if (key < FIELD_COUNT) {
+      const config_field_t *field = &s_fields[key];
+      for (uint8_t i = 0; i < count && i < field->count; i++) {
+        int32_t value;
+        memcpy(&value, records + n + i * sizeof(int32_t), sizeof(value));
+        if (value < field->min || value > field->max) {
+          ESP_LOGW(TAG, "Ignored key %u[%u] = %ld", key, i, (long)value);
+          continue;
+        }
+        put_value(config, field, i, value);
+      }
+    }
+    n += count * sizeof(int32_t);
+  }
+}
+
+// Returns the schema version the settings were loaded from, 0 if the
+// defaults were kept.
+static uint16_t load(config_t *config) {
+  uint8_t blob[CONFIG_BLOB_MAX_BYTES];
+  size_t len = sizeof(blob);
+  esp_err_t err = nvs_get_blob(s_nvs, CONFIG_BLOB_KEY, blob, &len);
+  if (err == ESP_ERR_NVS_NOT_FOUND) {
+    ESP_LOGI(TAG, "No stored settings, using defaults");
+    return 0;
+  }
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Error (%s) reading settings, using defaults",
+             esp_err_to_name(err));
+    return 0;
+  }
+
+  config_header_t header;
+  if (len < sizeof(header)) {
+    ESP_LOGW(TAG, "Stored settings too short, using defaults");
+    return 0;
+  }
+  memcpy(&header, blob, sizeof(header));
+  const uint8_t *records = blob + sizeof(header);
+  if (header.len != len - sizeof(header) ||
+      esp_rom_crc32_le(0, records, header.len) != header.crc) {
+    ESP_LOGW(TAG, "Stored settings corrupt, using defaults");
+    return 0;
+  }
+  if (header.version == 0 || header.version > CONFIG_SCHEMA_VERSION) {
+    ESP_LOGW(TAG, "Unknown settings version %u, using defaults",
+             header.version);
+    return 0;
+  }
+
+  apply_records(config, records, header.len);
+  for (uint16_t v = header.version; v < CONFIG_SCHEMA_VERSION; v++) {
+    if (s_migrations[v] != NULL) {
+      s_migrations[v](config);
+    }
+  }
+  if (header.version == CONFIG_SCHEMA_VERSION) {
+    s_committed_crc = header.crc;
+  }
+  ESP_LOGI(TAG, "Settings loaded, version %u", header.version);
+  return header.version;
+}
+
+static void commit_timer_cb(void *arg) {
+  if (s_commit_task != NULL) {
+    xTaskNotifyGive(s_commit_task);
+  }
+}
+
+esp_err_t config_store_init(const config_t *defaults, uint32_t commit_delay_ms,
+                            config_change_cb_t on_change) {
+  esp_err_t err = nvs_open(CONFIG_NAMESPACE, NVS_READWRITE, &s_nvs);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+    return err;
+  }
+
+  const esp_timer_create_args_t commit_timer_args = {
+      .callback = commit_timer_cb,
+      .name = "config_commit",
+  };
+  err = esp_timer_create(&commit_timer_args, &s_commit_timer);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create commit timer");
+    return err;
+  }
+  s_commit_lock = xSemaphoreCreateMutexStatic(&s_commit_lock_buffer);
+  s_commit_delay_us = (uint64_t)commit_delay_ms * 1000;
+  s_on_change = on_change;
+
+  s_buffers[0] = *defaults;
+  uint16_t version = load(&s_buffers[0]);
+  s_current = &s_buffers[0];
+  // Rewrite migrated settings so the migration runs only once.
+  if (version != 0 && version < CONFIG_SCHEMA_VERSION) {
+    s_dirty = true;
+    esp_timer_start_once(s_commit_timer, s_commit_delay_us);
+  }
+  return ESP_OK;
+}
+
+const config_t *config_store_get(void) { return s_current; }
+
+esp_err_t config_store_set(config_key_t key, uint8_t index, int32_t value) {
+  if (key < 0 || key >= FIELD_COUNT) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  const config_field_t *field = &s_fields[key];
+  if (index >= field->count || value < field->min || value > field->max) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  portENTER_CRITICAL(&s_lock);
+  const config_t *current = s_current;
+  bool changed = get_value(current, field, index) != value;
+  if (changed) {
+    config_t *next = current == &s_buffers[0] ? &s_buffers[1] : &s_buffers[0];
+    *next = *current;
+    put_value(next, field, index, value);
+    s_current = next;
+    s_dirty = true;
+  }
+  portEXIT_CRITICAL(&s_lock);
+  if (!changed) {
+    return ESP_OK;
+  }
+
+  // Every change restarts the delay, a burst ends in one commit.
+  esp_timer_stop(s_commit_timer);
+  esp_timer_start_once(s_commit_timer, s_commit_delay_us);
+  if (s_on_change != NULL) {
+    s_on_change(key, index);
+  }
+  return ESP_OK;
+}
+
+esp_err_t config_store_flush(void) {
+  xSemaphoreTake(s_commit_lock, portMAX_DELAY);
+  portENTER_CRITICAL(&s_lock);
+  bool dirty = s_dirty;
+  config_t config = *s_current;
+  s_dirty = false;
+  portEXIT_CRITICAL(&s_lock);
+
+  esp_err_t err = ESP_OK;
+  if (dirty) {
+    uint8_t blob[CONFIG_BLOB_MAX_BYTES];
+    size_t len = serialize(&config, blob + sizeof(config_header_t));
+    config_header_t header = {
+        .version = CONFIG_SCHEMA_VERSION,
+        .len = (uint16_t)len,
+        .crc = esp_rom_crc32_le(0, blob + sizeof(header), len),
+    };
+    memcpy(blob, &header, sizeof(header));
+
+    // Changed and changed back, the flash already holds it.
+    if (header.crc != s_committed_crc) {
+      err = nvs_set_blob(s_nvs, CONFIG_BLOB_KEY, blob, sizeof(header) + len);
+      if (err == ESP_OK) {
+        err = nvs_commit(s_nvs);
+      }
+      if (err == ESP_OK) {
+        s_committed_crc = header.crc;
+        ESP_LOGI(TAG, "Settings committed to NVS");
+      } else {
+        ESP_LOGE(TAG, "Error (%s) writing settings to NVS!",
+                 esp_err_to_name(err));
+        // Retried with the next change or flush.
+        portENTER_CRITICAL(&s_lock);
+        s_dirty = true;
+        portEXIT_CRITICAL(&s_lock);
+      }
+    }
+  }
+  xSemaphoreGive(s_commit_lock);
+  return err;
+}
+
+void config_store_task(void *arg) {
+  s_commit_task = xTaskGetCurrentTaskHandle();
+  while (1) {
+    // Also commits what the timer left pending before the task ran.
+    config_store_flush();
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
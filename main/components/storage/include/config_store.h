@@ -0,0 +1,106 @@
+#pragma once
+
+#include "esp_err.h"
+#include "growgrid_types.h"
+#include "telemetry_window.h"
+#include <stdint.h>
+
+/**
+ * Settings that can be changed at runtime, kept across reboots.
+ *
+ * All settings are loaded from NVS once by config_store_init into a RAM
+ * cache. Reads go to the cache without a lock. Changes are published to the
+ * cache at once and written to NVS in one commit after
+ * config_store_init's commit delay has passed without another change, so a
+ * burst of commands costs one flash write. Commits that would not change
+ * the stored blob are skipped. The commits run in config_store_task.
+ *
+ * The blob is a header with the schema version and a CRC, followed by one
+ * record per setting: key, value count and the values. Unknown keys and
+ * values beyond a setting's count are skipped and missing ones keep their
+ * default, so settings and sensors can be added without a migration. A
+ * setting whose meaning changes gets a new key or a migration step in
+ * config_store.c together with a CONFIG_SCHEMA_VERSION bump.
+ */
+
+#define CONFIG_NAMESPACE "config"
+#define CONFIG_SCHEMA_VERSION 1
+
+// Wire values in the blob and in change events, only ever appended.
+typedef enum {
+  CONFIG_KEY_SAMPLE_INTERVAL, // Indexed by sensor_data_type_t
+  CONFIG_KEY_SOIL_DRY,
+  CONFIG_KEY_SOIL_WET,
+  CONFIG_KEY_TELEMETRY_MODE,
+  CONFIG_KEY_TELEMETRY_WINDOW,
+} config_key_t;
+
+// Every member is 32 bits wide, see config_store_set.
+typedef struct {
+  uint32_t sample_interval_ms[SENSOR_DATA_TYPE_COUNT];
+  // Raw ADC readings of the soil calibration, 0 keeps the board's.
+  int32_t soil_dry_raw;
+  int32_t soil_wet_raw;
+  telemetry_mode_t telemetry_mode;
+  uint32_t telemetry_window_ms;
+} config_t;
+
+/**
+ * @brief Called after a setting changed, in the task that changed it.
+ *
+ * @param key The setting.
+ * @param index The changed value of an array setting, otherwise 0.
+ */
+typedef void (*config_change_cb_t)(config_key_t key, uint8_t index);
+
+/**
+ * @brief Loads the settings from NVS, falling back to the defaults.
+ *
+ * Must be called once after nvs_flash_init and before any other function.
+ * A blob with a bad CRC or a newer schema version is ignored.
+ *
+ * @param defaults Values of settings that were never changed.
+ * @param commit_delay_ms Quiet time after the last change before it is
+ *                        written to NVS.
+ * @param on_change Called for every change, may be NULL.
+ * @return ESP_OK on success.
+ */
+esp_err_t config_store_init(const config_t *defaults, uint32_t commit_delay_ms,
+                            config_change_cb_t on_change);
+
+/**
+ * @brief Returns the current settings.
+ *
+ * Lock-free. The settings stay valid until the next-but-one change, so
+ * read the members needed right away rather than keeping the pointer.
+ */
+const config_t *config_store_get(void);
+
+/**
+ * @brief Changes one setting.
+ *
+ * Readers see the new value at once, the NVS commit is deferred. Setting
+ * the current value again does nothing.
+ *
+ * @param key The setting.
+ * @param index Index into an array setting, otherwise 0.
+ * @param value The new value, enums and unsigned values cast to int32_t.
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for an unknown key or an
+ *         index or value out of the setting's range.
+ */
+esp_err_t config_store_set(config_key_t key, uint8_t index, int32_t value);
+
+/**
+ * @brief Writes pending changes to NVS now, e.g. before a restart.
+ *
+ * @return ESP_OK on success or if nothing was pending.
+ */
+esp_err_t config_store_flush(void);
+
+/**
+ * @brief Writes the changes to NVS once the commit delay has passed.
+ *
+ * Runs forever, the caller creates the task right after config_store_init.
+ * Until it runs, changes only reach NVS with config_store_flush.
+ */
+void config_store_task(void *arg);
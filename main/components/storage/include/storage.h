@@ -1,6 +1,8 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
 
 #define STORAGE_NAMESPACE "credentials"
 
@@ -13,6 +15,18 @@ typedef struct {
   char ntp_server[64];
 } credentials_t;
 
+typedef struct {
+  char site[32];
+  char device[32];
+} device_identity_t;
+
+// Last good association, used to skip the scan on the next connect. The
+// lease is kept by lwIP itself (CONFIG_LWIP_DHCP_RESTORE_LAST_IP).
+typedef struct {
+  uint8_t bssid[6];
+  uint8_t channel;
+} wifi_cache_t;
+
 /**
  * @brief Saves credentials to NVS.
  *
@@ -27,4 +41,61 @@ esp_err_t storage_save_credentials(const credentials_t *credentials);
  * @param credentials Pointer to a credentials struct to populate.
  * @return ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if not found.
  */
-esp_err_t storage_read_credentials(credentials_t *credentials);
\ No newline at end of file
+esp_err_t storage_read_credentials(credentials_t *credentials);
+
+/**
+ * @brief Saves the device identity (site and device name) to NVS.
+ *
+ * @param identity Pointer to the identity struct to save.
+ * @return ESP_OK on success.
+ */
+esp_err_t storage_save_identity(const device_identity_t *identity);
+
+/**
+ * @brief Reads the device identity from NVS.
+ *
+ * @param identity Pointer to an identity struct to populate.
+ * @return ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if not found.
+ */
+esp_err_t storage_read_identity(device_identity_t *identity);
+
+/**
+ * @brief Saves the last good Wi-Fi association to NVS.
+ *
+ * @param cache Pointer to the cache struct to save.
+ * @return ESP_OK on success.
+ */
+esp_err_t storage_save_wifi_cache(const wifi_cache_t *cache);
+
+/**
+ * @brief Reads the last good Wi-Fi association from NVS.
+ *
+ * @param cache Pointer to a cache struct to populate.
+ * @return ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if not found.
+ */
+esp_err_t storage_read_wifi_cache(wifi_cache_t *cache);
+
+/**
+ * @brief Removes the cached Wi-Fi association, e.g. after it failed.
+ *
+ * @return ESP_OK on success or if there was nothing to remove.
+ */
+esp_err_t storage_erase_wifi_cache(void);
+
+/**
+ * @brief Saves the pump rule source to NVS.
+ *
+ * @param rules The source, see rule_engine.h. Not NUL-terminated.
+ * @param len Length of the source in bytes.
+ * @return ESP_OK on success.
+ */
+esp_err_t storage_save_rules(const char *rules, size_t len);
+
+/**
+ * @brief Reads the pump rule source from NVS.
+ *
+ * @param rules Buffer to populate, not NUL-terminated.
+ * @param[in,out] len Size of the buffer, set to the source length.
+ * @return ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if not found.
+ */
+esp_err_t storage_read_rules(char *rules, size_t *len);
@@ -43,3 +43,138 @@ esp_err_t storage_read_credentials(credentials_t *credentials) {
   nvs_close(nvs_handle);
   return err;
 }
+
+esp_err_t storage_save_identity(const device_identity_t *identity) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &nvs_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+    return err;
+  }
+
+  err = nvs_set_blob(nvs_handle, "identity", identity,
+                     sizeof(device_identity_t));
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) writing identity to NVS!",
+             esp_err_to_name(err));
+  } else {
+    ESP_LOGI(TAG, "Identity saved to NVS");
+  }
+
+  nvs_commit(nvs_handle);
+  nvs_close(nvs_handle);
+  return err;
+}
+
+esp_err_t storage_read_identity(device_identity_t *identity) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READONLY, &nvs_handle);
+  if (err != ESP_OK) {
+    ESP_LOGD(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+    return err;
+  }
+
+  size_t required_size = sizeof(device_identity_t);
+  err = nvs_get_blob(nvs_handle, "identity", identity, &required_size);
+  if (err != ESP_OK) {
+    ESP_LOGD(TAG, "Error (%s) reading identity from NVS!",
+             esp_err_to_name(err));
+  }
+
+  nvs_close(nvs_handle);
+  return err;
+}
+
+esp_err_t storage_save_wifi_cache(const wifi_cache_t *cache) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &nvs_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+    return err;
+  }
+
+  err = nvs_set_blob(nvs_handle, "wifi_cache", cache, sizeof(wifi_cache_t));
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) writing Wi-Fi cache to NVS!",
+             esp_err_to_name(err));
+  }
+
+  nvs_commit(nvs_handle);
+  nvs_close(nvs_handle);
+  return err;
+}
+
+esp_err_t storage_read_wifi_cache(wifi_cache_t *cache) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READONLY, &nvs_handle);
+  if (err != ESP_OK) {
+    ESP_LOGD(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+    return err;
+  }
+
+  size_t required_size = sizeof(wifi_cache_t);
+  err = nvs_get_blob(nvs_handle, "wifi_cache", cache, &required_size);
+  if (err != ESP_OK) {
+    ESP_LOGD(TAG, "Error (%s) reading Wi-Fi cache from NVS!",
+             esp_err_to_name(err));
+  }
+
+  nvs_close(nvs_handle);
+  return err;
+}
+
+esp_err_t storage_erase_wifi_cache(void) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &nvs_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+    return err;
+  }
+
+  err = nvs_erase_key(nvs_handle, "wifi_cache");
+  if (err == ESP_ERR_NVS_NOT_FOUND) {
+    err = ESP_OK;
+  }
+
+  nvs_commit(nvs_handle);
+  nvs_close(nvs_handle);
+  return err;
+}
+
+esp_err_t storage_save_rules(const char *rules, size_t len) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &nvs_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+    return err;
+  }
+
+  err = nvs_set_blob(nvs_handle, "rules", rules, len);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) writing rules to NVS!", esp_err_to_name(err));
+  } else {
+    ESP_LOGI(TAG, "Rules saved to NVS");
+  }
+
+  nvs_commit(nvs_handle);
+  nvs_close(nvs_handle);
+  return err;
+}
+
+esp_err_t storage_read_rules(char *rules, size_t *len) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READONLY, &nvs_handle);
+  if (err != ESP_OK) {
+    ESP_LOGD(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+    return err;
+  }
+
+  err = nvs_get_blob(nvs_handle, "rules", rules, len);
+  if (err != ESP_OK) {
+    ESP_LOGD(TAG, "Error (%s) reading rules from NVS!",
+             esp_err_to_name(err));
+  }
+
+  nvs_close(nvs_handle);
+  return err;
+}
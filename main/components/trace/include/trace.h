@@ -0,0 +1,143 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Binary trace of the telemetry pipeline.
+ *
+ * Each trace point writes one fixed-size record (cycle count, span, point,
+ * phase, argument) into a ring per core. Writers claim a slot with a single
+ * atomic increment, so points may be hit from any task or ISR without a lock.
+ * A span follows one sample from the sensor read over the event bus to the
+ * MQTT publish.
+ *
+ * Built with idf.py -DGROWGRID_TRACE=ON, otherwise every macro below
+ * compiles to nothing. The rings are dumped on demand with the `trace`
+ * command and converted with tools/trace_to_perfetto.py.
+ */
+
+#ifndef GROWGRID_TRACE
+#define GROWGRID_TRACE 0
+#endif
+
+// Records per core, a power of two. The oldest records are overwritten.
+#define TRACE_RING_RECORDS 512
+
+// Dump layout, all fields little endian:
+//   header    "GGTR", u8 version, u8 cores, u8 points, u8 record size,
+//             u32 cpu_hz
+//   names     one NUL-terminated name per trace point
+//   per core  u32 record count, then the records oldest first
+#define TRACE_DUMP_MAGIC "GGTR"
+#define TRACE_DUMP_VERSION 1
+
+// X(name)
+#define TRACE_POINTS(X)                                                        \
+  X(SENSOR_READ)                                                               \
+  X(EVENT_POST)                                                                \
+  X(EVENT_DISTRIBUTE)                                                          \
+  X(EVENT_RECEIVE)                                                             \
+  X(MQTT_PUBLISH)                                                              \
+  X(MQTT_ENQUEUE)
+
+typedef enum {
+#define TRACE_POINT_ID_(name) TRACE_POINT_##name,
+  TRACE_POINTS(TRACE_POINT_ID_)
+#undef TRACE_POINT_ID_
+  TRACE_POINT_COUNT,
+} trace_point_t;
+
+typedef enum {
+  TRACE_PHASE_BEGIN,
+  TRACE_PHASE_END,
+  TRACE_PHASE_INSTANT,
+} trace_phase_t;
+
+typedef struct {
+  uint32_t cycles; // CPU cycle counter, unwrapped on the host
+  uint16_t span;   // 0 if the record belongs to no span
+  uint8_t point;
+  uint8_t phase;
+  uint32_t arg;
+} trace_record_t;
+
+_Static_assert(sizeof(trace_record_t) == 12, "Trace record layout changed");
+
+#if GROWGRID_TRACE
+
+#include "esp_cpu.h"
+#include "freertos/FreeRTOS.h"
+
+typedef struct {
+  uint32_t head; // Total records written, the slot is head % size
+  trace_record_t records[TRACE_RING_RECORDS];
+} trace_ring_t;
+
+extern trace_ring_t trace_rings[portNUM_PROCESSORS];
+extern volatile bool trace_active;
+
+static inline void trace_record(trace_point_t point, trace_phase_t phase,
+                                uint16_t span, uint32_t arg) {
+  if (!trace_active) {
+    return;
+  }
+  trace_ring_t *ring = &trace_rings[esp_cpu_get_core_id()];
+  uint32_t slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED) &
+                  (TRACE_RING_RECORDS - 1);
+  trace_record_t *rec = &ring->records[slot];
+  rec->cycles = esp_cpu_get_cycle_count();
+  rec->span = span;
+  rec->point = (uint8_t)point;
+  rec->phase = (uint8_t)phase;
+  rec->arg = arg;
+}
+
+#define TRACE_BEGIN(point, span, arg)                                          \
+  trace_record(TRACE_POINT_##point, TRACE_PHASE_BEGIN, (span), (uint32_t)(arg))
+#define TRACE_END(point, span, arg)                                            \
+  trace_record(TRACE_POINT_##point, TRACE_PHASE_END, (span), (uint32_t)(arg))
+#define TRACE_INSTANT(point, span, arg)                                        \
+  trace_record(TRACE_POINT_##point, TRACE_PHASE_INSTANT, (span),              \
+               (uint32_t)(arg))
+#define TRACE_SPAN_NEW() trace_span_new()
+
+/**
+ * @brief Returns a new span id, never 0.
+ */
+uint16_t trace_span_new(void);
+
+/**
+ * @brief Returns the size of a dump of full rings, the largest possible.
+ */
+size_t trace_dump_size(void);
+
+/**
+ * @brief Writes a dump of all rings into a buffer.
+ *
+ * Recording is paused while the rings are copied, records of points hit in
+ * the meantime are lost.
+ *
+ * @return The dump length, or 0 if it did not fit into the buffer.
+ */
+size_t trace_dump(uint8_t *buf, size_t size);
+
+/**
+ * @brief Writes a dump of all rings to the console as hex lines.
+ *
+ * The lines are framed by "GGTRACE BEGIN" and "GGTRACE END" and can be fed
+ * to tools/trace_to_perfetto.py together with the rest of the monitor
+ * output.
+ */
+void trace_dump_uart(void);
+
+#else
+
+// The arguments are still referenced so variables that only feed trace
+// points do not trigger unused warnings, the compiler drops them.
+#define TRACE_BEGIN(point, span, arg) ((void)(span), (void)(arg))
+#define TRACE_END(point, span, arg) ((void)(span), (void)(arg))
+#define TRACE_INSTANT(point, span, arg) ((void)(span), (void)(arg))
+#define TRACE_SPAN_NEW() ((uint16_t)0)
+
+#endif
@@ -0,0 +1,140 @@
+#include "trace.h"
+
+#if GROWGRID_TRACE
+
+#include "sdkconfig.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TRACE_HEADER_BYTES 12
+#define TRACE_UART_LINE_BYTES 32
+
+trace_ring_t trace_rings[portNUM_PROCESSORS];
+volatile bool trace_active = true;
+
+static uint16_t s_next_span;
+
+static const char *const s_point_names[] = {
+#define TRACE_POINT_NAME_(name) #name,
+    TRACE_POINTS(TRACE_POINT_NAME_)
+#undef TRACE_POINT_NAME_
+};
+
+typedef void (*trace_write_fn)(const void *data, size_t len, void *ctx);
+
+uint16_t trace_span_new(void) {
+  uint16_t span;
+  do {
+    span = __atomic_add_fetch(&s_next_span, 1, __ATOMIC_RELAXED);
+  } while (span == 0);
+  return span;
+}
+
+static uint32_t ring_count(const trace_ring_t *ring) {
+  return ring->head < TRACE_RING_RECORDS ? ring->head : TRACE_RING_RECORDS;
+}
+
+static void write_u32(trace_write_fn write, void *ctx, uint32_t value) {
+  uint8_t bytes[4] = {value, value >> 8, value >> 16, value >> 24};
+  write(bytes, sizeof(bytes), ctx);
+}
+
+// Streams the dump so the console path needs no buffer. The rings are
+// little endian like the dump, so records are written as they are.
+static void dump(trace_write_fn write, void *ctx) {
+  trace_active = false;
+
+  uint8_t header[8] = {0};
+  memcpy(header, TRACE_DUMP_MAGIC, 4);
+  header[4] = TRACE_DUMP_VERSION;
+  header[5] = portNUM_PROCESSORS;
+  header[6] = TRACE_POINT_COUNT;
+  header[7] = sizeof(trace_record_t);
+  write(header, sizeof(header), ctx);
+  write_u32(write, ctx, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000000U);
+
+  for (int i = 0; i < TRACE_POINT_COUNT; i++) {
+    write(s_point_names[i], strlen(s_point_names[i]) + 1, ctx);
+  }
+
+  for (int core = 0; core < portNUM_PROCESSORS; core++) {
+    const trace_ring_t *ring = &trace_rings[core];
+    uint32_t count = ring_count(ring);
+    write_u32(write, ctx, count);
+    // Oldest first: once the ring wrapped that is the slot after the head.
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t slot = (ring->head - count + i) & (TRACE_RING_RECORDS - 1);
+      write(&ring->records[slot], sizeof(trace_record_t), ctx);
+    }
+  }
+
+  trace_active = true;
+}
+
+size_t trace_dump_size(void) {
+  size_t size = TRACE_HEADER_BYTES;
+  for (int i = 0; i < TRACE_POINT_COUNT; i++) {
+    size += strlen(s_point_names[i]) + 1;
+  }
+  // Full rings, so the size still holds when records arrive meanwhile.
+  size += portNUM_PROCESSORS * (4 + sizeof(trace_rings[0].records));
+  return size;
+}
+
+typedef struct {
+  uint8_t *buf;
+  size_t size;
+  size_t len;
+} buffer_writer_t;
+
+static void buffer_write(const void *data, size_t len, void *ctx) {
+  buffer_writer_t *w = ctx;
+  if (w->len + len <= w->size) {
+    memcpy(w->buf + w->len, data, len);
+  }
+  w->len += len;
+}
+
+size_t trace_dump(uint8_t *buf, size_t size) {
+  buffer_writer_t w = {.buf = buf, .size = size};
+  dump(buffer_write, &w);
+  return w.len <= size ? w.len : 0;
+}
+
+typedef struct {
+  uint8_t line[TRACE_UART_LINE_BYTES];
+  size_t len;
+} uart_writer_t;
+
+static void uart_flush(uart_writer_t *w) {
+  if (w->len == 0) {
+    return;
+  }
+  printf("GGTRACE ");
+  for (size_t i = 0; i < w->len; i++) {
+    printf("%02x", w->line[i]);
+  }
+  printf("\n");
+  w->len = 0;
+}
+
+static void uart_write(const void *data, size_t len, void *ctx) {
+  uart_writer_t *w = ctx;
+  const uint8_t *bytes = data;
+  for (size_t i = 0; i < len; i++) {
+    w->line[w->len++] = bytes[i];
+    if (w->len == sizeof(w->line)) {
+      uart_flush(w);
+    }
+  }
+}
+
+void trace_dump_uart(void) {
+  uart_writer_t w = {0};
+  printf("GGTRACE BEGIN\n");
+  dump(uart_write, &w);
+  uart_flush(&w);
+  printf("GGTRACE END\n");
+}
+
+#endif
@@ -0,0 +1,7 @@
+#include "soil_moisture.h"
+#include "map_value.h"
+
+int soil_moisture_percent(int raw, int wet, int dry) {
+  int percent = map_value(raw, wet, dry, 100, 0);
+  return percent > 100 ? 100 : percent;
+}
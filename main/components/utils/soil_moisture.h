@@ -0,0 +1,10 @@
+#pragma once
+
+/**
+ * @brief Converts a raw soil sensor reading into a moisture percentage.
+ *
+ * The capacitive sensor reads lower the wetter the soil, so @p wet maps to
+ * 100 % and @p dry to 0 %. Readings wetter than the calibration are capped
+ * at 100 %.
+ */
+int soil_moisture_percent(int raw, int wet, int dry);
@@ -0,0 +1,339 @@
+#include "app_config.h"
+#include "derived_metrics.h"
+#include "esp_log.h"
+#include "event_bus.h"
+#include "event_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "pump_control.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Feeds the recording in $REPLAY_FILE into event_bus_post and writes a JSON
+ * report to $REPLAY_OUTPUT, or stdout.
+ *
+ * $REPLAY_SPEED scales the recorded timing: 1 (default) is real time, N is N
+ * times faster, 0 posts as fast as the subscriber keeps up. A subscriber at
+ * the pump control priority receives everything and runs the control step
+ * of the pump control task (pump_control.h) on it, with $REPLAY_RULES or
+ * PUMP_DEFAULT_RULES and the recorded sample times as the clock, so the
+ * report shows what the pipeline delivered and what the rules decided.
+ * Reports of different firmware versions on the same recording are directly
+ * comparable. The recording holds the raw lux only, so the DLI of light
+ * samples is integrated again before posting, as the light sensor task does.
+ *
+ * With a `predict` rule the irrigation model learns from the recorded
+ * samples and pump runs, and the report compares the crossing it predicted
+ * at its first pulse with the one in the recording. The replayed pulses do
+ * not change the recorded moisture, so only the first one is meaningful.
+ */
+
+static const char *TAG = "REPLAY";
+
+#define EVENT_TYPE_COUNT (EVENT_TYPE_CONFIG_CHANGED + 1)
+// The subscriber is considered drained after this long without an event.
+#define DRAIN_IDLE_MS 200
+
+static const char *const s_event_type_names[EVENT_TYPE_COUNT] = {
+    [EVENT_TYPE_SENSOR_DATA] = "sensor_data",
+    [EVENT_TYPE_WIFI_CONNECTED] = "wifi_connected",
+    [EVENT_TYPE_WIFI_DISCONNECTED] = "wifi_disconnected",
+    [EVENT_TYPE_MQTT_CONNECTED] = "mqtt_connected",
+    [EVENT_TYPE_PUMP_STATE_CHANGE] = "pump_state_change",
+    [EVENT_TYPE_COMMAND] = "command",
+    [EVENT_TYPE_COMMAND_ACK] = "command_ack",
+    [EVENT_TYPE_SENSOR_HEALTH] = "sensor_health",
+    [EVENT_TYPE_CONFIG_CHANGED] = "config_changed",
+};
+
+typedef struct {
+  uint32_t posted[EVENT_TYPE_COUNT];
+  uint32_t post_failed;
+  uint32_t delivered[EVENT_TYPE_COUNT];
+  uint32_t soil_samples;
+  uint32_t pump_starts; // Rule engine decisions to start the pump
+  int64_t first_start_s; // Sample time of the first start, -1 if none
+  uint64_t first_sample_us;
+  uint32_t recorded_pump_changes;
+  uint32_t pulses;              // Predicted pulses
+  int64_t first_pulse_s;        // -1 if none
+  int64_t predicted_crossing_s; // Made at the first pulse, -1 if none
+  int64_t crossing_s;           // Recorded moisture below the threshold
+} replay_stats_t;
+
+static replay_stats_t s_stats = {
+    .first_start_s = -1,
+    .first_pulse_s = -1,
+    .predicted_crossing_s = -1,
+    .crossing_s = -1,
+};
+static rule_program_t s_program;
+static pump_control_t s_ctrl;
+static int64_t s_now_us; // Time of the latest sample since the first one
+static dli_t s_dli;      // Only touched by app_main
+static volatile uint32_t s_delivered_total;
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// Like the pump control task, with the recorded sample times as the clock
+// and the recorded pump runs teaching the model. The decisions are counted
+// instead of carried out, so they do not change the recorded moisture.
+static void control_step(void) {
+  pump_control_decision_t decision = pump_control_step(&s_ctrl, s_now_us);
+  uint32_t now_s = (uint32_t)(s_now_us / 1000000);
+  switch (decision.action) {
+  case PUMP_CONTROL_START:
+    s_stats.pump_starts++;
+    if (s_stats.first_start_s < 0) {
+      s_stats.first_start_s = now_s;
+    }
+    break;
+  case PUMP_CONTROL_PULSE:
+    s_stats.pulses++;
+    if (s_stats.first_pulse_s < 0) {
+      s_stats.first_pulse_s = now_s;
+      s_stats.predicted_crossing_s = now_s + decision.plan.crossing_in_s;
+    }
+    break;
+  case PUMP_CONTROL_STOP:
+  case PUMP_CONTROL_NONE:
+    break;
+  }
+}
+
+static void feed_sensor_data(const sensor_data_t *data) {
+  if (s_stats.first_sample_us == 0) {
+    s_stats.first_sample_us = data->timestamp_us;
+  }
+  s_now_us = (int64_t)(data->timestamp_us - s_stats.first_sample_us);
+  // The time of day is taken from the sample timestamp in the local time
+  // zone of the host (set TZ to match the device).
+  pump_control_set_wall_clock(&s_ctrl, (int64_t)data->timestamp_us);
+  if (!pump_control_sensor_data(&s_ctrl, data, s_now_us) ||
+      data->type != SENSOR_DATA_TYPE_SOIL_MOISTURE) {
+    return;
+  }
+  s_stats.soil_samples++;
+  if (s_stats.crossing_s < 0 && s_program.predict_below_pct > 0 &&
+      data->payload.soil_moisture.percent <
+          (int)s_program.predict_below_pct) {
+    s_stats.crossing_s = s_now_us / 1000000;
+  }
+}
+
+static void control_task(void *arg) {
+  QueueHandle_t queue = arg;
+  event_t event;
+  while (1) {
+    if (xQueueReceive(queue, &event, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    if (event.type < EVENT_TYPE_COUNT) {
+      s_stats.delivered[event.type]++;
+    }
+    if (event.type == EVENT_TYPE_PUMP_STATE_CHANGE) {
+      s_stats.recorded_pump_changes++;
+      pump_control_pump_state(&s_ctrl, event.data.pump_state.is_on,
+                              s_now_us);
+    } else if (event.type == EVENT_TYPE_SENSOR_DATA) {
+      feed_sensor_data(&event.data.sensor_data);
+    } else if (event.type == EVENT_TYPE_SENSOR_HEALTH) {
+      pump_control_sensor_health(&s_ctrl, event.data.sensor_health.sensor,
+                                 event.data.sensor_health.state);
+    }
+    control_step();
+    s_delivered_total++;
+  }
+}
+
+static uint8_t *read_file(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *data = size > 0 ? malloc((size_t)size) : NULL;
+  if (data != NULL && fread(data, 1, (size_t)size, f) != (size_t)size) {
+    free(data);
+    data = NULL;
+  }
+  fclose(f);
+  *len = (size_t)size;
+  return data;
+}
+
+// Adds what the sensor tasks derive before posting a sample.
+static void derive(sensor_data_t *data) {
+  if (data->type == SENSOR_DATA_TYPE_LIGHT) {
+    data->payload.light.dli =
+        dli_add(&s_dli, data->timestamp_us,
+                dli_local_day(data->timestamp_us), data->payload.light.lux);
+  }
+}
+
+// At full speed the replay still waits for the subscriber, so no event is
+// lost to a full queue and the run measures what the pipeline sustains.
+static void wait_for_room(uint32_t posted) {
+  uint64_t deadline = now_us() + EVENT_BUS_POST_TIMEOUT_MS * 1000;
+  while (posted - s_delivered_total >= EVENT_BUS_QUEUE_SIZE &&
+         now_us() < deadline) {
+    taskYIELD();
+  }
+}
+
+// Waits until the subscriber has been idle for DRAIN_IDLE_MS.
+static void wait_drained(void) {
+  uint32_t seen;
+  do {
+    seen = s_delivered_total;
+    vTaskDelay(pdMS_TO_TICKS(DRAIN_IDLE_MS));
+  } while (seen != s_delivered_total);
+}
+
+static void write_report(FILE *out, const char *path, double speed,
+                         const event_log_reader_t *reader, esp_err_t result,
+                         uint64_t recording_us, uint64_t wall_us) {
+  uint32_t posted = 0;
+  uint32_t delivered = 0;
+  for (int i = 0; i < EVENT_TYPE_COUNT; i++) {
+    posted += s_stats.posted[i];
+    delivered += s_stats.delivered[i];
+  }
+  double wall_s = (double)wall_us / 1e6;
+  fprintf(out,
+          "{\"file\":\"%s\",\"speed\":%.2f,\"result\":\"%s\","
+          "\"chunks\":%" PRIu32 ",\"lost_chunks\":%" PRIu32
+          ",\"skipped\":%" PRIu32 ",\n\"events\":%" PRIu32
+          ",\"post_failed\":%" PRIu32 ",\"delivered\":%" PRIu32
+          ",\"recording_s\":%.1f,\"wall_s\":%.3f,\"events_per_s\":%.0f,\n"
+          "\"by_type\":{",
+          path, speed, esp_err_to_name(result), reader->chunks,
+          reader->lost_chunks, reader->skipped, posted, s_stats.post_failed,
+          delivered, (double)recording_us / 1e6, wall_s,
+          wall_s > 0 ? posted / wall_s : 0);
+  for (int i = 0; i < EVENT_TYPE_COUNT; i++) {
+    fprintf(out, "%s\"%s\":{\"posted\":%" PRIu32 ",\"delivered\":%" PRIu32 "}",
+            i > 0 ? "," : "", s_event_type_names[i], s_stats.posted[i],
+            s_stats.delivered[i]);
+  }
+  fprintf(out,
+          "},\n\"control\":{\"soil_samples\":%" PRIu32
+          ",\"pump_starts\":%" PRIu32 ",\"first_start_s\":%" PRId64
+          ",\"recorded_pump_changes\":%" PRIu32 "},\n",
+          s_stats.soil_samples, s_stats.pump_starts, s_stats.first_start_s,
+          s_stats.recorded_pump_changes);
+  fprintf(out,
+          "\"predict\":{\"pulses\":%" PRIu32 ",\"first_pulse_s\":%" PRId64
+          ",\"predicted_crossing_s\":%" PRId64 ",\"crossing_s\":%" PRId64
+          ",\"rate_pct_per_h\":%.3f,\"gain_pct_per_s\":%.3f}}\n",
+          s_stats.pulses, s_stats.first_pulse_s, s_stats.predicted_crossing_s,
+          s_stats.crossing_s,
+          (double)irrigation_model_rate_q16(&s_ctrl.model) / 65536.0,
+          (double)s_ctrl.model.gain_q16 / 65536.0);
+}
+
+void app_main(void) {
+  const char *path = getenv("REPLAY_FILE");
+  const char *speed_env = getenv("REPLAY_SPEED");
+  const char *output = getenv("REPLAY_OUTPUT");
+  const char *rules = getenv("REPLAY_RULES");
+  double speed = speed_env != NULL ? atof(speed_env) : 1.0;
+
+  size_t len = 0;
+  uint8_t *data = path != NULL ? read_file(path, &len) : NULL;
+  if (data == NULL || speed < 0) {
+    ESP_LOGE(TAG, "Set REPLAY_FILE to a recording and REPLAY_SPEED >= 0");
+    exit(2);
+  }
+
+  if (rules == NULL) {
+    rules = PUMP_DEFAULT_RULES;
+  }
+  int line;
+  if (rule_compile(rules, strlen(rules), &s_program, &line) !=
+      RULE_COMPILE_OK) {
+    ESP_LOGE(TAG, "REPLAY_RULES fail in statement %d", line);
+    exit(2);
+  }
+  static const irrigation_config_t irrigation_config = IRRIGATION_CONFIG;
+  pump_control_init(&s_ctrl, &s_program, &irrigation_config, 0);
+  dli_init(&s_dli, DLI_LUX_PER_PPFD, DLI_MAX_GAP_MS);
+
+  ESP_ERROR_CHECK(event_bus_init());
+  ESP_ERROR_CHECK(event_bus_start_distributor());
+  QueueHandle_t queue = event_bus_subscribe();
+  if (queue == NULL ||
+      xTaskCreate(control_task, "replay_control", TASK_STACK_PUMP_CONTROL,
+                  queue, TASK_PRIO_PUMP_CONTROL, NULL) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to start the control subscriber");
+    exit(1);
+  }
+
+  event_log_reader_t reader;
+  event_log_reader_init(&reader, data, len);
+  event_t event;
+  uint64_t time_us;
+  bool first = true;
+  uint64_t first_us = 0;
+  uint64_t last_us = 0;
+  uint32_t posted = 0;
+  uint64_t start = now_us();
+  esp_err_t result;
+  while ((result = event_log_reader_next(&reader, &event, &time_us)) ==
+         ESP_OK) {
+    if (first) {
+      first_us = time_us;
+      first = false;
+    }
+    last_us = time_us;
+    if (speed > 0) {
+      uint64_t due = start + (uint64_t)((double)(time_us - first_us) / speed);
+      uint64_t now = now_us();
+      if (due > now) {
+        vTaskDelay(pdMS_TO_TICKS((due - now) / 1000));
+      }
+    } else {
+      wait_for_room(posted);
+    }
+    if (event.type == EVENT_TYPE_SENSOR_DATA) {
+      derive(&event.data.sensor_data);
+    }
+    if (event.type < EVENT_TYPE_COUNT) {
+      s_stats.posted[event.type]++;
+    }
+    if (event_bus_post(&event, EVENT_BUS_POST_TIMEOUT_MS) == ESP_OK) {
+      posted++;
+    } else {
+      s_stats.post_failed++;
+    }
+  }
+  wait_drained();
+  uint64_t wall_us = now_us() - start - DRAIN_IDLE_MS * 1000;
+
+  // ESP_ERR_NOT_FOUND is the regular end of the recording.
+  FILE *out = output != NULL ? fopen(output, "w") : stdout;
+  if (out == NULL) {
+    ESP_LOGE(TAG, "Cannot open %s", output);
+    exit(1);
+  }
+  write_report(out, path, speed, &reader,
+               result == ESP_ERR_NOT_FOUND ? ESP_OK : result,
+               last_us - first_us, wall_us);
+  if (out != stdout) {
+    fclose(out);
+  }
+  free(data);
+  // The scheduler keeps running after app_main returns on this target.
+  exit(result == ESP_ERR_NOT_FOUND ? 0 : 1);
+}
@@ -0,0 +1,47 @@
+#include "test.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *s_suite;
+static const char *s_test;
+static int s_failed_checks;
+
+static void report(const char *file, int line) {
+  fprintf(stderr, "FAIL %s/%s at %s:%d: ", s_suite, s_test, file, line);
+  s_failed_checks++;
+}
+
+void test_check(bool ok, const char *expr, const char *file, int line) {
+  if (!ok) {
+    report(file, line);
+    fprintf(stderr, "%s\n", expr);
+  }
+}
+
+void test_check_eq(int64_t actual, int64_t expected, const char *expr,
+                   const char *file, int line) {
+  if (actual != expected) {
+    report(file, line);
+    fprintf(stderr, "%s is %" PRId64 ", expected %" PRId64 "\n", expr, actual,
+            expected);
+  }
+}
+
+int test_run_suite(const test_suite_t *suite, const char *filter) {
+  char name[128];
+  int failed = 0;
+  s_suite = suite->name;
+  for (int i = 0; i < suite->count; i++) {
+    snprintf(name, sizeof(name), "%s/%s", suite->name, suite->tests[i].name);
+    if (filter != NULL && strstr(name, filter) == NULL) {
+      continue;
+    }
+    s_test = suite->tests[i].name;
+    s_failed_checks = 0;
+    suite->tests[i].run();
+    printf("%s %s\n", s_failed_checks == 0 ? "ok  " : "FAIL", name);
+    failed += s_failed_checks != 0;
+  }
+  return failed;
+}
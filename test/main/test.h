@@ -0,0 +1,48 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A host test is a function of checks. A failed check is reported with its
+ * location and the test goes on, so one run shows every broken expectation.
+ */
+typedef struct {
+  const char *name;
+  void (*run)(void);
+} test_t;
+
+typedef struct {
+  const char *name;
+  const test_t *tests;
+  int count;
+} test_suite_t;
+
+#define TEST_SUITE(id, table)                                                  \
+  const test_suite_t test_suite_##id = {#id, (table),                          \
+                                        sizeof(table) / sizeof((table)[0])}
+
+#define TEST_CHECK(cond) test_check((cond), #cond, __FILE__, __LINE__)
+
+// Also prints both values when they differ.
+#define TEST_CHECK_EQ(actual, expected)                                        \
+  test_check_eq((int64_t)(actual), (int64_t)(expected), #actual, __FILE__,     \
+                __LINE__)
+
+/**
+ * @brief Records a check of the running test.
+ */
+void test_check(bool ok, const char *expr, const char *file, int line);
+
+/**
+ * @brief Records an equality check of the running test.
+ */
+void test_check_eq(int64_t actual, int64_t expected, const char *expr,
+                   const char *file, int line);
+
+/**
+ * @brief Runs the tests of a suite whose name contains the filter.
+ *
+ * @param filter Substring of "suite/test", NULL runs all.
+ * @return The number of failed tests.
+ */
+int test_run_suite(const test_suite_t *suite, const char *filter);
@@ -0,0 +1,227 @@
+#include "duty_cycle.h"
+#include "test.h"
+#include <string.h>
+
+#define SAMPLE_MS 60000
+#define UPLOAD_MS (15 * 60000)
+#define POINTS_PER_SAMPLE 4
+#define T0_US ((int64_t)TELEMETRY_MIN_VALID_TIMESTAMP_US)
+
+// What low_power.c keeps in RTC memory, driven by a simulated clock.
+typedef struct {
+  duty_cycle_t duty;
+  duty_buffer_t buffer;
+  int64_t now_us;
+  bool upload_ok;     // Outcome of the next bursts
+  uint32_t wake_ms;   // Time a wake takes before going back to sleep
+  uint32_t sample_at; // Wakes that sampled
+  uint32_t upload_at; // Wakes that uploaded
+} device_t;
+
+static const duty_cycle_config_t s_config = {SAMPLE_MS, UPLOAD_MS};
+
+static void device_boot(device_t *dev, int64_t now_us) {
+  memset(dev, 0, sizeof(*dev));
+  dev->now_us = now_us;
+  dev->upload_ok = true;
+  duty_cycle_init(&dev->duty, &s_config, now_us);
+  duty_buffer_reset(&dev->buffer);
+}
+
+static void sample(device_t *dev) {
+  for (int i = 0; i < POINTS_PER_SAMPLE; i++) {
+    telemetry_point_t point = {(uint64_t)dev->now_us, i, (float)i};
+    duty_cycle_store(&dev->duty, &dev->buffer, &point);
+  }
+}
+
+// One timer wakeup as in low_power_task, then sleeps until the next one.
+static unsigned device_wake(device_t *dev) {
+  unsigned actions = duty_cycle_wake(&dev->duty, &dev->buffer, dev->now_us);
+  if (actions & DUTY_ACTION_SAMPLE) {
+    sample(dev);
+    duty_cycle_sampled(&dev->duty, dev->now_us);
+    dev->sample_at++;
+  }
+  dev->now_us += (int64_t)dev->wake_ms * 1000;
+  if (actions & DUTY_ACTION_UPLOAD) {
+    duty_cycle_uploaded(&dev->duty, &dev->buffer, dev->upload_ok, 2000000,
+                        dev->now_us);
+    dev->upload_at++;
+  }
+  dev->now_us += duty_cycle_sleep_us(&dev->duty, dev->now_us);
+  return actions;
+}
+
+static void test_first_wake_samples_and_uploads(void) {
+  device_t dev;
+  device_boot(&dev, T0_US);
+  TEST_CHECK_EQ(device_wake(&dev), DUTY_ACTION_SAMPLE | DUTY_ACTION_UPLOAD);
+  TEST_CHECK_EQ(dev.duty.stats.uploads, 1);
+  TEST_CHECK_EQ(dev.buffer.count, 0);
+  TEST_CHECK_EQ(dev.now_us, T0_US + SAMPLE_MS * 1000LL);
+}
+
+static void test_schedule(void) {
+  device_t dev;
+  device_boot(&dev, T0_US);
+  while (dev.now_us < T0_US + 3600 * 1000000LL) {
+    device_wake(&dev);
+  }
+  // Samples at every minute, bursts at 0, 15, 30 and 45 minutes.
+  TEST_CHECK_EQ(dev.duty.stats.wakes, 60);
+  TEST_CHECK_EQ(dev.sample_at, 60);
+  TEST_CHECK_EQ(dev.duty.stats.uploads, 4);
+  TEST_CHECK_EQ(dev.duty.stats.samples, 60 * POINTS_PER_SAMPLE);
+  TEST_CHECK_EQ(dev.duty.stats.radio_on_us, 4 * 2000000LL);
+  // The last burst at 45 min took the samples up to then.
+  TEST_CHECK_EQ(dev.buffer.count, 14 * POINTS_PER_SAMPLE);
+}
+
+// The schedule stays on the sample grid while the wakes take time.
+static void test_wake_time_does_not_drift(void) {
+  device_t dev;
+  device_boot(&dev, T0_US);
+  dev.wake_ms = 1500;
+  while (dev.sample_at < 30) {
+    device_wake(&dev);
+  }
+  TEST_CHECK_EQ(dev.duty.next_sample_us, T0_US + 30LL * SAMPLE_MS * 1000);
+  // Bursts are scheduled from their end, off the sample grid.
+  TEST_CHECK_EQ(dev.duty.stats.wakes, 30 + 1);
+}
+
+static void test_missed_samples_are_skipped(void) {
+  device_t dev;
+  device_boot(&dev, T0_US);
+  device_wake(&dev);
+  // Woken 3.5 intervals late, e.g. by a long burst.
+  dev.now_us = T0_US + 7 * SAMPLE_MS * 1000LL / 2;
+  TEST_CHECK(device_wake(&dev) & DUTY_ACTION_SAMPLE);
+  TEST_CHECK_EQ(dev.sample_at, 2);
+  TEST_CHECK_EQ(dev.duty.next_sample_us,
+                T0_US + 7 * SAMPLE_MS * 1000LL / 2 + SAMPLE_MS * 1000LL);
+}
+
+static void test_failed_upload_keeps_buffer(void) {
+  device_t dev;
+  device_boot(&dev, T0_US);
+  device_wake(&dev);
+  dev.upload_ok = false;
+  while (dev.upload_at < 2) {
+    device_wake(&dev);
+  }
+  TEST_CHECK_EQ(dev.duty.stats.upload_failures, 1);
+  TEST_CHECK_EQ(dev.buffer.count, 15 * POINTS_PER_SAMPLE);
+  // Retried with the next burst, one interval later.
+  TEST_CHECK_EQ(dev.duty.next_upload_us, dev.now_us + UPLOAD_MS * 1000LL -
+                                             SAMPLE_MS * 1000LL);
+
+  dev.upload_ok = true;
+  while (dev.upload_at < 3) {
+    device_wake(&dev);
+  }
+  TEST_CHECK_EQ(dev.duty.stats.uploads, 2);
+  TEST_CHECK_EQ(dev.buffer.count, 0);
+  TEST_CHECK_EQ(dev.duty.stats.samples, 31 * POINTS_PER_SAMPLE);
+  TEST_CHECK_EQ(dev.duty.stats.dropped, 0);
+}
+
+static void test_full_buffer_uploads_early(void) {
+  static const duty_cycle_config_t config = {SAMPLE_MS, 24 * 3600000};
+  device_t dev;
+  device_boot(&dev, T0_US);
+  duty_cycle_init(&dev.duty, &config, T0_US);
+  device_wake(&dev);
+
+  uint32_t early = 0;
+  for (int i = 0; i < 2 * DUTY_BUFFER_CAPACITY / POINTS_PER_SAMPLE; i++) {
+    int64_t scheduled_us = dev.duty.next_upload_us;
+    bool full =
+        dev.buffer.count + TELEMETRY_CHANNEL_COUNT > DUTY_BUFFER_CAPACITY;
+    unsigned actions = device_wake(&dev);
+    TEST_CHECK_EQ((actions & DUTY_ACTION_UPLOAD) != 0, full);
+    early += full && dev.now_us < scheduled_us;
+  }
+  TEST_CHECK(early >= 2);
+  TEST_CHECK_EQ(dev.duty.stats.uploads, 1 + early);
+  TEST_CHECK_EQ(dev.duty.stats.dropped, 0);
+}
+
+static void test_full_buffer_drops_while_offline(void) {
+  device_t dev;
+  device_boot(&dev, T0_US);
+  dev.upload_ok = false;
+  for (int i = 0; i < DUTY_BUFFER_CAPACITY; i++) {
+    device_wake(&dev);
+  }
+  TEST_CHECK_EQ(dev.buffer.count, DUTY_BUFFER_CAPACITY);
+  TEST_CHECK_EQ(dev.duty.stats.samples, DUTY_BUFFER_CAPACITY);
+  TEST_CHECK_EQ(dev.duty.stats.samples + dev.duty.stats.dropped,
+                DUTY_BUFFER_CAPACITY * POINTS_PER_SAMPLE);
+  TEST_CHECK_EQ(dev.duty.stats.uploads, 0);
+}
+
+// A cold boot samples at 1970 until SNTP steps the clock.
+static void test_clock_step(void) {
+  device_t dev;
+  device_boot(&dev, 5000000);
+  dev.upload_ok = false;
+  device_wake(&dev);
+  device_wake(&dev);
+  int64_t sleep_us = duty_cycle_sleep_us(&dev.duty, dev.now_us);
+
+  int64_t step_us = T0_US;
+  duty_cycle_shift(&dev.duty, &dev.buffer, step_us);
+  dev.now_us += step_us;
+  TEST_CHECK_EQ(duty_cycle_sleep_us(&dev.duty, dev.now_us), sleep_us);
+  telemetry_point_t point;
+  duty_buffer_get(&dev.buffer, 0, &point);
+  TEST_CHECK_EQ(point.timestamp_us, 5000000 + step_us);
+  duty_buffer_get(&dev.buffer, POINTS_PER_SAMPLE, &point);
+  TEST_CHECK_EQ(point.timestamp_us, 5000000 + SAMPLE_MS * 1000LL + step_us);
+
+  // Points after the step fit the same buffer.
+  dev.upload_ok = true;
+  while (dev.upload_at < 2) {
+    device_wake(&dev);
+  }
+  TEST_CHECK_EQ(dev.duty.stats.dropped, 0);
+  TEST_CHECK_EQ(dev.buffer.count, 0);
+}
+
+static void test_buffer_round_trip(void) {
+  duty_buffer_t buffer;
+  duty_buffer_reset(&buffer);
+  telemetry_point_t in = {T0_US + 250000, TELEMETRY_CHANNEL_VPD, 1.25f};
+  TEST_CHECK(duty_buffer_push(&buffer, &in));
+  in.timestamp_us += 3600 * 1000000ULL;
+  TEST_CHECK(duty_buffer_push(&buffer, &in));
+
+  telemetry_point_t out;
+  duty_buffer_get(&buffer, 1, &out);
+  // Offsets are whole seconds after the first point.
+  TEST_CHECK_EQ(out.timestamp_us, in.timestamp_us);
+  TEST_CHECK_EQ(out.channel, TELEMETRY_CHANNEL_VPD);
+  TEST_CHECK(out.value == 1.25f);
+
+  in.timestamp_us = T0_US + 250000 + (UINT16_MAX + 1ULL) * 1000000;
+  TEST_CHECK(!duty_buffer_push(&buffer, &in));
+  in.timestamp_us = T0_US - 2000000;
+  TEST_CHECK(!duty_buffer_push(&buffer, &in));
+  TEST_CHECK_EQ(buffer.count, 2);
+}
+
+static const test_t s_tests[] = {
+    {"first_wake_samples_and_uploads", test_first_wake_samples_and_uploads},
+    {"schedule", test_schedule},
+    {"wake_time_does_not_drift", test_wake_time_does_not_drift},
+    {"missed_samples_are_skipped", test_missed_samples_are_skipped},
+    {"failed_upload_keeps_buffer", test_failed_upload_keeps_buffer},
+    {"full_buffer_uploads_early", test_full_buffer_uploads_early},
+    {"full_buffer_drops_while_offline", test_full_buffer_drops_while_offline},
+    {"clock_step", test_clock_step},
+    {"buffer_round_trip", test_buffer_round_trip},
+};
+
+TEST_SUITE(duty_cycle, s_tests);
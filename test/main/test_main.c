@@ -0,0 +1,22 @@
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// X(suite), one test_<suite>.c each.
+#define TEST_SUITES(X) X(duty_cycle) X(pump_control) X(rule_engine)
+
+#define TEST_SUITE_DECLARE_(id) extern const test_suite_t test_suite_##id;
+TEST_SUITES(TEST_SUITE_DECLARE_)
+#undef TEST_SUITE_DECLARE_
+
+void app_main(void) {
+  const char *filter = getenv("TEST_FILTER");
+  int failed = 0;
+#define TEST_SUITE_RUN_(id) failed += test_run_suite(&test_suite_##id, filter);
+  TEST_SUITES(TEST_SUITE_RUN_)
+#undef TEST_SUITE_RUN_
+
+  printf("%d test(s) failed\n", failed);
+  // The scheduler keeps running after app_main returns on this target.
+  exit(failed != 0);
+}
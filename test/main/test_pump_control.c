@@ -0,0 +1,141 @@
+#include "pump_control.h"
+#include "telemetry.h"
+#include "test.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define S(seconds) ((int64_t)(seconds) * 1000000)
+
+static const irrigation_config_t s_config = {
+    .bin_s = 900,
+    .memory_shift = 5,
+    .min_bins = 8,
+    .demand_ref_dc = 200,
+    .settle_s = 1800,
+    .min_pulse_s = 5,
+    .max_pulse_s = 60,
+    .default_pulse_s = 20,
+};
+static rule_program_t s_program;
+static pump_control_t s_ctrl;
+
+static void load(const char *src) {
+  TEST_CHECK_EQ(rule_compile(src, strlen(src), &s_program, NULL),
+                RULE_COMPILE_OK);
+  pump_control_init(&s_ctrl, &s_program, &s_config, 0);
+}
+
+static bool soil(int percent, int64_t now_us) {
+  sensor_data_t data = {.type = SENSOR_DATA_TYPE_SOIL_MOISTURE,
+                        .payload.soil_moisture.percent = percent};
+  return pump_control_sensor_data(&s_ctrl, &data, now_us);
+}
+
+static pump_control_action_t step(int64_t now_us) {
+  return pump_control_step(&s_ctrl, now_us).action;
+}
+
+static void test_rules(void) {
+  load("on if soil_moisture < 30 reset 35; pump max_run_s=120 min_off_s=600");
+  TEST_CHECK_EQ(step(S(1)), PUMP_CONTROL_NONE);
+  TEST_CHECK_EQ(pump_control_next_check_ms(&s_ctrl, S(1)), UINT32_MAX);
+  soil(25, S(2));
+  TEST_CHECK_EQ(step(S(2)), PUMP_CONTROL_START);
+  TEST_CHECK_EQ(step(S(3)), PUMP_CONTROL_NONE);
+  TEST_CHECK_EQ(pump_control_next_check_ms(&s_ctrl, S(3)), 119000);
+  TEST_CHECK_EQ(step(S(122)), PUMP_CONTROL_STOP);
+  TEST_CHECK_EQ(pump_control_next_check_ms(&s_ctrl, S(122)), 600000);
+  TEST_CHECK_EQ(step(S(721)), PUMP_CONTROL_NONE);
+  TEST_CHECK_EQ(step(S(722)), PUMP_CONTROL_START);
+
+  // A start that could not be carried out counts as a stop.
+  pump_control_stopped(&s_ctrl, S(723));
+  TEST_CHECK(!s_ctrl.engine.pump_on);
+  TEST_CHECK_EQ(step(S(724)), PUMP_CONTROL_NONE);
+}
+
+// The rules rest until the deadline of the run, however early they ask.
+static void test_timed_run(void) {
+  load("on if soil_moisture < 30 reset 35");
+  soil(25, S(1));
+  pump_control_timed_run(&s_ctrl, 30, S(1) + 500000);
+  TEST_CHECK(s_ctrl.engine.pump_on);
+  for (int64_t t = S(1) + 500000; t < S(31) + 500000; t += 250000) {
+    pump_control_decision_t decision = pump_control_step(&s_ctrl, t);
+    TEST_CHECK(!decision.run_ended);
+    TEST_CHECK_EQ(decision.action, PUMP_CONTROL_NONE);
+  }
+  TEST_CHECK_EQ(pump_control_next_check_ms(&s_ctrl, S(31)), 500);
+  TEST_CHECK_EQ(pump_control_next_check_ms(&s_ctrl, S(31) + 499999), 1);
+
+  pump_control_decision_t decision =
+      pump_control_step(&s_ctrl, S(31) + 500000);
+  TEST_CHECK(decision.run_ended);
+  // Still dry, so the rules take over right away.
+  TEST_CHECK_EQ(decision.action, PUMP_CONTROL_START);
+  TEST_CHECK_EQ(s_ctrl.run_end_us, 0);
+
+  // A run stopped early is over as well.
+  pump_control_timed_run(&s_ctrl, 30, S(40));
+  pump_control_stopped(&s_ctrl, S(45));
+  decision = pump_control_step(&s_ctrl, S(46));
+  TEST_CHECK(!decision.run_ended);
+  TEST_CHECK_EQ(decision.action, PUMP_CONTROL_START);
+}
+
+static void test_pump_state_teaches_model(void) {
+  load("");
+  pump_control_pump_state(&s_ctrl, false, S(5));
+  TEST_CHECK(!s_ctrl.model.settling);
+  pump_control_pump_state(&s_ctrl, true, S(10));
+  pump_control_pump_state(&s_ctrl, true, S(12));
+  pump_control_pump_state(&s_ctrl, false, S(35));
+  TEST_CHECK(s_ctrl.model.settling);
+  TEST_CHECK_EQ(s_ctrl.model.pulse_s, 25);
+  TEST_CHECK_EQ(s_ctrl.model.settle_until_s, 35 + s_config.settle_s);
+}
+
+static void test_soil_health(void) {
+  load("on if soil_moisture < 30 reset 35");
+  TEST_CHECK(soil(25, S(1)));
+  TEST_CHECK(!pump_control_sensor_health(
+      &s_ctrl, SENSOR_DATA_TYPE_TEMP_HUMIDITY, SENSOR_HEALTH_FAILED));
+  TEST_CHECK(pump_control_sensor_health(
+      &s_ctrl, SENSOR_DATA_TYPE_SOIL_MOISTURE, SENSOR_HEALTH_SUSPECT));
+  TEST_CHECK(!pump_control_sensor_health(
+      &s_ctrl, SENSOR_DATA_TYPE_SOIL_MOISTURE, SENSOR_HEALTH_FAILED));
+  TEST_CHECK(!soil(25, S(2)));
+  TEST_CHECK_EQ(step(S(2)), PUMP_CONTROL_NONE);
+
+  TEST_CHECK(pump_control_sensor_health(
+      &s_ctrl, SENSOR_DATA_TYPE_SOIL_MOISTURE, SENSOR_HEALTH_OK));
+  TEST_CHECK_EQ(step(S(3)), PUMP_CONTROL_NONE);
+  TEST_CHECK(soil(25, S(4)));
+  TEST_CHECK_EQ(step(S(4)), PUMP_CONTROL_START);
+}
+
+static void test_wall_clock(void) {
+  setenv("TZ", "UTC0", 1);
+  tzset();
+  load("on if time 06:00-22:00");
+  pump_control_set_wall_clock(&s_ctrl, S(12 * 3600));
+  TEST_CHECK_EQ(step(S(1)), PUMP_CONTROL_NONE);
+  int64_t day_us = (int64_t)TELEMETRY_MIN_VALID_TIMESTAMP_US;
+  pump_control_set_wall_clock(&s_ctrl, day_us + S(5 * 3600));
+  TEST_CHECK_EQ(step(S(2)), PUMP_CONTROL_NONE);
+  pump_control_set_wall_clock(&s_ctrl, day_us + S(6 * 3600));
+  TEST_CHECK_EQ(step(S(3)), PUMP_CONTROL_START);
+  pump_control_set_wall_clock(&s_ctrl, day_us + S(22 * 3600));
+  TEST_CHECK_EQ(step(S(4)), PUMP_CONTROL_STOP);
+}
+
+static const test_t s_tests[] = {
+    {"rules", test_rules},
+    {"timed_run", test_timed_run},
+    {"pump_state_teaches_model", test_pump_state_teaches_model},
+    {"soil_health", test_soil_health},
+    {"wall_clock", test_wall_clock},
+};
+
+TEST_SUITE(pump_control, s_tests);
@@ -0,0 +1,459 @@
+#include "rule_engine.h"
+#include "test.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SOIL RULE_SIGNAL_SOIL_MOISTURE
+#define TIME RULE_SIGNAL_TIME_OF_DAY
+
+// Programs are large, keep them out of the test stacks.
+static rule_program_t s_program;
+static rule_program_t s_program2;
+static rule_engine_t s_engine;
+
+static rule_compile_status_t compile(rule_program_t *program,
+                                     const char *src, int *error_line) {
+  return rule_compile(src, strlen(src), program, error_line);
+}
+
+static void load(const char *src) {
+  int line;
+  TEST_CHECK_EQ(compile(&s_program, src, &line), RULE_COMPILE_OK);
+  rule_engine_init(&s_engine, &s_program);
+}
+
+static uint16_t active_on(void) {
+  return rule_engine_active(&s_engine, RULE_ACTION_PUMP_ON);
+}
+
+static void check_error(const char *src, rule_compile_status_t status,
+                        int line) {
+  int error_line = -1;
+  TEST_CHECK_EQ(compile(&s_program, src, &error_line), status);
+  TEST_CHECK_EQ(error_line, line);
+}
+
+static void test_compile(void) {
+  int line = -1;
+  TEST_CHECK_EQ(compile(&s_program,
+                        "# Zone 1\n"
+                        "on if soil_moisture < 30 reset 35 and "
+                        "time 06:00-22:00\n"
+                        "inhibit if temperature < 5 reset 7; "
+                        "inhibit if vpd < 0.4 reset 0.5\n"
+                        "pump max_run_s=120 min_off_s=600\n"
+                        "predict below=30 target=40\n",
+                        &line),
+                RULE_COMPILE_OK);
+  TEST_CHECK_EQ(line, 0);
+  TEST_CHECK_EQ(s_program.rule_count, 3);
+  TEST_CHECK_EQ(s_program.condition_count, 4);
+  TEST_CHECK_EQ(s_program.max_run_s, 120);
+  TEST_CHECK_EQ(s_program.min_off_s, 600);
+  TEST_CHECK_EQ(s_program.predict_below_pct, 30);
+  TEST_CHECK_EQ(s_program.predict_target_pct, 40);
+  TEST_CHECK(s_program.conditions[3].set == 0.4f);
+  TEST_CHECK(s_program.conditions[3].reset == 0.5f);
+  // Three hysteresis conditions with two edges, the window with two.
+  TEST_CHECK_EQ(s_program.edge_start[RULE_SIGNAL_COUNT], 8);
+
+  TEST_CHECK_EQ(compile(&s_program, "", &line), RULE_COMPILE_OK);
+  TEST_CHECK_EQ(compile(&s_program, "on if dli>-1.5", &line),
+                RULE_COMPILE_OK);
+  TEST_CHECK(s_program.conditions[0].set == -1.5f);
+}
+
+static void test_compile_errors(void) {
+  check_error("on soil_moisture < 30", RULE_COMPILE_SYNTAX, 1);
+  check_error("on if soil_moisture < 30\n\non if moisture < 30",
+              RULE_COMPILE_SYNTAX, 3);
+  check_error("on if soil_moisture < 30 or vpd > 1", RULE_COMPILE_SYNTAX, 1);
+  check_error("on if soil_moisture < 3O", RULE_COMPILE_SYNTAX, 1);
+  check_error("on if soil_moisture < 30 reset", RULE_COMPILE_SYNTAX, 1);
+  check_error("pump max_run_s=-1", RULE_COMPILE_SYNTAX, 1);
+  check_error("water if vpd > 1", RULE_COMPILE_SYNTAX, 1);
+  check_error("on if time 6:00-22:00", RULE_COMPILE_SYNTAX, 1);
+
+  // Comments and ';' count as lines of their own.
+  check_error("# comment\non if vpd < 1; on if vpd > 2 reset 3",
+              RULE_COMPILE_RANGE, 3);
+  check_error("on if soil_moisture < 30 reset 25", RULE_COMPILE_RANGE, 1);
+  check_error("on if time 25:00-06:00", RULE_COMPILE_RANGE, 1);
+  check_error("on if time 06:60-07:00", RULE_COMPILE_RANGE, 1);
+  check_error("on if time 24:00-06:00", RULE_COMPILE_RANGE, 1);
+  check_error("\npredict below=40 target=40", RULE_COMPILE_RANGE, 2);
+  check_error("predict below=40 target=101", RULE_COMPILE_RANGE, 1);
+}
+
+static void test_compile_too_large(void) {
+  static char src[(RULE_MAX_RULES + 1) * 64];
+  size_t len = 0;
+  for (int i = 0; i <= RULE_MAX_RULES; i++) {
+    len += (size_t)snprintf(src + len, sizeof(src) - len,
+                            "on if soil_moisture < %d\n", i);
+  }
+  check_error(src, RULE_COMPILE_TOO_LARGE, RULE_MAX_RULES + 1);
+
+  // Three conditions per rule run out of conditions first.
+  int rules = RULE_MAX_CONDITIONS / 3 + 1;
+  TEST_CHECK(rules <= RULE_MAX_RULES);
+  len = 0;
+  for (int i = 0; i < rules; i++) {
+    len += (size_t)snprintf(src + len, sizeof(src) - len,
+                            "on if vpd > 1 and dli > 2 and light > 3\n");
+  }
+  check_error(src, RULE_COMPILE_TOO_LARGE, rules);
+}
+
+static void test_hysteresis_below(void) {
+  load("on if soil_moisture < 30 reset 35");
+  static const struct {
+    float value;
+    uint16_t active;
+  } steps[] = {
+      {40, 0}, {30, 0}, {29, 1}, {33, 1}, {35, 1}, {35.5f, 0},
+      {33, 0}, {30, 0}, {29.9f, 1}, {50, 0}, {10, 1},
+  };
+  for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    rule_engine_update(&s_engine, SOIL, steps[i].value);
+    TEST_CHECK_EQ(active_on(), steps[i].active);
+  }
+}
+
+static void test_hysteresis_above(void) {
+  load("inhibit if temperature > 30 reset 28");
+  static const struct {
+    float value;
+    uint16_t active;
+  } steps[] = {
+      {20, 0}, {30, 0}, {31, 1}, {29, 1}, {28, 1}, {27.9f, 0},
+      {29, 0}, {30.1f, 1}, {-5, 0}, {45, 1},
+  };
+  for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    rule_engine_update(&s_engine, RULE_SIGNAL_TEMPERATURE, steps[i].value);
+    TEST_CHECK_EQ(rule_engine_active(&s_engine, RULE_ACTION_PUMP_INHIBIT),
+                  steps[i].active);
+  }
+}
+
+static bool in_window(const char *window, int minutes) {
+  char src[32];
+  snprintf(src, sizeof(src), "on if time %s", window);
+  load(src);
+  rule_engine_update(&s_engine, TIME, (float)minutes);
+  return active_on() == 1;
+}
+
+static void test_time_window(void) {
+  TEST_CHECK(!in_window("06:00-22:00", 5 * 60 + 59));
+  TEST_CHECK(in_window("06:00-22:00", 6 * 60));
+  TEST_CHECK(in_window("06:00-22:00", 21 * 60 + 59));
+  TEST_CHECK(!in_window("06:00-22:00", 22 * 60));
+
+  // Wrapping past midnight.
+  TEST_CHECK(!in_window("22:00-06:00", 21 * 60 + 59));
+  TEST_CHECK(in_window("22:00-06:00", 22 * 60));
+  TEST_CHECK(in_window("22:00-06:00", 0));
+  TEST_CHECK(in_window("22:00-06:00", 5 * 60 + 59));
+  TEST_CHECK(!in_window("22:00-06:00", 6 * 60));
+  TEST_CHECK(!in_window("22:00-06:00", 12 * 60));
+
+  TEST_CHECK(in_window("18:00-24:00", 23 * 60 + 59));
+  TEST_CHECK(!in_window("18:00-24:00", 0));
+  TEST_CHECK(in_window("00:00-24:00", 12 * 60));
+  TEST_CHECK(in_window("06:00-06:00", 3 * 60));
+
+  // A day passing through the wrapped window.
+  load("on if time 22:00-06:00");
+  for (int minutes = 0; minutes < 2 * 24 * 60; minutes += 7) {
+    int local = minutes % (24 * 60);
+    rule_engine_update(&s_engine, TIME, (float)local);
+    TEST_CHECK_EQ(active_on(), local >= 22 * 60 || local < 6 * 60);
+  }
+}
+
+static void test_forget(void) {
+  load("on if soil_moisture < 30 and time 06:00-22:00");
+  TEST_CHECK(!rule_engine_forget(&s_engine, SOIL));
+  rule_engine_update(&s_engine, SOIL, 20);
+  rule_engine_update(&s_engine, TIME, 12 * 60);
+  TEST_CHECK_EQ(active_on(), 1);
+
+  TEST_CHECK(rule_engine_forget(&s_engine, SOIL));
+  TEST_CHECK_EQ(active_on(), 0);
+  TEST_CHECK_EQ(s_engine.known_signals & (1u << SOIL), 0);
+  TEST_CHECK(!rule_engine_forget(&s_engine, SOIL));
+
+  // The next reading counts as the first, wherever the cursor was.
+  TEST_CHECK(rule_engine_update(&s_engine, SOIL, 25));
+  TEST_CHECK_EQ(active_on(), 1);
+  rule_engine_forget(&s_engine, SOIL);
+  rule_engine_update(&s_engine, SOIL, 40);
+  TEST_CHECK_EQ(active_on(), 0);
+}
+
+static void test_reload(void) {
+  load("on if soil_moisture < 30 reset 35");
+  rule_engine_update(&s_engine, SOIL, 29);
+  rule_engine_update(&s_engine, SOIL, 32);
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 100), RULE_DECISION_START);
+
+  // The same rules again: 32 is inside the band, so the rule starts false.
+  s_program2 = s_program;
+  rule_engine_reload(&s_engine, &s_program2);
+  TEST_CHECK_EQ(active_on(), 0);
+  TEST_CHECK(s_engine.pump_on);
+  TEST_CHECK_EQ(s_engine.started_s, 100);
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 110), RULE_DECISION_STOP);
+
+  // New thresholds apply to the last values right away.
+  TEST_CHECK_EQ(compile(&s_program, "on if soil_moisture < 40\n"
+                                    "pump min_off_s=60",
+                        NULL),
+                RULE_COMPILE_OK);
+  rule_engine_reload(&s_engine, &s_program);
+  TEST_CHECK_EQ(active_on(), 1);
+  // The pause runs from the stop under the old program.
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 150), RULE_DECISION_NONE);
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 170), RULE_DECISION_START);
+
+  // Signals that never reported stay unknown.
+  TEST_CHECK_EQ(s_engine.known_signals, 1u << SOIL);
+}
+
+static void test_limits(void) {
+  load("on if soil_moisture < 30\n"
+       "inhibit if temperature < 5\n"
+       "pump max_run_s=120 min_off_s=600");
+  TEST_CHECK_EQ(rule_engine_next_check_s(&s_engine, 0), UINT32_MAX);
+  rule_engine_update(&s_engine, SOIL, 20);
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 1000), RULE_DECISION_START);
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 1100), RULE_DECISION_NONE);
+  TEST_CHECK_EQ(rule_engine_next_check_s(&s_engine, 1100), 20);
+
+  // The run-time limit stops the pump although the rule still holds.
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 1120), RULE_DECISION_STOP);
+  TEST_CHECK(!rule_engine_may_start(&s_engine, 1121));
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 1121), RULE_DECISION_NONE);
+  TEST_CHECK_EQ(rule_engine_next_check_s(&s_engine, 1121), 599);
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 1719), RULE_DECISION_NONE);
+  TEST_CHECK_EQ(rule_engine_next_check_s(&s_engine, 1720), 0);
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 1720), RULE_DECISION_START);
+
+  // Dropping the rule stops it before the limit.
+  rule_engine_update(&s_engine, SOIL, 40);
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 1730), RULE_DECISION_STOP);
+  TEST_CHECK_EQ(rule_engine_next_check_s(&s_engine, 1730), UINT32_MAX);
+
+  // An inhibit blocks the start after the pause too.
+  rule_engine_update(&s_engine, SOIL, 20);
+  rule_engine_update(&s_engine, RULE_SIGNAL_TEMPERATURE, 3);
+  TEST_CHECK(!rule_engine_may_start(&s_engine, 5000));
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 5000), RULE_DECISION_NONE);
+  rule_engine_update(&s_engine, RULE_SIGNAL_TEMPERATURE, 6);
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 5001), RULE_DECISION_START);
+
+  // A manual start is held to the same limit. Times wrap like the tick
+  // counter they come from.
+  rule_engine_set_pump(&s_engine, false, UINT32_MAX - 1000);
+  rule_engine_set_pump(&s_engine, true, UINT32_MAX - 10);
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 100), RULE_DECISION_NONE);
+  TEST_CHECK_EQ(rule_engine_pump(&s_engine, 110), RULE_DECISION_STOP);
+}
+
+// Brute-force reference: every condition re-evaluated on every update.
+typedef struct {
+  bool known[RULE_SIGNAL_COUNT];
+  float values[RULE_SIGNAL_COUNT];
+  bool state[RULE_MAX_CONDITIONS];
+} reference_t;
+
+static bool reference_evaluate(const rule_condition_t *cond, float value,
+                               bool state) {
+  float lo = cond->set < cond->reset ? cond->set : cond->reset;
+  float hi = cond->set < cond->reset ? cond->reset : cond->set;
+  switch (cond->kind) {
+  case RULE_CONDITION_BELOW:
+    return value < lo || (state && value <= hi);
+  case RULE_CONDITION_ABOVE:
+    return value > hi || (state && value >= lo);
+  default: {
+    int minutes = (int)value;
+    int start = (int)cond->set;
+    int end = (int)cond->reset;
+    if (start == end) {
+      return true;
+    }
+    return start < end ? minutes >= start && minutes < end
+                       : minutes >= start || minutes < end;
+  }
+  }
+}
+
+static void reference_update(reference_t *ref, const rule_program_t *program,
+                             int signal, float value) {
+  for (int c = 0; c < program->condition_count; c++) {
+    const rule_condition_t *cond = &program->conditions[c];
+    if (cond->signal == signal) {
+      ref->state[c] = reference_evaluate(cond, value, ref->state[c]);
+    }
+  }
+  ref->known[signal] = true;
+  ref->values[signal] = value;
+}
+
+static void reference_forget(reference_t *ref, const rule_program_t *program,
+                             int signal) {
+  for (int c = 0; c < program->condition_count; c++) {
+    if (program->conditions[c].signal == signal) {
+      ref->state[c] = false;
+    }
+  }
+  ref->known[signal] = false;
+}
+
+static void reference_active(const reference_t *ref,
+                             const rule_program_t *program,
+                             bool active[RULE_MAX_RULES]) {
+  for (int r = 0; r < program->rule_count; r++) {
+    active[r] = true;
+  }
+  for (int c = 0; c < program->condition_count; c++) {
+    active[program->conditions[c].rule] &= ref->state[c];
+  }
+}
+
+static uint32_t s_seed;
+
+static uint32_t next_random(uint32_t n) {
+  s_seed = s_seed * 1664525u + 1013904223u;
+  return (s_seed >> 8) % n;
+}
+
+// Thresholds on a coarse grid, so values often sit exactly on one.
+static const int s_random_signals[] = {
+    RULE_SIGNAL_TEMPERATURE, RULE_SIGNAL_HUMIDITY, SOIL, TIME};
+#define RANDOM_SIGNAL_COUNT 4
+
+static size_t random_source(char *src, size_t size) {
+  size_t len = 0;
+  int rules = 1 + (int)next_random(RULE_MAX_RULES);
+  int conditions = 0;
+  for (int r = 0; r < rules && conditions < RULE_MAX_CONDITIONS; r++) {
+    len += (size_t)snprintf(src + len, size - len, "%s if ",
+                            next_random(4) == 0 ? "inhibit" : "on");
+    int count = 1 + (int)next_random(3);
+    for (int i = 0; i < count && conditions < RULE_MAX_CONDITIONS; i++) {
+      const char *join = i > 0 ? " and " : "";
+      int signal = s_random_signals[next_random(RANDOM_SIGNAL_COUNT)];
+      if (signal == TIME) {
+        len += (size_t)snprintf(src + len, size - len,
+                                "%stime %02u:00-%02u:00", join,
+                                next_random(24), next_random(25));
+      } else {
+        static const char *const names[] = {"temperature", "humidity",
+                                            "light", "soil_moisture"};
+        int set = (int)next_random(10);
+        int band = (int)next_random(3);
+        bool below = next_random(2) == 0;
+        len += (size_t)snprintf(src + len, size - len, "%s%s %c %d reset %d",
+                                join, names[signal], below ? '<' : '>', set,
+                                below ? set + band : set - band);
+      }
+      conditions++;
+    }
+    len += (size_t)snprintf(src + len, size - len, "\n");
+  }
+  return len;
+}
+
+static float random_value(int signal) {
+  if (signal == TIME) {
+    int minutes = (int)next_random(25) * 60 + (int)next_random(3) - 1;
+    return (float)(minutes < 0 ? 0 : minutes % (24 * 60));
+  }
+  return (float)next_random(25) / 2 - 1;
+}
+
+static bool matches(const reference_t *ref, const rule_program_t *program) {
+  bool active[RULE_MAX_RULES];
+  reference_active(ref, program, active);
+  uint16_t counts[RULE_ACTION_COUNT] = {0};
+  for (int r = 0; r < program->rule_count; r++) {
+    if (active[r] != (s_engine.false_count[r] == 0)) {
+      return false;
+    }
+    counts[program->rules[r].action] += active[r];
+  }
+  return counts[RULE_ACTION_PUMP_ON] == active_on() &&
+         counts[RULE_ACTION_PUMP_INHIBIT] ==
+             rule_engine_active(&s_engine, RULE_ACTION_PUMP_INHIBIT);
+}
+
+static void test_matches_brute_force(void) {
+  static char src[RULE_MAX_RULES * 128];
+  static reference_t ref;
+  s_seed = 1;
+  for (int program = 0; program < 200; program++) {
+    size_t len = random_source(src, sizeof(src));
+    int line;
+    if (rule_compile(src, len, &s_program, &line) != RULE_COMPILE_OK) {
+      TEST_CHECK_EQ(line, 0);
+      return;
+    }
+    rule_engine_init(&s_engine, &s_program);
+    memset(&ref, 0, sizeof(ref));
+
+    for (int step = 0; step < 500; step++) {
+      int signal = s_random_signals[next_random(RANDOM_SIGNAL_COUNT)];
+      bool before[RULE_MAX_RULES];
+      bool after[RULE_MAX_RULES];
+      reference_active(&ref, &s_program, before);
+      bool changed;
+      uint32_t op = next_random(20);
+      if (op == 0) {
+        changed = rule_engine_forget(&s_engine, (rule_signal_t)signal);
+        reference_forget(&ref, &s_program, signal);
+      } else if (op == 1) {
+        // Reloading the same rules restarts every condition from false.
+        rule_engine_reload(&s_engine, &s_program);
+        memset(ref.state, 0, sizeof(ref.state));
+        for (int s = 0; s < RULE_SIGNAL_COUNT; s++) {
+          if (ref.known[s]) {
+            reference_update(&ref, &s_program, s, ref.values[s]);
+          }
+        }
+        changed = true;
+      } else {
+        float value = random_value(signal);
+        changed = rule_engine_update(&s_engine, (rule_signal_t)signal, value);
+        reference_update(&ref, &s_program, signal, value);
+      }
+      reference_active(&ref, &s_program, after);
+      size_t rules_size = sizeof(bool) * s_program.rule_count;
+      bool rules_changed = memcmp(before, after, rules_size) != 0;
+      if (!matches(&ref, &s_program) || (rules_changed && !changed)) {
+        printf("program %d step %d op %u signal %d:\n%.*s", program, step, op,
+               signal, (int)len, src);
+        TEST_CHECK(matches(&ref, &s_program));
+        TEST_CHECK(!rules_changed || changed);
+        return;
+      }
+    }
+  }
+}
+
+static const test_t s_tests[] = {
+    {"compile", test_compile},
+    {"compile_errors", test_compile_errors},
+    {"compile_too_large", test_compile_too_large},
+    {"hysteresis_below", test_hysteresis_below},
+    {"hysteresis_above", test_hysteresis_above},
+    {"time_window", test_time_window},
+    {"forget", test_forget},
+    {"reload", test_reload},
+    {"limits", test_limits},
+    {"matches_brute_force", test_matches_brute_force},
+};
+
+TEST_SUITE(rule_engine, s_tests);
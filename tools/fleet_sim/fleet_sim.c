@@ -0,0 +1,741 @@
+/**
+ * Fleet load simulator: emulates many GrowGrid controllers against a local
+ * broker to find where the Mosquitto -> ingest -> InfluxDB stack
+ * saturates.
+ *
+ * Every virtual device has its own MQTT connection and publishes the same
+ * topics and payloads as the firmware (core/telemetry.c serializes them):
+ * one temperature/humidity, light and soil sample per interval, in line
+ * protocol or JSON. Reconnect storms drop a share of the fleet at once, like
+ * an access point reboot.
+ *
+ * Reported at the end, as JSON on stdout:
+ *   - publish rate of the fleet and ingest rate seen by the broker ($SYS)
+ *   - end-to-end latency from publish until a probe point is queryable in
+ *     InfluxDB (needs INFLUXDB_TOKEN, see influx.h)
+ *   - drops: samples shed while offline, failed publishes, and points that
+ *     never arrived in InfluxDB
+ *
+ * Devices live under the sites <prefix>-<n> (default fleetsim-0...), so the
+ * data is easy to tell apart and delete.
+ */
+#include "derived_metrics.h"
+#include "influx.h"
+#include "telemetry.h"
+#include <getopt.h>
+#include <inttypes.h>
+#include <mosquitto.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_LATENCY_PROBES 4096
+#define RECONNECT_BASE_MS 500 // Firmware WIFI_RECONNECT_BASE_MS
+#define RECONNECT_MAX_MS 60000
+
+typedef struct {
+  const char *host;
+  int port;
+  const char *username;
+  const char *password;
+  const char *site_prefix;
+  int devices;
+  int sites;
+  int workers;
+  uint32_t interval_ms;
+  telemetry_format_t format;
+  int qos;
+  int duration_s;
+  int storm_every_s;
+  double storm_fraction;
+  uint32_t storm_jitter_ms;
+  int settle_s;
+  uint32_t probe_interval_ms;
+} config_t;
+
+typedef struct {
+  struct mosquitto *mosq;
+  int index;
+  char prefix[96]; // growgrid/<site>/<device>
+  char lp_tags[64];
+  char telemetry[TELEMETRY_CHANNEL_COUNT][128];
+  char line_protocol[128];
+  bool connected;
+  int64_t next_sample_us;
+  int64_t reconnect_at_us; // 0 unless a reconnect is scheduled
+  uint32_t backoff_exp;
+  unsigned seed;
+  float temperature;
+  float humidity;
+  dli_t dli;
+} device_t;
+
+typedef struct {
+  device_t *devices;
+  int count;
+  pthread_t thread;
+} worker_t;
+
+static config_t s_config = {
+    .host = "localhost",
+    .port = 1883,
+    .site_prefix = "fleetsim",
+    .devices = 100,
+    .sites = 1,
+    .workers = 4,
+    .interval_ms = 5000,
+    .format = TELEMETRY_FORMAT_LINE_PROTOCOL,
+    .qos = 0,
+    .duration_s = 60,
+    .storm_fraction = 0.5,
+    .settle_s = 10,
+    .probe_interval_ms = 1000,
+};
+
+static atomic_bool s_running = true;
+static atomic_int s_storm_epoch;
+static atomic_int s_connected;
+static atomic_uint_fast64_t s_messages;
+static atomic_uint_fast64_t s_points;
+static atomic_uint_fast64_t s_publish_errors;
+static atomic_uint_fast64_t s_offline_drops;
+static atomic_uint_fast64_t s_reconnects;
+
+// Latest probe point of device 0, picked up by the probe thread.
+static atomic_int_fast64_t s_probe_ts_us;
+static double s_latency_ms[MAX_LATENCY_PROBES];
+static int s_latency_count;
+
+// Broker counters from $SYS, updated by the monitor client.
+static pthread_mutex_t s_sys_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t s_sys_received;
+static uint64_t s_sys_dropped;
+static uint64_t s_sys_received_start;
+static bool s_sys_seen;
+
+static int64_t mono_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t wall_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static float jitter(device_t *dev, float amplitude) {
+  return amplitude * ((float)rand_r(&dev->seed) / (float)RAND_MAX - 0.5f);
+}
+
+static void on_connect(struct mosquitto *mosq, void *obj, int rc) {
+  device_t *dev = obj;
+  if (rc != 0) {
+    return; // on_disconnect follows and schedules the retry
+  }
+  dev->connected = true;
+  dev->backoff_exp = 0;
+  atomic_fetch_add(&s_connected, 1);
+}
+
+// Same equal-jitter backoff as the firmware's Wi-Fi reconnect.
+static void schedule_reconnect(device_t *dev, int64_t now_us) {
+  uint32_t delay_ms = RECONNECT_MAX_MS;
+  if (dev->backoff_exp < 31 &&
+      (RECONNECT_BASE_MS << dev->backoff_exp) < RECONNECT_MAX_MS) {
+    delay_ms = RECONNECT_BASE_MS << dev->backoff_exp;
+    dev->backoff_exp++;
+  }
+  delay_ms = delay_ms / 2 + (uint32_t)rand_r(&dev->seed) % (delay_ms / 2 + 1);
+  dev->reconnect_at_us = now_us + (int64_t)delay_ms * 1000;
+}
+
+static void on_disconnect(struct mosquitto *mosq, void *obj, int rc) {
+  device_t *dev = obj;
+  if (dev->connected) {
+    dev->connected = false;
+    atomic_fetch_sub(&s_connected, 1);
+  }
+  // Storms schedule their own reconnect, rc is 0 for those.
+  if (rc != 0 && atomic_load(&s_running)) {
+    schedule_reconnect(dev, mono_us());
+  }
+}
+
+static bool build_topics(device_t *dev, int index) {
+  int site = index % s_config.sites;
+  int ok = snprintf(dev->prefix, sizeof(dev->prefix), "growgrid/%s-%d/dev-%d",
+                    s_config.site_prefix, site, index) <
+               (int)sizeof(dev->prefix) &&
+           snprintf(dev->lp_tags, sizeof(dev->lp_tags),
+                    "site=%s-%d,device=dev-%d", s_config.site_prefix, site,
+                    index) < (int)sizeof(dev->lp_tags) &&
+           snprintf(dev->line_protocol, sizeof(dev->line_protocol), "%s/lp",
+                    dev->prefix) < (int)sizeof(dev->line_protocol);
+  for (int c = 0; ok && c < TELEMETRY_CHANNEL_COUNT; c++) {
+    ok = snprintf(dev->telemetry[c], sizeof(dev->telemetry[c]),
+                  "%s/telemetry/%s", dev->prefix,
+                  telemetry_channel_name(c)) < (int)sizeof(dev->telemetry[c]);
+  }
+  return ok;
+}
+
+static bool device_init(device_t *dev, int index) {
+  memset(dev, 0, sizeof(*dev));
+  dev->index = index;
+  dev->seed = (unsigned)index * 2654435761u + 1;
+  dev->temperature = 22.0f + jitter(dev, 4.0f);
+  dev->humidity = 55.0f + jitter(dev, 10.0f);
+  dli_init(&dev->dli, 54, 600000);
+  // Spread the first samples over one interval, like devices booted at
+  // random times.
+  dev->next_sample_us =
+      mono_us() + (int64_t)(rand_r(&dev->seed) % s_config.interval_ms) * 1000;
+
+  char client_id[64];
+  snprintf(client_id, sizeof(client_id), "%s-dev-%d", s_config.site_prefix,
+           index);
+  if (!build_topics(dev, index) ||
+      (dev->mosq = mosquitto_new(client_id, true, dev)) == NULL) {
+    return false;
+  }
+  if (s_config.username != NULL) {
+    mosquitto_username_pw_set(dev->mosq, s_config.username,
+                              s_config.password);
+  }
+  mosquitto_connect_callback_set(dev->mosq, on_connect);
+  mosquitto_disconnect_callback_set(dev->mosq, on_disconnect);
+  if (mosquitto_connect_async(dev->mosq, s_config.host, s_config.port, 60) !=
+      MOSQ_ERR_SUCCESS) {
+    schedule_reconnect(dev, mono_us());
+  }
+  return true;
+}
+
+static void publish(device_t *dev, const char *topic, const char *payload,
+                    int len, int points) {
+  if (mosquitto_publish(dev->mosq, NULL, topic, len, payload, s_config.qos,
+                        false) != MOSQ_ERR_SUCCESS) {
+    atomic_fetch_add(&s_publish_errors, 1);
+    return;
+  }
+  atomic_fetch_add(&s_messages, 1);
+  atomic_fetch_add(&s_points, (uint_fast64_t)points);
+}
+
+// Mirrors publish_points in platform_mqtt.c: line protocol sends all points
+// of a sample in one message, JSON one message per point.
+static void publish_sample(device_t *dev, const sensor_data_t *data) {
+  telemetry_point_t points[TELEMETRY_MAX_POINTS_PER_SAMPLE];
+  int count = telemetry_points_from_sensor_data(data, points);
+  if (!dev->connected) {
+    // The firmware sheds telemetry while offline.
+    atomic_fetch_add(&s_offline_drops, (uint_fast64_t)count);
+    return;
+  }
+
+  if (s_config.format == TELEMETRY_FORMAT_LINE_PROTOCOL) {
+    char payload[TELEMETRY_MAX_POINTS_PER_SAMPLE * 96];
+    int len = 0;
+    for (int i = 0; i < count; i++) {
+      int n = telemetry_format_line_protocol(&points[i], dev->lp_tags,
+                                             payload + len,
+                                             sizeof(payload) - len - 1);
+      if (n < 0) {
+        atomic_fetch_add(&s_publish_errors, 1);
+        return;
+      }
+      len += n;
+      payload[len++] = '\n';
+    }
+    publish(dev, dev->line_protocol, payload, len, count);
+    return;
+  }
+
+  for (int i = 0; i < count; i++) {
+    char payload[96];
+    int len = telemetry_format_json(&points[i], payload, sizeof(payload));
+    if (len > 0) {
+      publish(dev, dev->telemetry[points[i].channel], payload, len, 1);
+    }
+  }
+}
+
+static void sample(device_t *dev) {
+  uint64_t ts = wall_us();
+  dev->temperature += jitter(dev, 0.2f);
+  dev->humidity += jitter(dev, 0.5f);
+
+  sensor_data_t data = {.timestamp_us = ts,
+                        .type = SENSOR_DATA_TYPE_TEMP_HUMIDITY};
+  data.payload.temp_humidity.temperature = dev->temperature;
+  data.payload.temp_humidity.humidity = dev->humidity;
+  publish_sample(dev, &data);
+  if (dev->index == 0 && dev->connected) {
+    atomic_store(&s_probe_ts_us, (int_fast64_t)ts);
+  }
+
+  data.type = SENSOR_DATA_TYPE_LIGHT;
+  data.payload.light.lux = 8000 + (uint32_t)(rand_r(&dev->seed) % 4000);
+  data.payload.light.dli = dli_add(&dev->dli, ts, dli_local_day(ts),
+                                   data.payload.light.lux);
+  publish_sample(dev, &data);
+
+  data.type = SENSOR_DATA_TYPE_SOIL_MOISTURE;
+  data.payload.soil_moisture.percent = 35 + rand_r(&dev->seed) % 30;
+  publish_sample(dev, &data);
+}
+
+static void storm(worker_t *w, int64_t now_us) {
+  for (int i = 0; i < w->count; i++) {
+    device_t *dev = &w->devices[i];
+    // Spread over the fleet by index so every worker drops the same share.
+    if ((double)((dev->index * 7919) % 1000) / 1000.0 >=
+            s_config.storm_fraction ||
+        !dev->connected) {
+      continue;
+    }
+    // Counted as offline right away, samples until the reconnect are shed.
+    dev->connected = false;
+    atomic_fetch_sub(&s_connected, 1);
+    mosquitto_disconnect(dev->mosq);
+    uint32_t delay_ms = s_config.storm_jitter_ms > 0
+                            ? (uint32_t)rand_r(&dev->seed) %
+                                  s_config.storm_jitter_ms
+                            : 0;
+    dev->reconnect_at_us = now_us + (int64_t)delay_ms * 1000;
+  }
+}
+
+// Drives all connections of one worker from a single poll loop.
+static void *worker_main(void *arg) {
+  worker_t *w = arg;
+  struct pollfd *fds = calloc((size_t)w->count, sizeof(*fds));
+  int *owner = calloc((size_t)w->count, sizeof(*owner));
+  int storm_epoch = 0;
+  int64_t interval_us = (int64_t)s_config.interval_ms * 1000;
+
+  while (atomic_load(&s_running)) {
+    int64_t now = mono_us();
+    if (atomic_load(&s_storm_epoch) != storm_epoch) {
+      storm_epoch = atomic_load(&s_storm_epoch);
+      storm(w, now);
+    }
+
+    int nfds = 0;
+    for (int i = 0; i < w->count; i++) {
+      device_t *dev = &w->devices[i];
+      if (dev->reconnect_at_us != 0 && now >= dev->reconnect_at_us) {
+        dev->reconnect_at_us = 0;
+        atomic_fetch_add(&s_reconnects, 1);
+        if (mosquitto_reconnect_async(dev->mosq) != MOSQ_ERR_SUCCESS) {
+          schedule_reconnect(dev, now);
+        }
+      }
+      if (now >= dev->next_sample_us) {
+        sample(dev);
+        dev->next_sample_us += interval_us;
+      }
+
+      int sock = mosquitto_socket(dev->mosq);
+      if (sock >= 0) {
+        fds[nfds].fd = sock;
+        fds[nfds].events =
+            POLLIN | (mosquitto_want_write(dev->mosq) ? POLLOUT : 0);
+        fds[nfds].revents = 0;
+        owner[nfds++] = i;
+      }
+    }
+
+    poll(fds, (nfds_t)nfds, 10);
+
+    for (int j = 0; j < nfds; j++) {
+      struct mosquitto *mosq = w->devices[owner[j]].mosq;
+      if (fds[j].revents & (POLLIN | POLLHUP | POLLERR)) {
+        mosquitto_loop_read(mosq, 1);
+      }
+      if (fds[j].revents & POLLOUT) {
+        mosquitto_loop_write(mosq, 1);
+      }
+    }
+    for (int i = 0; i < w->count; i++) {
+      mosquitto_loop_misc(w->devices[i].mosq);
+    }
+  }
+
+  for (int i = 0; i < w->count; i++) {
+    mosquitto_disconnect(w->devices[i].mosq);
+    mosquitto_loop_write(w->devices[i].mosq, 1);
+  }
+  free(fds);
+  free(owner);
+  return NULL;
+}
+
+static void on_sys_message(struct mosquitto *mosq, void *obj,
+                           const struct mosquitto_message *msg) {
+  uint64_t value = strtoull(msg->payload != NULL ? msg->payload : "0", NULL,
+                            10);
+  pthread_mutex_lock(&s_sys_lock);
+  if (strcmp(msg->topic, "$SYS/broker/messages/received") == 0) {
+    if (!s_sys_seen) {
+      s_sys_received_start = value;
+      s_sys_seen = true;
+    }
+    s_sys_received = value;
+  } else if (strcmp(msg->topic, "$SYS/broker/publish/messages/dropped") ==
+             0) {
+    s_sys_dropped = value;
+  }
+  pthread_mutex_unlock(&s_sys_lock);
+}
+
+static void on_sys_connect(struct mosquitto *mosq, void *obj, int rc) {
+  if (rc == 0) {
+    mosquitto_subscribe(mosq, NULL, "$SYS/broker/messages/received", 0);
+    mosquitto_subscribe(mosq, NULL, "$SYS/broker/publish/messages/dropped",
+                        0);
+  }
+}
+
+static struct mosquitto *start_sys_monitor(void) {
+  struct mosquitto *mosq = mosquitto_new(NULL, true, NULL);
+  if (mosq == NULL) {
+    return NULL;
+  }
+  if (s_config.username != NULL) {
+    mosquitto_username_pw_set(mosq, s_config.username, s_config.password);
+  }
+  mosquitto_connect_callback_set(mosq, on_sys_connect);
+  mosquitto_message_callback_set(mosq, on_sys_message);
+  if (mosquitto_connect_async(mosq, s_config.host, s_config.port, 60) !=
+          MOSQ_ERR_SUCCESS ||
+      mosquitto_loop_start(mosq) != MOSQ_ERR_SUCCESS) {
+    mosquitto_destroy(mosq);
+    return NULL;
+  }
+  return mosq;
+}
+
+// Polls InfluxDB for the latest probe point of device 0 and records how long
+// after its publish it became queryable.
+static void *probe_main(void *arg) {
+  const influx_t *influx = arg;
+  char flux[512];
+  snprintf(flux, sizeof(flux),
+           "from(bucket: \"%s\") |> range(start: -5m)"
+           " |> filter(fn: (r) => r._measurement == \"temperature\" and"
+           " r.site == \"%s-0\" and r.device == \"dev-0\")"
+           " |> last() |> map(fn: (r) => ({ns: int(v: r._time)}))"
+           " |> keep(columns: [\"ns\"])",
+           influx->bucket, s_config.site_prefix);
+
+  int64_t waiting_for = 0;
+  while (atomic_load(&s_running) && s_latency_count < MAX_LATENCY_PROBES) {
+    if (waiting_for == 0) {
+      waiting_for = atomic_load(&s_probe_ts_us);
+    }
+    int64_t ns;
+    if (waiting_for != 0 && influx_query_int(influx, flux, &ns) &&
+        ns / 1000 >= waiting_for) {
+      s_latency_ms[s_latency_count++] =
+          (double)((int64_t)wall_us() - waiting_for) / 1000.0;
+      waiting_for = 0;
+    }
+    usleep(s_config.probe_interval_ms * 1000 / 10);
+  }
+  return NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int count, int pct) {
+  if (count == 0) {
+    return 0;
+  }
+  int rank = (pct * count + 99) / 100;
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static bool count_influx_points(const influx_t *influx, uint64_t start_us,
+                                uint64_t stop_us, int64_t *count) {
+  char flux[512];
+  snprintf(flux, sizeof(flux),
+           "from(bucket: \"%s\") |> range(start: time(v: %" PRIu64 "),"
+           " stop: time(v: %" PRIu64 "))"
+           " |> filter(fn: (r) => r._field == \"value\" and"
+           " r.site =~ /^%s-[0-9]+$/)"
+           " |> group() |> count() |> keep(columns: [\"_value\"])",
+           influx->bucket, start_us * 1000, (stop_us + 1000000) * 1000,
+           s_config.site_prefix);
+  return influx_query_int(influx, flux, count);
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -h, --host HOST           broker host (localhost)\n"
+          "  -p, --port PORT           broker port (1883)\n"
+          "  -u, --username USER       MQTT user, or $MQTT_USERNAME\n"
+          "  -P, --password PASS       MQTT password, or $MQTT_PASSWORD\n"
+          "  -n, --devices N           virtual devices (100)\n"
+          "  -s, --sites N             sites to spread them over (1)\n"
+          "  -w, --workers N           threads driving connections (4)\n"
+          "  -i, --interval-ms MS      sample interval per device (5000)\n"
+          "  -f, --format lp|json      telemetry format (lp)\n"
+          "  -q, --qos 0|1             telemetry QoS (0, as the firmware)\n"
+          "  -d, --duration S          run time (60)\n"
+          "      --storm-every S       drop part of the fleet every S s (off)\n"
+          "      --storm-fraction F    share of devices dropped (0.5)\n"
+          "      --storm-jitter-ms MS  spread of their reconnects (0)\n"
+          "      --settle S            wait for ingest before counting "
+          "(10)\n"
+          "      --site-prefix NAME    site name prefix (fleetsim)\n",
+          argv0);
+}
+
+static bool parse_args(int argc, char **argv) {
+  enum { OPT_STORM_EVERY = 256, OPT_STORM_FRACTION, OPT_STORM_JITTER,
+         OPT_SETTLE, OPT_SITE_PREFIX };
+  static const struct option options[] = {
+      {"host", required_argument, NULL, 'h'},
+      {"port", required_argument, NULL, 'p'},
+      {"username", required_argument, NULL, 'u'},
+      {"password", required_argument, NULL, 'P'},
+      {"devices", required_argument, NULL, 'n'},
+      {"sites", required_argument, NULL, 's'},
+      {"workers", required_argument, NULL, 'w'},
+      {"interval-ms", required_argument, NULL, 'i'},
+      {"format", required_argument, NULL, 'f'},
+      {"qos", required_argument, NULL, 'q'},
+      {"duration", required_argument, NULL, 'd'},
+      {"storm-every", required_argument, NULL, OPT_STORM_EVERY},
+      {"storm-fraction", required_argument, NULL, OPT_STORM_FRACTION},
+      {"storm-jitter-ms", required_argument, NULL, OPT_STORM_JITTER},
+      {"settle", required_argument, NULL, OPT_SETTLE},
+      {"site-prefix", required_argument, NULL, OPT_SITE_PREFIX},
+      {NULL, 0, NULL, 0},
+  };
+
+  s_config.username = getenv("MQTT_USERNAME");
+  s_config.password = getenv("MQTT_PASSWORD");
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "h:p:u:P:n:s:w:i:f:q:d:", options,
+                            NULL)) != -1) {
+    switch (opt) {
+    case 'h':
+      s_config.host = optarg;
+      break;
+    case 'p':
+      s_config.port = atoi(optarg);
+      break;
+    case 'u':
+      s_config.username = optarg;
+      break;
+    case 'P':
+      s_config.password = optarg;
+      break;
+    case 'n':
+      s_config.devices = atoi(optarg);
+      break;
+    case 's':
+      s_config.sites = atoi(optarg);
+      break;
+    case 'w':
+      s_config.workers = atoi(optarg);
+      break;
+    case 'i':
+      s_config.interval_ms = (uint32_t)strtoul(optarg, NULL, 10);
+      break;
+    case 'f':
+      if (strcmp(optarg, "json") == 0) {
+        s_config.format = TELEMETRY_FORMAT_JSON;
+      } else if (strcmp(optarg, "lp") == 0) {
+        s_config.format = TELEMETRY_FORMAT_LINE_PROTOCOL;
+      } else {
+        return false;
+      }
+      break;
+    case 'q':
+      s_config.qos = atoi(optarg);
+      break;
+    case 'd':
+      s_config.duration_s = atoi(optarg);
+      break;
+    case OPT_STORM_EVERY:
+      s_config.storm_every_s = atoi(optarg);
+      break;
+    case OPT_STORM_FRACTION:
+      s_config.storm_fraction = atof(optarg);
+      break;
+    case OPT_STORM_JITTER:
+      s_config.storm_jitter_ms = (uint32_t)strtoul(optarg, NULL, 10);
+      break;
+    case OPT_SETTLE:
+      s_config.settle_s = atoi(optarg);
+      break;
+    case OPT_SITE_PREFIX:
+      s_config.site_prefix = optarg;
+      break;
+    default:
+      return false;
+    }
+  }
+  return s_config.devices > 0 && s_config.sites > 0 && s_config.workers > 0 &&
+         s_config.interval_ms > 0 && s_config.duration_s > 0 &&
+         (s_config.qos == 0 || s_config.qos == 1);
+}
+
+int main(int argc, char **argv) {
+  if (!parse_args(argc, argv)) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (s_config.workers > s_config.devices) {
+    s_config.workers = s_config.devices;
+  }
+
+  mosquitto_lib_init();
+  influx_t influx;
+  bool influx_enabled = influx_init(&influx);
+  if (!influx_enabled) {
+    fprintf(stderr, "INFLUXDB_TOKEN not set, skipping latency and drop "
+                    "checks in InfluxDB\n");
+  }
+
+  device_t *devices = calloc((size_t)s_config.devices, sizeof(*devices));
+  worker_t *workers = calloc((size_t)s_config.workers, sizeof(*workers));
+  if (devices == NULL || workers == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  for (int i = 0; i < s_config.devices; i++) {
+    if (!device_init(&devices[i], i)) {
+      fprintf(stderr, "Failed to set up device %d\n", i);
+      return 1;
+    }
+  }
+
+  struct mosquitto *sys = start_sys_monitor();
+  uint64_t start_us = wall_us();
+  int64_t start_mono = mono_us();
+
+  // Worker i takes devices [devices * i / workers, devices * (i + 1) /
+  // workers), so the counts differ by at most one.
+  for (int i = 0; i < s_config.workers; i++) {
+    int first = (int)((int64_t)s_config.devices * i / s_config.workers);
+    int end = (int)((int64_t)s_config.devices * (i + 1) / s_config.workers);
+    workers[i].devices = &devices[first];
+    workers[i].count = end - first;
+    pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+  }
+  pthread_t probe;
+  if (influx_enabled) {
+    pthread_create(&probe, NULL, probe_main, &influx);
+  }
+
+  uint64_t last_messages = 0;
+  for (int s = 1; s <= s_config.duration_s; s++) {
+    sleep(1);
+    if (s_config.storm_every_s > 0 && s % s_config.storm_every_s == 0) {
+      atomic_fetch_add(&s_storm_epoch, 1);
+      fprintf(stderr, "Reconnect storm\n");
+    }
+    uint64_t messages = atomic_load(&s_messages);
+    fprintf(stderr, "%4ds  connected %d/%d  %8" PRIu64 " msg/s\n", s,
+            atomic_load(&s_connected), s_config.devices,
+            messages - last_messages);
+    last_messages = messages;
+  }
+
+  atomic_store(&s_running, false);
+  for (int i = 0; i < s_config.workers; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+  if (influx_enabled) {
+    pthread_join(probe, NULL);
+  }
+  double elapsed_s = (double)(mono_us() - start_mono) / 1e6;
+  uint64_t stop_us = wall_us();
+
+  int64_t influx_points = -1;
+  if (influx_enabled) {
+    fprintf(stderr, "Waiting %d s for ingest to flush\n",
+            s_config.settle_s);
+    sleep((unsigned)s_config.settle_s);
+    if (!count_influx_points(&influx, start_us, stop_us, &influx_points)) {
+      fprintf(stderr, "Counting points in InfluxDB failed\n");
+      influx_points = -1;
+    }
+  }
+
+  pthread_mutex_lock(&s_sys_lock);
+  uint64_t broker_received = s_sys_received - s_sys_received_start;
+  uint64_t broker_dropped = s_sys_dropped;
+  bool sys_seen = s_sys_seen;
+  pthread_mutex_unlock(&s_sys_lock);
+  if (sys != NULL) {
+    mosquitto_disconnect(sys);
+    mosquitto_loop_stop(sys, false);
+    mosquitto_destroy(sys);
+  }
+
+  qsort(s_latency_ms, (size_t)s_latency_count, sizeof(double),
+        compare_double);
+  uint64_t points = atomic_load(&s_points);
+  uint64_t messages = atomic_load(&s_messages);
+
+  printf("{\"devices\":%d,\"sites\":%d,\"format\":\"%s\",\"qos\":%d,"
+         "\"interval_ms\":%" PRIu32 ",\"duration_s\":%.1f,\n",
+         s_config.devices, s_config.sites,
+         s_config.format == TELEMETRY_FORMAT_JSON ? "json" : "lp",
+         s_config.qos, s_config.interval_ms, elapsed_s);
+  printf(" \"published\":{\"messages\":%" PRIu64 ",\"points\":%" PRIu64
+         ",\"msg_per_s\":%.1f,\"errors\":%" PRIu64 ",\"offline_drops\":%" PRIu64
+         ",\"reconnects\":%" PRIu64 "},\n",
+         messages, points, (double)messages / elapsed_s,
+         (uint64_t)atomic_load(&s_publish_errors),
+         (uint64_t)atomic_load(&s_offline_drops),
+         (uint64_t)atomic_load(&s_reconnects));
+  if (sys_seen) {
+    // $SYS counters cover every client of the broker, not just this run.
+    printf(" \"broker\":{\"received\":%" PRIu64 ",\"msg_per_s\":%.1f,"
+           "\"dropped\":%" PRIu64 "},\n",
+           broker_received, (double)broker_received / elapsed_s,
+           broker_dropped);
+  } else {
+    printf(" \"broker\":null,\n");
+  }
+  if (influx_points >= 0) {
+    printf(" \"influx\":{\"points\":%" PRId64 ",\"missing\":%" PRId64
+           ",\"latency_ms\":{\"probes\":%d,\"p50\":%.1f,\"p90\":%.1f,"
+           "\"p99\":%.1f,\"max\":%.1f}}}\n",
+           influx_points, (int64_t)points - influx_points, s_latency_count,
+           percentile(s_latency_ms, s_latency_count, 50),
+           percentile(s_latency_ms, s_latency_count, 90),
+           percentile(s_latency_ms, s_latency_count, 99),
+           percentile(s_latency_ms, s_latency_count, 100));
+  } else {
+    printf(" \"influx\":null}\n");
+  }
+
+  for (int i = 0; i < s_config.devices; i++) {
+    mosquitto_destroy(devices[i].mosq);
+  }
+  free(devices);
+  free(workers);
+  mosquitto_lib_cleanup();
+  return 0;
+}
@@ -0,0 +1,101 @@
+#include "influx.h"
+#include <curl/curl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESPONSE_MAX 8192
+
+typedef struct {
+  char data[RESPONSE_MAX];
+  size_t len;
+} response_t;
+
+static void copy_env(char *dest, size_t size, const char *name,
+                     const char *fallback) {
+  const char *value = getenv(name);
+  snprintf(dest, size, "%s", value != NULL ? value : fallback);
+}
+
+bool influx_init(influx_t *influx) {
+  copy_env(influx->url, sizeof(influx->url), "INFLUXDB_URL",
+           "http://localhost:8086");
+  copy_env(influx->token, sizeof(influx->token), "INFLUXDB_TOKEN", "");
+  copy_env(influx->org, sizeof(influx->org), "INFLUXDB_ORG", "growgrid");
+  copy_env(influx->bucket, sizeof(influx->bucket), "INFLUXDB_BUCKET",
+           "growgrid");
+  return influx->token[0] != '\0';
+}
+
+static size_t on_data(char *ptr, size_t size, size_t nmemb, void *ctx) {
+  response_t *resp = ctx;
+  size_t len = size * nmemb;
+  size_t room = sizeof(resp->data) - 1 - resp->len;
+  size_t n = len < room ? len : room;
+  memcpy(resp->data + resp->len, ptr, n);
+  resp->len += n;
+  resp->data[resp->len] = '\0';
+  return len;
+}
+
+// Annotated CSV: a header row per table, then rows whose last column is the
+// value. Rows that do not end in an integer are headers or blank.
+static bool sum_last_column(char *csv, int64_t *value) {
+  bool found = false;
+  int64_t sum = 0;
+  char *save;
+  for (char *line = strtok_r(csv, "\n", &save); line != NULL;
+       line = strtok_r(NULL, "\n", &save)) {
+    char *field = strrchr(line, ',');
+    field = field != NULL ? field + 1 : line;
+    char *end;
+    long long v = strtoll(field, &end, 10);
+    if (end != field && (*end == '\0' || *end == '\r')) {
+      sum += v;
+      found = true;
+    }
+  }
+  *value = sum;
+  return found;
+}
+
+bool influx_query_int(const influx_t *influx, const char *flux,
+                      int64_t *value) {
+  response_t *resp = calloc(1, sizeof(*resp));
+  CURL *curl = curl_easy_init();
+  if (resp == NULL || curl == NULL) {
+    free(resp);
+    if (curl != NULL) {
+      curl_easy_cleanup(curl);
+    }
+    return false;
+  }
+
+  char url[256];
+  char auth[300];
+  snprintf(url, sizeof(url), "%s/api/v2/query?org=%s", influx->url,
+           influx->org);
+  snprintf(auth, sizeof(auth), "Authorization: Token %s", influx->token);
+  struct curl_slist *headers = curl_slist_append(NULL, auth);
+  headers = curl_slist_append(headers, "Accept: application/csv");
+  headers = curl_slist_append(headers, "Content-Type: application/vnd.flux");
+
+  curl_easy_setopt(curl, CURLOPT_URL, url);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, flux);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, on_data);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, resp);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+
+  long status = 0;
+  bool ok = curl_easy_perform(curl) == CURLE_OK;
+  if (ok) {
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    ok = status == 200 && sum_last_column(resp->data, value);
+  }
+
+  free(resp);
+  curl_slist_free_all(headers);
+  curl_easy_cleanup(curl);
+  return ok;
+}
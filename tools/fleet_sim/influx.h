@@ -0,0 +1,29 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+  char url[128];
+  char token[256];
+  char org[64];
+  char bucket[64];
+} influx_t;
+
+/**
+ * @brief Reads INFLUXDB_URL, INFLUXDB_TOKEN, INFLUXDB_ORG and
+ * INFLUXDB_BUCKET, with the defaults of the docker stack.
+ *
+ * @return false if no token is set, Influx checks are skipped then.
+ */
+bool influx_init(influx_t *influx);
+
+/**
+ * @brief Runs a Flux query and sums the last column of all result rows.
+ *
+ * Queries are written so that they return one numeric row, e.g. ending in
+ * count() or mapping _time to an integer.
+ *
+ * @return true on success, false on HTTP or parse errors.
+ */
+bool influx_query_int(const influx_t *influx, const char *flux,
+                      int64_t *value);
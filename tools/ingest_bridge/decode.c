@@ -0,0 +1,254 @@
+#include "decode.h"
+#include "telemetry.h"
+#include "telemetry_window.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TOPIC_PREFIX "growgrid"
+#define TOPIC_MAX_LEVELS 5
+#define JSON_MAX_LEN 256
+#define JSON_MAX_FIELDS 8
+
+typedef struct {
+  char key[16];
+  double value;
+  uint64_t integer; // Exact value for timestamp_us, doubles lose precision
+} json_field_t;
+
+// Splits the topic in place, returns the number of levels or -1.
+static int split_topic(char *topic, char **levels) {
+  int count = 0;
+  for (char *level = topic; level != NULL; count++) {
+    if (count == TOPIC_MAX_LEVELS) {
+      return -1;
+    }
+    levels[count] = level;
+    level = strchr(level, '/');
+    if (level != NULL) {
+      *level++ = '\0';
+    }
+  }
+  return count;
+}
+
+// Site and device become tag values unescaped. Devices sanitize them to
+// this set (mqtt_topics.c), anything else did not come from the firmware.
+static bool valid_tag_value(const char *value) {
+  if (*value == '\0') {
+    return false;
+  }
+  for (; *value != '\0'; value++) {
+    if (!isalnum((unsigned char)*value) && strchr("-_.", *value) == NULL) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool channel_from_name(const char *name, telemetry_channel_t *channel) {
+  for (int i = 0; i < TELEMETRY_CHANNEL_COUNT; i++) {
+    if (strcmp(name, telemetry_channel_name((telemetry_channel_t)i)) == 0) {
+      *channel = (telemetry_channel_t)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static const char *skip_space(const char *p) {
+  while (isspace((unsigned char)*p)) {
+    p++;
+  }
+  return p;
+}
+
+// Parses the flat objects the firmware publishes: string keys, numeric
+// values.
+static int parse_json(const char *json, json_field_t *fields) {
+  const char *p = skip_space(json);
+  if (*p++ != '{') {
+    return -1;
+  }
+  int count = 0;
+  p = skip_space(p);
+  if (*p == '}') {
+    return 0;
+  }
+  while (count < JSON_MAX_FIELDS) {
+    if (*p++ != '"') {
+      return -1;
+    }
+    const char *end = strchr(p, '"');
+    if (end == NULL || (size_t)(end - p) >= sizeof(fields[0].key)) {
+      return -1;
+    }
+    json_field_t *field = &fields[count++];
+    memcpy(field->key, p, (size_t)(end - p));
+    field->key[end - p] = '\0';
+
+    p = skip_space(end + 1);
+    if (*p++ != ':') {
+      return -1;
+    }
+    p = skip_space(p);
+    char *num_end;
+    field->value = strtod(p, &num_end);
+    if (num_end == p) {
+      return -1;
+    }
+    field->integer = *p != '-' ? strtoull(p, NULL, 10) : 0;
+    p = skip_space(num_end);
+    if (*p == '}') {
+      return *skip_space(p + 1) == '\0' ? count : -1;
+    }
+    if (*p++ != ',') {
+      return -1;
+    }
+    p = skip_space(p);
+  }
+  return -1;
+}
+
+static const json_field_t *find_field(const json_field_t *fields, int count,
+                                      const char *key) {
+  for (int i = 0; i < count; i++) {
+    if (strcmp(fields[i].key, key) == 0) {
+      return &fields[i];
+    }
+  }
+  return NULL;
+}
+
+static int decode_line_protocol(const char *payload, size_t len,
+                                strbuf_t *out) {
+  if (len == 0 || memchr(payload, '\0', len) != NULL) {
+    return DECODE_ERROR;
+  }
+  int points = 0;
+  bool in_line = false;
+  for (size_t i = 0; i < len; i++) {
+    if (payload[i] == '\n') {
+      in_line = false;
+    } else if (!in_line) {
+      in_line = true;
+      points++;
+    }
+  }
+  bool newline = payload[len - 1] == '\n';
+  if (!strbuf_reserve(out, len + 1)) {
+    return DECODE_ERROR;
+  }
+  strbuf_append(out, payload, len);
+  if (!newline) {
+    strbuf_append(out, "\n", 1);
+  }
+  return points;
+}
+
+static int append_line(strbuf_t *out, const char *line, int len) {
+  if (len < 0 || !strbuf_reserve(out, (size_t)len + 1)) {
+    return DECODE_ERROR;
+  }
+  strbuf_append(out, line, (size_t)len);
+  strbuf_append(out, "\n", 1);
+  return 1;
+}
+
+static int decode_point(telemetry_channel_t channel, const json_field_t *fields,
+                        int count, const char *tags, strbuf_t *out) {
+  const json_field_t *value = find_field(fields, count, "value");
+  const json_field_t *ts = find_field(fields, count, "timestamp_us");
+  if (value == NULL || ts == NULL) {
+    return DECODE_ERROR;
+  }
+  telemetry_point_t point = {
+      .timestamp_us = ts->integer,
+      .channel = channel,
+      .value = (float)value->value,
+  };
+  // nan and inf are not valid line protocol, one would fail its batch.
+  if (!isfinite(point.value)) {
+    return DECODE_ERROR;
+  }
+  char line[160];
+  return append_line(out, line,
+                     telemetry_format_line_protocol(&point, tags, line,
+                                                    sizeof(line)));
+}
+
+static int decode_summary(telemetry_channel_t channel,
+                          const json_field_t *fields, int count,
+                          const char *tags, strbuf_t *out) {
+  static const char *const keys[] = {"count", "min",    "max",
+                                     "mean",  "stddev", "timestamp_us"};
+  const json_field_t *f[6];
+  for (int i = 0; i < 6; i++) {
+    f[i] = find_field(fields, count, keys[i]);
+    if (f[i] == NULL) {
+      return DECODE_ERROR;
+    }
+  }
+  telemetry_summary_t summary = {
+      .window_start_us = f[5]->integer,
+      .channel = channel,
+      .count = (uint32_t)f[0]->integer,
+      .min = (float)f[1]->value,
+      .max = (float)f[2]->value,
+      .mean = (float)f[3]->value,
+      .stddev = (float)f[4]->value,
+  };
+  if (!isfinite(summary.min) || !isfinite(summary.max) ||
+      !isfinite(summary.mean) || !isfinite(summary.stddev)) {
+    return DECODE_ERROR;
+  }
+  char line[256];
+  return append_line(out, line,
+                     telemetry_format_summary_line_protocol(
+                         &summary, tags, line, sizeof(line)));
+}
+
+int decode_message(const char *topic, const char *payload, size_t len,
+                   strbuf_t *out) {
+  char topic_copy[128];
+  char *levels[TOPIC_MAX_LEVELS];
+  if (snprintf(topic_copy, sizeof(topic_copy), "%s", topic) >=
+      (int)sizeof(topic_copy)) {
+    return DECODE_ERROR;
+  }
+  int depth = split_topic(topic_copy, levels);
+  if (depth < 4 || strcmp(levels[0], TOPIC_PREFIX) != 0 ||
+      !valid_tag_value(levels[1]) || !valid_tag_value(levels[2])) {
+    return DECODE_ERROR;
+  }
+  const char *kind = levels[3];
+
+  if (depth == 4 && (strcmp(kind, "lp") == 0 || strcmp(kind, "diag") == 0)) {
+    return decode_line_protocol(payload, len, out);
+  }
+
+  bool is_summary = strcmp(kind, "summary") == 0;
+  telemetry_channel_t channel;
+  if (depth != 5 || !(is_summary || strcmp(kind, "telemetry") == 0) ||
+      !channel_from_name(levels[4], &channel) || len >= JSON_MAX_LEN) {
+    return DECODE_ERROR;
+  }
+
+  char json[JSON_MAX_LEN];
+  memcpy(json, payload, len);
+  json[len] = '\0';
+  json_field_t fields[JSON_MAX_FIELDS];
+  int count = parse_json(json, fields);
+  if (count < 0) {
+    return DECODE_ERROR;
+  }
+
+  char tags[160];
+  snprintf(tags, sizeof(tags), "site=%s,device=%s", levels[1], levels[2]);
+  return is_summary ? decode_summary(channel, fields, count, tags, out)
+                    : decode_point(channel, fields, count, tags, out);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "strbuf.h"
+#include <stddef.h>
+
+#define DECODE_ERROR (-1)
+
+/**
+ * @brief Converts one device message to line protocol and appends it.
+ *
+ * Topics are growgrid/<site>/<device>/<kind>[/<channel>]:
+ *   - lp, diag: line protocol, passed through
+ *   - telemetry/<channel>: `{"value","timestamp_us"}`
+ *   - summary/<channel>: `{"count","min","max","mean","stddev",
+ *     "timestamp_us"}`
+ *
+ * JSON is written with the firmware's own serializers and the site and
+ * device tags from the topic, so both device formats land in the same
+ * series, as with Telegraf.
+ *
+ * @return The number of points appended, or DECODE_ERROR for unknown topics
+ * and malformed payloads, including JSON values that are not finite as a
+ * float, @p out is unchanged then.
+ */
+int decode_message(const char *topic, const char *payload, size_t len,
+                   strbuf_t *out);
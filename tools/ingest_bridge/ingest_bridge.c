@@ -0,0 +1,383 @@
+/**
+ * Ingest bridge: subscribes to the device topics and writes them to
+ * InfluxDB in batches, replacing the Telegraf MQTT consumers and the
+ * Node-RED InfluxDB output.
+ *
+ * Each pipeline is one MQTT connection in a shared subscription group, so
+ * the broker spreads messages over pipelines (and over bridge instances with
+ * the same group), plus one writer thread with its own HTTP connection.
+ * JSON payloads are decoded and serialized with the firmware's telemetry
+ * code, line protocol payloads are passed through (decode.h).
+ *
+ * Settings come from the command line or the environment, *_FILE variants
+ * read docker secrets. Counters are served in the Prometheus format on
+ * --metrics-port (metrics.h) and logged every STATS_INTERVAL_S.
+ */
+#include "decode.h"
+#include "metrics.h"
+#include "strbuf.h"
+#include "writer.h"
+#include <curl/curl.h>
+#include <getopt.h>
+#include <mosquitto.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STATS_INTERVAL_S 10
+#define DECODE_ERROR_LOG_EVERY 1000
+#define SECRET_MAX 256
+
+typedef struct {
+  const char *host;
+  int port;
+  const char *username;
+  const char *password;
+  const char *group;
+  int clients;
+  int metrics_port;
+  writer_config_t writer;
+} config_t;
+
+typedef struct {
+  int index;
+  struct mosquitto *mosq;
+  writer_t *writer;
+  strbuf_t scratch; // Loop thread only
+} pipeline_t;
+
+static const char *const s_topics[] = {
+    "growgrid/+/+/lp",
+    "growgrid/+/+/diag",
+    "growgrid/+/+/telemetry/+",
+    "growgrid/+/+/summary/+",
+};
+
+#define TOPIC_COUNT (int)(sizeof(s_topics) / sizeof(s_topics[0]))
+
+static config_t s_config = {
+    .port = 1883,
+    .group = "growgrid-ingest",
+    .clients = 2,
+    .metrics_port = 9108,
+    .writer =
+        {
+            .batch_points = 5000,
+            .flush_interval_ms = 1000,
+            .max_buffered_points = 200000,
+        },
+};
+static volatile sig_atomic_t s_stop;
+
+static void on_signal(int sig) {
+  (void)sig;
+  s_stop = 1;
+}
+
+// Returns $NAME, the trimmed content of the file in $NAME_FILE, or fallback.
+static const char *env_or(const char *name, const char *fallback) {
+  const char *value = getenv(name);
+  if (value != NULL) {
+    return value;
+  }
+  char file_var[64];
+  snprintf(file_var, sizeof(file_var), "%s_FILE", name);
+  const char *path = getenv(file_var);
+  if (path == NULL) {
+    return fallback;
+  }
+  FILE *f = fopen(path, "r");
+  char *secret = calloc(1, SECRET_MAX);
+  if (f == NULL || secret == NULL) {
+    fprintf(stderr, "Cannot read %s\n", path);
+    exit(1);
+  }
+  size_t len = fread(secret, 1, SECRET_MAX - 1, f);
+  fclose(f);
+  while (len > 0 && (secret[len - 1] == '\n' || secret[len - 1] == '\r' ||
+                     secret[len - 1] == ' ')) {
+    secret[--len] = '\0';
+  }
+  return secret;
+}
+
+static uint32_t env_uint(const char *name, uint32_t fallback) {
+  const char *value = getenv(name);
+  return value != NULL ? (uint32_t)strtoul(value, NULL, 10) : fallback;
+}
+
+static void on_connect(struct mosquitto *mosq, void *ctx, int rc) {
+  pipeline_t *p = ctx;
+  if (rc != 0) {
+    fprintf(stderr, "Pipeline %d: connect refused: %s\n", p->index,
+            mosquitto_connack_string(rc));
+    return;
+  }
+  for (int i = 0; i < TOPIC_COUNT; i++) {
+    char filter[128];
+    snprintf(filter, sizeof(filter), "$share/%s/%s", s_config.group,
+             s_topics[i]);
+    mosquitto_subscribe(mosq, NULL, filter, 1);
+  }
+  fprintf(stderr, "Pipeline %d: connected\n", p->index);
+}
+
+static void on_disconnect(struct mosquitto *mosq, void *ctx, int rc) {
+  (void)mosq;
+  pipeline_t *p = ctx;
+  if (rc != 0) {
+    fprintf(stderr, "Pipeline %d: connection lost, reconnecting\n",
+            p->index);
+  }
+}
+
+static void on_message(struct mosquitto *mosq, void *ctx,
+                       const struct mosquitto_message *msg) {
+  (void)mosq;
+  pipeline_t *p = ctx;
+  atomic_fetch_add(&bridge_metrics.messages_received, 1);
+
+  strbuf_clear(&p->scratch);
+  int points = decode_message(msg->topic, msg->payload,
+                              (size_t)msg->payloadlen, &p->scratch);
+  if (points == DECODE_ERROR) {
+    unsigned long long errors =
+        atomic_fetch_add(&bridge_metrics.decode_errors, 1);
+    if (errors % DECODE_ERROR_LOG_EVERY == 0) {
+      fprintf(stderr, "Cannot decode message on %s (%llu so far)\n",
+              msg->topic, errors + 1);
+    }
+    return;
+  }
+  if (points > 0) {
+    atomic_fetch_add(&bridge_metrics.points_decoded, (unsigned)points);
+    writer_add(p->writer, p->scratch.data, p->scratch.len, (uint32_t)points);
+  }
+}
+
+static bool pipeline_start(pipeline_t *p, int index) {
+  p->index = index;
+  p->writer = writer_start(&s_config.writer);
+  if (p->writer == NULL) {
+    return false;
+  }
+
+  // Persistent sessions keep QoS 1 messages queued in the broker while the
+  // bridge restarts.
+  char client_id[96];
+  snprintf(client_id, sizeof(client_id), "%s-%d", s_config.group, index);
+  p->mosq = mosquitto_new(client_id, false, p);
+  if (p->mosq == NULL) {
+    return false;
+  }
+  if (s_config.username != NULL) {
+    mosquitto_username_pw_set(p->mosq, s_config.username, s_config.password);
+  }
+  mosquitto_connect_callback_set(p->mosq, on_connect);
+  mosquitto_disconnect_callback_set(p->mosq, on_disconnect);
+  mosquitto_message_callback_set(p->mosq, on_message);
+  mosquitto_reconnect_delay_set(p->mosq, 1, 30, true);
+
+  // The loop thread keeps retrying if the broker is not up yet.
+  int rc = mosquitto_connect_async(p->mosq, s_config.host, s_config.port, 30);
+  if (rc != MOSQ_ERR_SUCCESS) {
+    fprintf(stderr, "Pipeline %d: %s, retrying\n", index,
+            mosquitto_strerror(rc));
+  }
+  return mosquitto_loop_start(p->mosq) == MOSQ_ERR_SUCCESS;
+}
+
+static void pipeline_stop(pipeline_t *p) {
+  if (p->mosq != NULL) {
+    mosquitto_disconnect(p->mosq);
+    mosquitto_loop_stop(p->mosq, false);
+    mosquitto_destroy(p->mosq);
+  }
+  if (p->writer != NULL) {
+    writer_stop(p->writer);
+  }
+  strbuf_free(&p->scratch);
+}
+
+static void log_stats(double elapsed_s, unsigned long long *last_written,
+                      double *last_cpu) {
+  unsigned long long written = atomic_load(&bridge_metrics.points_written);
+  double cpu = metrics_cpu_seconds();
+  double points = (double)(written - *last_written);
+  fprintf(stderr,
+          "%.0f points/s, %.0f points per CPU second, %lld buffered, "
+          "%llu dropped, %llu decode errors\n",
+          points / elapsed_s, cpu > *last_cpu ? points / (cpu - *last_cpu) : 0,
+          atomic_load(&bridge_metrics.buffered_points),
+          atomic_load(&bridge_metrics.points_dropped),
+          atomic_load(&bridge_metrics.decode_errors));
+  *last_written = written;
+  *last_cpu = cpu;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -h, --host HOST           broker host, $MQTT_HOST (localhost)\n"
+          "  -p, --port PORT           broker port, $MQTT_PORT (1883)\n"
+          "  -u, --username USER       MQTT user, $MQTT_USERNAME[_FILE]\n"
+          "  -P, --password PASS       MQTT password, $MQTT_PASSWORD[_FILE]\n"
+          "  -g, --group NAME          shared subscription group, "
+          "$INGEST_GROUP\n"
+          "                            (growgrid-ingest)\n"
+          "  -c, --clients N           pipelines, $INGEST_CLIENTS (2)\n"
+          "  -b, --batch-points N      points per write, "
+          "$INGEST_BATCH_POINTS (5000)\n"
+          "  -f, --flush-ms MS         max batch age, $INGEST_FLUSH_MS "
+          "(1000)\n"
+          "      --max-buffered N      points buffered per pipeline,\n"
+          "                            $INGEST_MAX_BUFFERED_POINTS "
+          "(200000)\n"
+          "  -m, --metrics-port PORT   Prometheus endpoint, 0 disables,\n"
+          "                            $INGEST_METRICS_PORT (9108)\n"
+          "InfluxDB: $INFLUXDB_URL (http://localhost:8086), "
+          "$INFLUXDB_TOKEN[_FILE],\n"
+          "$INFLUXDB_ORG and $INFLUXDB_BUCKET (growgrid)\n",
+          argv0);
+}
+
+static bool parse_args(int argc, char **argv) {
+  enum { OPT_MAX_BUFFERED = 256 };
+  static const struct option options[] = {
+      {"host", required_argument, NULL, 'h'},
+      {"port", required_argument, NULL, 'p'},
+      {"username", required_argument, NULL, 'u'},
+      {"password", required_argument, NULL, 'P'},
+      {"group", required_argument, NULL, 'g'},
+      {"clients", required_argument, NULL, 'c'},
+      {"batch-points", required_argument, NULL, 'b'},
+      {"flush-ms", required_argument, NULL, 'f'},
+      {"max-buffered", required_argument, NULL, OPT_MAX_BUFFERED},
+      {"metrics-port", required_argument, NULL, 'm'},
+      {NULL, 0, NULL, 0},
+  };
+
+  config_t *c = &s_config;
+  writer_config_t *w = &c->writer;
+  c->host = env_or("MQTT_HOST", "localhost");
+  c->port = (int)env_uint("MQTT_PORT", (uint32_t)c->port);
+  c->username = env_or("MQTT_USERNAME", NULL);
+  c->password = env_or("MQTT_PASSWORD", NULL);
+  c->group = env_or("INGEST_GROUP", c->group);
+  c->clients = (int)env_uint("INGEST_CLIENTS", (uint32_t)c->clients);
+  c->metrics_port =
+      (int)env_uint("INGEST_METRICS_PORT", (uint32_t)c->metrics_port);
+  w->batch_points = env_uint("INGEST_BATCH_POINTS", w->batch_points);
+  w->flush_interval_ms = env_uint("INGEST_FLUSH_MS", w->flush_interval_ms);
+  w->max_buffered_points =
+      env_uint("INGEST_MAX_BUFFERED_POINTS", w->max_buffered_points);
+  w->url = env_or("INFLUXDB_URL", "http://localhost:8086");
+  w->token = env_or("INFLUXDB_TOKEN", "");
+  w->org = env_or("INFLUXDB_ORG", "growgrid");
+  w->bucket = env_or("INFLUXDB_BUCKET", "growgrid");
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "h:p:u:P:g:c:b:f:m:", options,
+                            NULL)) != -1) {
+    switch (opt) {
+    case 'h':
+      c->host = optarg;
+      break;
+    case 'p':
+      c->port = atoi(optarg);
+      break;
+    case 'u':
+      c->username = optarg;
+      break;
+    case 'P':
+      c->password = optarg;
+      break;
+    case 'g':
+      c->group = optarg;
+      break;
+    case 'c':
+      c->clients = atoi(optarg);
+      break;
+    case 'b':
+      w->batch_points = (uint32_t)strtoul(optarg, NULL, 10);
+      break;
+    case 'f':
+      w->flush_interval_ms = (uint32_t)strtoul(optarg, NULL, 10);
+      break;
+    case OPT_MAX_BUFFERED:
+      w->max_buffered_points = (uint32_t)strtoul(optarg, NULL, 10);
+      break;
+    case 'm':
+      c->metrics_port = atoi(optarg);
+      break;
+    default:
+      return false;
+    }
+  }
+  return c->clients > 0 && w->batch_points > 0 && w->flush_interval_ms > 0 &&
+         w->max_buffered_points >= w->batch_points && w->token[0] != '\0';
+}
+
+int main(int argc, char **argv) {
+  if (!parse_args(argc, argv)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+  mosquitto_lib_init();
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+
+  if (s_config.metrics_port > 0 && !metrics_serve(s_config.metrics_port)) {
+    fprintf(stderr, "Cannot serve metrics on port %d\n",
+            s_config.metrics_port);
+    return 1;
+  }
+
+  pipeline_t *pipelines = calloc((size_t)s_config.clients, sizeof(*pipelines));
+  if (pipelines == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  int started = 0;
+  while (started < s_config.clients &&
+         pipeline_start(&pipelines[started], started)) {
+    started++;
+  }
+  int rc = 0;
+  if (started < s_config.clients) {
+    fprintf(stderr, "Failed to start pipeline %d\n", started);
+    // The failed one may be half set up.
+    started++;
+    rc = 1;
+    s_stop = 1;
+  } else {
+    fprintf(stderr,
+            "Bridging %s:%d to %s with %d pipelines, %u points per batch\n",
+            s_config.host, s_config.port, s_config.writer.url,
+            s_config.clients, (unsigned)s_config.writer.batch_points);
+  }
+
+  unsigned long long last_written = 0;
+  double last_cpu = metrics_cpu_seconds();
+  for (int tick = 1; !s_stop; tick++) {
+    sleep(1);
+    if (tick % STATS_INTERVAL_S == 0) {
+      log_stats(STATS_INTERVAL_S, &last_written, &last_cpu);
+    }
+  }
+
+  // Disconnect first so the writers flush everything that was acknowledged.
+  for (int i = 0; i < started; i++) {
+    pipeline_stop(&pipelines[i]);
+  }
+  free(pipelines);
+  curl_global_cleanup();
+  mosquitto_lib_cleanup();
+  return rc;
+}
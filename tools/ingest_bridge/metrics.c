@@ -0,0 +1,112 @@
+#include "metrics.h"
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define METRICS_BODY_MAX 2048
+
+metrics_t bridge_metrics;
+
+static int s_listen_fd = -1;
+
+double metrics_cpu_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int format_metrics(char *buf, size_t size) {
+  metrics_t *m = &bridge_metrics;
+  return snprintf(
+      buf, size,
+      "# TYPE growgrid_ingest_messages_received_total counter\n"
+      "growgrid_ingest_messages_received_total %llu\n"
+      "# TYPE growgrid_ingest_decode_errors_total counter\n"
+      "growgrid_ingest_decode_errors_total %llu\n"
+      "# TYPE growgrid_ingest_points_decoded_total counter\n"
+      "growgrid_ingest_points_decoded_total %llu\n"
+      "# TYPE growgrid_ingest_points_written_total counter\n"
+      "growgrid_ingest_points_written_total %llu\n"
+      "# TYPE growgrid_ingest_points_dropped_total counter\n"
+      "growgrid_ingest_points_dropped_total %llu\n"
+      "# TYPE growgrid_ingest_write_requests_total counter\n"
+      "growgrid_ingest_write_requests_total %llu\n"
+      "# TYPE growgrid_ingest_write_errors_total counter\n"
+      "growgrid_ingest_write_errors_total %llu\n"
+      "# TYPE growgrid_ingest_write_retries_total counter\n"
+      "growgrid_ingest_write_retries_total %llu\n"
+      "# TYPE growgrid_ingest_write_seconds_total counter\n"
+      "growgrid_ingest_write_seconds_total %.6f\n"
+      "# TYPE growgrid_ingest_buffered_points gauge\n"
+      "growgrid_ingest_buffered_points %lld\n"
+      "# TYPE growgrid_ingest_cpu_seconds_total counter\n"
+      "growgrid_ingest_cpu_seconds_total %.6f\n",
+      atomic_load(&m->messages_received), atomic_load(&m->decode_errors),
+      atomic_load(&m->points_decoded), atomic_load(&m->points_written),
+      atomic_load(&m->points_dropped), atomic_load(&m->write_requests),
+      atomic_load(&m->write_errors), atomic_load(&m->write_retries),
+      (double)atomic_load(&m->write_duration_us) / 1e6,
+      atomic_load(&m->buffered_points), metrics_cpu_seconds());
+}
+
+// One request per connection, whatever the path: scrapers and curl only.
+static void *serve_main(void *arg) {
+  (void)arg;
+  char request[1024];
+  char body[METRICS_BODY_MAX];
+  char header[128];
+  for (;;) {
+    int fd = accept(s_listen_fd, NULL, NULL);
+    if (fd < 0) {
+      continue;
+    }
+    struct timeval timeout = {.tv_sec = 2};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (read(fd, request, sizeof(request)) > 0) {
+      int len = format_metrics(body, sizeof(body));
+      int header_len =
+          snprintf(header, sizeof(header),
+                   "HTTP/1.1 200 OK\r\n"
+                   "Content-Type: text/plain; version=0.0.4\r\n"
+                   "Content-Length: %d\r\n"
+                   "Connection: close\r\n\r\n",
+                   len);
+      if (write(fd, header, (size_t)header_len) == header_len) {
+        (void)!write(fd, body, (size_t)len);
+      }
+    }
+    close(fd);
+  }
+  return NULL;
+}
+
+bool metrics_serve(int port) {
+  s_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (s_listen_fd < 0) {
+    return false;
+  }
+  int on = 1;
+  setsockopt(s_listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in addr = {
+      .sin_family = AF_INET,
+      .sin_port = htons((uint16_t)port),
+      .sin_addr.s_addr = htonl(INADDR_ANY),
+  };
+  if (bind(s_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(s_listen_fd, 8) != 0) {
+    close(s_listen_fd);
+    s_listen_fd = -1;
+    return false;
+  }
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, serve_main, NULL) != 0) {
+    return false;
+  }
+  pthread_detach(thread);
+  return true;
+}
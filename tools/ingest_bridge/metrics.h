@@ -0,0 +1,36 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/**
+ * Ingest counters, shared by all pipelines and exported in the Prometheus
+ * text format. Points per CPU second (points_written_total over
+ * cpu_seconds_total) is the figure to compare against Telegraf.
+ */
+typedef struct {
+  atomic_ullong messages_received;
+  atomic_ullong decode_errors;
+  atomic_ullong points_decoded;
+  atomic_ullong points_written;
+  atomic_ullong points_dropped; // Buffer full or rejected by InfluxDB
+  atomic_ullong write_requests;
+  atomic_ullong write_errors;
+  atomic_ullong write_retries;
+  atomic_ullong write_duration_us;
+  atomic_llong buffered_points; // Decoded, not yet acknowledged by InfluxDB
+} metrics_t;
+
+extern metrics_t bridge_metrics;
+
+/**
+ * @brief Seconds of CPU time used by the process, all threads.
+ */
+double metrics_cpu_seconds(void);
+
+/**
+ * @brief Serves the metrics on http://0.0.0.0:<port>/metrics from a
+ * background thread.
+ *
+ * @return false if the port could not be bound.
+ */
+bool metrics_serve(int port);
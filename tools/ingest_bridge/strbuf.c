@@ -0,0 +1,36 @@
+#include "strbuf.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool strbuf_reserve(strbuf_t *buf, size_t len) {
+  if (buf->len + len <= buf->cap) {
+    return true;
+  }
+  size_t cap = buf->cap > 0 ? buf->cap : 4096;
+  while (cap < buf->len + len) {
+    cap *= 2;
+  }
+  char *data = realloc(buf->data, cap);
+  if (data == NULL) {
+    return false;
+  }
+  buf->data = data;
+  buf->cap = cap;
+  return true;
+}
+
+bool strbuf_append(strbuf_t *buf, const char *data, size_t len) {
+  if (!strbuf_reserve(buf, len)) {
+    return false;
+  }
+  memcpy(buf->data + buf->len, data, len);
+  buf->len += len;
+  return true;
+}
+
+void strbuf_clear(strbuf_t *buf) { buf->len = 0; }
+
+void strbuf_free(strbuf_t *buf) {
+  free(buf->data);
+  *buf = (strbuf_t){0};
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+// Growable byte buffer holding line protocol.
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+} strbuf_t;
+
+/**
+ * @brief Appends bytes, growing the buffer as needed.
+ *
+ * @return false if memory ran out, the buffer is unchanged then.
+ */
+bool strbuf_append(strbuf_t *buf, const char *data, size_t len);
+
+/**
+ * @brief Makes room for @p len more bytes without changing the content.
+ */
+bool strbuf_reserve(strbuf_t *buf, size_t len);
+
+void strbuf_clear(strbuf_t *buf);
+void strbuf_free(strbuf_t *buf);
@@ -0,0 +1,273 @@
+#include "writer.h"
+#include "metrics.h"
+#include "strbuf.h"
+#include <curl/curl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WRITE_TIMEOUT_S 10L
+#define WRITE_MAX_ATTEMPTS 5
+#define WRITE_BACKOFF_BASE_MS 250
+#define WRITE_ERROR_BODY_MAX 256
+
+struct writer {
+  writer_config_t config;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  strbuf_t pending; // Filled by writer_add under the lock
+  uint32_t pending_points;
+  struct timespec pending_since;
+  bool stopping;
+
+  // Writer thread only.
+  strbuf_t sending;
+  CURL *curl;
+  struct curl_slist *headers;
+  char write_url[512];
+  char error_body[WRITE_ERROR_BODY_MAX];
+  size_t error_len;
+};
+
+static int64_t mono_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_ms(uint32_t ms) {
+  struct timespec ts = {.tv_sec = ms / 1000,
+                        .tv_nsec = (long)(ms % 1000) * 1000000};
+  nanosleep(&ts, NULL);
+}
+
+static size_t on_response(char *ptr, size_t size, size_t nmemb, void *ctx) {
+  writer_t *writer = ctx;
+  size_t len = size * nmemb;
+  size_t room = sizeof(writer->error_body) - 1 - writer->error_len;
+  size_t n = len < room ? len : room;
+  memcpy(writer->error_body + writer->error_len, ptr, n);
+  writer->error_len += n;
+  writer->error_body[writer->error_len] = '\0';
+  return len;
+}
+
+static bool setup_curl(writer_t *writer) {
+  const writer_config_t *c = &writer->config;
+  writer->curl = curl_easy_init();
+  if (writer->curl == NULL) {
+    return false;
+  }
+  char *org = curl_easy_escape(writer->curl, c->org, 0);
+  char *bucket = curl_easy_escape(writer->curl, c->bucket, 0);
+  snprintf(writer->write_url, sizeof(writer->write_url),
+           "%s/api/v2/write?org=%s&bucket=%s&precision=ns", c->url, org,
+           bucket);
+  curl_free(org);
+  curl_free(bucket);
+
+  char auth[320];
+  snprintf(auth, sizeof(auth), "Authorization: Token %s", c->token);
+  writer->headers = curl_slist_append(NULL, auth);
+  writer->headers = curl_slist_append(
+      writer->headers, "Content-Type: text/plain; charset=utf-8");
+
+  CURL *curl = writer->curl;
+  curl_easy_setopt(curl, CURLOPT_URL, writer->write_url);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, writer->headers);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, on_response);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, writer);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT, WRITE_TIMEOUT_S);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  return true;
+}
+
+// 0 on success, 1 to retry, -1 to drop the batch.
+static int post_batch(writer_t *writer, const char *data, size_t len) {
+  writer->error_len = 0;
+  writer->error_body[0] = '\0';
+  curl_easy_setopt(writer->curl, CURLOPT_POSTFIELDS, data);
+  curl_easy_setopt(writer->curl, CURLOPT_POSTFIELDSIZE_LARGE,
+                   (curl_off_t)len);
+
+  int64_t start = mono_us();
+  CURLcode res = curl_easy_perform(writer->curl);
+  atomic_fetch_add(&bridge_metrics.write_requests, 1);
+  atomic_fetch_add(&bridge_metrics.write_duration_us,
+                   (unsigned long long)(mono_us() - start));
+  if (res != CURLE_OK) {
+    fprintf(stderr, "InfluxDB write failed: %s\n", curl_easy_strerror(res));
+    return 1;
+  }
+
+  long status = 0;
+  curl_easy_getinfo(writer->curl, CURLINFO_RESPONSE_CODE, &status);
+  if (status >= 200 && status < 300) {
+    return 0;
+  }
+  fprintf(stderr, "InfluxDB write returned %ld: %s\n", status,
+          writer->error_body);
+  return status == 429 || status >= 500 ? 1 : -1;
+}
+
+static void write_batch(writer_t *writer, const char *data, size_t len,
+                        uint32_t points) {
+  int result = 1;
+  for (int attempt = 0; attempt < WRITE_MAX_ATTEMPTS && result > 0;
+       attempt++) {
+    if (attempt > 0) {
+      atomic_fetch_add(&bridge_metrics.write_retries, 1);
+      sleep_ms(WRITE_BACKOFF_BASE_MS << (attempt - 1));
+    }
+    result = post_batch(writer, data, len);
+  }
+  if (result == 0) {
+    atomic_fetch_add(&bridge_metrics.points_written, points);
+  } else {
+    atomic_fetch_add(&bridge_metrics.write_errors, 1);
+    atomic_fetch_add(&bridge_metrics.points_dropped, points);
+  }
+  atomic_fetch_sub(&bridge_metrics.buffered_points, (long long)points);
+}
+
+// Writes the swapped buffer in requests of at most batch_points lines. After
+// an outage it can hold up to max_buffered_points.
+static void write_sending(writer_t *writer, uint32_t points) {
+  const char *data = writer->sending.data;
+  const char *end = data + writer->sending.len;
+  while (points > 0) {
+    const char *cut = data;
+    uint32_t batch = 0;
+    while (batch < writer->config.batch_points && batch < points &&
+           (cut = memchr(cut, '\n', (size_t)(end - cut))) != NULL) {
+      cut++;
+      batch++;
+    }
+    if (batch == points || cut == NULL) {
+      // The rest, also if the counts passed to writer_add were off.
+      cut = end;
+      batch = points;
+    }
+    write_batch(writer, data, (size_t)(cut - data), batch);
+    data = cut;
+    points -= batch;
+  }
+  strbuf_clear(&writer->sending);
+}
+
+static struct timespec deadline_after(const struct timespec *since,
+                                      uint32_t ms) {
+  struct timespec ts = *since;
+  ts.tv_sec += ms / 1000;
+  ts.tv_nsec += (long)(ms % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+  return ts;
+}
+
+static void *writer_main(void *arg) {
+  writer_t *writer = arg;
+  const writer_config_t *c = &writer->config;
+  for (;;) {
+    pthread_mutex_lock(&writer->lock);
+    while (!writer->stopping && writer->pending_points < c->batch_points) {
+      if (writer->pending_points == 0) {
+        pthread_cond_wait(&writer->cond, &writer->lock);
+        continue;
+      }
+      struct timespec deadline =
+          deadline_after(&writer->pending_since, c->flush_interval_ms);
+      if (pthread_cond_timedwait(&writer->cond, &writer->lock, &deadline) !=
+          0) {
+        break; // Flush interval reached
+      }
+    }
+    // Swap buffers so devices keep publishing while the request runs.
+    strbuf_t full = writer->pending;
+    writer->pending = writer->sending;
+    writer->sending = full;
+    uint32_t points = writer->pending_points;
+    writer->pending_points = 0;
+    bool stopping = writer->stopping;
+    pthread_mutex_unlock(&writer->lock);
+
+    if (points > 0) {
+      write_sending(writer, points);
+    }
+    if (stopping) {
+      return NULL;
+    }
+  }
+}
+
+writer_t *writer_start(const writer_config_t *config) {
+  writer_t *writer = calloc(1, sizeof(*writer));
+  if (writer == NULL) {
+    return NULL;
+  }
+  writer->config = *config;
+  pthread_mutex_init(&writer->lock, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&writer->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if (!setup_curl(writer) ||
+      pthread_create(&writer->thread, NULL, writer_main, writer) != 0) {
+    if (writer->curl != NULL) {
+      curl_slist_free_all(writer->headers);
+      curl_easy_cleanup(writer->curl);
+    }
+    free(writer);
+    return NULL;
+  }
+  return writer;
+}
+
+bool writer_add(writer_t *writer, const char *lines, size_t len,
+                uint32_t points) {
+  pthread_mutex_lock(&writer->lock);
+  bool ok = writer->pending_points + points <=
+                writer->config.max_buffered_points &&
+            strbuf_append(&writer->pending, lines, len);
+  if (ok) {
+    if (writer->pending_points == 0) {
+      clock_gettime(CLOCK_MONOTONIC, &writer->pending_since);
+      pthread_cond_signal(&writer->cond);
+    }
+    writer->pending_points += points;
+    if (writer->pending_points >= writer->config.batch_points) {
+      pthread_cond_signal(&writer->cond);
+    }
+    atomic_fetch_add(&bridge_metrics.buffered_points, (long long)points);
+  }
+  pthread_mutex_unlock(&writer->lock);
+
+  if (!ok) {
+    atomic_fetch_add(&bridge_metrics.points_dropped, points);
+  }
+  return ok;
+}
+
+void writer_stop(writer_t *writer) {
+  pthread_mutex_lock(&writer->lock);
+  writer->stopping = true;
+  pthread_cond_signal(&writer->cond);
+  pthread_mutex_unlock(&writer->lock);
+  pthread_join(writer->thread, NULL);
+
+  curl_slist_free_all(writer->headers);
+  curl_easy_cleanup(writer->curl);
+  strbuf_free(&writer->pending);
+  strbuf_free(&writer->sending);
+  pthread_mutex_destroy(&writer->lock);
+  pthread_cond_destroy(&writer->cond);
+  free(writer);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  const char *url; // InfluxDB base URL, e.g. http://influxdb2:8086
+  const char *token;
+  const char *org;
+  const char *bucket;
+  uint32_t batch_points;        // Flush once this many points are buffered
+  uint32_t flush_interval_ms;   // ... or when the oldest is this old
+  uint32_t max_buffered_points; // Waiting for the next request, newer
+                                // points are dropped beyond this
+} writer_config_t;
+
+typedef struct writer writer_t;
+
+/**
+ * @brief Starts a writer thread with its own HTTP connection.
+ *
+ * Points are batched into /api/v2/write requests of at most batch_points
+ * points. Network errors, 429 and 5xx responses are retried with backoff
+ * while new points keep buffering, other errors drop the batch.
+ *
+ * @return The writer, or NULL if the thread or connection could not be set
+ * up.
+ */
+writer_t *writer_start(const writer_config_t *config);
+
+/**
+ * @brief Queues newline-terminated line protocol.
+ *
+ * @param points The number of lines in @p lines, for batching and metrics.
+ * @return false if the buffer is full and the points were dropped.
+ */
+bool writer_add(writer_t *writer, const char *lines, size_t len,
+                uint32_t points);
+
+/**
+ * @brief Writes what is buffered, stops the thread and frees the writer.
+ */
+void writer_stop(writer_t *writer);
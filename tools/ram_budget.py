@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""Prints the static RAM (.data + .bss) of each component and enforces budgets.
+
+Runs after every firmware link. Sizes come from the symbol tables of the
+component archives in the build directory. Storage generated from
+mem_layout.h is named s_mem_<component>__<id>_* and charged to <component>,
+wherever it is defined.
+
+Exits with 1 if a component or the total is over its budget.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+RAM_TYPES = set("bBdDgGsS")
+LAYOUT_SYMBOL = re.compile(r"^s_mem_([a-z0-9_]+?)__")
+
+
+def archive_symbols(nm, archive):
+    out = subprocess.run([nm, "-S", "-t", "d", archive],
+                         capture_output=True, text=True, check=True).stdout
+    for line in out.splitlines():
+        parts = line.split()
+        # <value> <size> <type> <name>, symbols without a size are skipped.
+        if len(parts) == 4 and parts[2] in RAM_TYPES:
+            yield parts[3], int(parts[1])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--nm", required=True)
+    parser.add_argument("--build-dir", required=True)
+    parser.add_argument("--budget", required=True)
+    args = parser.parse_args()
+
+    with open(args.budget) as f:
+        budget = json.load(f)
+    total_budget = budget.pop("total", None)
+
+    used = {name: 0 for name in budget}
+    idf_dir = os.path.join(args.build_dir, "esp-idf")
+    for component in sorted(os.listdir(idf_dir)):
+        archive = os.path.join(idf_dir, component, "lib%s.a" % component)
+        if not os.path.isfile(archive):
+            continue
+        for symbol, size in archive_symbols(args.nm, archive):
+            match = LAYOUT_SYMBOL.match(symbol)
+            owner = match.group(1) if match else component
+            if owner in used:
+                used[owner] += size
+
+    failed = False
+    print("Static RAM by component (.data + .bss):")
+    print("  %-16s %8s %8s" % ("component", "used", "budget"))
+    for name in sorted(used):
+        over = used[name] > budget[name]
+        failed |= over
+        print("  %-16s %8d %8d%s" % (name, used[name], budget[name],
+                                     "  OVER BUDGET" if over else ""))
+    total = sum(used.values())
+    if total_budget is not None:
+        over = total > total_budget
+        failed |= over
+        print("  %-16s %8d %8d%s" % ("total", total, total_budget,
+                                     "  OVER BUDGET" if over else ""))
+
+    if failed:
+        print("RAM budget exceeded, see %s" % args.budget, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""Converts a GrowGrid trace dump to Chrome trace JSON for ui.perfetto.dev.
+
+The input is either the raw payload of the <prefix>/trace topic, e.g.
+
+  mosquitto_sub -C 1 -t growgrid/<site>/<device>/trace > trace.bin
+
+or captured monitor output containing a dump sent with target "uart". The
+layout is described in main/components/trace/include/trace.h.
+
+Spans become async slices, one track per trace point, so a sample can be
+followed from the sensor read to the MQTT publish by its span id. Records
+outside any span (span 0) are paired by order of appearance.
+"""
+
+import argparse
+import json
+import re
+import struct
+import sys
+
+MAGIC = b"GGTR"
+VERSION = 1
+RECORD = struct.Struct("<IHBBI")
+PHASE_BEGIN, PHASE_END, PHASE_INSTANT = range(3)
+UART_LINE = re.compile(r"GGTRACE ([0-9a-f]+)\s*$")
+
+
+def read_uart(text):
+    """Returns the bytes of the last complete dump in monitor output."""
+    dump = None
+    current = None
+    for line in text.splitlines():
+        if "GGTRACE BEGIN" in line:
+            current = bytearray()
+        elif "GGTRACE END" in line and current is not None:
+            dump = bytes(current)
+            current = None
+        elif current is not None:
+            match = UART_LINE.search(line)
+            if match:
+                current += bytes.fromhex(match.group(1))
+    if dump is None:
+        raise ValueError("no complete GGTRACE dump in the input")
+    return dump
+
+
+def parse(data):
+    if data[:4] != MAGIC:
+        raise ValueError("not a trace dump")
+    version, cores, points, record_size, cpu_hz = struct.unpack_from(
+        "<BBBBI", data, 4)
+    if version != VERSION or record_size != RECORD.size:
+        raise ValueError("unsupported dump version %d" % version)
+    offset = 12
+
+    names = []
+    for _ in range(points):
+        end = data.index(b"\0", offset)
+        names.append(data[offset:end].decode())
+        offset = end + 1
+
+    rings = []
+    for _ in range(cores):
+        (count,) = struct.unpack_from("<I", data, offset)
+        offset += 4
+        rings.append([RECORD.unpack_from(data, offset + i * RECORD.size)
+                      for i in range(count)])
+        offset += count * RECORD.size
+    return cpu_hz, names, rings
+
+
+def unwrap(records):
+    """Yields records with the 32 bit cycle counter extended to 64 bits."""
+    total = 0
+    prev = None
+    for cycles, span, point, phase, arg in records:
+        if prev is not None:
+            total += (cycles - prev) & 0xFFFFFFFF
+        prev = cycles
+        yield total, span, point, phase, arg
+
+
+def to_events(cpu_hz, names, rings):
+    cycles_per_us = cpu_hz / 1e6
+    events = [{"name": "process_name", "ph": "M", "pid": 1,
+               "args": {"name": "growgrid"}}]
+    next_id = 0x10000  # Above every span id
+    for core, records in enumerate(rings):
+        events.append({"name": "thread_name", "ph": "M", "pid": 1,
+                       "tid": core, "args": {"name": "core %d" % core}})
+        open_ids = {}
+        for cycles, span, point, phase, arg in unwrap(records):
+            name = names[point] if point < len(names) else "point_%d" % point
+            event = {"name": name, "cat": "growgrid", "pid": 1, "tid": core,
+                     "ts": cycles / cycles_per_us,
+                     "args": {"span": span, "arg": arg}}
+            if phase == PHASE_INSTANT:
+                event.update(ph="i", s="t")
+            else:
+                if span != 0:
+                    slice_id = span
+                elif phase == PHASE_BEGIN:
+                    slice_id = next_id
+                    next_id += 1
+                    open_ids.setdefault(point, []).append(slice_id)
+                elif open_ids.get(point):
+                    slice_id = open_ids[point].pop()
+                else:
+                    continue  # Its begin was overwritten in the ring
+                event.update(ph="b" if phase == PHASE_BEGIN else "e",
+                             id=slice_id)
+            events.append(event)
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("input", help="binary dump or monitor log")
+    parser.add_argument("-o", "--output", help="JSON file, default stdout")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        data = f.read()
+    try:
+        if b"GGTRACE BEGIN" in data:
+            data = read_uart(data.decode(errors="replace"))
+        cpu_hz, names, rings = parse(data)
+    except (ValueError, struct.error) as e:
+        print("%s: %s" % (args.input, e), file=sys.stderr)
+        return 1
+
+    trace = {"traceEvents": to_events(cpu_hz, names, rings),
+             "displayTimeUnit": "ns"}
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+    print("%d records from %d core(s)" % (sum(map(len, rings)), len(rings)),
+          file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())